@@ -0,0 +1,2216 @@
+// Microbenchmarks for the server's hot paths. Not part of the server build.
+//
+//   ./bench registry [readers] [seconds]
+//   ./bench checksum [megabytes]
+//   ./bench compress [file]
+//   ./bench hex [megabytes]
+//   ./bench timers [endpoints]
+//   ./bench heartbeats [campuses]
+//   ./bench fanout [campuses]
+//   ./bench topics [subscriptions] [campuses]
+//   ./bench cluster [nodes] [seconds]   (starts ./server processes)
+//   ./bench failover [rounds]           (starts ./server processes)
+//   ./bench storm [rounds]              (starts a ./server process)
+//   ./bench credentials [campuses]
+//   ./bench credit [seconds]            (starts a ./server process)
+//   ./bench lanes [seconds]             (starts a ./server process)
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <shared_mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iterator>
+#include <set>
+#include "campus_registry.h"
+#include "checksum.h"
+#include "compression.h"
+#include "hex_codec.h"
+#include "timer_wheel.h"
+#include "heartbeat.h"
+#include "fanout.h"
+#include "topic_index.h"
+#include "cluster.h"
+#include "replication.h"
+#include "session_token.h"
+#include "credentials.h"
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <csignal>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include "protocol.h"
+
+static const char* benchCampuses[] = {"CFD", "KARACHI", "LAHORE", "MULTAN", "PESHAWAR"};
+static const int benchCampusCount = 5;
+
+// Result of one contention run
+struct RunResult {
+    uint64_t lookups;
+    uint64_t writes;
+};
+
+// Runs readers that route (look up a campus, touch its outbound queue
+// pointer) and record heartbeats, against one writer that keeps
+// connecting and disconnecting campuses
+template <typename Lookup, typename Heartbeat, typename Connect>
+static RunResult runContention(int readers, double seconds, Lookup lookup, Heartbeat heartbeat,
+                               Connect connect) {
+    std::atomic<bool> running{true};
+    std::atomic<uint64_t> lookups{0};
+    std::atomic<uint64_t> writes{0};
+    std::vector<std::thread> threads;
+
+    for (int r = 0; r < readers; r++) {
+        threads.emplace_back([&, r]() {
+            uint64_t count = 0;
+            unsigned seed = r * 7919 + 1;
+            while (running.load(std::memory_order_relaxed)) {
+                for (int i = 0; i < 256; i++) {
+                    seed = seed * 1103515245 + 12345;
+                    const char* name = benchCampuses[(seed >> 16) % benchCampusCount];
+                    if ((i & 15) == 0) {
+                        heartbeat(name);
+                    } else {
+                        lookup(name);
+                    }
+                }
+                count += 256;
+            }
+            lookups += count;
+        });
+    }
+
+    threads.emplace_back([&]() {
+        uint64_t count = 0;
+        int socket = 100;
+        while (running.load(std::memory_order_relaxed)) {
+            connect(benchCampuses[count % benchCampusCount], socket++, count & 1);
+            count++;
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+        writes = count;
+    });
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    running = false;
+    for (auto& t : threads) {
+        t.join();
+    }
+    return {lookups.load(), writes.load()};
+}
+
+static void report(const char* name, const RunResult& result, double seconds) {
+    std::cout << std::left << std::setw(22) << name << std::right << std::setw(12)
+              << std::fixed << std::setprecision(2) << result.lookups / seconds / 1e6
+              << " M lookups/s" << std::setw(10) << result.writes << " writes\n";
+}
+
+// Baseline: the map the server used before the registry, keyed by name
+struct MapInfo {
+    int tcpSocket;
+    time_t lastHeartbeat;
+    bool isActive;
+    std::shared_ptr<OutboundQueue> outbound;
+};
+
+template <typename Mutex, typename ReadLock>
+static RunResult benchMap(int readers, double seconds) {
+    std::map<std::string, MapInfo> campuses;
+    Mutex mutex;
+    std::atomic<uint64_t> sink{0};
+
+    return runContention(readers, seconds,
+        [&](const char* name) {
+            ReadLock lock(mutex);
+            auto it = campuses.find(name);
+            if (it != campuses.end() && it->second.isActive) {
+                sink.fetch_add((uintptr_t)it->second.outbound.get() & 1, std::memory_order_relaxed);
+            }
+        },
+        [&](const char* name) {
+            std::lock_guard<Mutex> lock(mutex);
+            auto it = campuses.find(name);
+            if (it != campuses.end()) {
+                it->second.lastHeartbeat = time(nullptr);
+            }
+        },
+        [&](const char* name, int socket, bool active) {
+            std::lock_guard<Mutex> lock(mutex);
+            campuses[name] = {socket, time(nullptr), active,
+                              std::make_shared<OutboundQueue>(1 << 20, 1 << 18)};
+        });
+}
+
+static RunResult benchRegistry(int readers, double seconds) {
+    CampusRegistry registry;
+    for (int i = 0; i < benchCampusCount; i++) {
+        registry.addCampus(i + 1, benchCampuses[i]);
+    }
+    std::atomic<uint64_t> sink{0};
+
+    return runContention(readers, seconds,
+        [&](const char* name) {
+            CampusRegistry::ReadGuard guard;
+            const ClientInfo* info = registry.lookup(name);
+            if (info && info->isActive) {
+                sink.fetch_add((uintptr_t)info->outbound.get() & 1, std::memory_order_relaxed);
+            }
+        },
+        [&](const char* name) {
+            registry.touchHeartbeat(registry.idOf(name));
+        },
+        [&](const char* name, int socket, bool active) {
+            uint16_t id = registry.idOf(name);
+            registry.publish({socket, name, "127.0.0.1", true, -1, id, PROTOCOL_BINARY,
+                              std::make_shared<OutboundQueue>(1 << 20, 1 << 18)});
+            if (!active) {
+                registry.deactivate(id, socket, -1);
+            }
+        });
+}
+
+static int benchRegistryMain(int argc, char* argv[]) {
+    int maxReaders = argc > 2 ? atoi(argv[2]) : (int)std::thread::hardware_concurrency();
+    double seconds = argc > 3 ? atof(argv[3]) : 1.0;
+    if (maxReaders < 1) maxReaders = 1;
+
+    std::cout << "Campus lookups under one connect/disconnect writer (" << seconds
+              << "s per run)\n";
+    for (int readers = 1; readers <= maxReaders; readers *= 2) {
+        std::cout << "\n" << readers << " reader thread(s):\n";
+        report("map + mutex", benchMap<std::mutex, std::lock_guard<std::mutex>>(readers, seconds),
+               seconds);
+        report("map + shared_mutex",
+               benchMap<std::shared_mutex, std::shared_lock<std::shared_mutex>>(readers, seconds),
+               seconds);
+        report("registry (epoch)", benchRegistry(readers, seconds), seconds);
+    }
+    return 0;
+}
+
+static volatile uint64_t benchSink;
+
+// Runs fn over the buffer in FILE_CHUNK_SIZE pieces, as a transfer would,
+// and prints throughput and the cost of checking 1 GB
+template <typename Checksum>
+static void benchChecksum(const char* name, const std::vector<char>& data, int passes,
+                          Checksum fn) {
+    uint64_t sink = 0;      // Keeps the checksums from being optimised away
+    auto started = std::chrono::steady_clock::now();
+    for (int pass = 0; pass < passes; pass++) {
+        for (size_t offset = 0; offset < data.size(); offset += FILE_CHUNK_SIZE) {
+            size_t length = std::min<size_t>(FILE_CHUNK_SIZE, data.size() - offset);
+            sink += fn(data.data() + offset, length);
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                                   started).count();
+    double gigabytes = (double)data.size() * passes / 1e9;
+
+    std::cout << "  " << std::left << std::setw(22) << name << std::right << std::fixed
+              << std::setprecision(2) << std::setw(8) << gigabytes / seconds << " GB/s"
+              << std::setw(10) << std::setprecision(1) << seconds / gigabytes * 1000
+              << " ms per GB\n";
+    benchSink = sink;
+}
+
+static int benchChecksumMain(int argc, char* argv[]) {
+    int megabytes = argc > 2 ? atoi(argv[2]) : 256;
+    if (megabytes < 1) megabytes = 1;
+
+    std::vector<char> data((size_t)megabytes * 1024 * 1024);
+    unsigned seed = 12345;
+    for (char& c : data) {
+        seed = seed * 1103515245 + 12345;
+        c = (char)(seed >> 16);
+    }
+
+    std::cout << "Transfer checksums over " << megabytes << " MB in "
+              << FILE_CHUNK_SIZE / 1024 << " KB chunks\n";
+    std::cout << "  (CRC32C dispatches to "
+              << (crc32cHardwareAvailable() ? "SSE4.2" : "the table") << ", SHA-256 to "
+              << (sha256HardwareAvailable() ? "SHA-NI" : "portable code") << ")\n";
+    if (crc32cHardwareAvailable()) {
+        benchChecksum("crc32c sse4.2", data, 4, [](const char* p, size_t n) {
+            return crc32cHardware(p, n);
+        });
+    }
+    benchChecksum("crc32c slicing-by-8", data, 2, [](const char* p, size_t n) {
+        return crc32cSoftware(p, n);
+    });
+
+    if (sha256HardwareAvailable()) {
+        Sha256 sha;
+        benchChecksum("sha-256 sha-ni", data, 2, [&sha](const char* p, size_t n) {
+            sha.update(p, n);
+            return 0;
+        });
+    }
+    Sha256 portable(false);
+    benchChecksum("sha-256 portable", data, 1, [&portable](const char* p, size_t n) {
+        portable.update(p, n);
+        return 0;
+    });
+    return 0;
+}
+
+// Compresses the buffer in FILE_CHUNK_SIZE pieces, as a transfer would,
+// then decompresses and checks every piece
+static void benchCodec(const char* name, Codec codec, int level, const std::vector<char>& data) {
+    std::vector<std::string> chunks;
+    std::string out;
+    size_t bypassed = 0;
+    size_t wire = 0;
+
+    auto started = std::chrono::steady_clock::now();
+    for (size_t offset = 0; offset < data.size(); offset += FILE_CHUNK_SIZE) {
+        size_t length = std::min<size_t>(FILE_CHUNK_SIZE, data.size() - offset);
+        if (compressPayload(codec, data.data() + offset, length, out, level)) {
+            wire += out.size();
+            chunks.push_back(out);
+        } else {
+            wire += length;
+            bypassed++;
+            chunks.push_back(std::string());
+        }
+    }
+    double compressSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                                           started).count();
+
+    bool intact = true;
+    started = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < chunks.size(); i++) {
+        if (chunks[i].empty()) continue;
+        size_t offset = i * FILE_CHUNK_SIZE;
+        size_t length = std::min<size_t>(FILE_CHUNK_SIZE, data.size() - offset);
+        if (!decompressPayload(chunks[i].data(), chunks[i].size(), out) || out.size() != length ||
+            memcmp(out.data(), data.data() + offset, length) != 0) {
+            intact = false;
+        }
+    }
+    double decompressSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                                             started).count();
+    double megabytes = data.size() / 1e6;
+
+    std::cout << "  " << std::left << std::setw(12) << name << std::right << std::fixed
+              << std::setprecision(2) << std::setw(7) << (double)data.size() / wire << "x"
+              << std::setprecision(0) << std::setw(11) << megabytes / compressSeconds;
+    if (bypassed < chunks.size()) {
+        std::cout << std::setw(12) << megabytes / decompressSeconds;
+    } else {
+        std::cout << std::setw(12) << "-";
+    }
+    std::cout << std::setw(10) << bypassed << (intact ? "" : "  MISMATCH") << "\n";
+}
+
+// Something like what campuses exchange: report lines and CSV rows
+static std::vector<char> officeText(size_t size) {
+    static const char* words[] = {"campus", "admissions", "semester", "students", "fee",
+                                  "schedule", "report", "department", "faculty", "the",
+                                  "of", "and", "for", "exam", "results", "registration"};
+    std::vector<char> data;
+    data.reserve(size + 256);
+    unsigned seed = 12345;
+    while (data.size() < size) {
+        std::string line;
+        for (int i = 0; i < 10; i++) {
+            seed = seed * 1103515245 + 12345;
+            line += words[(seed >> 16) % 16];
+            line += (i == 9) ? "," : " ";
+        }
+        seed = seed * 1103515245 + 12345;
+        line += std::to_string(20240000 + (seed >> 16) % 10000) + ",PKR " +
+                std::to_string((seed >> 8) % 100000) + "\n";
+        data.insert(data.end(), line.begin(), line.end());
+    }
+    data.resize(size);
+    return data;
+}
+
+static int benchCompressMain(int argc, char* argv[]) {
+    std::vector<char> data;
+    std::string source = "generated office text";
+    if (argc > 2) {
+        std::ifstream file(argv[2], std::ios::binary);
+        if (!file.is_open()) {
+            std::cerr << "Cannot open " << argv[2] << "\n";
+            return 1;
+        }
+        data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        source = argv[2];
+    } else {
+        data = officeText(64 * 1024 * 1024);
+    }
+    if (data.empty()) {
+        std::cerr << "Nothing to compress\n";
+        return 1;
+    }
+
+    std::cout << "Payload compression over " << source << " (" << data.size() / 1024 << " KB) in "
+              << FILE_CHUNK_SIZE / 1024 << " KB chunks\n";
+    std::cout << "  (speeds in MB/s of original data; bypassed chunks did not shrink by 1/8)\n";
+    std::cout << "  " << std::left << std::setw(12) << "codec" << std::right << std::setw(8)
+              << "ratio" << std::setw(11) << "compress" << std::setw(12) << "decompress"
+              << std::setw(10) << "bypassed" << "\n";
+    benchCodec("lz4", CODEC_LZ4, 0, data);
+    benchCodec("deflate-1", CODEC_DEFLATE, 1, data);
+    benchCodec("deflate-6", CODEC_DEFLATE, 6, data);
+    benchCodec("deflate-9", CODEC_DEFLATE, 9, data);
+    if (codecAvailable(CODEC_ZSTD)) {
+        benchCodec("zstd-1", CODEC_ZSTD, 1, data);
+        benchCodec("zstd-3", CODEC_ZSTD, 3, data);
+        benchCodec("zstd-9", CODEC_ZSTD, 9, data);
+    }
+    return 0;
+}
+
+// The loops the clients used before hex_codec, for comparison
+static void hexEncodeSprintf(const void* data, size_t length, std::string& out) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    out.clear();
+    for (size_t i = 0; i < length; i++) {
+        char hex[3];
+        sprintf(hex, "%02X", p[i]);
+        out += hex;
+    }
+}
+
+static void hexDecodeStrtol(const std::string& encoded, std::string& out) {
+    out.clear();
+    for (size_t i = 0; i < encoded.length(); i += 2) {
+        std::string byteStr = encoded.substr(i, 2);
+        out += (char)strtol(byteStr.c_str(), nullptr, 16);
+    }
+}
+
+// Runs fn passes times and prints GB/s of binary data (input when
+// encoding, output when decoding)
+template <typename Function>
+static void benchHex(const char* name, size_t bytes, int passes, Function fn) {
+    auto started = std::chrono::steady_clock::now();
+    for (int pass = 0; pass < passes; pass++) {
+        fn();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                                   started).count();
+    double gigabytes = (double)bytes * passes / 1e9;
+    std::cout << "  " << std::left << std::setw(22) << name << std::right << std::fixed
+              << std::setprecision(3) << std::setw(8) << gigabytes / seconds << " GB/s\n";
+}
+
+static int benchHexMain(int argc, char* argv[]) {
+    // Default: a text client's largest file, which stays in cache
+    int megabytes = argc > 2 ? atoi(argv[2]) : 1;
+    if (megabytes < 1) megabytes = 1;
+    int passes = std::max(1, 1024 / megabytes);
+
+    std::vector<char> data((size_t)megabytes * 1024 * 1024);
+    unsigned seed = 12345;
+    for (char& c : data) {
+        seed = seed * 1103515245 + 12345;
+        c = (char)(seed >> 16);
+    }
+    std::string encoded(2 * data.size(), '\0');
+    std::vector<char> decoded(data.size());
+    hexEncodeScalar(data.data(), data.size(), &encoded[0]);
+
+    // The old loops take a second or more per 10 MB: give them a slice
+    size_t sliceBytes = std::min<size_t>(data.size(), 1024 * 1024);
+    std::string slice(data.data(), sliceBytes);
+    std::string sliceEncoded = encoded.substr(0, 2 * sliceBytes);
+    std::string scratch;
+
+    std::cout << "Hex codec over " << megabytes << " MB (dispatch picks " << hexKernelName()
+              << ")\n";
+    std::cout << "Encode:\n";
+    benchHex("sprintf per byte", sliceBytes, 1, [&]() {
+        hexEncodeSprintf(slice.data(), slice.size(), scratch);
+    });
+    benchHex("scalar table", data.size(), std::max(1, passes / 4), [&]() {
+        hexEncodeScalar(data.data(), data.size(), &encoded[0]);
+    });
+    if (hexSse2Available()) {
+        benchHex("sse2", data.size(), passes, [&]() {
+            hexEncodeSse2(data.data(), data.size(), &encoded[0]);
+        });
+    }
+    if (hexAvx2Available()) {
+        benchHex("avx2", data.size(), passes, [&]() {
+            hexEncodeAvx2(data.data(), data.size(), &encoded[0]);
+        });
+    }
+
+    bool intact = true;
+    std::cout << "Decode:\n";
+    benchHex("substr + strtol", sliceBytes, 1, [&]() {
+        hexDecodeStrtol(sliceEncoded, scratch);
+    });
+    benchHex("scalar table", data.size(), std::max(1, passes / 4), [&]() {
+        intact &= hexDecodeScalar(encoded.data(), encoded.size(), decoded.data());
+    });
+    if (hexSse2Available()) {
+        benchHex("sse2", data.size(), passes, [&]() {
+            intact &= hexDecodeSse2(encoded.data(), encoded.size(), decoded.data());
+        });
+    }
+    if (hexAvx2Available()) {
+        benchHex("avx2", data.size(), passes, [&]() {
+            intact &= hexDecodeAvx2(encoded.data(), encoded.size(), decoded.data());
+        });
+    }
+    if (!intact || decoded != data) {
+        std::cout << "  MISMATCH\n";
+        return 1;
+    }
+    return 0;
+}
+
+// Simulated clock for the liveness runs: every endpoint heartbeats every
+// 10 s, and one in a hundred goes silent after the first minute
+#define SIM_HEARTBEAT_MS 10000
+#define SIM_SILENT_AFTER_MS 60000
+#define SIM_DURATION_MS 300000
+
+struct TimerRun {
+    double heartbeatNanos = 0;      // Per heartbeat
+    double tickMicros = 0;          // Per tick, mean
+    double worstTickMicros = 0;
+    uint64_t fired = 0;
+    uint64_t dead = 0;
+    uint64_t wrongDeaths = 0;       // Endpoints declared dead that kept beating
+};
+
+static TimerRun runWheel(uint32_t endpoints) {
+    LivenessTracker tracker(endpoints, LIVENESS_SUSPECT_MS, LIVENESS_DEAD_MS);
+    for (uint32_t id = 0; id < endpoints; id++) {
+        tracker.track(id, 0);
+    }
+
+    const uint64_t beatTicks = SIM_HEARTBEAT_MS / LIVENESS_TICK_MS;
+    std::vector<uint32_t> suspects;
+    std::vector<uint32_t> dead;
+    TimerRun result;
+    double heartbeatSeconds = 0;
+    double tickSeconds = 0;
+    uint64_t heartbeats = 0;
+    uint64_t ticks = 0;
+
+    for (uint64_t now = LIVENESS_TICK_MS; now <= SIM_DURATION_MS; now += LIVENESS_TICK_MS) {
+        // Endpoints beat in turn, so each tick carries an even share
+        uint64_t phase = (now / LIVENESS_TICK_MS) % beatTicks;
+        auto started = std::chrono::steady_clock::now();
+        for (uint32_t id = (uint32_t)phase; id < endpoints; id += (uint32_t)beatTicks) {
+            if (id % 100 == 0 && now > SIM_SILENT_AFTER_MS) continue;
+            tracker.heartbeat(id, now);
+            heartbeats++;
+        }
+        auto polled = std::chrono::steady_clock::now();
+
+        suspects.clear();
+        dead.clear();
+        result.fired += tracker.poll(now, suspects, dead);
+        auto finished = std::chrono::steady_clock::now();
+
+        double tick = std::chrono::duration<double>(finished - polled).count();
+        heartbeatSeconds += std::chrono::duration<double>(polled - started).count();
+        tickSeconds += tick;
+        result.worstTickMicros = std::max(result.worstTickMicros, tick * 1e6);
+        ticks++;
+        for (uint32_t id : dead) {
+            result.dead++;
+            if (id % 100 != 0) result.wrongDeaths++;
+        }
+    }
+
+    result.heartbeatNanos = heartbeats ? heartbeatSeconds * 1e9 / heartbeats : 0;
+    result.tickMicros = tickSeconds * 1e6 / ticks;
+    return result;
+}
+
+// The old monitor: a store per heartbeat, and a walk over every endpoint's
+// last heartbeat on each check (run here every tick, for the same promptness)
+static TimerRun runSweep(uint32_t endpoints) {
+    std::vector<uint64_t> lastHeartbeat(endpoints, 0);
+    std::vector<uint8_t> alive(endpoints, 1);
+
+    const uint64_t beatTicks = SIM_HEARTBEAT_MS / LIVENESS_TICK_MS;
+    TimerRun result;
+    double heartbeatSeconds = 0;
+    double tickSeconds = 0;
+    uint64_t heartbeats = 0;
+    uint64_t ticks = 0;
+
+    for (uint64_t now = LIVENESS_TICK_MS; now <= SIM_DURATION_MS; now += LIVENESS_TICK_MS) {
+        uint64_t phase = (now / LIVENESS_TICK_MS) % beatTicks;
+        auto beaten = std::chrono::steady_clock::now();
+        for (uint32_t id = (uint32_t)phase; id < endpoints; id += (uint32_t)beatTicks) {
+            if (id % 100 == 0 && now > SIM_SILENT_AFTER_MS) continue;
+            lastHeartbeat[id] = now;
+            heartbeats++;
+        }
+
+        auto started = std::chrono::steady_clock::now();
+        heartbeatSeconds += std::chrono::duration<double>(started - beaten).count();
+        for (uint32_t id = 0; id < endpoints; id++) {
+            if (alive[id] && now - lastHeartbeat[id] >= LIVENESS_DEAD_MS) {
+                alive[id] = 0;
+                result.dead++;
+                if (id % 100 != 0) result.wrongDeaths++;
+            }
+        }
+        double tick = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                                    started).count();
+        tickSeconds += tick;
+        result.worstTickMicros = std::max(result.worstTickMicros, tick * 1e6);
+        ticks++;
+    }
+
+    result.heartbeatNanos = heartbeats ? heartbeatSeconds * 1e9 / heartbeats : 0;
+    result.tickMicros = tickSeconds * 1e6 / ticks;
+    return result;
+}
+
+static void reportTimers(const char* name, uint32_t endpoints, const TimerRun& result) {
+    std::cout << "  " << std::left << std::setw(8) << name << std::right << std::setw(9)
+              << endpoints << std::fixed << std::setprecision(1) << std::setw(12)
+              << result.heartbeatNanos << std::setw(12) << result.tickMicros << std::setw(12)
+              << result.worstTickMicros << std::setw(10) << result.fired << std::setw(8)
+              << result.dead << (result.wrongDeaths ? "  WRONG" : "") << "\n";
+}
+
+static int benchTimersMain(int argc, char* argv[]) {
+    long endpoints = argc > 2 ? atol(argv[2]) : 100000;
+    if (endpoints < 100) endpoints = 100;
+
+    std::cout << "Liveness over " << SIM_DURATION_MS / 1000 << " simulated seconds, "
+              << LIVENESS_TICK_MS << " ms ticks, heartbeats every " << SIM_HEARTBEAT_MS / 1000
+              << " s, 1% silent after " << SIM_SILENT_AFTER_MS / 1000 << " s\n";
+    std::cout << "  " << std::left << std::setw(8) << "Method" << std::right << std::setw(9)
+              << "Endpoints" << std::setw(12) << "ns/beat" << std::setw(12) << "us/tick"
+              << std::setw(12) << "worst us" << std::setw(10) << "Fired" << std::setw(8)
+              << "Dead" << "\n";
+
+    bool correct = true;
+    for (uint32_t count : {(uint32_t)endpoints / 100, (uint32_t)endpoints / 10,
+                           (uint32_t)endpoints}) {
+        TimerRun wheel = runWheel(count);
+        TimerRun sweep = runSweep(count);
+        reportTimers("wheel", count, wheel);
+        reportTimers("sweep", count, sweep);
+        correct &= wheel.wrongDeaths == 0 && wheel.dead == sweep.dead;
+    }
+    if (!correct) {
+        std::cout << "  MISMATCH\n";
+        return 1;
+    }
+    return 0;
+}
+
+#define HEARTBEAT_ROUND 256          // Datagrams queued per round, well inside the socket buffer
+#define HEARTBEAT_TOTAL 500000
+
+// A UDP socket on a free loopback port, and a sender connected to it
+static bool openLoopback(int& receiver, int& sender) {
+    receiver = socket(AF_INET, SOCK_DGRAM, 0);
+    sender = socket(AF_INET, SOCK_DGRAM, 0);
+    if (receiver < 0 || sender < 0) return false;
+
+    int size = 4 * 1024 * 1024;
+    setsockopt(receiver, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(addr);
+    return bind(receiver, (struct sockaddr*)&addr, sizeof(addr)) == 0 &&
+           getsockname(receiver, (struct sockaddr*)&addr, &length) == 0 &&
+           connect(sender, (struct sockaddr*)&addr, sizeof(addr)) == 0;
+}
+
+// Queues the next HEARTBEAT_ROUND heartbeats, campuses in turn, with one
+// sendmmsg(); not timed
+static void sendRound(int sender, const std::vector<std::string>& datagrams, size_t& next) {
+    struct mmsghdr messages[HEARTBEAT_ROUND];
+    struct iovec parts[HEARTBEAT_ROUND];
+    memset(messages, 0, sizeof(messages));
+    for (int i = 0; i < HEARTBEAT_ROUND; i++) {
+        const std::string& datagram = datagrams[next];
+        next = (next + 1) % datagrams.size();
+        parts[i].iov_base = (void*)datagram.data();
+        parts[i].iov_len = datagram.size();
+        messages[i].msg_hdr.msg_iov = &parts[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+    }
+    int sent = 0;
+    while (sent < HEARTBEAT_ROUND) {
+        int result = sendmmsg(sender, messages + sent, HEARTBEAT_ROUND - sent, 0);
+        if (result <= 0) break;
+        sent += result;
+    }
+}
+
+struct HeartbeatRun {
+    uint64_t received = 0;
+    uint64_t syscalls = 0;
+    double seconds = 0;
+};
+
+static void reportHeartbeats(const char* name, const HeartbeatRun& run) {
+    std::cout << "  " << std::left << std::setw(28) << name << std::right << std::fixed
+              << std::setprecision(2) << std::setw(8) << run.received / run.seconds / 1e6
+              << " M/s";
+    if (run.syscalls > 0) {
+        std::cout << std::setw(10) << (double)run.syscalls / run.received << " syscalls/beat";
+    }
+    std::cout << "\n";
+}
+
+static int benchHeartbeatsMain(int argc, char* argv[]) {
+    long campuses = argc > 2 ? atol(argv[2]) : 5000;
+    if (campuses < 1) campuses = 1;
+    if (campuses > 65535) campuses = 65535;
+
+    std::vector<std::string> datagrams;
+    std::vector<std::pair<std::string, uint16_t>> names;
+    std::map<std::string, time_t> heartbeatMap;
+    for (long i = 1; i <= campuses; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "CAMPUS-%05ld", i);
+        names.push_back({name, (uint16_t)i});
+        heartbeatMap[name] = 0;
+        datagrams.push_back(std::string(HEARTBEAT_PREFIX) + name);
+    }
+    NameIndex index;
+    index.add(names);
+    std::mutex mapMutex;
+    std::vector<time_t> lastHeartbeat(campuses + 1, 0);
+    LivenessTracker liveness(campuses + 1, LIVENESS_SUSPECT_MS, LIVENESS_DEAD_MS);
+    for (long i = 1; i <= campuses; i++) {
+        liveness.track(i, 0);
+    }
+
+    std::cout << "Heartbeats from " << campuses << " campuses (name index: " << index.capacity()
+              << " slots)\n";
+
+    // Parsing and name lookup alone, from memory
+    std::cout << "Parse and look up:\n";
+    {
+        HeartbeatRun run;
+        uint64_t found = 0;
+        auto started = std::chrono::steady_clock::now();
+        for (int i = 0; i < HEARTBEAT_TOTAL; i++) {
+            std::string message(datagrams[i % campuses]);
+            if (message.find("HEARTBEAT:") != std::string::npos) {
+                std::string campusName = message.substr(10);
+                campusName.erase(campusName.find_last_not_of(" \n\r\t") + 1);
+                std::lock_guard<std::mutex> lock(mapMutex);
+                found += heartbeatMap.count(campusName);
+            }
+        }
+        run.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                                    started).count();
+        run.received = found;
+        reportHeartbeats("string + find + map", run);
+
+        found = 0;
+        started = std::chrono::steady_clock::now();
+        for (int i = 0; i < HEARTBEAT_TOTAL; i++) {
+            const std::string& datagram = datagrams[i % campuses];
+            const char* name;
+            size_t nameLength;
+            if (parseHeartbeat(datagram.data(), datagram.size(), name, nameLength)) {
+                found += index.find(name, nameLength) != 0;
+            }
+        }
+        run.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                                    started).count();
+        run.received = found;
+        reportHeartbeats("in place + perfect hash", run);
+    }
+
+    int receiver, sender;
+    if (!openLoopback(receiver, sender)) {
+        std::cout << "Cannot open a loopback UDP socket\n";
+        return 1;
+    }
+
+    // Whole ingest path, receive timed and send not: the old loop of one
+    // recvfrom per datagram, against batches of HEARTBEAT_BATCH
+    std::cout << "Receive and record (loopback UDP):\n";
+    HeartbeatRun old;
+    size_t next = 0;
+    char buffer[4096];
+    while (old.received < HEARTBEAT_TOTAL) {
+        sendRound(sender, datagrams, next);
+        auto started = std::chrono::steady_clock::now();
+        for (int i = 0; i < HEARTBEAT_ROUND; i++) {
+            memset(buffer, 0, sizeof(buffer));
+            int bytes = recvfrom(receiver, buffer, sizeof(buffer) - 1, MSG_DONTWAIT, nullptr,
+                                 nullptr);
+            old.syscalls++;
+            if (bytes <= 0) break;
+            std::string message(buffer);
+            if (message.find("HEARTBEAT:") != std::string::npos) {
+                std::string campusName = message.substr(10);
+                campusName.erase(campusName.find_last_not_of(" \n\r\t") + 1);
+                std::lock_guard<std::mutex> lock(mapMutex);
+                auto it = heartbeatMap.find(campusName);
+                if (it != heartbeatMap.end()) {
+                    it->second = time(nullptr);
+                }
+            }
+            old.received++;
+        }
+        old.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                                     started).count();
+    }
+    reportHeartbeats("recvfrom + map", old);
+
+    HeartbeatRun batched;
+    HeartbeatReceiver batch;
+    std::vector<uint32_t> resumed;
+    uint64_t now = 0;
+    while (batched.received < HEARTBEAT_TOTAL) {
+        sendRound(sender, datagrams, next);
+        auto started = std::chrono::steady_clock::now();
+        int pending = HEARTBEAT_ROUND;
+        while (pending > 0) {
+            int received = batch.receive(receiver, false);
+            batched.syscalls++;
+            if (received <= 0) break;
+
+            uint32_t ids[HEARTBEAT_BATCH];
+            size_t known = 0;
+            for (int i = 0; i < received; i++) {
+                const char* name;
+                size_t nameLength;
+                if (parseHeartbeat(batch.data(i), batch.length(i), name, nameLength)) {
+                    uint16_t id = index.find(name, nameLength);
+                    if (id != 0) ids[known++] = id;
+                }
+            }
+            time_t stamp = time(nullptr);
+            for (size_t i = 0; i < known; i++) {
+                lastHeartbeat[ids[i]] = stamp;
+            }
+            liveness.heartbeat(ids, known, now, resumed);
+            pending -= received;
+            batched.received += received;
+        }
+        batched.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                                         started).count();
+        now += LIVENESS_TICK_MS;
+    }
+    reportHeartbeats("recvmmsg + perfect hash", batched);
+
+    close(receiver);
+    close(sender);
+    return 0;
+}
+
+#define FANOUT_MESSAGE_SIZE 4096
+#define FANOUT_ROUNDS 200
+
+struct FanOutRun {
+    double seconds = 0;
+    size_t heldBytes = 0;       // Queued for one message, counting shared buffers once
+    size_t encodings = 0;       // Per message
+};
+
+// One broadcast of FANOUT_ROUNDS, queued to every campus's outbound queue
+// (as threads mode does) and then drained untimed. Campuses are spread over
+// the wire formats: mostly binary uncompressed, some lz4, some deflate and
+// some on the text protocol.
+static FanOutRun runFanOut(long campuses, const std::vector<char>& text, bool shared) {
+    std::vector<std::unique_ptr<OutboundQueue>> queues;
+    std::vector<int> protocols;
+    std::vector<Codec> codecs;
+    for (long i = 0; i < campuses; i++) {
+        queues.emplace_back(new OutboundQueue(SIZE_MAX, 0));
+        protocols.push_back(i % 10 == 9 ? PROTOCOL_TEXT : PROTOCOL_BINARY);
+        codecs.push_back(i % 10 == 7 ? CODEC_LZ4 : i % 10 == 8 ? CODEC_DEFLATE : CODEC_NONE);
+    }
+
+    FanOutRun run;
+    SharedFrame drained;
+    for (int round = 0; round < FANOUT_ROUNDS; round++) {
+        auto started = std::chrono::steady_clock::now();
+        if (shared) {
+            FanOut message(FRAME_BROADCAST, "", 0, "", text.data(), text.size());
+            for (long i = 0; i < campuses; i++) {
+                queues[i]->push(message.frameFor(protocols[i], codecs[i]));
+            }
+            run.encodings = message.encodingCount();
+        } else {
+            // The old loop: header built and body copied (and compressed)
+            // for each campus in turn
+            for (long i = 0; i < campuses; i++) {
+                std::string frame;
+                if (protocols[i] == PROTOCOL_BINARY) {
+                    frame = buildFrameHead(FRAME_BROADCAST, 0, (uint16_t)i, "", text.size());
+                    frame.append(text.data(), text.size());
+                    std::string compressed;
+                    if (codecs[i] != CODEC_NONE &&
+                        compressFrame(frame.data(), frame.size(), codecs[i], compressed)) {
+                        frame.swap(compressed);
+                    }
+                } else {
+                    frame = "BROADCAST:";
+                    frame.append(text.data(), text.size());
+                }
+                queues[i]->push(makeSharedFrame(std::move(frame)));
+            }
+            run.encodings = campuses;
+        }
+        run.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                                     started).count();
+
+        std::set<const std::string*> buffers;
+        run.heldBytes = 0;
+        for (long i = 0; i < campuses; i++) {
+            queues[i]->pop(drained);
+            if (buffers.insert(drained.get()).second) {
+                run.heldBytes += drained->size();
+            }
+        }
+    }
+    return run;
+}
+
+static void reportFanOut(const char* name, const FanOutRun& run) {
+    std::cout << "  " << std::left << std::setw(20) << name << std::right << std::fixed
+              << std::setprecision(1) << std::setw(10) << run.seconds * 1e6 / FANOUT_ROUNDS
+              << " us/message" << std::setw(10) << run.heldBytes / 1024.0 << " KB queued"
+              << std::setw(8) << run.encodings << " encodings\n";
+}
+
+static int benchFanOutMain(int argc, char* argv[]) {
+    long campuses = argc > 2 ? atol(argv[2]) : 1000;
+    if (campuses < 1) campuses = 1;
+
+    std::vector<char> text = officeText(FANOUT_MESSAGE_SIZE);
+    std::cout << "One " << FANOUT_MESSAGE_SIZE << "-byte broadcast to " << campuses
+              << " campuses:\n";
+    reportFanOut("per campus", runFanOut(campuses, text, false));
+    reportFanOut("encode once", runFanOut(campuses, text, true));
+    return 0;
+}
+
+#define TOPIC_DEPARTMENTS 2000
+#define TOPIC_PUBLISHES 200000
+#define TOPIC_CAMPUSES 63           // Default subscribers
+
+// The index's answer worked out the obvious way: every pattern checked
+struct ScannedTopic {
+    uint16_t subscriber;
+    uint16_t campus;
+    std::string department;     // Lowercase
+};
+
+static TopicIndex::Subscribers scanTopics(const std::vector<ScannedTopic>& patterns,
+                                          uint16_t campus, const std::string& department) {
+    TopicIndex::Subscribers matched;
+    for (const ScannedTopic& pattern : patterns) {
+        if ((pattern.campus == 0 || pattern.campus == campus) &&
+            (pattern.department == TOPIC_WILDCARD || pattern.department == department)) {
+            matched.insert(pattern.subscriber);
+        }
+    }
+    return matched;
+}
+
+// Publishes to random campus/department topics against subscriptions
+// spread over every campus id, one in 20 with a wildcard campus and one in
+// 100 with a wildcard department
+static int benchTopicsMain(int argc, char* argv[]) {
+    long subscribers = argc > 3 ? atol(argv[3]) : TOPIC_CAMPUSES;
+    if (subscribers < 1 || subscribers > MAX_CAMPUS_ID) subscribers = TOPIC_CAMPUSES;
+    long total = argc > 2 ? atol(argv[2]) : 10000;
+    if (total < subscribers) total = subscribers;
+    if (total > subscribers * TOPIC_MAX_PER_SUBSCRIBER) {
+        total = subscribers * TOPIC_MAX_PER_SUBSCRIBER;
+    }
+
+    unsigned seed = 42;
+    auto random = [&seed]() {
+        seed = seed * 1103515245 + 12345;
+        return seed >> 16;
+    };
+    std::vector<std::string> departments;
+    for (int i = 0; i < TOPIC_DEPARTMENTS; i++) {
+        departments.push_back("department" + std::to_string(i));
+    }
+
+    TopicIndex index;
+    std::vector<ScannedTopic> scanned;
+    for (long subscriber = 1; subscriber <= subscribers; subscriber++) {
+        std::vector<Topic> topics;
+        long count = total / subscribers + (subscriber <= total % subscribers ? 1 : 0);
+        for (long i = 0; i < count; i++) {
+            Topic topic;
+            topic.campus = random() % 20 == 0 ? 0 : 1 + random() % subscribers;
+            topic.department = random() % 100 == 0 ? std::string(TOPIC_WILDCARD)
+                                                  : departments[random() % TOPIC_DEPARTMENTS];
+            topics.push_back(topic);
+        }
+        for (const Topic& topic : index.subscribe((uint16_t)subscriber, topics)) {
+            scanned.push_back({(uint16_t)subscriber, topic.campus, topic.department});
+        }
+    }
+
+    std::vector<std::pair<uint16_t, std::string>> publishes;
+    for (int i = 0; i < TOPIC_PUBLISHES; i++) {
+        publishes.push_back({(uint16_t)(1 + random() % subscribers),
+                             departments[random() % TOPIC_DEPARTMENTS]});
+    }
+
+    std::cout << "Topic matches: " << index.size() << " subscriptions from " << subscribers
+              << " campuses over " << TOPIC_DEPARTMENTS << " departments\n";
+
+    uint64_t matches = 0;
+    auto started = std::chrono::steady_clock::now();
+    for (const auto& publish : publishes) {
+        matches += index.match(publish.first, publish.second).size();
+    }
+    double indexSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                                        started).count();
+
+    // The scan is much slower; a tenth of the publishes is plenty
+    size_t scanCount = publishes.size() / 10;
+    bool correct = true;
+    started = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < scanCount; i++) {
+        TopicIndex::Subscribers matched = scanTopics(scanned, publishes[i].first,
+                                                     publishes[i].second);
+        correct &= matched == index.match(publishes[i].first, publishes[i].second);
+    }
+    double scanSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                                       started).count();
+    benchSink = matches;
+
+    std::cout << std::fixed << std::setprecision(1)
+              << "  index  " << std::setw(10) << indexSeconds * 1e9 / publishes.size()
+              << " ns/publish\n"
+              << "  scan   " << std::setw(10) << scanSeconds * 1e9 / scanCount
+              << " ns/publish (includes one index lookup to check it)\n"
+              << "  " << std::setprecision(2) << (double)matches / publishes.size()
+              << " subscribers per publish\n";
+    if (!correct) {
+        std::cout << "  MISMATCH\n";
+        return 1;
+    }
+    return 0;
+}
+
+#define CLUSTER_NAMES 10000          // Synthetic campuses for the placement test
+#define CLUSTER_BASE_PORT 9100       // Node i listens on 9100 + 10 * i
+#define CLUSTER_MESSAGE_SIZE 200
+#define CLUSTER_WINDOW 2000          // Messages a sender may have undelivered
+
+// How evenly the ring spreads campuses over k nodes, and how many change
+// home when node k joins (ideally 1/k of them)
+static void benchPlacement(int maxNodes) {
+    std::vector<std::string> names;
+    for (int i = 0; i < CLUSTER_NAMES; i++) {
+        names.push_back("CAMPUS-" + std::to_string(i));
+    }
+
+    std::cout << "Placement of " << CLUSTER_NAMES << " campuses (" << CLUSTER_VIRTUAL_NODES
+              << " points per node):\n";
+    HashRing ring;
+    std::vector<int> homes(names.size(), -1);
+    for (int k = 1; k <= maxNodes; k++) {
+        ring.add(k - 1, "N" + std::to_string(k - 1));
+        std::vector<int> counts(k, 0);
+        int moved = 0;
+        for (size_t i = 0; i < names.size(); i++) {
+            int home = ring.ownerOf(names[i]);
+            if (homes[i] >= 0 && homes[i] != home) moved++;
+            homes[i] = home;
+            counts[home]++;
+        }
+        int fewest = *std::min_element(counts.begin(), counts.end());
+        int most = *std::max_element(counts.begin(), counts.end());
+        double ideal = (double)names.size() / k;
+        std::cout << "  " << k << " nodes: per node " << std::fixed << std::setprecision(2)
+                  << fewest / ideal << "-" << most / ideal << " of even";
+        if (k > 1) {
+            std::cout << ", moved " << std::setprecision(1) << 100.0 * moved / names.size()
+                      << "% (ideal " << 100.0 / k << "%)";
+        }
+        std::cout << "\n";
+    }
+}
+
+struct BenchCampus {
+    int fd = -1;
+    uint16_t id = 0;
+    uint16_t targetId = 0;
+    std::atomic<uint64_t> sent{0};
+    std::atomic<uint64_t> received{0};
+};
+
+// Logs a campus in at the first node, following redirects to its home.
+// A session token, if given, is offered with the password, as are any
+// other offers ("Credit:1,"); reply gets the AUTH line.
+static bool benchLogin(BenchCampus& campus, const std::string& name, uint16_t port,
+                       const std::string& token = "", std::string* reply = nullptr,
+                       const std::string& offers = "") {
+    static const std::map<std::string, std::string> passwords = {
+        {"CFD", "NU-CFD-123"}, {"KARACHI", "NU-KHI-123"}, {"LAHORE", "NU-LHR-123"},
+        {"MULTAN", "NU-MLN-123"}, {"PESHAWAR", "NU-PWR-123"}};
+
+    for (int hop = 0; hop <= CLUSTER_MAX_REDIRECTS; hop++) {
+        campus.fd = socket(AF_INET, SOCK_STREAM, 0);
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (connect(campus.fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+            close(campus.fd);
+            campus.fd = -1;
+            return false;
+        }
+
+        std::string auth = "AUTH:Proto:2," + offers + (token.empty() ? "" : "Token:" + token + ",") +
+                           "Campus:" + name + ",Pass:" + passwords.at(name);
+        send(campus.fd, auth.data(), auth.size(), 0);
+
+        // Read the reply a byte at a time so no frame is consumed with it.
+        // A redirect has no newline; the server closes after it.
+        std::string line;
+        char c;
+        while (recv(campus.fd, &c, 1, 0) == 1 && c != '\n') {
+            line += c;
+        }
+        if (reply) *reply = line;
+        if (line.compare(0, 12, "AUTH:SUCCESS") == 0) return true;
+        close(campus.fd);
+        std::string host;
+        if (line.compare(0, 14, "AUTH:REDIRECT:") != 0 ||
+            !parseHostPort(line.substr(14), host, port)) {
+            return false;
+        }
+    }
+    return false;
+}
+
+static void benchSender(BenchCampus& campus, BenchCampus& target, std::atomic<bool>& running) {
+    std::string message(CLUSTER_MESSAGE_SIZE, 'm');
+    std::string frame = buildFrame(FRAME_MESSAGE, campus.id, campus.targetId, "Bench", message);
+    std::string batch;
+    for (int i = 0; i < 32; i++) batch += frame;
+
+    while (running) {
+        // Closed loop: never more than a window ahead of the receiver, so
+        // the servers' queues stay below their watermarks
+        if (campus.sent - target.received > CLUSTER_WINDOW) {
+            usleep(100);
+            continue;
+        }
+        if (send(campus.fd, batch.data(), batch.size(), MSG_NOSIGNAL) != (ssize_t)batch.size()) {
+            break;
+        }
+        campus.sent += 32;
+    }
+}
+
+static void benchReceiver(BenchCampus& campus) {
+    FrameDecoder decoder;
+    Frame frame;
+    int bytesRead;
+    while ((bytesRead = recv(campus.fd, decoder.prepare(65536), 65536, 0)) > 0) {
+        decoder.commit(bytesRead);
+        FrameDecoder::Status status;
+        while ((status = decoder.next(frame)) == FrameDecoder::FRAME_READY) {
+            if (frame.header.type == FRAME_MESSAGE) campus.received++;
+        }
+        if (status == FrameDecoder::MALFORMED) break;
+    }
+}
+
+// Starts ./server quietly, with a journal directory of its own that
+// stopServers() removes
+static pid_t spawnServer(const std::vector<std::string>& options,
+                         std::vector<std::string>& journals) {
+    char journal[] = "/tmp/bench-server-XXXXXX";
+    if (!mkdtemp(journal)) return -1;
+    journals.push_back(journal);
+
+    std::vector<std::string> args = {"server", "--journal-dir=" + journals.back(),
+                                     "--mcast-group=none", "--log-level=error"};
+    args.insert(args.end(), options.begin(), options.end());
+    pid_t pid = fork();
+    if (pid == 0) {
+        int null = open("/dev/null", O_RDWR);
+        dup2(null, 0);
+        dup2(null, 1);
+        dup2(null, 2);
+        std::vector<char*> argv;
+        for (std::string& arg : args) argv.push_back(&arg[0]);
+        argv.push_back(nullptr);
+        execv("./server", argv.data());
+        _exit(127);
+    }
+    return pid;
+}
+
+static void stopServers(std::vector<pid_t>& servers, std::vector<std::string>& journals) {
+    for (pid_t pid : servers) {
+        kill(pid, SIGKILL);
+        waitpid(pid, nullptr, 0);
+    }
+    for (const std::string& journal : journals) {
+        std::string command = "rm -rf " + journal;
+        if (system(command.c_str()) != 0) {
+            std::cerr << "  could not remove " << journal << "\n";
+        }
+    }
+    servers.clear();
+    journals.clear();
+}
+
+// Closed-loop routing between logged-in campuses, each sending to the next
+// one in the array; returns delivered msgs/s
+static double measureRouting(BenchCampus* campuses, int count, double seconds) {
+    std::atomic<bool> running{true};
+    std::vector<std::thread> threads;
+    for (int i = 0; i < count; i++) {
+        threads.emplace_back(benchReceiver, std::ref(campuses[i]));
+        threads.emplace_back(benchSender, std::ref(campuses[i]),
+                             std::ref(campuses[(i + 1) % count]), std::ref(running));
+    }
+
+    usleep(500 * 1000);     // Warm up
+    uint64_t before = 0;
+    for (int i = 0; i < count; i++) before += campuses[i].received;
+    auto started = std::chrono::steady_clock::now();
+    usleep((useconds_t)(seconds * 1e6));
+    uint64_t after = 0;
+    for (int i = 0; i < count; i++) after += campuses[i].received;
+    double rate = (after - before) / std::chrono::duration<double>(
+                                         std::chrono::steady_clock::now() - started).count();
+
+    running = false;
+    for (int i = 0; i < count; i++) shutdown(campuses[i].fd, SHUT_RDWR);
+    for (std::thread& thread : threads) thread.join();
+    return rate;
+}
+
+// Each campus sends to the next (CFD to KARACHI, ..., PESHAWAR to CFD)
+// through a cluster of k ./server processes on loopback, with as many
+// messages in flight as CLUSTER_WINDOW allows. Returns delivered msgs/s.
+static double runCluster(int k, double seconds, int& crossRoutes) {
+    std::string spec;
+    for (int i = 0; i < k; i++) {
+        spec += (i ? "," : "") + std::string("N") + std::to_string(i) + "@127.0.0.1:" +
+                std::to_string(CLUSTER_BASE_PORT + 10 * i);
+    }
+
+    std::vector<pid_t> servers;
+    std::vector<std::string> journals;
+    for (int i = 0; i < k; i++) {
+        servers.push_back(spawnServer({"--cluster=" + spec, "--node=N" + std::to_string(i)},
+                                      journals));
+    }
+    // Links are dialled every CLUSTER_RETRY_MS until the others are up
+    usleep((CLUSTER_RETRY_MS * 2 + 500) * 1000);
+
+    HashRing ring;
+    for (int i = 0; i < k; i++) ring.add(i, "N" + std::to_string(i));
+    crossRoutes = 0;
+
+    BenchCampus campuses[benchCampusCount];
+    bool loggedIn = true;
+    for (int i = 0; i < benchCampusCount; i++) {
+        campuses[i].id = (uint16_t)(i + 1);
+        campuses[i].targetId = (uint16_t)((i + 1) % benchCampusCount + 1);
+        loggedIn &= benchLogin(campuses[i], benchCampuses[i], CLUSTER_BASE_PORT);
+        const char* target = benchCampuses[(i + 1) % benchCampusCount];
+        crossRoutes += ring.ownerOf(benchCampuses[i]) != ring.ownerOf(target);
+    }
+
+    double rate = 0;
+    if (loggedIn) {
+        rate = measureRouting(campuses, benchCampusCount, seconds);
+    } else {
+        std::cerr << "  could not log every campus in (is ./server built?)\n";
+    }
+
+    for (BenchCampus& campus : campuses) {
+        if (campus.fd >= 0) close(campus.fd);
+    }
+    stopServers(servers, journals);
+    return rate;
+}
+
+static int benchClusterMain(int argc, char* argv[]) {
+    int maxNodes = argc > 2 ? atoi(argv[2]) : 4;
+    double seconds = argc > 3 ? atof(argv[3]) : 3;
+    if (maxNodes < 1) maxNodes = 1;
+    if (seconds <= 0) seconds = 3;
+
+    benchPlacement(std::max(maxNodes, 8));
+
+    std::cout << "\nRouted messages (" << CLUSTER_MESSAGE_SIZE << " bytes, each campus to the "
+              << "next, " << seconds << " s per run):\n";
+    for (int k = 1; k <= maxNodes; k++) {
+        int crossRoutes = 0;
+        double rate = runCluster(k, seconds, crossRoutes);
+        std::cout << "  " << k << " node" << (k > 1 ? "s" : " ") << std::fixed
+                  << std::setprecision(0) << std::setw(12) << rate << " msgs/s  ("
+                  << crossRoutes << " of " << benchCampusCount << " routes cross nodes)\n";
+    }
+    return 0;
+}
+
+#define FAILOVER_PRIMARY_PORT 9200
+#define FAILOVER_STANDBY_PORT 9300
+#define FAILOVER_STORED 100000      // Messages for an offline campus per store run
+#define FAILOVER_ROUTING_SECONDS 2
+
+// A primary on FAILOVER_PRIMARY_PORT and, if asked, a standby of it, given
+// time to get in sync
+static void startPrimary(bool withStandby, std::vector<pid_t>& servers,
+                         std::vector<std::string>& journals) {
+    std::string primary = "127.0.0.1:" + std::to_string(FAILOVER_PRIMARY_PORT);
+    if (!withStandby) {
+        servers.push_back(spawnServer({"--port=" + std::to_string(FAILOVER_PRIMARY_PORT)},
+                                      journals));
+        usleep(500 * 1000);
+        return;
+    }
+    servers.push_back(spawnServer({"--port=" + std::to_string(FAILOVER_PRIMARY_PORT),
+                                   "--standby=127.0.0.1"}, journals));
+    servers.push_back(spawnServer({"--port=" + std::to_string(FAILOVER_STANDBY_PORT),
+                                   "--standby-of=" + primary}, journals));
+    usleep((REPLICATION_RETRY_MS * 2 + 500) * 1000);
+}
+
+// Logs in at the first server of the pair that takes the campus, going
+// round with the client's pauses
+static bool benchRejoin(BenchCampus& campus, const std::string& name) {
+    auto started = std::chrono::steady_clock::now();
+    int pauseMillis = FAILOVER_RETRY_MS;
+    while (std::chrono::steady_clock::now() - started <
+           std::chrono::milliseconds(FAILOVER_GIVE_UP_MS)) {
+        if (benchLogin(campus, name, FAILOVER_PRIMARY_PORT) ||
+            benchLogin(campus, name, FAILOVER_STANDBY_PORT)) {
+            return true;
+        }
+        usleep(pauseMillis * 1000);
+        pauseMillis = std::min(pauseMillis * 2, FAILOVER_RETRY_MAX_MS);
+    }
+    return false;
+}
+
+// Live routing between five campuses; a standby has nothing to do for it
+static double runReplicatedRouting(bool withStandby) {
+    std::vector<pid_t> servers;
+    std::vector<std::string> journals;
+    startPrimary(withStandby, servers, journals);
+
+    BenchCampus campuses[benchCampusCount];
+    bool loggedIn = true;
+    for (int i = 0; i < benchCampusCount; i++) {
+        campuses[i].id = (uint16_t)(i + 1);
+        campuses[i].targetId = (uint16_t)((i + 1) % benchCampusCount + 1);
+        loggedIn &= benchLogin(campuses[i], benchCampuses[i], FAILOVER_PRIMARY_PORT);
+    }
+    double rate = loggedIn ? measureRouting(campuses, benchCampusCount, FAILOVER_ROUTING_SECONDS)
+                           : 0;
+    for (BenchCampus& campus : campuses) {
+        if (campus.fd >= 0) close(campus.fd);
+    }
+    stopServers(servers, journals);
+    return rate;
+}
+
+// CFD sends FAILOVER_STORED messages to KARACHI, which is offline, then one
+// to LAHORE; once that arrives the primary has journaled them all. With a
+// standby the primary is then killed at once and KARACHI collects what the
+// standby had mirrored by then. Returns stored msgs/s.
+static double runReplicatedStore(bool withStandby, uint64_t& recovered) {
+    std::vector<pid_t> servers;
+    std::vector<std::string> journals;
+    startPrimary(withStandby, servers, journals);
+
+    BenchCampus cfd, lahore, karachi;
+    double rate = 0;
+    recovered = 0;
+    if (benchLogin(cfd, "CFD", FAILOVER_PRIMARY_PORT) &&
+        benchLogin(lahore, "LAHORE", FAILOVER_PRIMARY_PORT)) {
+        std::string message(CLUSTER_MESSAGE_SIZE, 's');
+        std::string frame = buildFrame(FRAME_MESSAGE, 1, 2, "Bench", message);
+        std::string batch;
+        for (int i = 0; i < 100; i++) batch += frame;
+        std::string marker = buildFrame(FRAME_MESSAGE, 1, 3, "Bench", "done");
+
+        auto started = std::chrono::steady_clock::now();
+        for (int sent = 0; sent < FAILOVER_STORED; sent += 100) {
+            send(cfd.fd, batch.data(), batch.size(), MSG_NOSIGNAL);
+        }
+        send(cfd.fd, marker.data(), marker.size(), MSG_NOSIGNAL);
+
+        FrameDecoder decoder;
+        Frame reply;
+        bool done = false;
+        int bytesRead;
+        while (!done && (bytesRead = recv(lahore.fd, decoder.prepare(4096), 4096, 0)) > 0) {
+            decoder.commit(bytesRead);
+            while (decoder.next(reply) == FrameDecoder::FRAME_READY) {
+                done |= reply.header.type == FRAME_MESSAGE;
+            }
+        }
+        rate = FAILOVER_STORED / std::chrono::duration<double>(
+                                     std::chrono::steady_clock::now() - started).count();
+
+        if (withStandby) {
+            kill(servers[0], SIGKILL);
+            if (benchRejoin(karachi, "KARACHI")) {
+                struct timeval timeout = {1, 0};
+                setsockopt(karachi.fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+                benchReceiver(karachi);
+                recovered = karachi.received;
+            }
+        }
+    }
+    for (BenchCampus* campus : {&cfd, &lahore, &karachi}) {
+        if (campus->fd >= 0) close(campus->fd);
+    }
+    stopServers(servers, journals);
+    return rate;
+}
+
+// Kills the primary under five logged-in campuses and times each one until
+// it is logged in at the standby. Returns the time until the last is back.
+static double runFailover(double& meanMillis) {
+    std::vector<pid_t> servers;
+    std::vector<std::string> journals;
+    startPrimary(true, servers, journals);
+
+    BenchCampus campuses[benchCampusCount];
+    double back[benchCampusCount] = {};
+    bool loggedIn = true;
+    for (int i = 0; i < benchCampusCount; i++) {
+        loggedIn &= benchLogin(campuses[i], benchCampuses[i], FAILOVER_PRIMARY_PORT);
+    }
+
+    double last = -1;
+    meanMillis = -1;
+    if (loggedIn) {
+        auto killed = std::chrono::steady_clock::now();
+        kill(servers[0], SIGKILL);
+
+        std::vector<std::thread> threads;
+        for (int i = 0; i < benchCampusCount; i++) {
+            threads.emplace_back([&, i]() {
+                char byte;
+                while (recv(campuses[i].fd, &byte, 1, 0) > 0) {
+                }
+                close(campuses[i].fd);
+                campuses[i].fd = -1;
+                back[i] = benchRejoin(campuses[i], benchCampuses[i])
+                              ? std::chrono::duration<double, std::milli>(
+                                    std::chrono::steady_clock::now() - killed).count()
+                              : -1;
+            });
+        }
+        for (std::thread& thread : threads) thread.join();
+
+        meanMillis = 0;
+        for (double millis : back) {
+            if (millis < 0) {
+                last = meanMillis = -1;
+                break;
+            }
+            last = std::max(last, millis);
+            meanMillis += millis / benchCampusCount;
+        }
+    }
+    for (BenchCampus& campus : campuses) {
+        if (campus.fd >= 0) close(campus.fd);
+    }
+    stopServers(servers, journals);
+    return last;
+}
+
+static int benchFailoverMain(int argc, char* argv[]) {
+    int rounds = argc > 2 ? atoi(argv[2]) : 5;
+    if (rounds < 1) rounds = 5;
+
+    // Runs alternate, so drift on a busy machine hits both sides alike
+    const int pairs = 3;
+    double routing[2] = {0, 0};
+    double storing[2] = {0, 0};
+    uint64_t recovered = 0;
+    uint64_t leastRecovered = FAILOVER_STORED;
+    for (int pair = 0; pair < pairs; pair++) {
+        for (int withStandby = 0; withStandby < 2; withStandby++) {
+            routing[withStandby] += runReplicatedRouting(withStandby) / pairs;
+            storing[withStandby] += runReplicatedStore(withStandby, recovered) / pairs;
+            if (withStandby) leastRecovered = std::min(leastRecovered, recovered);
+        }
+    }
+
+    std::cout << "Replication overhead (primary alone vs. with a standby attached, mean of "
+              << pairs << " runs each):\n";
+    std::cout << std::fixed << std::setprecision(0) << "  routing   " << std::setw(10)
+              << routing[0] << " -> " << std::setw(10) << routing[1] << " msgs/s  ("
+              << std::setprecision(1) << std::showpos
+              << 100.0 * (routing[1] - routing[0]) / routing[0] << std::noshowpos
+              << "%; live messages are not replicated)\n";
+    std::cout << std::setprecision(0) << "  storing   " << std::setw(10) << storing[0] << " -> "
+              << std::setw(10) << storing[1] << " msgs/s  (" << std::setprecision(1)
+              << std::showpos << 100.0 * (storing[1] - storing[0]) / storing[0]
+              << std::noshowpos << "%; at least "
+              << leastRecovered << " of " << FAILOVER_STORED
+              << " on the standby when the primary was killed)\n";
+
+    std::cout << "\nFailover (primary killed under " << benchCampusCount
+              << " campuses, until each is logged in at the standby):\n";
+    for (int round = 1; round <= rounds; round++) {
+        double mean;
+        double last = runFailover(mean);
+        if (last < 0) {
+            std::cout << "  round " << round << ": not every campus got back\n";
+            continue;
+        }
+        std::cout << "  round " << round << ": last back after " << std::setprecision(1)
+                  << std::setw(7) << last << " ms, mean " << std::setw(7) << mean << " ms\n";
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------
+// Reconnect storms: every campus drops at once and logs in again, either
+// with its password (subscriptions sent again) or with its session token
+// (the server kept them). Each then sends one message to the next campus;
+// the time until a campus has one from its neighbour is how long the storm
+// kept it from routing.
+
+#define STORM_PORT 9400
+#define STORM_TOPICS 16             // Subscriptions each campus holds besides its own
+#define STORM_CHECKS 200000         // Token checks timed in-process
+#define STORM_HASHES 20             // Password checks timed in-process
+
+struct StormCampus {
+    BenchCampus link;
+    std::string name;
+    std::string token;
+    std::string subscriptions;      // The SUB control frame
+    bool resumed = false;
+    double loggedInMillis = 0;      // Since the storm began
+    double routedMillis = -1;       // Until a message from the previous campus
+};
+
+static std::string sessionOf(const std::string& reply, bool& resumed) {
+    resumed = reply.find("|RESUMED:1") != std::string::npos;
+    size_t start = reply.find("|SESSION:");
+    if (start == std::string::npos) return "";
+    start += 9;
+    return reply.substr(start, reply.find('|', start) - start);
+}
+
+static void stormRejoin(StormCampus& campus, StormCampus& next, bool useToken,
+                        std::chrono::steady_clock::time_point began) {
+    std::string reply;
+    if (!benchLogin(campus.link, campus.name, STORM_PORT, useToken ? campus.token : "", &reply)) {
+        return;
+    }
+    campus.token = sessionOf(reply, campus.resumed);
+    if (!campus.resumed) {
+        send(campus.link.fd, campus.subscriptions.data(), campus.subscriptions.size(),
+             MSG_NOSIGNAL);
+    }
+    campus.loggedInMillis = std::chrono::duration<double, std::milli>(
+                                std::chrono::steady_clock::now() - began).count();
+
+    std::string message = buildFrame(FRAME_MESSAGE, campus.link.id, next.link.id, "Bench",
+                                     "after the storm");
+    send(campus.link.fd, message.data(), message.size(), MSG_NOSIGNAL);
+
+    // A message sent before this campus was back was stored and comes with
+    // the replay
+    struct timeval timeout = {2, 0};
+    setsockopt(campus.link.fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    FrameDecoder decoder;
+    Frame frame;
+    int bytesRead;
+    while ((bytesRead = recv(campus.link.fd, decoder.prepare(4096), 4096, 0)) > 0) {
+        decoder.commit(bytesRead);
+        bool routed = false;
+        while (decoder.next(frame) == FrameDecoder::FRAME_READY) {
+            routed |= frame.header.type == FRAME_MESSAGE;
+        }
+        if (routed) {
+            campus.routedMillis = std::chrono::duration<double, std::milli>(
+                                      std::chrono::steady_clock::now() - began).count();
+            return;
+        }
+    }
+}
+
+static double percentile(std::vector<double> values, double share) {
+    if (values.empty()) return 0;
+    size_t index = std::min(values.size() - 1, (size_t)(share * values.size()));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+// Returns false if the server could not be reached
+static bool runStorm(bool useToken, int rounds) {
+    std::vector<pid_t> servers;
+    std::vector<std::string> journals;
+    servers.push_back(spawnServer({"--port=" + std::to_string(STORM_PORT)}, journals));
+    usleep(500 * 1000);
+
+    StormCampus campuses[benchCampusCount];
+    bool ready = true;
+    for (int i = 0; i < benchCampusCount && ready; i++) {
+        StormCampus& campus = campuses[i];
+        campus.name = benchCampuses[i];
+        campus.link.id = (uint16_t)(i + 1);
+        std::string topics = campus.name + "/*";
+        for (int t = 0; t < STORM_TOPICS; t++) topics += ",*/Storm" + std::to_string(t);
+        campus.subscriptions = buildFrame(FRAME_CONTROL, campus.link.id, 0, "", "SUB:" + topics);
+
+        std::string reply;
+        ready = benchLogin(campus.link, campus.name, STORM_PORT, "", &reply);
+        campus.token = sessionOf(reply, campus.resumed);
+        send(campus.link.fd, campus.subscriptions.data(), campus.subscriptions.size(),
+             MSG_NOSIGNAL);
+    }
+
+    std::vector<double> routed;
+    double stormMillis = 0;
+    int reconnects = 0, resumed = 0, lost = 0;
+    for (int round = 0; round < rounds && ready; round++) {
+        auto began = std::chrono::steady_clock::now();
+        for (StormCampus& campus : campuses) {
+            close(campus.link.fd);
+            campus.link.fd = -1;
+            campus.routedMillis = -1;
+        }
+        std::vector<std::thread> threads;
+        for (int i = 0; i < benchCampusCount; i++) {
+            threads.emplace_back(stormRejoin, std::ref(campuses[i]),
+                                 std::ref(campuses[(i + 1) % benchCampusCount]), useToken, began);
+        }
+        for (std::thread& thread : threads) thread.join();
+
+        double lastLogin = 0;
+        for (StormCampus& campus : campuses) {
+            if (campus.link.fd < 0 || campus.routedMillis < 0) {
+                lost++;
+                continue;
+            }
+            reconnects++;
+            resumed += campus.resumed;
+            lastLogin = std::max(lastLogin, campus.loggedInMillis);
+            routed.push_back(campus.routedMillis);
+        }
+        stormMillis += lastLogin;
+    }
+    for (StormCampus& campus : campuses) {
+        if (campus.link.fd >= 0) close(campus.link.fd);
+    }
+    stopServers(servers, journals);
+    if (!ready) return false;
+
+    std::cout << std::fixed << std::setprecision(0) << "  " << std::left << std::setw(10)
+              << (useToken ? "token" : "password") << std::right << std::setw(8)
+              << (stormMillis > 0 ? reconnects / (stormMillis / 1000) : 0)
+              << " reconnects/s   first routed message after p50 " << std::setprecision(2)
+              << std::setw(6) << percentile(routed, 0.5) << " ms, p99 " << std::setw(6)
+              << percentile(routed, 0.99) << " ms  (" << resumed << " of " << reconnects
+              << " resumed";
+    if (lost > 0) std::cout << ", " << lost << " not back";
+    std::cout << ")\n";
+    return true;
+}
+
+static int benchStormMain(int argc, char* argv[]) {
+    int rounds = argc > 2 ? atoi(argv[2]) : 200;
+    if (rounds < 1) rounds = 200;
+
+    // What the server does per login, before anything else
+    CredentialTable credentials({makeCredential("LAHORE", 3, "NU-LHR-123", CREDENTIAL_ITERATIONS)},
+                                MAX_CAMPUS_ID);
+    SessionTokens tokens(SESSION_TOKEN_TTL);
+    std::string token = tokens.begin(3, time(nullptr));
+    int matched = 0;
+    auto started = std::chrono::steady_clock::now();
+    for (int i = 0; i < STORM_HASHES; i++) {
+        matched += credentials.verify("LAHORE", "NU-LHR-123");
+    }
+    double passwordMillis = std::chrono::duration<double, std::milli>(
+                                std::chrono::steady_clock::now() - started).count() / STORM_HASHES;
+    started = std::chrono::steady_clock::now();
+    for (int i = 0; i < STORM_CHECKS; i++) {
+        matched += tokens.verify(token, 3, time(nullptr));
+    }
+    double tokenNanos = std::chrono::duration<double, std::nano>(
+                            std::chrono::steady_clock::now() - started).count() / STORM_CHECKS;
+    std::cout << "Login checks: password " << std::fixed << std::setprecision(1) << passwordMillis
+              << " ms (" << CREDENTIAL_ITERATIONS << " PBKDF2 iterations), session token "
+              << std::setprecision(0) << tokenNanos << " ns"
+              << (matched == STORM_HASHES + STORM_CHECKS ? "" : " (mismatch)") << "\n";
+
+    std::cout << "\nReconnect storm (" << benchCampusCount << " campuses with " << STORM_TOPICS + 1
+              << " subscriptions each drop and log in at once, " << rounds << " rounds):\n";
+    for (bool useToken : {false, true}) {
+        if (!runStorm(useToken, rounds)) {
+            std::cerr << "Could not log in at ./server on port " << STORM_PORT << "\n";
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------
+// Credentials: what a password check costs at a few PBKDF2 iteration
+// counts, and loading and searching a file with many campuses, then
+// adding them all to a registry as the server does and looking them up.
+
+#define CREDENTIAL_LOOKUPS 1000000
+
+static int benchCredentialsMain(int argc, char* argv[]) {
+    int campuses = argc > 2 ? atoi(argv[2]) : 10000;
+    if (campuses < 1 || campuses > MAX_CAMPUS_ID) campuses = 10000;
+
+    std::cout << "Password check (PBKDF2-HMAC-SHA256, "
+              << (sha256HardwareAvailable() ? "SHA-NI" : "portable") << "), one core:\n";
+    for (uint32_t iterations : {1000u, 10000u, 100000u, 600000u}) {
+        CredentialTable table({makeCredential("LAHORE", 3, "NU-LHR-123", iterations)}, 1000);
+        int checks = std::max(3, (int)(2000000 / iterations));
+        int matched = 0;
+        auto started = std::chrono::steady_clock::now();
+        for (int i = 0; i < checks; i++) {
+            matched += table.verify("LAHORE", "NU-LHR-123");
+        }
+        double millis = std::chrono::duration<double, std::milli>(
+                            std::chrono::steady_clock::now() - started).count() / checks;
+        std::cout << "  " << std::setw(7) << iterations << " iterations  " << std::fixed
+                  << std::setprecision(2) << std::setw(8) << millis << " ms  " << std::setw(7)
+                  << std::setprecision(0) << 1000 / millis << " logins/s"
+                  << (iterations == CREDENTIAL_ITERATIONS ? "  (default)" : "")
+                  << (matched == checks ? "" : "  (mismatch)") << "\n";
+    }
+
+    // Real salts and hashes, but one iteration so the file is quick to make
+    char path[] = "/tmp/bench-credentials-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        std::cerr << "Cannot create a temporary file\n";
+        return 1;
+    }
+    close(fd);
+    std::vector<std::string> names;
+    {
+        std::ofstream file(path);
+        for (int i = 0; i < campuses; i++) {
+            names.push_back("CAMPUS" + std::to_string(i));
+            file << formatCredential(makeCredential(names.back(), (uint16_t)(i + 1), "secret", 1))
+                 << "\n";
+        }
+    }
+
+    auto started = std::chrono::steady_clock::now();
+    std::shared_ptr<const CredentialTable> table = CredentialTable::load(path, MAX_CAMPUS_ID);
+    double loadMillis = std::chrono::duration<double, std::milli>(
+                            std::chrono::steady_clock::now() - started).count();
+    unlink(path);
+
+    std::vector<uint32_t> order(CREDENTIAL_LOOKUPS);
+    uint32_t state = 12345;
+    for (uint32_t& index : order) {
+        state = state * 1103515245 + 12345;
+        index = (state >> 8) % campuses;
+    }
+    size_t found = 0;
+    started = std::chrono::steady_clock::now();
+    for (uint32_t index : order) {
+        found += table->find(names[index]) != nullptr;
+    }
+    double lookupNanos = std::chrono::duration<double, std::nano>(
+                             std::chrono::steady_clock::now() - started).count() / CREDENTIAL_LOOKUPS;
+
+    std::cout << "\nCredentials file with " << campuses << " campuses: loaded in " << std::fixed
+              << std::setprecision(1) << loadMillis << " ms (" << std::setprecision(2)
+              << loadMillis * 1000 / campuses << " us per line), lookup " << std::setprecision(0)
+              << lookupNanos << " ns" << (found == CREDENTIAL_LOOKUPS ? "" : " (mismatch)")
+              << "\n";
+
+    CampusRegistry registry;
+    std::vector<std::pair<std::string, uint16_t>> listed;
+    for (const Credential& entry : table->all()) {
+        listed.emplace_back(entry.campus, entry.id);
+    }
+    started = std::chrono::steady_clock::now();
+    registry.addCampuses(listed);
+    double addMillis = std::chrono::duration<double, std::milli>(
+                           std::chrono::steady_clock::now() - started).count();
+    for (const auto& campus : listed) {
+        registry.publish({-1, campus.first, "127.0.0.1", true, -1, campus.second,
+                          PROTOCOL_BINARY, nullptr});
+    }
+
+    found = 0;
+    started = std::chrono::steady_clock::now();
+    {
+        CampusRegistry::ReadGuard guard;
+        for (uint32_t index : order) {
+            const ClientInfo* info = registry.lookup(names[index]);
+            found += info && info->campusName == names[index];
+        }
+    }
+    lookupNanos = std::chrono::duration<double, std::nano>(
+                      std::chrono::steady_clock::now() - started).count() / CREDENTIAL_LOOKUPS;
+    std::cout << "Registry with the same campuses: added in " << std::setprecision(1) << addMillis
+              << " ms, lookup by name " << std::setprecision(0) << lookupNanos << " ns"
+              << (found == CREDENTIAL_LOOKUPS ? "" : " (mismatch)") << "\n";
+    return 0;
+}
+
+// ---------------------------------------------------------------------
+// Credit: four campuses stream 60 KB messages at one campus as fast as
+// they are let, first with only the watermarks to hold them back (they
+// stop on FLOW:PAUSE and go on at FLOW:RESUME, as the clients did before
+// credit), then with send credit. The target reads at full speed, then at
+// a fixed rate well below what the senders offer. Delivered throughput,
+// how much was lost, and the server's peak memory (VmHWM).
+
+#define CREDIT_PORT 9500
+#define CREDIT_MESSAGE_SIZE 60000
+#define CREDIT_SLOW_RATE (32 * 1024 * 1024)     // Bytes/s the slow target reads
+
+struct CreditSender {
+    BenchCampus link;
+    std::string name;
+    int64_t window = 0;         // 0: no credit
+    std::mutex mutex;
+    std::condition_variable changed;
+    int64_t credit = 0;
+    bool paused = false;
+    uint64_t waitedMicros = 0;
+};
+
+// Reads CREDIT and FLOW control frames for one sender
+static void creditListener(CreditSender& sender) {
+    FrameDecoder decoder;
+    Frame frame;
+    int bytesRead;
+    while ((bytesRead = recv(sender.link.fd, decoder.prepare(4096), 4096, 0)) > 0) {
+        decoder.commit(bytesRead);
+        while (decoder.next(frame) == FrameDecoder::FRAME_READY) {
+            if (frame.header.type != FRAME_CONTROL) continue;
+            std::string text(frame.payload, frame.header.payloadLength);
+            std::lock_guard<std::mutex> lock(sender.mutex);
+            if (text.compare(0, 7, "CREDIT:") == 0) {
+                sender.credit += strtoll(text.c_str() + text.find(':', 7) + 1, nullptr, 10);
+            } else if (text.compare(0, 11, "FLOW:PAUSE:") == 0) {
+                sender.paused = true;
+            } else if (text.compare(0, 12, "FLOW:RESUME:") == 0) {
+                sender.paused = false;
+            }
+            sender.changed.notify_all();
+        }
+    }
+    std::lock_guard<std::mutex> lock(sender.mutex);
+    sender.paused = false;
+    sender.credit = INT64_MAX / 2;
+    sender.changed.notify_all();
+}
+
+static void creditPump(CreditSender& sender, uint16_t targetId, std::atomic<bool>& running) {
+    std::string frame = buildFrame(FRAME_MESSAGE, sender.link.id, targetId, "Bench",
+                                   std::string(CREDIT_MESSAGE_SIZE, 'c'));
+    while (running) {
+        {
+            std::unique_lock<std::mutex> lock(sender.mutex);
+            auto started = std::chrono::steady_clock::now();
+            sender.changed.wait(lock, [&] {
+                return !running || (sender.window > 0 ? sender.credit > 0 : !sender.paused);
+            });
+            sender.waitedMicros += std::chrono::duration_cast<std::chrono::microseconds>(
+                                       std::chrono::steady_clock::now() - started).count();
+            if (!running) break;
+            if (sender.window > 0) sender.credit -= frame.size();
+        }
+        if (send(sender.link.fd, frame.data(), frame.size(), MSG_NOSIGNAL) !=
+            (ssize_t)frame.size()) {
+            break;
+        }
+        sender.link.sent++;
+    }
+}
+
+// Counts messages; paced to rate bytes/s unless rate is 0
+static void creditTarget(BenchCampus& target, std::atomic<uint64_t>& bytes, uint64_t rate) {
+    FrameDecoder decoder;
+    Frame frame;
+    int bytesRead;
+    auto started = std::chrono::steady_clock::now();
+    while ((bytesRead = recv(target.fd, decoder.prepare(65536), 65536, 0)) > 0) {
+        decoder.commit(bytesRead);
+        bytes += bytesRead;
+        while (decoder.next(frame) == FrameDecoder::FRAME_READY) {
+            if (frame.header.type == FRAME_MESSAGE) target.received++;
+        }
+        if (rate > 0) {
+            auto due = started + std::chrono::microseconds(bytes.load() * 1000000 / rate);
+            std::this_thread::sleep_until(due);
+        }
+    }
+}
+
+static long peakMemoryKB(pid_t pid) {
+    std::ifstream status("/proc/" + std::to_string(pid) + "/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) return atol(line.c_str() + 6);
+    }
+    return -1;
+}
+
+// Returns false if the server could not be reached
+static bool runCredit(bool credited, uint64_t rate, double seconds) {
+    std::vector<pid_t> servers;
+    std::vector<std::string> journals;
+    servers.push_back(spawnServer({"--port=" + std::to_string(CREDIT_PORT)}, journals));
+    usleep(500 * 1000);
+    long idleKB = peakMemoryKB(servers[0]);
+
+    BenchCampus target;
+    target.id = 2;
+    bool ready = benchLogin(target, "KARACHI", CREDIT_PORT);
+    const char* names[] = {"CFD", "LAHORE", "MULTAN", "PESHAWAR"};
+    const uint16_t ids[] = {1, 3, 4, 5};
+    CreditSender senders[4];
+    for (int i = 0; i < 4 && ready; i++) {
+        std::string reply;
+        senders[i].name = names[i];
+        senders[i].link.id = ids[i];
+        ready = benchLogin(senders[i].link, names[i], CREDIT_PORT, "", &reply,
+                           credited ? "Credit:1," : "");
+        size_t window = reply.find("|CREDIT:");
+        senders[i].window = window == std::string::npos ? 0 : atoll(reply.c_str() + window + 8);
+        senders[i].credit = senders[i].window;
+        ready &= senders[i].window > 0 || !credited;
+    }
+    if (!ready) {
+        stopServers(servers, journals);
+        return false;
+    }
+
+    std::atomic<bool> running{true};
+    std::atomic<uint64_t> delivered{0};
+    std::vector<std::thread> threads;
+    threads.emplace_back(creditTarget, std::ref(target), std::ref(delivered), rate);
+    for (CreditSender& sender : senders) {
+        threads.emplace_back(creditListener, std::ref(sender));
+        threads.emplace_back(creditPump, std::ref(sender), target.id, std::ref(running));
+    }
+
+    usleep(300 * 1000);     // Warm up
+    uint64_t before = delivered;
+    auto started = std::chrono::steady_clock::now();
+    usleep((useconds_t)(seconds * 1e6));
+    double rateMB = (delivered - before) / 1e6 / std::chrono::duration<double>(
+                                                   std::chrono::steady_clock::now() - started).count();
+    running = false;
+    for (CreditSender& sender : senders) sender.changed.notify_all();
+    usleep(1000 * 1000);    // Let the target drain what the server still holds
+    long peakKB = peakMemoryKB(servers[0]);
+
+    uint64_t sent = 0;
+    uint64_t waited = 0;
+    for (CreditSender& sender : senders) {
+        shutdown(sender.link.fd, SHUT_RDWR);
+        sent += sender.link.sent;
+        waited += sender.waitedMicros;
+    }
+    shutdown(target.fd, SHUT_RDWR);
+    for (std::thread& thread : threads) thread.join();
+    for (CreditSender& sender : senders) close(sender.link.fd);
+    close(target.fd);
+    stopServers(servers, journals);
+
+    std::cout << "  " << std::left << std::setw(11) << (credited ? "credit" : "watermarks")
+              << std::right << std::fixed << std::setprecision(0) << std::setw(6) << rateMB
+              << " MB/s delivered  " << std::setw(6) << sent - target.received << " of "
+              << std::setw(6) << sent << " lost  server peak " << std::setw(6)
+              << (peakKB - idleKB) / 1024.0 << " MB over idle  senders waiting "
+              << std::setw(3) << 100.0 * waited / (4 * (seconds + 0.3) * 1e6) << "%\n";
+    return true;
+}
+
+static int benchCreditMain(int argc, char* argv[]) {
+    double seconds = argc > 2 ? atof(argv[2]) : 3;
+    if (seconds <= 0) seconds = 3;
+
+    for (uint64_t rate : {(uint64_t)0, (uint64_t)CREDIT_SLOW_RATE}) {
+        std::cout << (rate == 0 ? "Target reading at full speed"
+                                : "Target reading " + std::to_string(rate >> 20) + " MB/s")
+                  << " (4 senders, " << CREDIT_MESSAGE_SIZE / 1000 << " KB messages, "
+                  << seconds << " s):\n";
+        for (bool credited : {false, true}) {
+            if (!runCredit(credited, rate, seconds)) {
+                std::cerr << "Could not log in at ./server on port " << CREDIT_PORT << "\n";
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------
+// Lanes: one campus streams a 16 MB file at another, in 128 KB chunks,
+// as fast as its send credit allows, while a third sends it a short
+// department message every few milliseconds. The target reads through a
+// small receive buffer, at full speed and then at a fixed rate, like a
+// campus at the far end of a slower link. Each message carries the time
+// it was sent, so the target sees how long it waited behind the file.
+// Runs once per --lanes mode.
+
+#define LANES_PORT 9700
+#define LANES_FILE_SIZE (16 * 1024 * 1024)
+#define LANES_MESSAGE_EVERY_US 5000
+#define LANES_RECEIVE_BUFFER (128 * 1024)  // The target's share of the link
+#define LANES_SLOW_RATE (32 * 1024 * 1024)
+
+static int64_t benchNanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Sends the file again and again, spending credit on every chunk
+static void lanesFileSender(CreditSender& sender, uint16_t targetId, std::atomic<bool>& running) {
+    std::string data(FILE_CHUNK_SIZE, 'f');
+    uint32_t transferId = 1;
+    while (running) {
+        std::string begin = buildTransferFrame(FRAME_FILE_BEGIN, sender.link.id, targetId,
+                                               transferId, LANES_FILE_SIZE, 0, "lanes.bin", 9);
+        if (send(sender.link.fd, begin.data(), begin.size(), MSG_NOSIGNAL) < 0) return;
+        for (uint64_t offset = 0; offset < LANES_FILE_SIZE && running; offset += FILE_CHUNK_SIZE) {
+            std::string chunk = buildTransferFrame(FRAME_FILE_CHUNK, sender.link.id, targetId,
+                                                   transferId, offset, 0, data.data(), data.size());
+            {
+                std::unique_lock<std::mutex> lock(sender.mutex);
+                sender.changed.wait(lock, [&] { return !running || sender.credit > 0; });
+                sender.credit -= chunk.size();
+            }
+            if (send(sender.link.fd, chunk.data(), chunk.size(), MSG_NOSIGNAL) !=
+                (ssize_t)chunk.size()) {
+                return;
+            }
+            sender.link.sent += chunk.size();
+        }
+        char digest[SHA256_DIGEST_SIZE] = {};
+        std::string end = buildTransferFrame(FRAME_FILE_END, sender.link.id, targetId, transferId,
+                                             LANES_FILE_SIZE, 0, digest, sizeof(digest));
+        if (send(sender.link.fd, end.data(), end.size(), MSG_NOSIGNAL) < 0) return;
+        transferId++;
+    }
+}
+
+static void lanesChatSender(BenchCampus& campus, uint16_t targetId, std::atomic<bool>& running) {
+    while (running) {
+        std::string frame = buildFrame(FRAME_MESSAGE, campus.id, targetId, "Bench",
+                                       "T" + std::to_string(benchNanos()));
+        if (send(campus.fd, frame.data(), frame.size(), MSG_NOSIGNAL) != (ssize_t)frame.size()) {
+            return;
+        }
+        campus.sent++;
+        usleep(LANES_MESSAGE_EVERY_US);
+    }
+}
+
+// Paced to rate bytes/s unless rate is 0. Message latencies (ms) go to
+// latencies once measuring is set.
+static void lanesTarget(BenchCampus& target, uint64_t rate, std::atomic<bool>& measuring,
+                        std::atomic<uint64_t>& fileBytes, std::vector<double>& latencies) {
+    FrameDecoder decoder;
+    Frame frame;
+    int bytesRead;
+    uint64_t total = 0;
+    auto started = std::chrono::steady_clock::now();
+    while ((bytesRead = recv(target.fd, decoder.prepare(65536), 65536, 0)) > 0) {
+        decoder.commit(bytesRead);
+        total += bytesRead;
+        while (decoder.next(frame) == FrameDecoder::FRAME_READY) {
+            if (!measuring) continue;
+            if (frame.header.type == FRAME_FILE_CHUNK) {
+                fileBytes += frame.header.payloadLength - TRANSFER_HEADER_SIZE;
+            } else if (frame.header.type == FRAME_MESSAGE) {
+                const char* text = (const char*)memchr(frame.payload, 'T', frame.header.payloadLength);
+                if (text) latencies.push_back((benchNanos() - atoll(text + 1)) / 1e6);
+            }
+        }
+        if (rate > 0) {
+            std::this_thread::sleep_until(started + std::chrono::microseconds(total * 1000000 / rate));
+        }
+    }
+}
+
+// Returns false if the server could not be reached
+static bool runLanes(const std::string& mode, uint64_t rate, double seconds) {
+    std::vector<pid_t> servers;
+    std::vector<std::string> journals;
+    servers.push_back(spawnServer({"--port=" + std::to_string(LANES_PORT), "--lanes=" + mode},
+                                  journals));
+    usleep(500 * 1000);
+
+    BenchCampus target;
+    BenchCampus chat;
+    CreditSender file;
+    target.id = 2;
+    chat.id = 1;
+    file.link.id = 3;
+    std::string reply;
+    bool ready = benchLogin(target, "KARACHI", LANES_PORT) && benchLogin(chat, "CFD", LANES_PORT) &&
+                 benchLogin(file.link, "LAHORE", LANES_PORT, "", &reply, "Credit:1,");
+    size_t window = reply.find("|CREDIT:");
+    if (!ready || window == std::string::npos) {
+        stopServers(servers, journals);
+        return false;
+    }
+    file.window = file.credit = atoll(reply.c_str() + window + 8);
+    int receiveBuffer = LANES_RECEIVE_BUFFER;
+    setsockopt(target.fd, SOL_SOCKET, SO_RCVBUF, &receiveBuffer, sizeof(receiveBuffer));
+
+    std::atomic<bool> running{true};
+    std::atomic<bool> measuring{false};
+    std::atomic<uint64_t> fileBytes{0};
+    std::vector<double> latencies;
+    std::vector<std::thread> threads;
+    threads.emplace_back(lanesTarget, std::ref(target), rate, std::ref(measuring),
+                         std::ref(fileBytes), std::ref(latencies));
+    threads.emplace_back(creditListener, std::ref(file));
+    threads.emplace_back(lanesFileSender, std::ref(file), target.id, std::ref(running));
+    threads.emplace_back(lanesChatSender, std::ref(chat), target.id, std::ref(running));
+
+    usleep(500 * 1000);     // Let the file fill the path
+    measuring = true;
+    auto started = std::chrono::steady_clock::now();
+    usleep((useconds_t)(seconds * 1e6));
+    measuring = false;
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    running = false;
+    file.changed.notify_all();
+
+    shutdown(chat.fd, SHUT_RDWR);
+    shutdown(file.link.fd, SHUT_RDWR);
+    shutdown(target.fd, SHUT_RDWR);
+    for (std::thread& thread : threads) thread.join();
+    close(chat.fd);
+    close(file.link.fd);
+    close(target.fd);
+    stopServers(servers, journals);
+
+    std::cout << "  " << std::left << std::setw(9) << mode << std::right << std::fixed
+              << std::setprecision(2) << "message latency p50 " << std::setw(7)
+              << percentile(latencies, 0.5) << " ms, p99 " << std::setw(7)
+              << percentile(latencies, 0.99) << " ms, max " << std::setw(7)
+              << percentile(latencies, 1.0) << " ms (" << latencies.size()
+              << " messages)  file " << std::setprecision(0) << std::setw(5)
+              << fileBytes / 1e6 / elapsed << " MB/s\n";
+    return true;
+}
+
+static int benchLanesMain(int argc, char* argv[]) {
+    double seconds = argc > 2 ? atof(argv[2]) : 3;
+    if (seconds <= 0) seconds = 3;
+
+    for (uint64_t rate : {(uint64_t)0, (uint64_t)LANES_SLOW_RATE}) {
+        std::cout << (rate == 0 ? "Target reading at full speed"
+                                : "Target reading " + std::to_string(rate >> 20) + " MB/s")
+                  << " (" << LANES_FILE_SIZE / (1024 * 1024) << " MB files in "
+                  << FILE_CHUNK_SIZE / 1024 << " KB chunks, a message every "
+                  << LANES_MESSAGE_EVERY_US / 1000 << " ms, " << seconds << " s):\n";
+        for (const char* mode : {"fifo", "strict", "weighted"}) {
+            if (!runLanes(mode, rate, seconds)) {
+                std::cerr << "Could not log in at ./server on port " << LANES_PORT << "\n";
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    std::string which = argc > 1 ? argv[1] : "";
+
+    if (which == "registry") {
+        return benchRegistryMain(argc, argv);
+    }
+    if (which == "checksum") {
+        return benchChecksumMain(argc, argv);
+    }
+    if (which == "compress") {
+        return benchCompressMain(argc, argv);
+    }
+    if (which == "hex") {
+        return benchHexMain(argc, argv);
+    }
+    if (which == "timers") {
+        return benchTimersMain(argc, argv);
+    }
+    if (which == "heartbeats") {
+        return benchHeartbeatsMain(argc, argv);
+    }
+    if (which == "fanout") {
+        return benchFanOutMain(argc, argv);
+    }
+    if (which == "topics") {
+        return benchTopicsMain(argc, argv);
+    }
+    if (which == "cluster") {
+        return benchClusterMain(argc, argv);
+    }
+    if (which == "failover") {
+        return benchFailoverMain(argc, argv);
+    }
+    if (which == "storm") {
+        return benchStormMain(argc, argv);
+    }
+    if (which == "credentials") {
+        return benchCredentialsMain(argc, argv);
+    }
+    if (which == "credit") {
+        return benchCreditMain(argc, argv);
+    }
+    if (which == "lanes") {
+        return benchLanesMain(argc, argv);
+    }
+
+    std::cerr << "Usage: " << argv[0] << " registry [readers] [seconds]\n"
+              << "       " << argv[0] << " checksum [megabytes]\n"
+              << "       " << argv[0] << " compress [file]\n"
+              << "       " << argv[0] << " hex [megabytes]\n"
+              << "       " << argv[0] << " timers [endpoints]\n"
+              << "       " << argv[0] << " heartbeats [campuses]\n"
+              << "       " << argv[0] << " fanout [campuses]\n"
+              << "       " << argv[0] << " topics [subscriptions] [campuses]\n"
+              << "       " << argv[0] << " cluster [nodes] [seconds]\n"
+              << "       " << argv[0] << " failover [rounds]\n"
+              << "       " << argv[0] << " storm [rounds]\n"
+              << "       " << argv[0] << " credentials [campuses]\n"
+              << "       " << argv[0] << " credit [seconds]\n"
+              << "       " << argv[0] << " lanes [seconds]\n";
+    return 1;
+}
@@ -0,0 +1,378 @@
+#include "campus_registry.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+
+// Per-thread record index and guard nesting depth
+struct ThreadEpochState {
+    int index = -1;
+    int depth = 0;
+
+    ~ThreadEpochState() {
+        if (index >= 0) {
+            EpochReclaimer::instance().releaseRecord(index);
+        }
+    }
+};
+
+static thread_local ThreadEpochState epochState;
+
+EpochReclaimer& EpochReclaimer::instance() {
+    static EpochReclaimer* reclaimer = new EpochReclaimer();
+    return *reclaimer;
+}
+
+EpochReclaimer::Record& EpochReclaimer::threadRecord() {
+    if (epochState.index < 0) {
+        for (int i = 0; i < MAX_REGISTRY_READERS; i++) {
+            bool expected = false;
+            if (!records[i].inUse.load(std::memory_order_relaxed) &&
+                records[i].inUse.compare_exchange_strong(expected, true)) {
+                epochState.index = i;
+                break;
+            }
+        }
+        if (epochState.index < 0) {
+            throw std::runtime_error("Too many registry reader threads");
+        }
+    }
+    return records[epochState.index];
+}
+
+void EpochReclaimer::releaseRecord(int index) {
+    records[index].epoch.store(IDLE, std::memory_order_release);
+    records[index].inUse.store(false, std::memory_order_release);
+}
+
+void EpochReclaimer::enter() {
+    if (epochState.depth++ > 0) return;     // Nested guard: already announced
+
+    Record& record = threadRecord();
+    record.epoch.store(globalEpoch.load(std::memory_order_acquire), std::memory_order_seq_cst);
+}
+
+void EpochReclaimer::exit() {
+    if (--epochState.depth > 0) return;
+    records[epochState.index].epoch.store(IDLE, std::memory_order_release);
+}
+
+bool EpochReclaimer::tryAdvance() {
+    uint64_t current = globalEpoch.load(std::memory_order_seq_cst);
+    for (int i = 0; i < MAX_REGISTRY_READERS; i++) {
+        uint64_t epoch = records[i].epoch.load(std::memory_order_seq_cst);
+        if (epoch != IDLE && epoch != current) {
+            return false;   // A reader is still in an older epoch
+        }
+    }
+    return globalEpoch.compare_exchange_strong(current, current + 1);
+}
+
+void EpochReclaimer::retire(ClientInfo* info) {
+    std::lock_guard<std::mutex> lock(retiredMutex);
+    retired.push_back({globalEpoch.load(std::memory_order_seq_cst), info});
+}
+
+void EpochReclaimer::reclaim() {
+    std::vector<ClientInfo*> freeable;
+    {
+        std::lock_guard<std::mutex> lock(retiredMutex);
+        if (retired.empty()) return;
+
+        tryAdvance();
+        uint64_t safe = globalEpoch.load(std::memory_order_seq_cst);
+
+        size_t kept = 0;
+        for (size_t i = 0; i < retired.size(); i++) {
+            if (retired[i].epoch + 2 <= safe) {
+                freeable.push_back(retired[i].info);
+            } else {
+                retired[kept++] = retired[i];
+            }
+        }
+        retired.resize(kept);
+    }
+
+    for (ClientInfo* info : freeable) {
+        delete info;
+    }
+}
+
+#define NAME_INDEX_BUCKET_SIZE 4        // Names per bucket, on average
+#define NAME_INDEX_MAX_DISPLACEMENT 65536   // Tries per bucket before the table grows
+
+NameIndex::NameIndex() : slots(1), displacements(1, 0) {
+}
+
+uint64_t NameIndex::hash(const char* name, size_t length) {
+    // FNV-1a, then a final mix so the high bits depend on every byte
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)name[i];
+        hash *= 1099511628211ULL;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+// Two names in one bucket share a slot for only some displacements, unless
+// their hashes are identical
+size_t NameIndex::slotOf(uint64_t hash, uint32_t displacement, size_t mask) {
+    uint32_t base = (uint32_t)(hash >> 32);
+    uint32_t step = (uint32_t)(hash >> 12) | 1;
+    return (base + displacement * step) & mask;
+}
+
+// Places the fullest buckets first, each at the first displacement that
+// puts all of its names on free slots. False if some bucket has none.
+bool NameIndex::build(size_t slotCount) {
+    size_t bucketCount = 1;
+    while (bucketCount * NAME_INDEX_BUCKET_SIZE < entries.size()) {
+        bucketCount *= 2;
+    }
+
+    std::vector<std::vector<size_t>> buckets(bucketCount);
+    std::vector<uint64_t> hashes(entries.size());
+    for (size_t i = 0; i < entries.size(); i++) {
+        hashes[i] = hash(entries[i].name.data(), entries[i].name.size());
+        buckets[hashes[i] & (bucketCount - 1)].push_back(i);
+    }
+    std::vector<size_t> order(bucketCount);
+    for (size_t b = 0; b < bucketCount; b++) {
+        order[b] = b;
+    }
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return buckets[a].size() > buckets[b].size();
+    });
+
+    std::vector<Entry> table(slotCount);
+    std::vector<uint32_t> chosen(bucketCount, 0);
+    std::vector<size_t> taken;
+    size_t mask = slotCount - 1;
+    for (size_t b : order) {
+        if (buckets[b].empty()) break;
+
+        bool placed = false;
+        for (uint32_t d = 0; d < NAME_INDEX_MAX_DISPLACEMENT && !placed; d++) {
+            taken.clear();
+            placed = true;
+            for (size_t i : buckets[b]) {
+                size_t slot = slotOf(hashes[i], d, mask);
+                if (table[slot].id != 0 ||
+                    std::find(taken.begin(), taken.end(), slot) != taken.end()) {
+                    placed = false;
+                    break;
+                }
+                taken.push_back(slot);
+            }
+            if (placed) {
+                chosen[b] = d;
+                for (size_t k = 0; k < taken.size(); k++) {
+                    table[taken[k]] = entries[buckets[b][k]];
+                }
+            }
+        }
+        if (!placed) return false;
+    }
+
+    slots.swap(table);
+    displacements.swap(chosen);
+    return true;
+}
+
+void NameIndex::add(const std::string& name, uint16_t id) {
+    add(std::vector<std::pair<std::string, uint16_t>>{{name, id}});
+}
+
+void NameIndex::add(const std::vector<std::pair<std::string, uint16_t>>& names) {
+    std::unordered_map<std::string, size_t> positions;
+    for (size_t i = 0; i < entries.size(); i++) {
+        positions[entries[i].name] = i;
+    }
+    for (const auto& added : names) {
+        if (added.second == 0) {
+            throw std::runtime_error("Name index ids start at 1");
+        }
+        auto it = positions.find(added.first);
+        if (it != positions.end()) {
+            entries[it->second].id = added.second;
+        } else {
+            positions[added.first] = entries.size();
+            entries.push_back({added.first, added.second});
+        }
+    }
+
+    // Twice as many slots as names keeps the build quick
+    size_t slotCount = 1;
+    while (slotCount < entries.size() * 2) {
+        slotCount *= 2;
+    }
+    while (!build(slotCount)) {
+        if (slotCount >= ((size_t)1 << 30)) {
+            throw std::runtime_error("Cannot build name index: duplicate hashes");
+        }
+        slotCount *= 2;
+    }
+}
+
+uint16_t NameIndex::find(const char* name, size_t length) const {
+    uint64_t h = hash(name, length);
+    uint32_t d = displacements[h & (displacements.size() - 1)];
+    const Entry& entry = slots[slotOf(h, d, slots.size() - 1)];
+    if (entry.id != 0 && entry.name.size() == length &&
+        memcmp(entry.name.data(), name, length) == 0) {
+        return entry.id;
+    }
+    return 0;
+}
+
+CampusRegistry::CampusRegistry() {
+    nameIndexes.emplace_back(new NameIndex());
+    nameIndex.store(nameIndexes.back().get(), std::memory_order_release);
+}
+
+CampusRegistry::~CampusRegistry() {
+    for (size_t id = 0; id < slots.size(); id++) {
+        Slot* slot = slots.find(id);
+        delete slot->info.load();
+        delete slot->name.load();
+    }
+}
+
+void CampusRegistry::addCampus(uint16_t id, const std::string& name) {
+    addCampuses({{name, id}});
+}
+
+void CampusRegistry::addCampuses(const std::vector<std::pair<std::string, uint16_t>>& campuses) {
+    std::lock_guard<std::mutex> lock(namesMutex);
+    std::vector<std::pair<std::string, uint16_t>> added;
+    std::unordered_map<std::string, uint16_t> addedIds;
+    std::unordered_map<uint16_t, std::string> addedNames;
+    uint16_t highest = highestId.load(std::memory_order_relaxed);
+
+    for (const auto& campus : campuses) {
+        const std::string& name = campus.first;
+        uint16_t id = campus.second;
+        if (id == 0 || id > MAX_CAMPUS_ID) {
+            throw std::runtime_error("Campus id out of range: " + std::to_string(id));
+        }
+
+        const std::string& current = nameOf(id);
+        auto batchName = addedNames.find(id);
+        const std::string& owner = batchName != addedNames.end() ? batchName->second : current;
+        if (!owner.empty()) {
+            if (owner == name) continue;
+            throw std::runtime_error("Campus id " + std::to_string(id) + " already belongs to " +
+                                     owner);
+        }
+        auto batchId = addedIds.find(name);
+        uint16_t known = batchId != addedIds.end() ? batchId->second : idOf(name);
+        if (known != 0) {
+            throw std::runtime_error("Campus " + name + " already has id " +
+                                     std::to_string(known));
+        }
+
+        added.emplace_back(name, id);
+        addedIds[name] = id;
+        addedNames[id] = name;
+        if (id > highest) highest = id;
+    }
+    if (added.empty()) return;
+
+    // Names are readable before the index or the highest id lead anyone to them
+    slots.grow((size_t)highest + 1);
+    for (const auto& campus : added) {
+        slots.at(campus.second).name.store(new std::string(campus.first),
+                                           std::memory_order_release);
+    }
+
+    std::unique_ptr<NameIndex> index(new NameIndex(*nameIndex.load(std::memory_order_acquire)));
+    index->add(added);
+    nameIndexes.push_back(std::move(index));
+    nameIndex.store(nameIndexes.back().get(), std::memory_order_release);
+
+    highestId.store(highest, std::memory_order_release);
+}
+
+const std::string& CampusRegistry::nameOf(uint16_t id) const {
+    static const std::string unknown;
+    const Slot* slot = slots.find(id);
+    const std::string* name = slot ? slot->name.load(std::memory_order_acquire) : nullptr;
+    return name ? *name : unknown;
+}
+
+const ClientInfo* CampusRegistry::lookup(uint16_t id) const {
+    const Slot* slot = id != 0 ? slots.find(id) : nullptr;
+    return slot ? slot->info.load(std::memory_order_acquire) : nullptr;
+}
+
+void CampusRegistry::touchHeartbeat(uint16_t id) {
+    touchHeartbeat(id, time(nullptr));
+}
+
+void CampusRegistry::touchHeartbeat(uint16_t id, time_t now) {
+    Slot* slot = id != 0 ? slots.find(id) : nullptr;
+    if (slot) slot->lastHeartbeat.store(now, std::memory_order_relaxed);
+}
+
+time_t CampusRegistry::lastHeartbeat(uint16_t id) const {
+    const Slot* slot = id != 0 ? slots.find(id) : nullptr;
+    return slot ? slot->lastHeartbeat.load(std::memory_order_relaxed) : 0;
+}
+
+void CampusRegistry::replace(uint16_t id, ClientInfo* info) {
+    ClientInfo* old = slots.at(id).info.exchange(info, std::memory_order_seq_cst);
+    EpochReclaimer& reclaimer = EpochReclaimer::instance();
+    if (old) {
+        reclaimer.retire(old);
+    }
+    reclaimer.reclaim();
+}
+
+void CampusRegistry::publish(const ClientInfo& info) {
+    if (info.campusId == 0 || !slots.find(info.campusId)) return;
+
+    std::lock_guard<std::mutex> lock(writerMutex);
+    slots.at(info.campusId).lastHeartbeat.store(time(nullptr), std::memory_order_relaxed);
+    replace(info.campusId, new ClientInfo(info));
+}
+
+// Marks a campus offline, but only if the published entry is still the
+// connection being closed (the campus may already have reconnected)
+bool CampusRegistry::deactivate(uint16_t id, int tcpSocket, int reactorIndex) {
+    const Slot* slot = id != 0 ? slots.find(id) : nullptr;
+    if (!slot) return false;
+
+    std::lock_guard<std::mutex> lock(writerMutex);
+    ClientInfo* current = slot->info.load(std::memory_order_acquire);
+    if (!current || !current->isActive || current->tcpSocket != tcpSocket ||
+        current->reactorIndex != reactorIndex) {
+        return false;
+    }
+
+    ClientInfo* offline = new ClientInfo(*current);
+    offline->isActive = false;
+    replace(id, offline);
+    return true;
+}
+
+// For a campus that could not join the broadcast group after logging in
+bool CampusRegistry::leaveMulticast(uint16_t id, int tcpSocket) {
+    const Slot* slot = id != 0 ? slots.find(id) : nullptr;
+    if (!slot) return false;
+
+    std::lock_guard<std::mutex> lock(writerMutex);
+    ClientInfo* current = slot->info.load(std::memory_order_acquire);
+    if (!current || !current->isActive || current->tcpSocket != tcpSocket ||
+        !current->multicast) {
+        return false;
+    }
+
+    ClientInfo* overTcp = new ClientInfo(*current);
+    overTcp->multicast = false;
+    replace(id, overTcp);
+    return true;
+}
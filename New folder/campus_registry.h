@@ -0,0 +1,169 @@
+#ifndef CAMPUS_REGISTRY_H
+#define CAMPUS_REGISTRY_H
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <ctime>
+#include <cstdint>
+#include "protocol.h"
+#include "outbound_queue.h"
+#include "compression.h"
+#include "campus_table.h"
+
+#define MAX_REGISTRY_READERS 1024   // Threads that may hold a read guard at once
+
+// Client information structure. Published by the registry as an immutable
+// snapshot: connect and disconnect replace it, never modify it in place.
+struct ClientInfo {
+    int tcpSocket;
+    std::string campusName;
+    std::string ipAddress;
+    bool isActive;
+    int reactorIndex = -1;      // Owning reactor in epoll modes
+    uint16_t campusId = 0;
+    int protocolVersion = PROTOCOL_TEXT;
+    std::shared_ptr<OutboundQueue> outbound;
+    Codec codec = CODEC_NONE;   // Compression negotiated at login (binary only)
+    bool multicast = false;     // Gets admin broadcasts from the multicast group
+};
+
+// Epoch-based reclamation. Readers announce the global epoch while they
+// hold pointers; a retired object is freed once the epoch has advanced
+// twice past its retirement, at which point no reader can still see it.
+class EpochReclaimer {
+private:
+    static const uint64_t IDLE = ~0ULL;
+
+    struct alignas(64) Record {
+        std::atomic<uint64_t> epoch{IDLE};
+        std::atomic<bool> inUse{false};
+    };
+
+    struct Retired {
+        uint64_t epoch;
+        ClientInfo* info;
+    };
+
+    Record records[MAX_REGISTRY_READERS];
+    std::atomic<uint64_t> globalEpoch{1};
+    std::mutex retiredMutex;
+    std::vector<Retired> retired;
+
+    Record& threadRecord();
+    bool tryAdvance();
+
+    EpochReclaimer() = default;
+
+public:
+    // Process-wide, never destroyed: threads release their record at exit
+    static EpochReclaimer& instance();
+
+    void enter();
+    void exit();
+    void retire(ClientInfo* info);
+    void reclaim();
+    void releaseRecord(int index);
+};
+
+// Maps campus names to ids with a perfect hash, rebuilt whenever a name is
+// added. Names are hashed once into 64 bits; the low bits
+// pick a bucket, and the bucket's displacement, chosen at build time so no
+// two names share a slot, turns the high bits into the slot. A lookup is
+// one pass over the name, one slot and one compare, with no probing.
+class NameIndex {
+private:
+    struct Entry {
+        std::string name;
+        uint16_t id = 0;
+    };
+
+    std::vector<Entry> slots;           // Power-of-two size
+    std::vector<uint32_t> displacements;    // One per bucket, power-of-two count
+    std::vector<Entry> entries;         // As added, for rebuilding
+
+    static uint64_t hash(const char* name, size_t length);
+    static size_t slotOf(uint64_t hash, uint32_t displacement, size_t mask);
+    bool build(size_t slotCount);
+
+public:
+    NameIndex();
+
+    void add(const std::string& name, uint16_t id);
+    void add(const std::vector<std::pair<std::string, uint16_t>>& names);  // One rebuild
+    uint16_t find(const char* name, size_t length) const;   // 0 if unknown
+    size_t size() const { return entries.size(); }
+    size_t capacity() const { return slots.size(); }
+};
+
+// Campus registry read by every routed message and heartbeat. Campus ids
+// are fixed once assigned, so a lookup is a perfect-hash lookup in an
+// immutable name index plus one atomic load from a slot table indexed by
+// id (see campus_table.h), which grows as higher ids are added. Connect
+// and disconnect take the writer mutex, publish a fresh ClientInfo and
+// retire the old one through the reclaimer. Adding campuses publishes a
+// new name index; the old ones are kept until the registry goes. Campuses
+// from one credentials file go in together, as one index.
+class CampusRegistry {
+private:
+    struct Slot {
+        std::atomic<ClientInfo*> info{nullptr};
+        std::atomic<time_t> lastHeartbeat{0};
+        std::atomic<const std::string*> name{nullptr};  // Set once
+    };
+
+    CampusTable<Slot> slots;
+    std::atomic<const NameIndex*> nameIndex{nullptr};
+    std::vector<std::unique_ptr<NameIndex>> nameIndexes;    // Every version published
+    std::atomic<uint16_t> highestId{0};
+    std::mutex namesMutex;
+    std::mutex writerMutex;
+
+    void replace(uint16_t id, ClientInfo* info);
+
+public:
+    CampusRegistry();
+    ~CampusRegistry();
+
+    // Safe while readers run. Adding a campus again under the same id does
+    // nothing; throws if the id or the name is already taken otherwise, or
+    // the id is outside 1..MAX_CAMPUS_ID. The batch checks every campus
+    // before adding any.
+    void addCampus(uint16_t id, const std::string& name);
+    void addCampuses(const std::vector<std::pair<std::string, uint16_t>>& campuses);
+
+    uint16_t idOf(const std::string& name) const { return idOf(name.data(), name.size()); }
+    uint16_t idOf(const char* name, size_t length) const {
+        return nameIndex.load(std::memory_order_acquire)->find(name, length);
+    }
+    const std::string& nameOf(uint16_t id) const;
+    uint16_t maxId() const { return highestId.load(std::memory_order_acquire); }
+
+    // Read side: the returned pointer is valid until the enclosing
+    // ReadGuard ends. Returns null for unknown or never-connected campuses.
+    const ClientInfo* lookup(uint16_t id) const;
+    const ClientInfo* lookup(const std::string& name) const { return lookup(idOf(name)); }
+
+    void touchHeartbeat(uint16_t id);
+    void touchHeartbeat(uint16_t id, time_t now);   // For batches: one clock read
+    time_t lastHeartbeat(uint16_t id) const;
+
+    // Write side
+    void publish(const ClientInfo& info);
+    bool deactivate(uint16_t id, int tcpSocket, int reactorIndex);
+    bool leaveMulticast(uint16_t id, int tcpSocket);
+    void reclaim() { EpochReclaimer::instance().reclaim(); }
+
+    class ReadGuard {
+    public:
+        ReadGuard() { EpochReclaimer::instance().enter(); }
+        ~ReadGuard() { EpochReclaimer::instance().exit(); }
+        ReadGuard(const ReadGuard&) = delete;
+        ReadGuard& operator=(const ReadGuard&) = delete;
+    };
+};
+
+#endif // CAMPUS_REGISTRY_H
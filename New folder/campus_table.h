@@ -0,0 +1,85 @@
+#ifndef CAMPUS_TABLE_H
+#define CAMPUS_TABLE_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <cstddef>
+
+#define MAX_CAMPUS_ID 0xFFFE        // Campus ids are 1..MAX_CAMPUS_ID; 0xFFFF is TARGET_LIST
+#define CAMPUS_TABLE_CHUNK 64       // Entries allocated at a time
+
+// Per-campus state indexed by id, for tables read on every routed message
+// while the credentials file may still add campuses. Entries live in
+// chunks that never move once allocated. Growing copies the directory of
+// chunks, extends it and publishes the copy, the way the registry
+// publishes its name index; old directories are kept until the table
+// goes, which costs a pointer per chunk per growth, and growth happens
+// only when the highest campus id goes up. A read is two loads, no lock.
+// T must be default-constructible; atomics start out zero.
+template <typename T>
+class CampusTable {
+private:
+    struct Directory {
+        std::vector<T*> chunks;
+    };
+
+    std::atomic<const Directory*> directory{nullptr};
+    std::vector<std::unique_ptr<Directory>> directories;    // Every version published
+    std::vector<std::unique_ptr<T[]>> chunks;
+    std::mutex growMutex;
+
+public:
+    explicit CampusTable(size_t size = 0) {
+        directories.emplace_back(new Directory());
+        directory.store(directories.back().get(), std::memory_order_release);
+        grow(size);
+    }
+
+    CampusTable(const CampusTable&) = delete;
+    CampusTable& operator=(const CampusTable&) = delete;
+
+    // Makes entries 0..size-1 exist. Safe while readers run; never shrinks.
+    void grow(size_t size) {
+        if (size > (size_t)MAX_CAMPUS_ID + 1) size = (size_t)MAX_CAMPUS_ID + 1;
+        size_t needed = (size + CAMPUS_TABLE_CHUNK - 1) / CAMPUS_TABLE_CHUNK;
+
+        std::lock_guard<std::mutex> lock(growMutex);
+        const Directory* current = directory.load(std::memory_order_acquire);
+        if (current->chunks.size() >= needed) return;
+
+        std::unique_ptr<Directory> next(new Directory(*current));
+        while (next->chunks.size() < needed) {
+            chunks.emplace_back(new T[CAMPUS_TABLE_CHUNK]());
+            next->chunks.push_back(chunks.back().get());
+        }
+        directories.push_back(std::move(next));
+        directory.store(directories.back().get(), std::memory_order_release);
+    }
+
+    // Ids below this have an entry
+    size_t size() const {
+        return directory.load(std::memory_order_acquire)->chunks.size() * CAMPUS_TABLE_CHUNK;
+    }
+
+    // Null for an id past the end
+    T* find(size_t id) const {
+        const Directory* current = directory.load(std::memory_order_acquire);
+        size_t chunk = id / CAMPUS_TABLE_CHUNK;
+        if (chunk >= current->chunks.size()) return nullptr;
+        return &current->chunks[chunk][id % CAMPUS_TABLE_CHUNK];
+    }
+
+    // Grows first if need be. id is at most MAX_CAMPUS_ID.
+    T& at(size_t id) {
+        T* entry = find(id);
+        if (!entry) {
+            grow(id + 1);
+            entry = find(id);
+        }
+        return *entry;
+    }
+};
+
+#endif // CAMPUS_TABLE_H
@@ -0,0 +1,342 @@
+#include "checksum.h"
+#include <cstring>
+#include <algorithm>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#include <cpuid.h>
+#endif
+
+// ---- CRC32C ----
+
+#define CRC32C_POLY 0x82F63B78     // Reflected Castagnoli polynomial
+
+// table[k][b]: CRC of byte b followed by k zero bytes
+struct Crc32cTable {
+    uint32_t table[8][256];
+
+    Crc32cTable() {
+        for (uint32_t b = 0; b < 256; b++) {
+            uint32_t crc = b;
+            for (int bit = 0; bit < 8; bit++) {
+                crc = (crc >> 1) ^ (CRC32C_POLY & (0 - (crc & 1)));
+            }
+            table[0][b] = crc;
+        }
+        for (uint32_t b = 0; b < 256; b++) {
+            for (int k = 1; k < 8; k++) {
+                table[k][b] = (table[k - 1][b] >> 8) ^ table[0][table[k - 1][b] & 0xFF];
+            }
+        }
+    }
+};
+
+static const Crc32cTable crcTable;
+
+uint32_t crc32cSoftware(const void* data, size_t length, uint32_t crc) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    const uint32_t (*t)[256] = crcTable.table;
+    crc = ~crc;
+
+    // Eight bytes per step (little-endian load)
+    while (length >= 8) {
+        uint32_t low, high;
+        memcpy(&low, p, 4);
+        memcpy(&high, p + 4, 4);
+        low ^= crc;
+        crc = t[7][low & 0xFF] ^ t[6][(low >> 8) & 0xFF] ^ t[5][(low >> 16) & 0xFF] ^
+              t[4][low >> 24] ^ t[3][high & 0xFF] ^ t[2][(high >> 8) & 0xFF] ^
+              t[1][(high >> 16) & 0xFF] ^ t[0][high >> 24];
+        p += 8;
+        length -= 8;
+    }
+    while (length--) {
+        crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xFF];
+    }
+    return ~crc;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+__attribute__((target("sse4.2")))
+uint32_t crc32cHardware(const void* data, size_t length, uint32_t crc) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+#if defined(__x86_64__)
+    uint64_t crc64 = ~crc;
+    while (length >= 8) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        crc64 = _mm_crc32_u64(crc64, word);
+        p += 8;
+        length -= 8;
+    }
+    crc = (uint32_t)crc64;
+#else
+    crc = ~crc;
+    while (length >= 4) {
+        uint32_t word;
+        memcpy(&word, p, 4);
+        crc = _mm_crc32_u32(crc, word);
+        p += 4;
+        length -= 4;
+    }
+#endif
+    while (length--) {
+        crc = _mm_crc32_u8(crc, *p++);
+    }
+    return ~crc;
+}
+
+bool crc32cHardwareAvailable() {
+    return __builtin_cpu_supports("sse4.2");
+}
+
+#else
+
+uint32_t crc32cHardware(const void* data, size_t length, uint32_t crc) {
+    return crc32cSoftware(data, length, crc);
+}
+
+bool crc32cHardwareAvailable() {
+    return false;
+}
+
+#endif
+
+typedef uint32_t (*Crc32cFunction)(const void*, size_t, uint32_t);
+
+static const Crc32cFunction crc32cImpl =
+    crc32cHardwareAvailable() ? crc32cHardware : crc32cSoftware;
+
+uint32_t crc32c(const void* data, size_t length, uint32_t crc) {
+    return crc32cImpl(data, length, crc);
+}
+
+// ---- SHA-256 (FIPS 180-4) ----
+
+static const uint32_t shaRounds[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static inline uint32_t rotr(uint32_t x, int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+static void sha256CompressSoftware(uint32_t state[8], const uint8_t* data, size_t blocks) {
+    for (; blocks > 0; blocks--, data += 64) {
+        uint32_t w[64];
+        for (int i = 0; i < 16; i++) {
+            w[i] = ((uint32_t)data[4 * i] << 24) | ((uint32_t)data[4 * i + 1] << 16) |
+                   ((uint32_t)data[4 * i + 2] << 8) | data[4 * i + 3];
+        }
+        for (int i = 16; i < 64; i++) {
+            uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; i++) {
+            uint32_t s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+            uint32_t choose = (e & f) ^ (~e & g);
+            uint32_t t1 = h + s1 + choose + shaRounds[i] + w[i];
+            uint32_t s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+            uint32_t majority = (a & b) ^ (a & c) ^ (b & c);
+            uint32_t t2 = s0 + majority;
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+        state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+// The SHA extensions keep the state as ABEF/CDGH and do two rounds per
+// sha256rnds2; sha256msg1/msg2 extend the message schedule four words at a
+// time
+__attribute__((target("sha,sse4.1")))
+static void sha256CompressHardware(uint32_t state[8], const uint8_t* data, size_t blocks) {
+    const __m128i byteSwap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    __m128i dcba = _mm_loadu_si128((const __m128i*)&state[0]);
+    __m128i hgfe = _mm_loadu_si128((const __m128i*)&state[4]);
+    __m128i cdab = _mm_shuffle_epi32(dcba, 0xB1);
+    __m128i efgh = _mm_shuffle_epi32(hgfe, 0x1B);
+    __m128i abef = _mm_alignr_epi8(cdab, efgh, 8);
+    __m128i cdgh = _mm_blend_epi16(efgh, cdab, 0xF0);
+
+    for (; blocks > 0; blocks--, data += 64) {
+        __m128i savedAbef = abef;
+        __m128i savedCdgh = cdgh;
+        __m128i message[4];
+        for (int i = 0; i < 4; i++) {
+            message[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 16 * i)),
+                                          byteSwap);
+        }
+
+        for (int group = 0; group < 16; group++) {
+            __m128i words = _mm_add_epi32(message[group & 3],
+                                          _mm_loadu_si128((const __m128i*)&shaRounds[4 * group]));
+            cdgh = _mm_sha256rnds2_epu32(cdgh, abef, words);
+            abef = _mm_sha256rnds2_epu32(abef, cdgh, _mm_shuffle_epi32(words, 0x0E));
+
+            // W[t+16..t+19] from W[t..t+15], replacing W[t..t+3]
+            if (group < 12) {
+                __m128i next = _mm_sha256msg1_epu32(message[group & 3], message[(group + 1) & 3]);
+                next = _mm_add_epi32(next, _mm_alignr_epi8(message[(group + 3) & 3],
+                                                           message[(group + 2) & 3], 4));
+                message[group & 3] = _mm_sha256msg2_epu32(next, message[(group + 3) & 3]);
+            }
+        }
+        abef = _mm_add_epi32(abef, savedAbef);
+        cdgh = _mm_add_epi32(cdgh, savedCdgh);
+    }
+
+    __m128i feba = _mm_shuffle_epi32(abef, 0x1B);
+    __m128i dchg = _mm_shuffle_epi32(cdgh, 0xB1);
+    _mm_storeu_si128((__m128i*)&state[0], _mm_blend_epi16(feba, dchg, 0xF0));
+    _mm_storeu_si128((__m128i*)&state[4], _mm_alignr_epi8(dchg, feba, 8));
+}
+
+bool sha256HardwareAvailable() {
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) return false;
+    return (ebx & (1u << 29)) && __builtin_cpu_supports("sse4.1");
+}
+
+#else
+
+static void sha256CompressHardware(uint32_t state[8], const uint8_t* data, size_t blocks) {
+    sha256CompressSoftware(state, data, blocks);
+}
+
+bool sha256HardwareAvailable() {
+    return false;
+}
+
+#endif
+
+static const bool sha256Hardware = sha256HardwareAvailable();
+
+Sha256::Sha256(bool allowHardware)
+    : blockLength(0), totalLength(0),
+      compress(allowHardware && sha256Hardware ? sha256CompressHardware
+                                               : sha256CompressSoftware) {
+    static const uint32_t initial[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memcpy(state, initial, sizeof(state));
+}
+
+void Sha256::update(const void* data, size_t length) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    totalLength += length;
+
+    if (blockLength > 0) {
+        size_t take = std::min(length, sizeof(block) - blockLength);
+        memcpy(block + blockLength, p, take);
+        blockLength += take;
+        p += take;
+        length -= take;
+        if (blockLength < sizeof(block)) return;
+        compress(state, block, 1);
+        blockLength = 0;
+    }
+    // Whole blocks straight from the caller's buffer
+    size_t blocks = length / sizeof(block);
+    compress(state, p, blocks);
+    p += blocks * sizeof(block);
+    length -= blocks * sizeof(block);
+    memcpy(block, p, length);
+    blockLength = length;
+}
+
+void Sha256::finish(uint8_t digest[SHA256_DIGEST_SIZE]) {
+    uint64_t bits = totalLength * 8;
+    uint8_t padding[72] = {0x80};
+    size_t padLength = (blockLength < 56 ? 56 : 120) - blockLength;
+    for (int i = 0; i < 8; i++) {
+        padding[padLength + i] = (uint8_t)(bits >> (56 - 8 * i));
+    }
+    update(padding, padLength + 8);
+
+    for (int i = 0; i < 8; i++) {
+        digest[4 * i] = (uint8_t)(state[i] >> 24);
+        digest[4 * i + 1] = (uint8_t)(state[i] >> 16);
+        digest[4 * i + 2] = (uint8_t)(state[i] >> 8);
+        digest[4 * i + 3] = (uint8_t)state[i];
+    }
+}
+
+std::string Sha256::hex(const uint8_t digest[SHA256_DIGEST_SIZE]) {
+    static const char digits[] = "0123456789abcdef";
+    std::string out(SHA256_DIGEST_SIZE * 2, '0');
+    for (int i = 0; i < SHA256_DIGEST_SIZE; i++) {
+        out[2 * i] = digits[digest[i] >> 4];
+        out[2 * i + 1] = digits[digest[i] & 0x0F];
+    }
+    return out;
+}
+
+HmacSha256::HmacSha256(const void* key, size_t keyLength) {
+    // Keys longer than a block are hashed first
+    uint8_t block[64] = {0};
+    if (keyLength > sizeof(block)) {
+        Sha256 sha;
+        sha.update(key, keyLength);
+        sha.finish(block);
+    } else {
+        memcpy(block, key, keyLength);
+    }
+
+    uint8_t pad[64];
+    for (size_t i = 0; i < sizeof(pad); i++) pad[i] = block[i] ^ 0x36;
+    inner.update(pad, sizeof(pad));
+    for (size_t i = 0; i < sizeof(pad); i++) pad[i] = block[i] ^ 0x5c;
+    outer.update(pad, sizeof(pad));
+}
+
+void HmacSha256::sign(const void* data, size_t length, uint8_t mac[SHA256_DIGEST_SIZE]) const {
+    Sha256 sha = inner;
+    sha.update(data, length);
+    sha.finish(mac);
+
+    sha = outer;
+    sha.update(mac, SHA256_DIGEST_SIZE);
+    sha.finish(mac);
+}
+
+void pbkdf2Sha256(const std::string& password, const void* salt, size_t saltLength,
+                  uint32_t iterations, uint8_t key[SHA256_DIGEST_SIZE]) {
+    HmacSha256 hmac(password.data(), password.size());
+
+    // U1 = HMAC(salt || block index 1), Un = HMAC(Un-1); the key is their XOR
+    std::string first(static_cast<const char*>(salt), saltLength);
+    first.append("\0\0\0\1", 4);
+    uint8_t block[SHA256_DIGEST_SIZE];
+    hmac.sign(first.data(), first.size(), block);
+    memcpy(key, block, SHA256_DIGEST_SIZE);
+
+    for (uint32_t i = 1; i < iterations; i++) {
+        hmac.sign(block, SHA256_DIGEST_SIZE, block);
+        for (int j = 0; j < SHA256_DIGEST_SIZE; j++) {
+            key[j] ^= block[j];
+        }
+    }
+}
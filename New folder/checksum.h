@@ -0,0 +1,60 @@
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+// Integrity checks for file transfers: CRC32C per chunk, SHA-256 per file.
+// HMAC-SHA256 signs session tokens; PBKDF2 hashes campus passwords.
+
+// CRC32C (Castagnoli). Uses the SSE4.2 crc32 instruction when the CPU has
+// it, checked once at startup, and a slicing-by-8 table otherwise. Pass the
+// previous result as crc to continue a running checksum.
+uint32_t crc32c(const void* data, size_t length, uint32_t crc = 0);
+
+// The two implementations, for benchmarks and tests
+uint32_t crc32cSoftware(const void* data, size_t length, uint32_t crc = 0);
+uint32_t crc32cHardware(const void* data, size_t length, uint32_t crc = 0);
+bool crc32cHardwareAvailable();
+
+// SHA-256 uses the x86 SHA extensions when present, like crc32c()
+bool sha256HardwareAvailable();
+
+#define SHA256_DIGEST_SIZE 32
+
+class Sha256 {
+private:
+    uint32_t state[8];
+    uint8_t block[64];
+    size_t blockLength;
+    uint64_t totalLength;
+    void (*compress)(uint32_t* state, const uint8_t* data, size_t blocks);
+
+public:
+    // allowHardware = false forces the portable code (benchmarks)
+    explicit Sha256(bool allowHardware = true);
+    void update(const void* data, size_t length);
+    void finish(uint8_t digest[SHA256_DIGEST_SIZE]);
+
+    static std::string hex(const uint8_t digest[SHA256_DIGEST_SIZE]);
+};
+
+// HMAC-SHA256 (RFC 2104) under one key. The key is absorbed once, so each
+// MAC costs the hashing of the message plus two blocks.
+class HmacSha256 {
+private:
+    Sha256 inner;   // State after the key XOR ipad block
+    Sha256 outer;   // State after the key XOR opad block
+
+public:
+    HmacSha256(const void* key, size_t keyLength);
+    void sign(const void* data, size_t length, uint8_t mac[SHA256_DIGEST_SIZE]) const;
+};
+
+// PBKDF2-HMAC-SHA256 (RFC 8018), first block only: a 32-byte key. Costs two
+// SHA-256 blocks per iteration.
+void pbkdf2Sha256(const std::string& password, const void* salt, size_t saltLength,
+                  uint32_t iterations, uint8_t key[SHA256_DIGEST_SIZE]);
+
+#endif // CHECKSUM_H
@@ -2,10 +2,20 @@
 #include <sstream>
 #include <iomanip>
 #include <algorithm>  // Required for std::transform
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <strings.h>
 
-CampusClient::CampusClient(const std::string& campus, const std::string& pass)
-    : campusName(campus), password(pass), tcpSocket(-1), udpSocket(-1),
-      isConnected(false), isRunning(false), currentDepartment("General") {
+CampusClient::CampusClient(const std::string& campus, const std::string& pass,
+                           const std::string& compression,
+                           const std::vector<std::string>& serverList)
+    : campusName(campus), password(pass), tcpSocket(-1), udpSocket(-1), multicastSocket(-1),
+      servers(serverList), serverPort(TCP_PORT), isConnected(false), isRunning(false), protocolVersion(PROTOCOL_TEXT), campusId(0),
+      compressionOffer(compression), codec(CODEC_NONE), currentDepartment("All") {
+    if (servers.empty() || !parseHostPort(servers.front(), serverHost, serverPort)) {
+        serverHost = SERVER_IP;
+    }
 }
 
 CampusClient::~CampusClient() {
@@ -20,9 +30,9 @@ void CampusClient::initializeTCPSocket() {
 
     memset(&serverAddr, 0, sizeof(serverAddr));
     serverAddr.sin_family = AF_INET;
-    serverAddr.sin_port = htons(TCP_PORT);
+    serverAddr.sin_port = htons(serverPort);
     
-    if (inet_pton(AF_INET, SERVER_IP, &serverAddr.sin_addr) <= 0) {
+    if (inet_pton(AF_INET, serverHost.c_str(), &serverAddr.sin_addr) <= 0) {
         throw std::runtime_error("Invalid server address");
     }
 
@@ -57,8 +67,21 @@ void CampusClient::initializeUDPSocket() {
     std::cout << "[INFO] UDP socket initialized\n";
 }
 
-bool CampusClient::authenticate() {
-    std::string authMsg = "AUTH:Campus:" + campusName + ",Pass:" + password;
+bool CampusClient::authenticate(std::string& redirect, bool offerMulticast) {
+    // Offer the binary protocol, compression, multicast broadcasts and send
+    // credit, and the last session's token when logging in again; older
+    // servers ignore all of them
+    std::string authMsg = "AUTH:Proto:" + std::to_string(PROTOCOL_BINARY) + ",Credit:1,";
+    if (!compressionOffer.empty() && compressionOffer != "none") {
+        authMsg += "Compress:" + compressionOffer + ",";
+    }
+    if (offerMulticast) {
+        authMsg += "Mcast:1,";
+    }
+    if (!sessionToken.empty()) {
+        authMsg += "Token:" + sessionToken + ",";
+    }
+    authMsg += "Campus:" + campusName + ",Pass:" + password;
     
     if (send(tcpSocket, authMsg.c_str(), authMsg.length(), 0) < 0) {
         std::cerr << "[ERROR] Failed to send authentication\n";
@@ -74,25 +97,186 @@ bool CampusClient::authenticate() {
         return false;
     }
 
-    std::string response(buffer);
-    if (response == "AUTH:SUCCESS") {
+    AuthReply reply;
+    if (parseAuthReply(buffer, bytesRead, reply)) {
+        protocolVersion = reply.protocolVersion;
+        campusId = reply.campusId;
+        codec = codecByName(reply.compression);
+        directory = reply.directory;
+        sessionToken = reply.session;
+        sessionResumed = reply.resumed;
+        {
+            // Every login starts with full windows; held messages go once
+            // the receive thread is back
+            std::lock_guard<std::mutex> lock(queueMutex);
+            creditWindow = reply.creditWindow;
+            credit.clear();
+        }
+
+        // Frames that arrived in the same read as the reply
+        if (protocolVersion == PROTOCOL_BINARY && !reply.leftover.empty()) {
+            memcpy(decoder.prepare(reply.leftover.size()), reply.leftover.data(),
+                   reply.leftover.size());
+            decoder.commit(reply.leftover.size());
+        }
+
         std::cout << "[SUCCESS] Authentication successful for " << campusName << " campus\n";
+        if (codec != CODEC_NONE) {
+            std::cout << "[INFO] Compression: " << codecName(codec) << "\n";
+        }
         isConnected = true;
+        if (sessionResumed) {
+            std::cout << "[INFO] Session resumed\n";
+        } else {
+            // What the server subscribes every campus to at login
+            std::lock_guard<std::mutex> lock(queueMutex);
+            subscriptions.assign(1, campusName + "/*");
+        }
+        if (!reply.multicastGroup.empty()) {
+            joinBroadcastGroup(reply);
+        }
         return true;
+    } else if (!reply.redirect.empty()) {
+        redirect = reply.redirect;
+        return false;
     } else {
         std::cerr << "[ERROR] Authentication failed\n";
         return false;
     }
 }
 
-void CampusClient::sendHeartbeat() {
-    struct sockaddr_in udpServerAddr;
-    memset(&udpServerAddr, 0, sizeof(udpServerAddr));
-    udpServerAddr.sin_family = AF_INET;
-    udpServerAddr.sin_port = htons(UDP_PORT);
-    inet_pton(AF_INET, SERVER_IP, &udpServerAddr.sin_addr);
+// Connects and logs in. A cluster node that is not this campus's home
+// names the one that is, and the login moves there.
+bool CampusClient::connectToServer(bool offerMulticast) {
+    for (int redirects = 0; ; redirects++) {
+        initializeTCPSocket();
+
+        std::string redirect;
+        if (authenticate(redirect, offerMulticast)) {
+            return true;
+        }
+        close(tcpSocket);
+        tcpSocket = -1;
+        if (redirect.empty()) {
+            return false;
+        }
+        if (redirects >= CLUSTER_MAX_REDIRECTS ||
+            !parseHostPort(redirect, serverHost, serverPort)) {
+            std::cerr << "[ERROR] Bad or looping redirect to " << redirect << "\n";
+            return false;
+        }
+        std::cout << "[INFO] " << campusName << " is homed on " << redirect
+                  << ", connecting there\n";
+    }
+}
 
+// Logs in again at the first of candidates that takes us, going round the
+// list with a growing pause until giveUpMillis have passed (0: once). The
+// first pause is short: a standby may answer with a redirect to the dead
+// primary for a moment before it takes over.
+// Runs on the receive thread between frames; senders wait on sendMutex
+// meanwhile. Broadcasts come over TCP afterwards.
+bool CampusClient::reconnect(const std::vector<std::string>& candidates, int giveUpMillis) {
+    leaveBroadcastGroup();
+    std::vector<std::string> topics;
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        topics = subscriptions;
+    }
+
+    auto started = std::chrono::steady_clock::now();
+    int pauseMillis = FAILOVER_RETRY_MS;
+    bool connected = false;
+    {
+        std::lock_guard<std::mutex> lock(sendMutex);
+        shutdown(tcpSocket, SHUT_RDWR);
+        close(tcpSocket);
+        tcpSocket = -1;
+        while (!connected && isRunning) {
+            for (size_t i = 0; i < candidates.size() && !connected; i++) {
+                if (!parseHostPort(candidates[i], serverHost, serverPort)) continue;
+                decoder = FrameDecoder();
+                try {
+                    connected = connectToServer(false);
+                } catch (const std::exception& e) {
+                    // Not up (yet): the next one, or the next round
+                    if (tcpSocket >= 0) close(tcpSocket);
+                    tcpSocket = -1;
+                }
+            }
+            if (connected || std::chrono::steady_clock::now() - started >=
+                                 std::chrono::milliseconds(giveUpMillis)) {
+                break;
+            }
+            usleep(pauseMillis * 1000);
+            pauseMillis = std::min(pauseMillis * 2, FAILOVER_RETRY_MAX_MS);
+        }
+    }
+    if (!connected) {
+        return false;
+    }
+
+    // Subscriptions live on the server; a new session starts from the default
+    if (!sessionResumed && topics != std::vector<std::string>(1, campusName + "/*")) {
+        sendSubscriptions(topics);
+    }
+    sendHeldFrames();
+    creditGranted.notify_all();
+    return true;
+}
+
+// The server moved this campus to another cluster node: log in there and
+// carry on
+bool CampusClient::followRedirect() {
+    std::string address;
+    address.swap(redirectTo);
+    std::string host;
+    uint16_t port;
+    if (!parseHostPort(address, host, port)) {
+        return true;
+    }
+    std::cout << "\n[INFO] " << campusName << " is now homed on " << address
+              << ", moving there\n";
+
+    if (!reconnect(std::vector<std::string>(1, address), 0)) {
+        std::cout << "[ERROR] Could not log in at " << address << "\n";
+        return false;
+    }
+    std::cout << "Campus " << campusName << "> ";
+    std::cout.flush();
+    return true;
+}
+
+// The connection dropped: log in again at the first server on the list
+// that takes us, which is the standby once it has taken over from a
+// primary that died
+bool CampusClient::failOver() {
+    std::cout << "[INFO] Reconnecting...\n";
+    auto started = std::chrono::steady_clock::now();
+    if (!reconnect(servers, FAILOVER_GIVE_UP_MS)) {
+        std::cout << "[ERROR] No server took " << campusName << " back within "
+                  << FAILOVER_GIVE_UP_MS / 1000 << " s\n";
+        return false;
+    }
+    auto millis = std::chrono::duration_cast<std::chrono::milliseconds>(
+                      std::chrono::steady_clock::now() - started).count();
+    std::cout << "[INFO] Back online at " << serverHost << ":" << serverPort << " after "
+              << millis << " ms\n";
+    std::cout << "Campus " << campusName << "> ";
+    std::cout.flush();
+    return true;
+}
+
+void CampusClient::sendHeartbeat() {
     while (isRunning && isConnected) {
+        // Whichever node the campus is logged in at
+        struct sockaddr_in udpServerAddr;
+        {
+            std::lock_guard<std::mutex> lock(sendMutex);
+            udpServerAddr = serverAddr;
+        }
+        udpServerAddr.sin_port = htons(ntohs(udpServerAddr.sin_port) + 1);
+
         std::string heartbeat = "HEARTBEAT:" + campusName;
         
         sendto(udpSocket, heartbeat.c_str(), heartbeat.length(), 0,
@@ -102,116 +286,485 @@ void CampusClient::sendHeartbeat() {
     }
 }
 
+bool CampusClient::sendToServer(const std::string& data) {
+    return sendToServer(data.data(), data.length());
+}
+
+bool CampusClient::sendToServer(const char* data, size_t length) {
+    // A short write would leave a torn frame on the stream, and an ack from
+    // the receive thread must not land in the middle of a file chunk
+    std::lock_guard<std::mutex> lock(sendMutex);
+    size_t offset = 0;
+    while (offset < length) {
+        ssize_t sent = send(tcpSocket, data + offset, length - offset, 0);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        offset += sent;
+    }
+    return true;
+}
+
 void CampusClient::receiveMessages() {
     char buffer[BUFFER_SIZE];
+    std::string expanded;       // Payload of the current frame if it was compressed
     
     while (isRunning && isConnected) {
+        if (protocolVersion == PROTOCOL_BINARY) {
+            // Drain anything already buffered (e.g. frames sent with the AUTH reply)
+            Frame frame;
+            FrameDecoder::Status status;
+            while ((status = decoder.next(frame)) == FrameDecoder::FRAME_READY) {
+                if (!inflateFrame(frame, expanded)) {
+                    std::cout << "[ERROR] Corrupt compressed frame from server, skipped\n";
+                    continue;
+                }
+                if (frame.header.type == FRAME_FILE_ACK) {
+                    TransferFrame ack;
+                    if (parseTransferFrame(frame, ack)) {
+                        transferAcks.post(ack);
+                    }
+                    continue;
+                }
+                if (isTransferFrame(frame.header.type)) {
+                    // Chunks go straight to disk
+                    TransferReport report;
+                    if (fileReceiver.handle(frame, directory,
+                            [this](const char* data, size_t length) {
+                                return sendToServer(data, length);
+                            }, report)) {
+                        displayTransfer(report, true);
+                    }
+                    continue;
+                }
+                std::string text = frameToText(frame, directory);
+                if (frame.header.type == FRAME_MESSAGE && frame.header.targetId != 0 &&
+                    frame.header.targetId != campusId) {
+                    // Came through a topic subscription: name whose department
+                    text.insert(text.find("|DEPT:") + 6,
+                                directory.nameOf(frame.header.targetId) + "/");
+                }
+                handleServerMessage(text);
+            }
+            if (status == FrameDecoder::MALFORMED) {
+                std::cout << "[ERROR] Corrupt data from server\n";
+                isConnected = false;
+                break;
+            }
+            if (!redirectTo.empty()) {
+                if (!followRedirect()) {
+                    isConnected = false;
+                    break;
+                }
+                continue;
+            }
+
+            int bytesRead = recv(tcpSocket, decoder.prepare(BUFFER_SIZE), BUFFER_SIZE, 0);
+            if (bytesRead <= 0) {
+                std::cout << "[INFO] Connection lost with server\n";
+                if (isRunning && failOver()) continue;
+                isConnected = false;
+                break;
+            }
+            decoder.commit(bytesRead);
+            continue;
+        }
+
         memset(buffer, 0, BUFFER_SIZE);
         int bytesRead = recv(tcpSocket, buffer, BUFFER_SIZE - 1, 0);
         
         if (bytesRead <= 0) {
             std::cout << "[INFO] Connection lost with server\n";
+            if (isRunning && failOver()) continue;
+            isConnected = false;
+            break;
+        }
+
+        handleServerMessage(std::string(buffer));
+        if (!redirectTo.empty() && !followRedirect()) {
             isConnected = false;
             break;
         }
+    }
+}
+
+bool CampusClient::isTargetPaused(const std::string& target) {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    return pausedTargets.count(target) > 0;
+}
+
+// Holds a file transfer while the server reports the target as congested,
+// since a dropped chunk would fail the whole transfer. Gives up after a
+// minute.
+bool CampusClient::waitWhilePaused(const std::string& target) {
+    for (int waited = 0; isTargetPaused(target); waited++) {
+        if (waited == 0) {
+            std::cout << "[WAIT] " << target << " is congested, transfer paused\n";
+        }
+        if (waited >= 600 || !isConnected) {
+            return false;
+        }
+        usleep(100000);
+    }
+    return true;
+}
+
+// Send credit (credit_ledger.h). Caller holds queueMutex.
+int64_t& CampusClient::creditFor(uint16_t targetId) {
+    return credit.emplace(targetId, creditWindow).first->second;
+}
+
+// Spends credit on a message, or keeps it back if its target has none
+// left or older messages for it are still waiting; they go out in order
+// as the server grants more. Returns how many are held for the target
+// (0: send it now).
+size_t CampusClient::holdForCredit(const std::string& frame) {
+    FrameHeader header;
+    if (frame.size() < FRAME_HEADER_SIZE || !decodeFrameHeader(frame.data(), header) ||
+        !spendsCredit(header)) {
+        return 0;
+    }
+    std::lock_guard<std::mutex> lock(queueMutex);
+    if (creditWindow == 0) return 0;
+    std::deque<std::string>& held = heldFrames[header.targetId];
+    int64_t& left = creditFor(header.targetId);
+    if (held.empty() && left > 0) {
+        left -= frame.size();   // May overdraw: a frame over the window still goes
+        return 0;
+    }
+    held.push_back(frame);
+    return held.size();
+}
+
+// File chunks wait for credit instead of being held: keeping a file in
+// memory is what credit is there to prevent. Gives up after a minute
+// without any.
+bool CampusClient::waitForCredit(const char* head, size_t length) {
+    FrameHeader header;
+    if (!decodeFrameHeader(head, header) || !spendsCredit(header)) {
+        return true;
+    }
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(60);
+    std::unique_lock<std::mutex> lock(queueMutex);
+    while (creditWindow > 0 &&
+           (creditFor(header.targetId) <= 0 || !heldFrames[header.targetId].empty())) {
+        if (!isConnected || std::chrono::steady_clock::now() >= deadline) {
+            return false;
+        }
+        creditGranted.wait_for(lock, std::chrono::milliseconds(100));
+    }
+    if (creditWindow > 0) {
+        creditFor(header.targetId) -= length;
+    }
+    return true;
+}
+
+// "CREDIT:<target id>:<bytes>": the server has passed on that much of
+// what we sent the target
+void CampusClient::handleCredit(const std::string& message) {
+    size_t colon = message.find(':', 7);
+    if (colon == std::string::npos) return;
+    uint16_t targetId = (uint16_t)atoi(message.c_str() + 7);
+    int64_t bytes = strtoll(message.c_str() + colon + 1, nullptr, 10);
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        if (creditWindow == 0) return;
+        creditFor(targetId) += bytes;
+    }
+    sendHeldFrames();
+    creditGranted.notify_all();
+}
+
+// Sends held messages while their targets have credit. Receive thread
+// only: it is the one thread that sends with queueMutex held, so the
+// order of messages to a campus cannot change.
+void CampusClient::sendHeldFrames() {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    for (auto& entry : heldFrames) {
+        std::deque<std::string>& held = entry.second;
+        int64_t& left = creditFor(entry.first);
+        while (!held.empty() && (creditWindow == 0 || left > 0)) {
+            if (!sendToServer(held.front())) return;
+            left -= held.front().size();
+            held.pop_front();
+        }
+    }
+}
+
+void CampusClient::displayTransfer(const TransferReport& report, bool received) {
+    if (!report.ok) {
+        std::cout << "\n[ERROR] File transfer " << (received ? "from " : "to ") << report.peer
+                  << " (" << report.name << ") failed: " << report.error << "\n";
+        std::cout << "Campus " << campusName << "> ";
+        std::cout.flush();
+        return;
+    }
+
+    std::cout << "\n╔════════════════════════════════════════╗\n";
+    std::cout << (received ? "║         FILE RECEIVED                  ║\n"
+                           : "║         FILE SENT                      ║\n");
+    std::cout << "╠════════════════════════════════════════╣\n";
+    std::cout << (received ? "║ From: " : "║ To: ") << report.peer << std::endl;
+    std::cout << "║ File: " << report.name << std::endl;
+    std::cout << "║ Size: " << report.size << " bytes\n";
+    if (report.resumedFrom > 0) {
+        std::cout << "║ Resumed from: " << report.resumedFrom << " bytes\n";
+    }
+    std::cout << "║ SHA-256: " << report.digest.substr(0, 16) << "... "
+              << (report.verified ? "verified" : "not confirmed") << std::endl;
+    if (received) {
+        std::cout << "║ Saved as: " << report.savedAs << std::endl;
+    }
+    std::cout << "║ Speed: " << std::fixed << std::setprecision(2) << report.megabytesPerSecond()
+              << " MB/s (" << std::setprecision(3) << report.seconds << " s)\n";
+    if (report.zeroCopy > 0) {
+        std::cout << "║ Zero-copy: " << report.zeroCopy << " bytes via sendfile\n";
+    }
+    if (report.compressedFrom > 0) {
+        std::cout << "║ Compressed: " << report.compressedFrom << " -> " << report.compressedTo
+                  << " bytes (" << codecName(codec) << ")\n";
+    }
+    std::cout << "╚════════════════════════════════════════╝\n";
+    if (received) {
+        std::cout << "Campus " << campusName << "> ";
+        std::cout.flush();
+    }
+}
+
+void CampusClient::handleServerMessage(const std::string& message) {
+    // Cluster mode: "REDIRECT:<host>:<port>", this campus's home moved.
+    // Acted on once the frames already received are handled.
+    if (message.find("REDIRECT:") == 0) {
+        redirectTo = message.substr(9);
+        return;
+    }
+
+    // Flow control: "FLOW:PAUSE:KARACHI" / "FLOW:RESUME:KARACHI"
+    if (message.find("FLOW:PAUSE:") == 0) {
+        std::string target = message.substr(11);
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            pausedTargets.insert(target);
+        }
+        std::cout << "\n[FLOW] " << target << " is congested; a message to it was not delivered.\n";
+        std::cout << "[FLOW] Hold messages for " << target << " until it resumes.\n";
+        std::cout << "Campus " << campusName << "> ";
+        std::cout.flush();
+        return;
+    }
+    if (message.find("FLOW:RESUME:") == 0) {
+        std::string target = message.substr(12);
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            pausedTargets.erase(target);
+        }
+        std::cout << "\n[FLOW] " << target << " is accepting messages again\n";
+        std::cout << "Campus " << campusName << "> ";
+        std::cout.flush();
+        return;
+    }
+
+    if (message.find("CREDIT:") == 0) {
+        handleCredit(message);
+        return;
+    }
+
+    if (message.find("BCAST:") == 0 || message.find("BCAST-LOST:") == 0) {
+        handleBroadcastRepair(message);
+        return;
+    }
 
-        std::string message(buffer);
+    // The topic list the server kept: "TOPICS:LAHORE/*,*/Admissions"
+    if (message.find("TOPICS:") == 0) {
+        std::vector<std::string> kept;
+        std::stringstream list(message.substr(7));
+        std::string topic;
+        while (std::getline(list, topic, ',')) {
+            kept.push_back(topic);
+        }
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            subscriptions.swap(kept);
+        }
+        std::cout << "\n[INFO] Subscribed to: "
+                  << (message.size() > 7 ? message.substr(7) : "nothing") << "\n";
+        std::cout << "Campus " << campusName << "> ";
+        std::cout.flush();
+        return;
+    }
+
+    // Check if it's a broadcast message
+    if (message.find("BROADCAST:") == 0) {
+        displayBroadcast(message.substr(10));
+    } 
+    // Check if it's a file transfer
+    else if (message.find("FILE:FROM:") == 0) {
+        // Parse file message: "FILE:FROM:LAHORE|NAME:doc.txt|SIZE:123|DATA:..."
+        size_t namePos = message.find("|NAME:");
+        size_t sizePos = message.find("|SIZE:");
+        size_t dataPos = message.find("|DATA:");
         
-        // Check if it's a broadcast message
-        if (message.find("BROADCAST:") == 0) {
-            std::string broadcastMsg = message.substr(10);
-            std::cout << "\n╔════════════════════════════════════════╗\n";
-            std::cout << "║      SYSTEM BROADCAST MESSAGE          ║\n";
-            std::cout << "╠════════════════════════════════════════╣\n";
-            std::cout << "║ " << broadcastMsg << std::endl;
-            std::cout << "╚════════════════════════════════════════╝\n";
-            std::cout << "Campus " << campusName << "> ";
-            std::cout.flush();
-        } 
-        // Check if it's a file transfer
-        else if (message.find("FILE:FROM:") == 0) {
-            // Parse file message: "FILE:FROM:LAHORE|NAME:doc.txt|SIZE:123|DATA:..."
-            size_t namePos = message.find("|NAME:");
-            size_t sizePos = message.find("|SIZE:");
-            size_t dataPos = message.find("|DATA:");
+        if (namePos != std::string::npos && sizePos != std::string::npos && dataPos != std::string::npos) {
+            std::string fromCampus = message.substr(10, namePos - 10);
+            std::string filename = message.substr(namePos + 6, sizePos - namePos - 6);
+            std::string sizeStr = message.substr(sizePos + 6, dataPos - sizePos - 6);
+            size_t dataEnd = message.find_last_not_of("\r\n") + 1;
             
-            if (namePos != std::string::npos && sizePos != std::string::npos && dataPos != std::string::npos) {
-                std::string fromCampus = message.substr(10, namePos - 10);
-                std::string filename = message.substr(namePos + 6, sizePos - namePos - 6);
-                std::string sizeStr = message.substr(sizePos + 6, dataPos - sizePos - 6);
-                std::string encodedData = message.substr(dataPos + 6);
-                
-                // Decode hex data
-                std::string fileContent;
-                for (size_t i = 0; i < encodedData.length(); i += 2) {
-                    std::string byteStr = encodedData.substr(i, 2);
-                    char byte = (char)strtol(byteStr.c_str(), nullptr, 16);
-                    fileContent += byte;
-                }
-                
-                // Save file with prefix
-                std::string savedFilename = "received_" + filename;
-                std::ofstream outFile(savedFilename, std::ios::binary);
-                outFile.write(fileContent.c_str(), fileContent.size());
-                outFile.close();
-                
-                std::cout << "\n╔════════════════════════════════════════╗\n";
-                std::cout << "║         FILE RECEIVED                  ║\n";
-                std::cout << "╠════════════════════════════════════════╣\n";
-                std::cout << "║ From: " << fromCampus << std::endl;
-                std::cout << "║ File: " << filename << std::endl;
-                std::cout << "║ Size: " << sizeStr << " bytes\n";
-                std::cout << "║ Saved as: " << savedFilename << std::endl;
-                std::cout << "╚════════════════════════════════════════╝\n";
+            // Save file with prefix, decoding straight into it a block at a time
+            std::string savedFilename = "received_" + filename;
+            std::ofstream outFile(savedFilename, std::ios::binary);
+            HexDecoder unhex([&outFile](const char* data, size_t length) {
+                return (bool)outFile.write(data, length);
+            });
+            bool decoded = dataEnd >= dataPos + 6 &&
+                           unhex.update(message.data() + dataPos + 6, dataEnd - dataPos - 6) &&
+                           unhex.finish();
+            outFile.close();
+            if (!decoded) {
+                std::remove(savedFilename.c_str());
+                std::cout << "\n[ERROR] File " << filename << " from " << fromCampus
+                          << " has corrupt data\n";
                 std::cout << "Campus " << campusName << "> ";
                 std::cout.flush();
-            }
-        }
-        else {
-            {
-                std::lock_guard<std::mutex> lock(queueMutex);
-                messageQueue.push(message);
+                return;
             }
             
-            std::cout << "\n[NEW MESSAGE RECEIVED] - Check messages to view\n";
+            std::cout << "\n╔════════════════════════════════════════╗\n";
+            std::cout << "║         FILE RECEIVED                  ║\n";
+            std::cout << "╠════════════════════════════════════════╣\n";
+            std::cout << "║ From: " << fromCampus << std::endl;
+            std::cout << "║ File: " << filename << std::endl;
+            std::cout << "║ Size: " << sizeStr << " bytes\n";
+            std::cout << "║ Saved as: " << savedFilename << std::endl;
+            std::cout << "╚════════════════════════════════════════╝\n";
             std::cout << "Campus " << campusName << "> ";
             std::cout.flush();
         }
     }
+    else {
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            messageQueue.push(message);
+        }
+        
+        std::cout << "\n[NEW MESSAGE RECEIVED] - Check messages to view\n";
+        std::cout << "Campus " << campusName << "> ";
+        std::cout.flush();
+    }
 }
 
-void CampusClient::receiveUDPBroadcasts() {
-    char buffer[BUFFER_SIZE];
-    struct sockaddr_in fromAddr;
-    socklen_t addrLen = sizeof(fromAddr);
-    
-    // Bind UDP socket to receive broadcasts
+// Joins on the interface the server is reached through. If that fails the
+// server is told to send broadcasts over TCP again.
+void CampusClient::joinBroadcastGroup(const AuthReply& reply) {
     struct sockaddr_in localAddr;
+    socklen_t addrLen = sizeof(localAddr);
     memset(&localAddr, 0, sizeof(localAddr));
-    localAddr.sin_family = AF_INET;
-    localAddr.sin_addr.s_addr = INADDR_ANY;
-    localAddr.sin_port = htons(UDP_PORT + 1); // Use different port for receiving
+    getsockname(tcpSocket, (struct sockaddr*)&localAddr, &addrLen);
 
-    while (isRunning) {
-        memset(buffer, 0, BUFFER_SIZE);
-        int bytesRead = recvfrom(udpSocket, buffer, BUFFER_SIZE - 1, 0,
-                                 (struct sockaddr*)&fromAddr, &addrLen);
-        
-        if (bytesRead > 0) {
-            std::string message(buffer);
-            
-            if (message.find("BROADCAST:") != std::string::npos) {
-                std::string broadcastMsg = message.substr(10);
-                std::cout << "\n╔════════════════════════════════════════╗\n";
-                std::cout << "║      SYSTEM BROADCAST MESSAGE          ║\n";
-                std::cout << "╠════════════════════════════════════════╣\n";
-                std::cout << "║ " << broadcastMsg << std::endl;
-                std::cout << "╚════════════════════════════════════════╝\n";
-                std::cout << "Campus " << campusName << "> ";
-                std::cout.flush();
-            }
+    std::string error;
+    multicastSocket = openMulticastReceiver(reply.multicastGroup, reply.multicastPort,
+                                            localAddr.sin_addr, error);
+    if (multicastSocket < 0) {
+        std::cerr << "[WARNING] Cannot join broadcast group " << reply.multicastGroup << " ("
+                  << error << "), broadcasts will come over TCP\n";
+        sendToServer(buildFrame(FRAME_CONTROL, campusId, 0, "",
+                                "MCAST-LEAVE:" + std::to_string(reply.multicastNext)));
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(broadcastMutex);
+    broadcasts.reset(reply.multicastSession, reply.multicastNext);
+    std::cout << "[INFO] Broadcasts via multicast " << reply.multicastGroup << ":"
+              << reply.multicastPort << "\n";
+}
+
+void CampusClient::receiveUDPBroadcasts() {
+    // This thread closes the socket, so its number is not reused under it
+    int groupSocket = multicastSocket;
+    if (groupSocket < 0) return;
+
+    char buffer[BUFFER_SIZE];
+    std::vector<std::pair<uint32_t, uint32_t>> nacks;
+
+    while (isRunning && multicastSocket == groupSocket) {
+        int bytesRead = recv(groupSocket, buffer, BUFFER_SIZE, 0);
+        if (bytesRead < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        BroadcastPacket packet;
+        if (!decodeBroadcastPacket(buffer, bytesRead, packet)) continue;
+
+        bool show;
+        nacks.clear();
+        {
+            std::lock_guard<std::mutex> lock(broadcastMutex);
+            show = broadcasts.receive(packet, nacks);
+        }
+        // Gaps are repaired over TCP
+        for (const auto& range : nacks) {
+            sendToServer(buildFrame(FRAME_CONTROL, campusId, 0, "",
+                                    "NACK:" + formatSequenceRange(range.first, range.second)));
+        }
+        if (show) {
+            displayBroadcast(std::string(packet.text, packet.length));
         }
     }
+    close(groupSocket);
+}
+
+// Stops taking broadcasts from the group; the broadcast thread sees the
+// shutdown and exits
+void CampusClient::leaveBroadcastGroup() {
+    std::lock_guard<std::mutex> lock(broadcastMutex);
+    if (multicastSocket < 0) return;
+    shutdown(multicastSocket, SHUT_RDWR);
+    multicastSocket = -1;
+    broadcasts.reset(0, 0);
+}
+
+// "BCAST:<sequence>:<text>" resends a broadcast; "BCAST-LOST:<first>-<last>"
+// means the server no longer has those
+void CampusClient::handleBroadcastRepair(const std::string& message) {
+    if (message.find("BCAST-LOST:") == 0) {
+        uint32_t first, last;
+        if (!parseSequenceRange(message.substr(11), first, last)) return;
+        {
+            std::lock_guard<std::mutex> lock(broadcastMutex);
+            broadcasts.lost(first, last);
+        }
+        std::cout << "\n[WARNING] " << (last - first + 1)
+                  << " broadcast(s) were missed and can no longer be recovered\n";
+        std::cout << "Campus " << campusName << "> ";
+        std::cout.flush();
+        return;
+    }
+
+    size_t textPos = message.find(':', 6);
+    if (textPos == std::string::npos) return;
+    uint32_t sequence = (uint32_t)strtoul(message.c_str() + 6, nullptr, 10);
+
+    bool show;
+    {
+        // Not tracking: the group could not be joined and this is catch-up
+        std::lock_guard<std::mutex> lock(broadcastMutex);
+        show = broadcasts.session() == 0 || broadcasts.repaired(sequence);
+    }
+    if (show) {
+        displayBroadcast(message.substr(textPos + 1));
+    }
+}
+
+void CampusClient::displayBroadcast(const std::string& text) {
+    std::cout << "\n╔════════════════════════════════════════╗\n";
+    std::cout << "║      SYSTEM BROADCAST MESSAGE          ║\n";
+    std::cout << "╠════════════════════════════════════════╣\n";
+    std::cout << "║ " << text << std::endl;
+    std::cout << "╚════════════════════════════════════════╝\n";
+    std::cout << "Campus " << campusName << "> ";
+    std::cout.flush();
 }
 
 void CampusClient::displayReceivedMessage(const std::string& message) {
@@ -246,18 +799,154 @@ void CampusClient::displayMenu() {
     std::cout << "║ 3. View Received Messages              ║\n";
     std::cout << "║ 4. Change Department                   ║\n";
     std::cout << "║ 5. Exit                                ║\n";
+    std::cout << "║ 6. Topic Subscriptions                 ║\n";
     std::cout << "╚════════════════════════════════════════╝\n";
 }
 
+// "lahore, karachi" -> {"LAHORE", "KARACHI"}
+std::vector<std::string> CampusClient::splitTargets(const std::string& targets) {
+    std::vector<std::string> names;
+    std::stringstream list(targets);
+    std::string name;
+    while (std::getline(list, name, ',')) {
+        name.erase(0, name.find_first_not_of(" \t"));
+        name.erase(name.find_last_not_of(" \t") + 1);
+        std::transform(name.begin(), name.end(), name.begin(), ::toupper);
+        if (!name.empty() && std::find(names.begin(), names.end(), name) == names.end()) {
+            names.push_back(name);
+        }
+    }
+    return names;
+}
+
+bool CampusClient::isAnyTargetPaused(const std::vector<std::string>& targets) {
+    for (const std::string& target : targets) {
+        if (isTargetPaused(target)) return true;
+    }
+    return false;
+}
+
+// Replaces this campus's topic subscriptions on the server. Binary clients
+// get back the list it kept ("TOPICS:").
+bool CampusClient::sendSubscriptions(const std::vector<std::string>& topics) {
+    std::string list;
+    for (const std::string& topic : topics) {
+        list += (list.empty() ? "" : ",") + topic;
+    }
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        subscriptions = topics;
+    }
+    if (protocolVersion == PROTOCOL_BINARY) {
+        return sendToServer(buildFrame(FRAME_CONTROL, campusId, 0, "", "SUB:" + list));
+    }
+    return sendToServer("SUB:" + list);
+}
+
+// Messages for this campus are narrowed to the new department; "All" takes
+// every department again. Subscriptions to other campuses stay.
+void CampusClient::changeDepartment() {
+    std::string department;
+    std::cout << "Enter department name (All for every department): ";
+    std::getline(std::cin, department);
+    department.erase(0, department.find_first_not_of(" \t"));
+    department.erase(department.find_last_not_of(" \t") + 1);
+    if (department.empty() || department.find_first_of(",|/") != std::string::npos) {
+        std::cout << "[ERROR] Invalid department name\n";
+        return;
+    }
+    bool all = department == "*" || strcasecmp(department.c_str(), "all") == 0;
+
+    std::string own = campusName + "/";
+    std::vector<std::string> topics(1, own + (all ? "*" : department));
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        for (const std::string& topic : subscriptions) {
+            if (topic.find(own) != 0) topics.push_back(topic);
+        }
+    }
+    currentDepartment = all ? "All" : department;
+    sendSubscriptions(topics);
+    std::cout << "[INFO] Department changed to " << currentDepartment << "\n";
+}
+
+// Lists the subscriptions and adds or drops one, e.g. "*/Admissions" for
+// Admissions messages to any campus
+void CampusClient::manageTopics() {
+    std::vector<std::string> topics;
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        topics = subscriptions;
+    }
+    std::cout << "\nSubscribed topics:\n";
+    for (const std::string& topic : topics) {
+        std::cout << "  " << topic << "\n";
+    }
+    if (topics.empty()) {
+        std::cout << "  (none)\n";
+    }
+
+    std::string topic;
+    std::cout << "Topic to add, or -topic to drop (e.g. */Admissions): ";
+    std::getline(std::cin, topic);
+    topic.erase(0, topic.find_first_not_of(" \t"));
+    topic.erase(topic.find_last_not_of(" \t") + 1);
+    if (topic.empty()) return;
+
+    bool dropping = topic[0] == '-';
+    if (dropping) topic.erase(0, 1);
+    size_t slash = topic.find('/');
+    if (slash == std::string::npos || slash == 0 || slash + 1 == topic.size() ||
+        topic.find_first_of(",|") != std::string::npos) {
+        std::cout << "[ERROR] A topic is CAMPUS/Department; either may be *\n";
+        return;
+    }
+    std::transform(topic.begin(), topic.begin() + slash, topic.begin(), ::toupper);
+
+    auto existing = std::find(topics.begin(), topics.end(), topic);
+    if (dropping) {
+        if (existing == topics.end()) {
+            std::cout << "[ERROR] Not subscribed to " << topic << "\n";
+            return;
+        }
+        topics.erase(existing);
+    } else if (existing == topics.end()) {
+        topics.push_back(topic);
+    }
+    sendSubscriptions(topics);
+}
+
+// Binary protocol: names the campuses that frames addressed to TARGET_LIST
+// go to, so a message or file for all of them is uploaded once
+bool CampusClient::sendTargetList(const std::vector<std::string>& targets) {
+    std::string ids;
+    for (const std::string& target : targets) {
+        uint16_t targetId = directory.idOf(target);
+        if (targetId == 0) {
+            std::cerr << "[ERROR] Unknown campus: " << target << "\n";
+            return false;
+        }
+        ids += (ids.empty() ? "" : ",") + std::to_string(targetId);
+    }
+    return sendToServer(buildFrame(FRAME_CONTROL, campusId, 0, "", "TARGETS:" + ids));
+}
+
 void CampusClient::sendMessage() {
     std::string targetCampus, targetDept, message;
     
     std::cout << "\nAvailable Campuses: LAHORE, KARACHI, PESHAWAR, CFD, MULTAN\n";
-    std::cout << "Enter target campus: ";
+    std::cout << "Enter target campus (several: LAHORE,KARACHI): ";
     std::getline(std::cin, targetCampus);
     
-    // Convert to uppercase
-    std::transform(targetCampus.begin(), targetCampus.end(), targetCampus.begin(), ::toupper);
+    std::vector<std::string> targets = splitTargets(targetCampus);
+    if (targets.empty()) {
+        std::cerr << "[ERROR] No target campus given\n";
+        return;
+    }
+    targetCampus = targets[0];
+    for (size_t i = 1; i < targets.size(); i++) {
+        targetCampus += "," + targets[i];
+    }
     
     std::cout << "Enter target department (Admissions/Academics/IT/Sports): ";
     std::getline(std::cin, targetDept);
@@ -265,10 +954,38 @@ void CampusClient::sendMessage() {
     std::cout << "Enter your message: ";
     std::getline(std::cin, message);
     
-    // Format: "TO:KARACHI|DEPT:Admissions|MSG:Hello from Lahore"
-    std::string fullMessage = "TO:" + targetCampus + "|DEPT:" + targetDept + "|MSG:" + message;
+    if (isAnyTargetPaused(targets)) {
+        std::cerr << "[WAIT] " << targetCampus << " is congested, try again shortly\n";
+        return;
+    }
+
+    std::string fullMessage;
+    if (protocolVersion == PROTOCOL_BINARY) {
+        uint16_t targetId = directory.idOf(targetCampus);
+        if (targets.size() > 1) {
+            if (!sendTargetList(targets)) return;
+            targetId = TARGET_LIST;
+        } else if (targetId == 0) {
+            std::cerr << "[ERROR] Unknown campus: " << targetCampus << "\n";
+            return;
+        }
+        fullMessage = buildFrame(FRAME_MESSAGE, campusId, targetId, targetDept, message);
+        std::string compressed;
+        if (compressFrame(fullMessage.data(), fullMessage.size(), codec, compressed)) {
+            fullMessage.swap(compressed);
+        }
+        size_t held = holdForCredit(fullMessage);
+        if (held > 0) {
+            std::cout << "[FLOW] " << targetCampus << " has no send credit left; message held ("
+                      << held << " waiting) until the server grants more\n";
+            return;
+        }
+    } else {
+        // Format: "TO:KARACHI|DEPT:Admissions|MSG:Hello from Lahore" (or "TO:KARACHI,LAHORE|...")
+        fullMessage = "TO:" + targetCampus + "|DEPT:" + targetDept + "|MSG:" + message;
+    }
     
-    if (send(tcpSocket, fullMessage.c_str(), fullMessage.length(), 0) < 0) {
+    if (!sendToServer(fullMessage)) {
         std::cerr << "[ERROR] Failed to send message\n";
     } else {
         std::cout << "[SUCCESS] Message sent to " << targetCampus << "\n";
@@ -279,16 +996,66 @@ void CampusClient::sendFile() {
     std::string targetCampus, filename;
     
     std::cout << "\nAvailable Campuses: LAHORE, KARACHI, PESHAWAR, CFD, MULTAN\n";
-    std::cout << "Enter target campus: ";
+    std::cout << "Enter target campus (several: LAHORE,KARACHI): ";
     std::getline(std::cin, targetCampus);
     
-    // Convert to uppercase
-    std::transform(targetCampus.begin(), targetCampus.end(), targetCampus.begin(), ::toupper);
+    std::vector<std::string> targets = splitTargets(targetCampus);
+    if (targets.empty()) {
+        std::cerr << "[ERROR] No target campus given\n";
+        return;
+    }
+    targetCampus = targets[0];
+    for (size_t i = 1; i < targets.size(); i++) {
+        targetCampus += "," + targets[i];
+    }
     
     std::cout << "Enter filename to send (in current directory): ";
     std::getline(std::cin, filename);
     
-    // Open and read file
+    uint16_t targetId = directory.idOf(targetCampus);
+    if (protocolVersion == PROTOCOL_BINARY && targets.size() == 1 && targetId == 0) {
+        std::cerr << "[ERROR] Unknown campus: " << targetCampus << "\n";
+        return;
+    }
+    if (isAnyTargetPaused(targets)) {
+        std::cerr << "[WAIT] " << targetCampus << " is congested, try again shortly\n";
+        return;
+    }
+
+    // Binary protocol: stream raw chunks, no size limit. Several campuses
+    // get one upload, which the server fans out; nobody confirms it then.
+    if (protocolVersion == PROTOCOL_BINARY) {
+        if (targets.size() > 1) {
+            if (!sendTargetList(targets)) return;
+            targetId = TARGET_LIST;
+        }
+        auto waitForTargets = [this, &targets]() {
+            for (const std::string& target : targets) {
+                if (!waitWhilePaused(target)) return false;
+            }
+            return true;
+        };
+        TransferReport report;
+        report.peer = targetCampus;
+        bool sent = sendFileChunked(filename, filename, campusId, targetId,
+            [this, &waitForTargets](const char* frame, size_t length) {
+                return waitForTargets() && waitForCredit(frame, length) &&
+                       sendToServer(frame, length);
+            }, transferAcks, report,
+            [this, &waitForTargets](const char* head, size_t headLength, int fd, uint64_t offset,
+                                    size_t length) {
+                if (!waitForTargets() || !waitForCredit(head, headLength + length)) return false;
+                std::lock_guard<std::mutex> lock(sendMutex);
+                return sendFileRange(tcpSocket, head, headLength, fd, offset, length);
+            }, codec);
+        if (!sent && report.error.empty()) {
+            report.error = "Failed to send file";
+        }
+        displayTransfer(report, false);
+        return;
+    }
+
+    // Text protocol peers: the whole file hex-encoded in one message
     std::ifstream file(filename, std::ios::binary);
     if (!file.is_open()) {
         std::cerr << "[ERROR] Cannot open file: " << filename << "\n";
@@ -300,33 +1067,28 @@ void CampusClient::sendFile() {
     size_t fileSize = file.tellg();
     file.seekg(0, std::ios::beg);
     
-    if (fileSize > 1000000) { // 1MB limit
+    if (fileSize > LEGACY_FILE_MAX) { // 1MB limit
         std::cerr << "[ERROR] File too large (max 1MB)\n";
         file.close();
         return;
     }
     
-    // Read file content
-    std::string fileContent;
-    fileContent.resize(fileSize);
-    file.read(&fileContent[0], fileSize);
-    file.close();
-    
-    // Encode file content in base64-like format (simplified)
-    std::string encodedContent;
-    for (unsigned char c : fileContent) {
-        char hex[3];
-        sprintf(hex, "%02X", c);
-        encodedContent += hex;
+    // Format: "FILE:TO:KARACHI|NAME:document.txt|SIZE:1234|DATA:...", the
+    // data hex-encoded as it is read
+    std::string fileMessage = "FILE:TO:" + targetCampus + "|NAME:" + filename +
+                              "|SIZE:" + std::to_string(fileSize) + "|DATA:";
+    fileMessage.reserve(fileMessage.size() + 2 * fileSize);
+    HexEncoder hex([&fileMessage](const char* data, size_t length) {
+        fileMessage.append(data, length);
+        return true;
+    });
+    std::vector<char> block(HEX_BLOCK_SIZE);
+    while (file.read(block.data(), block.size()) || file.gcount() > 0) {
+        hex.update(block.data(), file.gcount());
     }
+    file.close();
     
-    // Format: "FILE:TO:KARACHI|NAME:document.txt|SIZE:1234|DATA:..."
-    std::string fileMessage = "FILE:TO:" + targetCampus + 
-                              "|NAME:" + filename + 
-                              "|SIZE:" + std::to_string(fileSize) + 
-                              "|DATA:" + encodedContent;
-    
-    if (send(tcpSocket, fileMessage.c_str(), fileMessage.length(), 0) < 0) {
+    if (!sendToServer(fileMessage)) {
         std::cerr << "[ERROR] Failed to send file\n";
     } else {
         std::cout << "[SUCCESS] File '" << filename << "' (" << fileSize << " bytes) sent to " << targetCampus << "\n";
@@ -355,10 +1117,9 @@ void CampusClient::start() {
         
         std::cout << "\n[INFO] Initializing " << campusName << " Campus Client...\n";
         
-        initializeTCPSocket();
         initializeUDPSocket();
         
-        if (!authenticate()) {
+        if (!connectToServer(true)) {
             throw std::runtime_error("Authentication failed");
         }
         
@@ -400,13 +1161,13 @@ void CampusClient::run() {
         } else if (choice == "3") {
             viewMessages();
         } else if (choice == "4") {
-            std::cout << "Enter department name: ";
-            std::getline(std::cin, currentDepartment);
-            std::cout << "[INFO] Department changed to " << currentDepartment << "\n";
+            changeDepartment();
         } else if (choice == "5") {
             std::cout << "[INFO] Disconnecting from server...\n";
             stop();
             break;
+        } else if (choice == "6") {
+            manageTopics();
         } else {
             std::cout << "[ERROR] Invalid choice\n";
         }
@@ -423,15 +1184,43 @@ void CampusClient::stop() {
     if (udpSocket >= 0) {
         close(udpSocket);
     }
+    // Wakes the broadcast thread out of recv()
+    leaveBroadcastGroup();
     
     std::cout << "[INFO] Client stopped\n";
 }
 
 // Main function
 int main(int argc, char* argv[]) {
-    if (argc != 3) {
-        std::cout << "Usage: ./client <CAMPUS_NAME> <PASSWORD>\n";
-        std::cout << "Example: ./client LAHORE NU-LHR-123\n\n";
+    std::string compression = availableCodecs();
+    std::vector<std::string> servers(1, SERVER_IP ":" + std::to_string(TCP_PORT));
+    bool usage = argc < 3;
+    for (int i = 3; i < argc && !usage; i++) {
+        std::string arg = argv[i];
+        if (arg.find("--compress=") == 0) {
+            compression = arg.substr(11);
+        } else if (arg.find("--server=") == 0) {
+            // Tried in order after a lost connection
+            servers.clear();
+            std::stringstream list(arg.substr(9));
+            std::string entry, host;
+            uint16_t port;
+            while (std::getline(list, entry, ',')) {
+                usage |= !parseHostPort(entry, host, port);
+                servers.push_back(entry);
+            }
+            usage |= servers.empty();
+        } else {
+            usage = true;
+        }
+    }
+    if (usage) {
+        std::cout << "Usage: ./client <CAMPUS_NAME> <PASSWORD> [--compress=CODECS|none]\n";
+        std::cout << "                [--server=ADDRESS:PORT[,STANDBY:PORT...]]\n";
+        std::cout << "Example: ./client LAHORE NU-LHR-123\n";
+        std::cout << "Codecs, best first: " << availableCodecs() << " (default: all)\n";
+        std::cout << "Server: default " << SERVER_IP << ":" << TCP_PORT
+                  << "; in a cluster, any node; with a standby, the primary first\n\n";
         std::cout << "Available Campuses:\n";
         std::cout << "  LAHORE    : NU-LHR-123\n";
         std::cout << "  KARACHI   : NU-KHI-123\n";
@@ -443,6 +1232,9 @@ int main(int argc, char* argv[]) {
 
     std::string campusName = argv[1];
     std::string password = argv[2];
+
+    // sendfile() has no MSG_NOSIGNAL; a lost server shows up as a failed send
+    signal(SIGPIPE, SIG_IGN);
     
     // Convert campus name to uppercase
     std::transform(campusName.begin(), campusName.end(), campusName.begin(), ::toupper);
@@ -452,7 +1244,7 @@ int main(int argc, char* argv[]) {
     std::cout << "   Campus Client - " << campusName << "\n";
     std::cout << "========================================\n";
 
-    CampusClient client(campusName, password);
+    CampusClient client(campusName, password, compression, servers);
     client.start();
     
     sleep(1); // Give time for threads to initialize
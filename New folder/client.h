@@ -6,16 +6,26 @@
 #include <thread>
 #include <mutex>
 #include <queue>
+#include <deque>
+#include <vector>
+#include <set>
+#include <map>
+#include <condition_variable>
 #include <cstring>
 #include <fstream>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <unistd.h>
+#include "protocol.h"
+#include "file_transfer.h"
+#include "hex_codec.h"
+#include "multicast.h"
+#include "cluster.h"
+#include "replication.h"
 
-#define SERVER_IP "127.0.0.1"  // Change this to server IP in your network
-#define TCP_PORT 8080
-#define UDP_PORT 8081
+#define SERVER_IP "127.0.0.1"  // Default server; --server=ADDRESS:PORT,... picks others
+#define TCP_PORT 8080           // Heartbeats go to the next port up
 #define BUFFER_SIZE 4096
 
 class CampusClient {
@@ -26,21 +36,72 @@ private:
     
     int tcpSocket;
     int udpSocket;
-    struct sockaddr_in serverAddr;
+    int multicastSocket;            // Admin broadcasts; -1 when they come over TCP
+    struct sockaddr_in serverAddr;  // Guarded by sendMutex once connected
+    std::vector<std::string> servers;   // "<host>:<port>", primary first, then standbys
+    std::string serverHost;
+    uint16_t serverPort;
+    std::string redirectTo;         // Receive thread: home node to move to
     
     bool isConnected;
     bool isRunning;
+
+    // Negotiated during authentication
+    int protocolVersion;
+    uint16_t campusId;
+    std::string compressionOffer;   // Codecs to offer, best first ("none" to offer nothing)
+    Codec codec;                    // What the server picked
+    CampusDirectory directory;
+    std::string sessionToken;       // Offered at the next login to resume (session_token.h)
+    bool sessionResumed = false;    // The last login resumed: subscriptions stand on the server
+    FrameDecoder decoder;
+    FileReceiver fileReceiver;      // Chunked transfers in progress (receive thread)
+    TransferAcks transferAcks;      // Receiver answers for our own transfers
+    std::mutex sendMutex;           // The receive thread sends acks too
+    BroadcastTracker broadcasts;    // Multicast and repair threads both update it
+    std::mutex broadcastMutex;
     
     std::queue<std::string> messageQueue;
+    std::set<std::string> pausedTargets;   // Campuses the server reported as congested
+    std::vector<std::string> subscriptions;     // Topics, as the server last confirmed
+    uint32_t creditWindow = 0;      // Send credit per target (credit_ledger.h); 0: none given
+    std::map<uint16_t, int64_t> credit;     // Left, by target id; a full window until spent
+    std::map<uint16_t, std::deque<std::string>> heldFrames;    // Messages waiting for credit
     std::mutex queueMutex;
+    std::condition_variable creditGranted;  // File transfers wait on it with queueMutex
 
     // Private methods
     void initializeTCPSocket();
     void initializeUDPSocket();
-    bool authenticate();
+    bool authenticate(std::string& redirect, bool offerMulticast);
+    bool connectToServer(bool offerMulticast);
+    bool reconnect(const std::vector<std::string>& candidates, int giveUpMillis);
+    bool followRedirect();
+    bool failOver();
+    void leaveBroadcastGroup();
     void sendHeartbeat();
     void receiveMessages();
+    void handleServerMessage(const std::string& message);
+    bool sendToServer(const std::string& data);
+    bool sendToServer(const char* data, size_t length);
+    bool isTargetPaused(const std::string& target);
+    bool waitWhilePaused(const std::string& target);
+    int64_t& creditFor(uint16_t targetId);
+    size_t holdForCredit(const std::string& frame);
+    bool waitForCredit(const char* head, size_t length);
+    void handleCredit(const std::string& message);
+    void sendHeldFrames();
+    std::vector<std::string> splitTargets(const std::string& targets);
+    bool isAnyTargetPaused(const std::vector<std::string>& targets);
+    bool sendTargetList(const std::vector<std::string>& targets);
+    bool sendSubscriptions(const std::vector<std::string>& topics);
+    void changeDepartment();
+    void manageTopics();
+    void displayTransfer(const TransferReport& report, bool received);
+    void joinBroadcastGroup(const AuthReply& reply);
     void receiveUDPBroadcasts();
+    void handleBroadcastRepair(const std::string& message);
+    void displayBroadcast(const std::string& text);
     void displayMenu();
     void sendMessage();
     void sendFile();
@@ -48,7 +109,10 @@ private:
     void displayReceivedMessage(const std::string& message);
 
 public:
-    CampusClient(const std::string& campus, const std::string& pass);
+    CampusClient(const std::string& campus, const std::string& pass,
+                 const std::string& compression = availableCodecs(),
+                 const std::vector<std::string>& serverList =
+                     std::vector<std::string>(1, SERVER_IP ":" + std::to_string(TCP_PORT)));
     ~CampusClient();
     void start();
     void stop();
@@ -1,8 +1,12 @@
 #include "client_gui.h"
+#include <cerrno>
+#include <csignal>
+#include <chrono>
 
 CampusClientGUI::CampusClientGUI() 
     : tcpSocket(-1), udpSocket(-1), isConnected(false), 
-      isRunning(false), currentDepartment("General") {
+      isRunning(false), protocolVersion(PROTOCOL_TEXT), campusId(0), codec(CODEC_NONE),
+      currentDepartment("General") {
 }
 
 CampusClientGUI::~CampusClientGUI() {
@@ -200,7 +204,11 @@ void CampusClientGUI::initializeUDPSocket() {
 }
 
 bool CampusClientGUI::authenticate() {
-    std::string authMsg = "AUTH:Campus:" + campusName + ",Pass:" + password;
+    // Offer the binary protocol, compression and send credit; older servers
+    // ignore them
+    std::string authMsg = "AUTH:Proto:" + std::to_string(PROTOCOL_BINARY) +
+                          ",Compress:" + availableCodecs() + ",Credit:1" +
+                          ",Campus:" + campusName + ",Pass:" + password;
     
     if (send(tcpSocket, authMsg.c_str(), authMsg.length(), 0) < 0) {
         return false;
@@ -214,14 +222,51 @@ bool CampusClientGUI::authenticate() {
         return false;
     }
 
-    std::string response(buffer);
-    if (response == "AUTH:SUCCESS") {
+    AuthReply reply;
+    if (parseAuthReply(buffer, bytesRead, reply)) {
+        protocolVersion = reply.protocolVersion;
+        campusId = reply.campusId;
+        codec = codecByName(reply.compression);
+        directory = reply.directory;
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            creditWindow = reply.creditWindow;
+            credit.clear();
+            heldFrames.clear();
+        }
+
+        if (protocolVersion == PROTOCOL_BINARY && !reply.leftover.empty()) {
+            memcpy(decoder.prepare(reply.leftover.size()), reply.leftover.data(),
+                   reply.leftover.size());
+            decoder.commit(reply.leftover.size());
+        }
+
         isConnected = true;
         return true;
     }
     return false;
 }
 
+bool CampusClientGUI::sendToServer(const std::string& data) {
+    return sendToServer(data.data(), data.length());
+}
+
+bool CampusClientGUI::sendToServer(const char* data, size_t length) {
+    // A short write would leave a torn frame on the stream, and frames from
+    // the GTK thread must not land in the middle of a file chunk
+    std::lock_guard<std::mutex> lock(sendMutex);
+    size_t offset = 0;
+    while (offset < length) {
+        ssize_t sent = send(tcpSocket, data + offset, length - offset, 0);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        offset += sent;
+    }
+    return true;
+}
+
 void CampusClientGUI::sendHeartbeat() {
     struct sockaddr_in udpServerAddr;
     memset(&udpServerAddr, 0, sizeof(udpServerAddr));
@@ -239,8 +284,49 @@ void CampusClientGUI::sendHeartbeat() {
 
 void CampusClientGUI::receiveMessages() {
     char buffer[BUFFER_SIZE];
+    std::string expanded;       // Payload of the current frame if it was compressed
     
     while (isRunning && isConnected) {
+        if (protocolVersion == PROTOCOL_BINARY) {
+            Frame frame;
+            FrameDecoder::Status status;
+            while ((status = decoder.next(frame)) == FrameDecoder::FRAME_READY) {
+                if (!inflateFrame(frame, expanded)) {
+                    continue;   // Corrupt compressed payload
+                }
+                if (frame.header.type == FRAME_FILE_ACK) {
+                    TransferFrame ack;
+                    if (parseTransferFrame(frame, ack)) {
+                        transferAcks.post(ack);
+                    }
+                    continue;
+                }
+                if (isTransferFrame(frame.header.type)) {
+                    TransferReport report;
+                    if (fileReceiver.handle(frame, directory,
+                            [this](const char* data, size_t length) {
+                                return sendToServer(data, length);
+                            }, report)) {
+                        queueTransfer(report, true);
+                    }
+                    continue;
+                }
+                processReceivedMessage(frameToText(frame, directory));
+            }
+
+            int bytesRead = -1;
+            if (status != FrameDecoder::MALFORMED) {
+                bytesRead = recv(tcpSocket, decoder.prepare(BUFFER_SIZE), BUFFER_SIZE, 0);
+            }
+            if (bytesRead <= 0) {
+                isConnected = false;
+                g_idle_add(updateMessagesCallback, this);
+                break;
+            }
+            decoder.commit(bytesRead);
+            continue;
+        }
+
         memset(buffer, 0, BUFFER_SIZE);
         int bytesRead = recv(tcpSocket, buffer, BUFFER_SIZE - 1, 0);
         
@@ -256,20 +342,197 @@ void CampusClientGUI::receiveMessages() {
 }
 
 void CampusClientGUI::processReceivedMessage(const std::string& message) {
+    if (message.find("CREDIT:") == 0) {
+        handleCredit(message);
+        return;
+    }
     std::lock_guard<std::mutex> lock(queueMutex);
     messageQueue.push(message);
     g_idle_add(updateMessagesCallback, this);
 }
 
+bool CampusClientGUI::isTargetPaused(const std::string& target) {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    return pausedTargets.count(target) > 0;
+}
+
+// Send credit (credit_ledger.h), as in the console client. Caller holds
+// queueMutex.
+int64_t& CampusClientGUI::creditFor(uint16_t targetId) {
+    return credit.emplace(targetId, creditWindow).first->second;
+}
+
+// Spends credit on a message, or holds it (true) behind the ones already
+// waiting until the server grants more
+bool CampusClientGUI::holdForCredit(const std::string& frame) {
+    FrameHeader header;
+    if (frame.size() < FRAME_HEADER_SIZE || !decodeFrameHeader(frame.data(), header) ||
+        !spendsCredit(header)) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(queueMutex);
+    if (creditWindow == 0) return false;
+    std::deque<std::string>& held = heldFrames[header.targetId];
+    int64_t& left = creditFor(header.targetId);
+    if (held.empty() && left > 0 && !releasingTargets.count(header.targetId)) {
+        left -= frame.size();
+        return false;
+    }
+    held.push_back(frame);
+    return true;
+}
+
+// File chunks wait for credit rather than pile up in memory
+bool CampusClientGUI::waitForCredit(const char* head, size_t length) {
+    FrameHeader header;
+    if (!decodeFrameHeader(head, header) || !spendsCredit(header)) {
+        return true;
+    }
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(60);
+    std::unique_lock<std::mutex> lock(queueMutex);
+    while (creditWindow > 0 &&
+           (creditFor(header.targetId) <= 0 || !heldFrames[header.targetId].empty() ||
+            releasingTargets.count(header.targetId))) {
+        if (!isConnected || std::chrono::steady_clock::now() >= deadline) {
+            return false;
+        }
+        creditGranted.wait_for(lock, std::chrono::milliseconds(100));
+    }
+    if (creditWindow > 0) {
+        creditFor(header.targetId) -= length;
+    }
+    return true;
+}
+
+// "CREDIT:<target id>:<bytes>". Receive thread: sends what was held for
+// the target, in order, while the credit lasts. The sends happen outside
+// queueMutex, which the GTK thread takes; until they are done, new
+// messages for the target are held behind them.
+void CampusClientGUI::handleCredit(const std::string& message) {
+    size_t colon = message.find(':', 7);
+    if (colon == std::string::npos) return;
+    uint16_t targetId = (uint16_t)atoi(message.c_str() + 7);
+    std::unique_lock<std::mutex> lock(queueMutex);
+    if (creditWindow == 0) return;
+    creditFor(targetId) += strtoll(message.c_str() + colon + 1, nullptr, 10);
+
+    std::deque<std::string> ready;
+    bool connected = true;
+    while (connected) {
+        int64_t& left = creditFor(targetId);
+        std::deque<std::string>& held = heldFrames[targetId];
+        while (!held.empty() && left > 0) {
+            left -= held.front().size();
+            ready.push_back(std::move(held.front()));
+            held.pop_front();
+        }
+        if (ready.empty()) break;
+        releasingTargets.insert(targetId);
+        lock.unlock();
+        for (; !ready.empty() && connected; ready.pop_front()) {
+            connected = sendToServer(ready.front());
+        }
+        ready.clear();
+        lock.lock();
+        releasingTargets.erase(targetId);
+    }
+    lock.unlock();
+    creditGranted.notify_all();
+}
+
+void CampusClientGUI::queueTransfer(const TransferReport& report, bool received) {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    transferQueue.push(std::make_pair(report, received));
+    g_idle_add(updateMessagesCallback, this);
+}
+
+// Binary protocol file send. Runs on its own thread so a large file does
+// not freeze the window; the result comes back through transferQueue.
+void CampusClientGUI::sendFileChunkedAsync(const std::string& path, const std::string& name,
+                                           const std::string& target) {
+    uint16_t targetId = directory.idOf(target);
+    std::thread([this, path, name, target, targetId]() {
+        TransferReport report;
+        report.peer = target;
+        // Hold chunks while the target is congested rather than lose one
+        auto waitForTarget = [this, &target]() {
+            for (int waited = 0; isTargetPaused(target); waited++) {
+                if (waited >= 600 || !isConnected) return false;
+                usleep(100000);
+            }
+            return true;
+        };
+        sendFileChunked(path, name, campusId, targetId,
+            [this, &waitForTarget](const char* frame, size_t length) {
+                return waitForTarget() && waitForCredit(frame, length) &&
+                       sendToServer(frame, length);
+            }, transferAcks, report,
+            [this, &waitForTarget](const char* head, size_t headLength, int fd, uint64_t offset,
+                                   size_t length) {
+                if (!waitForTarget() || !waitForCredit(head, headLength + length)) return false;
+                std::lock_guard<std::mutex> lock(sendMutex);
+                return sendFileRange(tcpSocket, head, headLength, fd, offset, length);
+            }, codec);
+        if (!report.ok && report.error.empty()) {
+            report.error = "File not sent";
+        }
+        queueTransfer(report, false);
+    }).detach();
+}
+
+void CampusClientGUI::showTransfer(const TransferReport& report, bool received) {
+    char speed[64];
+    snprintf(speed, sizeof(speed), "%.2f MB/s", report.megabytesPerSecond());
+
+    if (!received) {
+        updateStatus(report.ok ? "File sent: " + report.name + " (" + speed +
+                                 (report.verified ? ", verified)" : ")")
+                               : "Error: " + report.error);
+        return;
+    }
+    if (!report.ok) {
+        appendToMessageView("\n[File " + report.name + " from " + report.peer + " failed: " +
+                            report.error + "]\n");
+        return;
+    }
+    appendToMessageView("\n=== FILE RECEIVED ===\n");
+    appendToMessageView("From: " + report.peer + "\n");
+    appendToMessageView("File: " + report.name + "\n");
+    appendToMessageView("Size: " + std::to_string(report.size) + " bytes\n");
+    appendToMessageView("Saved as: " + report.savedAs + "\n");
+    if (report.resumedFrom > 0) {
+        appendToMessageView("Resumed from: " + std::to_string(report.resumedFrom) + " bytes\n");
+    }
+    appendToMessageView("SHA-256: " + report.digest + " (verified)\n");
+    appendToMessageView(std::string("Speed: ") + speed + "\n");
+    appendToMessageView("====================\n");
+}
+
 gboolean CampusClientGUI::updateMessagesCallback(gpointer data) {
     CampusClientGUI *client = static_cast<CampusClientGUI*>(data);
     
     std::lock_guard<std::mutex> lock(client->queueMutex);
+    while (!client->transferQueue.empty()) {
+        client->showTransfer(client->transferQueue.front().first,
+                             client->transferQueue.front().second);
+        client->transferQueue.pop();
+    }
     while (!client->messageQueue.empty()) {
         std::string message = client->messageQueue.front();
         client->messageQueue.pop();
         
-        if (message.find("BROADCAST:") == 0) {
+        if (message.find("FLOW:PAUSE:") == 0) {
+            std::string target = message.substr(11);
+            client->pausedTargets.insert(target);
+            client->appendToMessageView("\n[" + target + " is congested; a message to it was "
+                                        "not delivered]\n");
+            client->updateStatus(target + " is congested");
+        } else if (message.find("FLOW:RESUME:") == 0) {
+            std::string target = message.substr(12);
+            client->pausedTargets.erase(target);
+            client->appendToMessageView("\n[" + target + " is accepting messages again]\n");
+            client->updateStatus(target + " is accepting messages again");
+        } else if (message.find("BROADCAST:") == 0) {
             client->appendToMessageView("\n=== BROADCAST ===\n" + 
                                        message.substr(10) + "\n================\n");
         } else if (message.find("FILE:FROM:") == 0) {
@@ -284,20 +547,25 @@ gboolean CampusClientGUI::updateMessagesCallback(gpointer data) {
                 std::string sizeStr = message.substr(sizePos + 6, dataPos - sizePos - 6);
                 
                 if (dataPos != std::string::npos) {
-                    std::string encodedData = message.substr(dataPos + 6);
-                    
-                    // Decode and save file
-                    std::string fileContent;
-                    for (size_t i = 0; i < encodedData.length(); i += 2) {
-                        std::string byteStr = encodedData.substr(i, 2);
-                        char byte = (char)strtol(byteStr.c_str(), nullptr, 16);
-                        fileContent += byte;
-                    }
+                    size_t dataEnd = message.find_last_not_of("\r\n") + 1;
                     
+                    // Decode straight into the file, a block at a time
                     std::string savedFilename = "received_" + filename;
                     std::ofstream outFile(savedFilename, std::ios::binary);
-                    outFile.write(fileContent.c_str(), fileContent.size());
+                    HexDecoder unhex([&outFile](const char* data, size_t length) {
+                        return (bool)outFile.write(data, length);
+                    });
+                    bool decoded = dataEnd >= dataPos + 6 &&
+                                   unhex.update(message.data() + dataPos + 6,
+                                                dataEnd - dataPos - 6) &&
+                                   unhex.finish();
                     outFile.close();
+                    if (!decoded) {
+                        std::remove(savedFilename.c_str());
+                        client->appendToMessageView("\n[File " + filename + " from " + from +
+                                                    " has corrupt data]\n");
+                        continue;
+                    }
                     
                     client->appendToMessageView("\n=== FILE RECEIVED ===\n");
                     client->appendToMessageView("From: " + from + "\n");
@@ -339,23 +607,45 @@ void CampusClientGUI::onSendMessageClicked(GtkWidget *widget, gpointer data) {
     gchar *target = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(client->targetCampusCombo));
     const gchar *dept = gtk_entry_get_text(GTK_ENTRY(client->targetDeptEntry));
     
+    if (target && client->isTargetPaused(target)) {
+        client->updateStatus(std::string(target) + " is congested, try again shortly");
+        g_free(target);
+        return;
+    }
+    
     GtkTextBuffer *buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(client->messageTextView));
     GtkTextIter start, end;
     gtk_text_buffer_get_bounds(buffer, &start, &end);
     gchar *messageText = gtk_text_buffer_get_text(buffer, &start, &end, FALSE);
     
-    std::string fullMessage = "TO:" + std::string(target) + 
-                              "|DEPT:" + std::string(dept) + 
-                              "|MSG:" + std::string(messageText);
+    std::string fullMessage;
+    uint16_t targetId = client->directory.idOf(target);
+    if (client->protocolVersion == PROTOCOL_BINARY) {
+        fullMessage = buildFrame(FRAME_MESSAGE, client->campusId, targetId, dept, messageText);
+        std::string compressed;
+        if (compressFrame(fullMessage.data(), fullMessage.size(), client->codec, compressed)) {
+            fullMessage.swap(compressed);
+        }
+    } else {
+        fullMessage = "TO:" + std::string(target) + 
+                      "|DEPT:" + std::string(dept) + 
+                      "|MSG:" + std::string(messageText);
+    }
     
-    send(client->tcpSocket, fullMessage.c_str(), fullMessage.length(), 0);
+    bool sent = false;
+    bool held = false;
+    if (client->protocolVersion != PROTOCOL_BINARY || targetId != 0) {
+        held = client->protocolVersion == PROTOCOL_BINARY && client->holdForCredit(fullMessage);
+        sent = held || client->sendToServer(fullMessage);
+    }
     
     gtk_text_buffer_set_text(buffer, "", 0);
     
     g_free(target);
     g_free(messageText);
     
-    client->updateStatus("Message sent successfully");
+    client->updateStatus(held ? "Message held until the server grants send credit"
+                              : sent ? "Message sent successfully" : "Error: Message not sent");
 }
 
 void CampusClientGUI::onSendFileClicked(GtkWidget *widget, gpointer data) {
@@ -366,7 +656,24 @@ void CampusClientGUI::onSendFileClicked(GtkWidget *widget, gpointer data) {
     gchar *target = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(client->fileTargetCombo));
     gchar *filename = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(client->fileChooserButton));
     
-    if (filename) {
+    if (filename && target && client->isTargetPaused(target)) {
+        client->updateStatus(std::string(target) + " is congested, try again shortly");
+        g_free(filename);
+    } else if (filename && target && client->protocolVersion == PROTOCOL_BINARY) {
+        // Streamed in raw chunks, any size
+        std::string justFilename = filename;
+        size_t lastSlash = justFilename.find_last_of("/\\");
+        if (lastSlash != std::string::npos) {
+            justFilename = justFilename.substr(lastSlash + 1);
+        }
+        if (client->directory.idOf(target) == 0) {
+            client->updateStatus("Error: Unknown campus");
+        } else {
+            client->updateStatus("Sending " + justFilename + "...");
+            client->sendFileChunkedAsync(filename, justFilename, target);
+        }
+        g_free(filename);
+    } else if (filename) {
         // Read file
         std::ifstream file(filename, std::ios::binary);
         if (file.is_open()) {
@@ -374,20 +681,7 @@ void CampusClientGUI::onSendFileClicked(GtkWidget *widget, gpointer data) {
             size_t fileSize = file.tellg();
             file.seekg(0, std::ios::beg);
             
-            if (fileSize <= 1000000) {
-                std::string fileContent;
-                fileContent.resize(fileSize);
-                file.read(&fileContent[0], fileSize);
-                file.close();
-                
-                // Encode
-                std::string encodedContent;
-                for (unsigned char c : fileContent) {
-                    char hex[3];
-                    sprintf(hex, "%02X", c);
-                    encodedContent += hex;
-                }
-                
+            if (fileSize <= LEGACY_FILE_MAX) {
                 // Get just the filename without path
                 std::string justFilename = filename;
                 size_t lastSlash = justFilename.find_last_of("/\\");
@@ -395,14 +689,26 @@ void CampusClientGUI::onSendFileClicked(GtkWidget *widget, gpointer data) {
                     justFilename = justFilename.substr(lastSlash + 1);
                 }
                 
-                std::string fileMessage = "FILE:TO:" + std::string(target) + 
-                                          "|NAME:" + justFilename + 
-                                          "|SIZE:" + std::to_string(fileSize) + 
-                                          "|DATA:" + encodedContent;
-                
-                send(client->tcpSocket, fileMessage.c_str(), fileMessage.length(), 0);
+                // Encode as it is read
+                std::string fileMessage = "FILE:TO:" + std::string(target) + "|NAME:" +
+                                          justFilename + "|SIZE:" + std::to_string(fileSize) +
+                                          "|DATA:";
+                fileMessage.reserve(fileMessage.size() + 2 * fileSize);
+                HexEncoder hex([&fileMessage](const char* data, size_t length) {
+                    fileMessage.append(data, length);
+                    return true;
+                });
+                std::vector<char> block(HEX_BLOCK_SIZE);
+                while (file.read(block.data(), block.size()) || file.gcount() > 0) {
+                    hex.update(block.data(), file.gcount());
+                }
+                file.close();
                 
-                client->updateStatus("File sent: " + justFilename);
+                if (client->sendToServer(fileMessage)) {
+                    client->updateStatus("File sent: " + justFilename);
+                } else {
+                    client->updateStatus("Error: File not sent");
+                }
             } else {
                 client->updateStatus("Error: File too large (max 1MB)");
             }
@@ -506,6 +812,9 @@ void CampusClientGUI::updateStatus(const std::string& status) {
 
 int main(int argc, char *argv[]) {
     gtk_init(&argc, &argv);
+
+    // sendfile() has no MSG_NOSIGNAL; a lost server shows up as a failed send
+    signal(SIGPIPE, SIG_IGN);
     
     CampusClientGUI client;
     client.createGUI();
@@ -7,6 +7,10 @@
 #include <thread>
 #include <mutex>
 #include <queue>
+#include <deque>
+#include <set>
+#include <map>
+#include <condition_variable>
 #include <cstring>
 #include <fstream>
 #include <algorithm>
@@ -14,6 +18,10 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <unistd.h>
+#include <utility>
+#include "protocol.h"
+#include "file_transfer.h"
+#include "hex_codec.h"
 
 #define SERVER_IP "127.0.0.1"
 #define TCP_PORT 8080
@@ -33,9 +41,26 @@ private:
     
     bool isConnected;
     bool isRunning;
+
+    // Negotiated during authentication
+    int protocolVersion;
+    uint16_t campusId;
+    Codec codec;                    // Compression the server picked
+    CampusDirectory directory;
+    FrameDecoder decoder;
+    FileReceiver fileReceiver;      // Receive thread only
+    TransferAcks transferAcks;      // Receiver answers for our own transfers
+    std::mutex sendMutex;           // File transfers and acks send from other threads
     
     std::queue<std::string> messageQueue;
+    std::queue<std::pair<TransferReport, bool>> transferQueue;  // Finished transfers, true if received
     std::mutex queueMutex;
+    std::set<std::string> pausedTargets;   // Congested campuses, under queueMutex
+    uint32_t creditWindow = 0;      // Send credit per target (credit_ledger.h); 0: none given
+    std::map<uint16_t, int64_t> credit;     // Left, by target id, under queueMutex
+    std::map<uint16_t, std::deque<std::string>> heldFrames;    // Messages waiting for credit
+    std::set<uint16_t> releasingTargets;    // Held messages being sent, outside queueMutex
+    std::condition_variable creditGranted;
     
     // GTK+ widgets
     GtkWidget *window;
@@ -72,6 +97,17 @@ private:
     void sendHeartbeat();
     void receiveMessages();
     void processReceivedMessage(const std::string& message);
+    bool sendToServer(const std::string& data);
+    bool sendToServer(const char* data, size_t length);
+    bool isTargetPaused(const std::string& target);
+    int64_t& creditFor(uint16_t targetId);
+    bool holdForCredit(const std::string& frame);
+    bool waitForCredit(const char* head, size_t length);
+    void handleCredit(const std::string& message);
+    void sendFileChunkedAsync(const std::string& path, const std::string& name,
+                              const std::string& target);
+    void queueTransfer(const TransferReport& report, bool received);
+    void showTransfer(const TransferReport& report, bool received);
     
     static gboolean updateMessagesCallback(gpointer data);
     static void onSendMessageClicked(GtkWidget *widget, gpointer data);
@@ -0,0 +1,88 @@
+#include "cluster.h"
+#include <algorithm>
+#include <sstream>
+#include <cstdlib>
+#include <arpa/inet.h>
+
+bool parseHostPort(const std::string& text, std::string& host, uint16_t& port) {
+    size_t colon = text.rfind(':');
+    if (colon == std::string::npos) return false;
+    host = text.substr(0, colon);
+    struct in_addr address;
+    int value = atoi(text.c_str() + colon + 1);
+    if (inet_pton(AF_INET, host.c_str(), &address) != 1 || value <= 0 || value > 65535) {
+        return false;
+    }
+    port = (uint16_t)value;
+    return true;
+}
+
+bool parseClusterSpec(const std::string& spec, std::vector<ClusterNode>& nodes,
+                      std::string& error) {
+    nodes.clear();
+    std::stringstream entries(spec);
+    std::string entry;
+    while (std::getline(entries, entry, ',')) {
+        size_t at = entry.find('@');
+        ClusterNode node;
+        if (at == std::string::npos || at == 0 ||
+            !parseHostPort(entry.substr(at + 1), node.host, node.port) ||
+            node.port > 65535 - CLUSTER_PEER_PORT_OFFSET) {
+            error = "bad cluster node \"" + entry + "\" (want NAME@ADDRESS:PORT)";
+            return false;
+        }
+        node.name = entry.substr(0, at);
+        for (const ClusterNode& other : nodes) {
+            if (other.name == node.name ||
+                (other.host == node.host && std::abs(other.port - node.port) <=
+                                                CLUSTER_PEER_PORT_OFFSET)) {
+                error = "cluster nodes " + other.name + " and " + node.name + " clash";
+                return false;
+            }
+        }
+        nodes.push_back(node);
+    }
+    if (nodes.empty()) {
+        error = "empty cluster";
+        return false;
+    }
+    return true;
+}
+
+// FNV-1a, then a 64-bit finalizer so that names differing in one
+// character land far apart on the ring
+uint64_t HashRing::hash(const std::string& key) {
+    uint64_t h = 14695981039346656037ULL;
+    for (unsigned char c : key) {
+        h = (h ^ c) * 1099511628211ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+void HashRing::add(int node, const std::string& name) {
+    remove(node);
+    for (int i = 0; i < CLUSTER_VIRTUAL_NODES; i++) {
+        points.push_back({hash(name + "#" + std::to_string(i)), node});
+    }
+    std::sort(points.begin(), points.end());
+}
+
+void HashRing::remove(int node) {
+    points.erase(std::remove_if(points.begin(), points.end(),
+                                [node](const std::pair<uint64_t, int>& point) {
+                                    return point.second == node;
+                                }),
+                 points.end());
+}
+
+int HashRing::ownerOf(const std::string& key) const {
+    if (points.empty()) return -1;
+    auto it = std::lower_bound(points.begin(), points.end(),
+                               std::make_pair(hash(key), -1));
+    return it == points.end() ? points.front().second : it->second;
+}
@@ -0,0 +1,67 @@
+#ifndef CLUSTER_H
+#define CLUSTER_H
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+
+// Federation of several servers. Every node is started with the same node
+// list, "--cluster=A@10.0.0.1:8080,B@10.0.0.2:8080", and its own name,
+// "--node=A". Each campus has one home node, chosen by consistent hashing
+// of its name over the nodes that are up, so a node joining or leaving
+// moves only the campuses whose home it takes or gives up.
+//
+// A node listens for campuses on its port, heartbeats on port + 1 and
+// other nodes on port + CLUSTER_PEER_PORT_OFFSET. It dials every other
+// node and announces itself with "PEER:<name>\n"; after that the link
+// carries binary protocol frames one way, with the real source and target
+// ids. A node counts as up while its link is connected.
+//
+// A campus that logs in to a node that is not its home is answered
+// "AUTH:REDIRECT:<host>:<port>". One already connected when its home moves
+// is sent "REDIRECT:<host>:<port>" (a control frame for binary clients).
+// Messages for a campus homed elsewhere, and not connected here, are
+// forwarded to its home, which delivers or stores them.
+
+#define CLUSTER_PEER_PORT_OFFSET 2
+#define CLUSTER_VIRTUAL_NODES 128       // Ring points per node
+#define CLUSTER_RETRY_MS 1000           // Between attempts to dial a node that is down
+#define CLUSTER_PING_MS 1000            // Idle links send a ping, so a dead node is noticed
+#define CLUSTER_QUEUE_HIGH (64 * 1024 * 1024)   // Per-link backlog before frames are dropped
+#define CLUSTER_QUEUE_LOW (16 * 1024 * 1024)
+#define CLUSTER_MAX_REDIRECTS 4         // Clients follow at most this many in a row
+
+struct ClusterNode {
+    std::string name;
+    std::string host;       // IPv4 address
+    uint16_t port = 0;      // Campus TCP port
+};
+
+// "A@127.0.0.1:8080,B@127.0.0.1:9080". False, with error set, for a bad
+// entry or a repeated name or address.
+bool parseClusterSpec(const std::string& spec, std::vector<ClusterNode>& nodes,
+                      std::string& error);
+
+// "<host>:<port>", as in redirects
+bool parseHostPort(const std::string& text, std::string& host, uint16_t& port);
+
+// Consistent hash ring over node indexes. Each node gets
+// CLUSTER_VIRTUAL_NODES points; a key belongs to the first point at or
+// after its own hash, wrapping around.
+class HashRing {
+private:
+    std::vector<std::pair<uint64_t, int>> points;   // Sorted by hash
+
+public:
+    static uint64_t hash(const std::string& key);
+
+    void add(int node, const std::string& name);
+    void remove(int node);
+    bool empty() const { return points.empty(); }
+
+    int ownerOf(const std::string& key) const;     // -1 if the ring is empty
+};
+
+#endif // CLUSTER_H
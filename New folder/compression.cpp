@@ -0,0 +1,420 @@
+#include "compression.h"
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include <zlib.h>
+#ifdef WITH_ZSTD
+#include <zstd.h>
+#endif
+
+static CodecStats codecTotals[CODEC_COUNT];
+
+CodecStats& codecStats(Codec codec) {
+    return codecTotals[codec < CODEC_COUNT ? codec : CODEC_NONE];
+}
+
+static uint64_t nanosSince(std::chrono::steady_clock::time_point started) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now() - started).count();
+}
+
+// ---- LZ4 block format ----
+//
+// A block is a series of sequences: token (literal count << 4 | match
+// length - 4), extra literal count bytes, the literals, match offset (u16
+// little-endian), extra match length bytes. Counts of 15 or more continue in
+// bytes of 255 until a smaller one. As the format requires, the last five
+// bytes are always literals and no match starts in the last twelve.
+
+#define LZ4_MIN_MATCH 4
+#define LZ4_LAST_LITERALS 5
+#define LZ4_MATCH_LIMIT 12
+#define LZ4_HASH_BITS 12            // 16 KB table, fits in L1
+#define LZ4_MAX_OFFSET 65535
+
+static inline uint32_t read32(const uint8_t* p) {
+    uint32_t value;
+    memcpy(&value, p, 4);
+    return value;
+}
+
+static inline uint64_t read64(const uint8_t* p) {
+    uint64_t value;
+    memcpy(&value, p, 8);
+    return value;
+}
+
+static inline uint32_t lz4Hash(uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - LZ4_HASH_BITS);
+}
+
+static uint8_t* putCount(uint8_t* op, size_t count) {
+    while (count >= 255) {
+        *op++ = 255;
+        count -= 255;
+    }
+    *op++ = (uint8_t)count;
+    return op;
+}
+
+// Where the match starting at ip and reference stops, at most limit.
+// Eight bytes at a time: the first differing byte is the lowest set bit
+// of the XOR (little-endian).
+static inline const uint8_t* extendMatch(const uint8_t* ip, const uint8_t* reference,
+                                         const uint8_t* limit) {
+    while (ip + 8 <= limit) {
+        uint64_t diff = read64(ip) ^ read64(reference);
+        if (diff) {
+            return ip + (__builtin_ctzll(diff) >> 3);
+        }
+        ip += 8;
+        reference += 8;
+    }
+    while (ip < limit && *ip == *reference) {
+        ip++;
+        reference++;
+    }
+    return ip;
+}
+
+// Greedy single-probe matcher. Returns the compressed size, or 0 if it
+// does not fit in capacity.
+static size_t lz4Compress(const uint8_t* src, size_t length, uint8_t* dst, size_t capacity) {
+    int32_t table[1 << LZ4_HASH_BITS];
+    std::fill(table, table + (1 << LZ4_HASH_BITS), -1);
+
+    const uint8_t* ip = src;
+    const uint8_t* anchor = src;
+    const uint8_t* end = src + length;
+    uint8_t* op = dst;
+    uint8_t* opEnd = dst + capacity;
+
+    if (length > LZ4_MATCH_LIMIT) {
+        const uint8_t* matchStartLimit = end - LZ4_MATCH_LIMIT;
+        const uint8_t* matchEndLimit = end - LZ4_LAST_LITERALS;
+
+        while (ip < matchStartLimit) {
+            uint32_t sequence = read32(ip);
+            uint32_t slot = lz4Hash(sequence);
+            int32_t candidate = table[slot];
+            table[slot] = (int32_t)(ip - src);
+
+            if (candidate < 0 || (ip - src) - candidate > LZ4_MAX_OFFSET ||
+                read32(src + candidate) != sequence) {
+                // Step faster the longer nothing has matched
+                ip += 1 + ((ip - anchor) >> 6);
+                continue;
+            }
+
+            const uint8_t* match = src + candidate;
+            while (ip > anchor && match > src && ip[-1] == match[-1]) {
+                ip--;
+                match--;
+            }
+            const uint8_t* matchEnd = extendMatch(ip + LZ4_MIN_MATCH, match + LZ4_MIN_MATCH,
+                                                  matchEndLimit);
+
+            size_t literals = ip - anchor;
+            size_t matchLength = matchEnd - ip - LZ4_MIN_MATCH;
+            if ((size_t)(opEnd - op) < 1 + literals / 255 + 1 + literals + 2 + matchLength / 255 + 1) {
+                return 0;
+            }
+
+            uint8_t* token = op++;
+            *token = (uint8_t)(std::min<size_t>(literals, 15) << 4);
+            if (literals >= 15) op = putCount(op, literals - 15);
+            memcpy(op, anchor, literals);
+            op += literals;
+
+            uint16_t offset = (uint16_t)(ip - match);
+            *op++ = offset & 0xFF;
+            *op++ = offset >> 8;
+            *token |= (uint8_t)std::min<size_t>(matchLength, 15);
+            if (matchLength >= 15) op = putCount(op, matchLength - 15);
+
+            ip = anchor = matchEnd;
+            table[lz4Hash(read32(ip - 2))] = (int32_t)(ip - 2 - src);
+        }
+    }
+
+    size_t literals = end - anchor;
+    if ((size_t)(opEnd - op) < 1 + literals / 255 + 1 + literals) {
+        return 0;
+    }
+    uint8_t* token = op++;
+    *token = (uint8_t)(std::min<size_t>(literals, 15) << 4);
+    if (literals >= 15) op = putCount(op, literals - 15);
+    memcpy(op, anchor, literals);
+    op += literals;
+    return op - dst;
+}
+
+// Checks every length and offset against both buffers, so a corrupt or
+// hostile block fails instead of reading or writing out of bounds
+static bool lz4Decompress(const uint8_t* src, size_t length, uint8_t* dst, size_t outLength) {
+    const uint8_t* ip = src;
+    const uint8_t* end = src + length;
+    uint8_t* op = dst;
+    uint8_t* opEnd = dst + outLength;
+
+    auto readCount = [&ip, end](size_t& count) {
+        uint8_t byte;
+        do {
+            if (ip >= end) return false;
+            byte = *ip++;
+            count += byte;
+        } while (byte == 255);
+        return true;
+    };
+
+    while (ip < end) {
+        uint8_t token = *ip++;
+        size_t literals = token >> 4;
+        if (literals == 15 && !readCount(literals)) return false;
+        if ((size_t)(end - ip) < literals || (size_t)(opEnd - op) < literals) return false;
+        if (literals <= 16 && end - ip >= 16 && opEnd - op >= 16) {
+            // Short runs: one fixed-size copy beats a variable memcpy
+            memcpy(op, ip, 16);
+        } else {
+            memcpy(op, ip, literals);
+        }
+        op += literals;
+        ip += literals;
+        if (ip == end) break;       // The last sequence has no match
+
+        if (end - ip < 2) return false;
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - dst)) return false;
+
+        size_t matchLength = token & 15;
+        if (matchLength == 15 && !readCount(matchLength)) return false;
+        matchLength += LZ4_MIN_MATCH;
+        if ((size_t)(opEnd - op) < matchLength) return false;
+
+        // Eight bytes at a time while the source is at least that far back
+        // and there is room to overshoot; overlapping copies that repeat the
+        // last few bytes go bytewise
+        const uint8_t* match = op - offset;
+        if (offset >= 8 && (size_t)(opEnd - op) >= matchLength + 8) {
+            for (size_t i = 0; i < matchLength; i += 8) {
+                memcpy(op + i, match + i, 8);
+            }
+        } else {
+            for (size_t i = 0; i < matchLength; i++) op[i] = match[i];
+        }
+        op += matchLength;
+    }
+    return op == opEnd;
+}
+
+// ---- Codec selection ----
+
+const char* codecName(Codec codec) {
+    switch (codec) {
+        case CODEC_LZ4: return "lz4";
+        case CODEC_DEFLATE: return "deflate";
+        case CODEC_ZSTD: return "zstd";
+        default: return "none";
+    }
+}
+
+bool codecAvailable(Codec codec) {
+    switch (codec) {
+        case CODEC_LZ4:
+        case CODEC_DEFLATE:
+            return true;
+#ifdef WITH_ZSTD
+        case CODEC_ZSTD:
+            return true;
+#endif
+        default:
+            return false;
+    }
+}
+
+Codec codecByName(const std::string& name) {
+    for (int codec = 1; codec < CODEC_COUNT; codec++) {
+        if (name == codecName((Codec)codec) && codecAvailable((Codec)codec)) {
+            return (Codec)codec;
+        }
+    }
+    return CODEC_NONE;
+}
+
+std::string availableCodecs() {
+    // Fastest first: the default preference
+    static const Codec order[] = {CODEC_LZ4, CODEC_ZSTD, CODEC_DEFLATE};
+    std::string list;
+    for (Codec codec : order) {
+        if (!codecAvailable(codec)) continue;
+        if (!list.empty()) list += "/";
+        list += codecName(codec);
+    }
+    return list;
+}
+
+// Splits "a/b/c" into codecs, skipping names that are unknown or not built in
+static std::vector<Codec> parseCodecList(const std::string& list) {
+    std::vector<Codec> codecs;
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t slash = list.find('/', start);
+        if (slash == std::string::npos) slash = list.size();
+        Codec codec = codecByName(list.substr(start, slash - start));
+        if (codec != CODEC_NONE) {
+            codecs.push_back(codec);
+        }
+        start = slash + 1;
+    }
+    return codecs;
+}
+
+Codec chooseCodec(const std::string& offered, const std::string& allowed) {
+    std::vector<Codec> permitted = parseCodecList(allowed);
+    for (Codec codec : parseCodecList(offered)) {
+        if (std::find(permitted.begin(), permitted.end(), codec) != permitted.end()) {
+            return codec;
+        }
+    }
+    return CODEC_NONE;
+}
+
+// ---- Payloads ----
+
+static void putU32(char* p, uint32_t value) {
+    p[0] = (char)(value >> 24);
+    p[1] = (char)(value >> 16);
+    p[2] = (char)(value >> 8);
+    p[3] = (char)value;
+}
+
+static uint32_t getU32(const char* p) {
+    const uint8_t* u = reinterpret_cast<const uint8_t*>(p);
+    return ((uint32_t)u[0] << 24) | ((uint32_t)u[1] << 16) | ((uint32_t)u[2] << 8) | u[3];
+}
+
+// Compresses into out starting at offset at, so a frame header can go in
+// front without another copy. On failure out is cleared.
+static bool compressAt(Codec codec, const char* data, size_t length, std::string& out, size_t at,
+                       int level) {
+    if (length < COMPRESS_MIN_BYTES || length > MAX_FRAME_PAYLOAD || !codecAvailable(codec)) {
+        out.clear();
+        return false;
+    }
+    auto started = std::chrono::steady_clock::now();
+
+    // Anything that saves less than an eighth is not worth the receiver's time
+    size_t capacity = length - length / 8;
+    out.resize(at + COMPRESS_HEADER_SIZE + capacity);
+    const uint8_t* src = reinterpret_cast<const uint8_t*>(data);
+    uint8_t* dst = reinterpret_cast<uint8_t*>(&out[at + COMPRESS_HEADER_SIZE]);
+
+    size_t written = 0;
+    if (codec == CODEC_LZ4) {
+        written = lz4Compress(src, length, dst, capacity);
+    } else if (codec == CODEC_DEFLATE) {
+        uLongf destLength = capacity;
+        if (compress2(dst, &destLength, src, length, level > 0 ? level : DEFLATE_LEVEL) == Z_OK) {
+            written = destLength;
+        }
+    }
+#ifdef WITH_ZSTD
+    else if (codec == CODEC_ZSTD) {
+        size_t result = ZSTD_compress(dst, capacity, src, length, level > 0 ? level : ZSTD_LEVEL);
+        if (!ZSTD_isError(result)) {
+            written = result;
+        }
+    }
+#endif
+
+    CodecStats& stats = codecStats(codec);
+    stats.compressNanos += nanosSince(started);
+    if (written == 0) {
+        stats.bypassed++;
+        out.clear();
+        return false;
+    }
+
+    out.resize(at + COMPRESS_HEADER_SIZE + written);
+    out[at] = (char)codec;
+    putU32(&out[at + 1], (uint32_t)length);
+    stats.frames++;
+    stats.bytesIn += length;
+    stats.bytesOut += COMPRESS_HEADER_SIZE + written;
+    return true;
+}
+
+bool compressPayload(Codec codec, const char* data, size_t length, std::string& out, int level) {
+    return compressAt(codec, data, length, out, 0, level);
+}
+
+bool decompressPayload(const char* data, size_t length, std::string& out) {
+    if (length < COMPRESS_HEADER_SIZE) return false;
+    Codec codec = (Codec)(uint8_t)data[0];
+    uint32_t original = getU32(data + 1);
+    if (!codecAvailable(codec) || original > MAX_FRAME_PAYLOAD) return false;
+
+    auto started = std::chrono::steady_clock::now();
+    out.resize(original);
+    const uint8_t* src = reinterpret_cast<const uint8_t*>(data + COMPRESS_HEADER_SIZE);
+    size_t srcLength = length - COMPRESS_HEADER_SIZE;
+    uint8_t* dst = reinterpret_cast<uint8_t*>(&out[0]);
+
+    bool ok = false;
+    if (codec == CODEC_LZ4) {
+        ok = lz4Decompress(src, srcLength, dst, original);
+    } else if (codec == CODEC_DEFLATE) {
+        uLongf destLength = original;
+        ok = uncompress(dst, &destLength, src, srcLength) == Z_OK && destLength == original;
+    }
+#ifdef WITH_ZSTD
+    else if (codec == CODEC_ZSTD) {
+        size_t result = ZSTD_decompress(dst, original, src, srcLength);
+        ok = !ZSTD_isError(result) && result == original;
+    }
+#endif
+
+    CodecStats& stats = codecStats(codec);
+    stats.decompressNanos += nanosSince(started);
+    if (ok) {
+        stats.inflated++;
+        stats.inflatedBytes += original;
+    }
+    return ok;
+}
+
+bool compressFrame(const FrameHeader& header, const char* payload, size_t length, Codec codec,
+                   std::string& out) {
+    if (!compressAt(codec, payload, length, out, FRAME_HEADER_SIZE, 0)) {
+        return false;
+    }
+    FrameHeader compressed = header;
+    compressed.flags |= FLAG_COMPRESSED;
+    compressed.payloadLength = out.size() - FRAME_HEADER_SIZE;
+    encodeFrameHeader(compressed, &out[0]);
+    return true;
+}
+
+bool compressFrame(const char* frame, size_t length, Codec codec, std::string& out) {
+    FrameHeader header;
+    if (length < FRAME_HEADER_SIZE || !decodeFrameHeader(frame, header) ||
+        (header.flags & FLAG_COMPRESSED)) {
+        return false;
+    }
+    return compressFrame(header, frame + FRAME_HEADER_SIZE, length - FRAME_HEADER_SIZE, codec, out);
+}
+
+bool inflateFrame(Frame& frame, std::string& scratch) {
+    if (!(frame.header.flags & FLAG_COMPRESSED)) {
+        return true;
+    }
+    if (!decompressPayload(frame.payload, frame.header.payloadLength, scratch)) {
+        return false;
+    }
+    frame.header.flags &= ~FLAG_COMPRESSED;
+    frame.header.payloadLength = scratch.size();
+    frame.payload = scratch.data();
+    return true;
+}
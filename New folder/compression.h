@@ -0,0 +1,88 @@
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include <string>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include "protocol.h"
+
+// Payload compression for the binary protocol.
+//
+// Codecs: LZ4 (the block format, implemented here; fast, modest ratio),
+// DEFLATE (zlib; slower, better ratio) and zstd when built with -DWITH_ZSTD.
+// The client lists the codecs it wants in its AUTH line, best first
+// ("Compress:lz4/deflate,"); the server picks the first one it has and
+// names it in its reply ("|COMPRESS:lz4"). Either side may then send frames
+// compressed with that codec. Servers that predate compression ignore the
+// field and never answer it, so nothing is compressed.
+//
+// A compressed frame has FLAG_COMPRESSED set and its payload is
+//   codec u8 | original length u32 | compressed bytes
+// Payloads under COMPRESS_MIN_BYTES go out as they are, and so does anything
+// that does not shrink by at least an eighth (already compressed files).
+
+enum Codec : uint8_t {
+    CODEC_NONE = 0,
+    CODEC_LZ4 = 1,
+    CODEC_DEFLATE = 2,
+    CODEC_ZSTD = 3
+};
+
+#define CODEC_COUNT 4
+#define COMPRESS_HEADER_SIZE 5
+#define COMPRESS_MIN_BYTES 256
+#define DEFLATE_LEVEL 6             // zlib's own default
+#define ZSTD_LEVEL 3                // zstd's own default
+
+const char* codecName(Codec codec);
+Codec codecByName(const std::string& name);     // CODEC_NONE if unknown or not built in
+bool codecAvailable(Codec codec);
+std::string availableCodecs();                  // "lz4/deflate", fastest first
+// First codec in offered ("a/b/c") that is built in and also listed in allowed
+Codec chooseCodec(const std::string& offered, const std::string& allowed);
+
+// Totals per codec since startup, for picking defaults. Times are measured
+// around each call on the calling thread.
+struct CodecStats {
+    std::atomic<uint64_t> frames{0};            // Payloads compressed
+    std::atomic<uint64_t> bypassed{0};          // Tried, but did not shrink enough
+    std::atomic<uint64_t> bytesIn{0};           // Of compressed payloads
+    std::atomic<uint64_t> bytesOut{0};
+    std::atomic<uint64_t> compressNanos{0};     // Includes bypassed attempts
+    std::atomic<uint64_t> inflated{0};          // Payloads decompressed
+    std::atomic<uint64_t> inflatedBytes{0};     // Their original size
+    std::atomic<uint64_t> decompressNanos{0};
+};
+
+CodecStats& codecStats(Codec codec);
+
+// Compresses length bytes of data into out (the COMPRESS_HEADER_SIZE header,
+// then the compressed bytes). level 0 is the codec's default. Returns false,
+// leaving out empty, below the threshold or when the data does not shrink.
+bool compressPayload(Codec codec, const char* data, size_t length, std::string& out,
+                     int level = 0);
+
+// Reverses compressPayload. False if the payload is corrupt or its codec is
+// not built in.
+bool decompressPayload(const char* data, size_t length, std::string& out);
+
+// The whole frame (header with FLAG_COMPRESSED, compressed payload) in out,
+// or false if the payload is not worth compressing
+bool compressFrame(const FrameHeader& header, const char* payload, size_t length, Codec codec,
+                   std::string& out);
+bool compressFrame(const char* frame, size_t length, Codec codec, std::string& out);
+
+// If frame is compressed, decompresses its payload into scratch and points
+// frame at it with the flag cleared. False if the payload is corrupt.
+bool inflateFrame(Frame& frame, std::string& scratch);
+
+// Codec a compressed frame was compressed with (CODEC_NONE if it is not)
+inline Codec frameCodec(const Frame& frame) {
+    if (!(frame.header.flags & FLAG_COMPRESSED) || frame.header.payloadLength == 0) {
+        return CODEC_NONE;
+    }
+    return (Codec)frame.payload[0];
+}
+
+#endif // COMPRESSION_H
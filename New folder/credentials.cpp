@@ -0,0 +1,135 @@
+#include "credentials.h"
+#include "hex_codec.h"
+#include <fstream>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstring>
+#include <sys/random.h>
+
+bool Credential::sameAs(const Credential& other) const {
+    return id == other.id && iterations == other.iterations && salt == other.salt &&
+           memcmp(hash, other.hash, SHA256_DIGEST_SIZE) == 0;
+}
+
+CredentialTable::CredentialTable(std::vector<Credential> credentials, uint16_t maxId)
+    : entries(std::move(credentials)) {
+    byName.reserve(entries.size());
+    std::vector<bool> taken(maxId + 1, false);
+    for (size_t i = 0; i < entries.size(); i++) {
+        const Credential& entry = entries[i];
+        if (entry.id == 0 || entry.id > maxId) {
+            throw std::runtime_error("Campus " + entry.campus + ": id " +
+                                     std::to_string(entry.id) + " outside 1.." +
+                                     std::to_string(maxId));
+        }
+        if (taken[entry.id]) {
+            throw std::runtime_error("Campus " + entry.campus + ": id " +
+                                     std::to_string(entry.id) + " given twice");
+        }
+        if (!byName.emplace(entry.campus, i).second) {
+            throw std::runtime_error("Campus " + entry.campus + " listed twice");
+        }
+        taken[entry.id] = true;
+    }
+}
+
+// "<campus>:<id>:<iterations>:<salt>:<hash>"; false if malformed
+static bool parseCredential(const std::string& line, Credential& entry) {
+    std::vector<std::string> fields;
+    size_t start = 0;
+    for (size_t colon; (colon = line.find(':', start)) != std::string::npos; start = colon + 1) {
+        fields.push_back(line.substr(start, colon - start));
+    }
+    fields.push_back(line.substr(start));
+    if (fields.size() != 5 || fields[0].empty() ||
+        fields[0].find_first_of(" \t,|=") != std::string::npos) {
+        return false;
+    }
+
+    char* end;
+    unsigned long id = strtoul(fields[1].c_str(), &end, 10);
+    if (fields[1].empty() || *end != '\0' || id > 0xFFFF) return false;
+    unsigned long iterations = strtoul(fields[2].c_str(), &end, 10);
+    if (fields[2].empty() || *end != '\0' || iterations == 0 || iterations > 0xFFFFFFFFUL) {
+        return false;
+    }
+
+    entry.campus = fields[0];
+    entry.id = (uint16_t)id;
+    entry.iterations = (uint32_t)iterations;
+    return !fields[3].empty() && hexDecode(fields[3].data(), fields[3].size(), entry.salt) &&
+           fields[4].size() == 2 * SHA256_DIGEST_SIZE &&
+           hexDecode(fields[4].data(), fields[4].size(), entry.hash);
+}
+
+std::shared_ptr<const CredentialTable> CredentialTable::load(const std::string& path,
+                                                             uint16_t maxId) {
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error("Cannot open credentials file " + path);
+    }
+
+    std::vector<Credential> credentials;
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line)) {
+        lineNumber++;
+        line.erase(line.find_last_not_of(" \r\t") + 1);
+        line.erase(0, line.find_first_not_of(" \t"));
+        if (line.empty() || line[0] == '#') continue;
+
+        Credential entry;
+        if (!parseCredential(line, entry)) {
+            throw std::runtime_error(path + ":" + std::to_string(lineNumber) +
+                                     ": expected <campus>:<id>:<iterations>:<salt>:<hash>");
+        }
+        credentials.push_back(std::move(entry));
+    }
+
+    try {
+        return std::make_shared<const CredentialTable>(std::move(credentials), maxId);
+    } catch (const std::runtime_error& e) {
+        throw std::runtime_error(path + ": " + e.what());
+    }
+}
+
+const Credential* CredentialTable::find(const std::string& campus) const {
+    auto it = byName.find(campus);
+    return it == byName.end() ? nullptr : &entries[it->second];
+}
+
+bool CredentialTable::verify(const std::string& campus, const std::string& password) const {
+    const Credential* entry = find(campus);
+    if (!entry) return false;
+
+    uint8_t hash[SHA256_DIGEST_SIZE];
+    pbkdf2Sha256(password, entry->salt.data(), entry->salt.size(), entry->iterations, hash);
+
+    // Every byte compared, so the time taken says nothing about the hash
+    uint8_t difference = 0;
+    for (int i = 0; i < SHA256_DIGEST_SIZE; i++) {
+        difference |= hash[i] ^ entry->hash[i];
+    }
+    return difference == 0;
+}
+
+Credential makeCredential(const std::string& campus, uint16_t id, const std::string& password,
+                          uint32_t iterations) {
+    Credential entry;
+    entry.campus = campus;
+    entry.id = id;
+    entry.iterations = iterations;
+    entry.salt.resize(CREDENTIAL_SALT_SIZE);
+    if (getrandom(&entry.salt[0], entry.salt.size(), 0) != (ssize_t)entry.salt.size()) {
+        throw std::runtime_error("No random source for a password salt");
+    }
+    pbkdf2Sha256(password, entry.salt.data(), entry.salt.size(), iterations, entry.hash);
+    return entry;
+}
+
+std::string formatCredential(const Credential& credential) {
+    return credential.campus + ":" + std::to_string(credential.id) + ":" +
+           std::to_string(credential.iterations) + ":" +
+           hexEncode(credential.salt.data(), credential.salt.size()) + ":" +
+           hexEncode(credential.hash, SHA256_DIGEST_SIZE);
+}
@@ -0,0 +1,70 @@
+#ifndef CREDENTIALS_H
+#define CREDENTIALS_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <cstdint>
+#include "checksum.h"
+
+// Campus credentials file, one campus per line:
+//
+//   <campus>:<id>:<iterations>:<salt>:<hash>
+//
+// with salt and hash in hex and hash = PBKDF2-HMAC-SHA256(password, salt,
+// iterations). Blank lines and lines starting with '#' are skipped. The
+// id is the campus's number in the binary protocol: once a server has
+// seen a campus its id cannot change, and every node of a cluster and a
+// standby pair must be given the same file. The iteration count is per
+// line, so the cost of a password check can be raised one campus at a
+// time; "./server --hash-password=<campus>:<id>" prints a line for a
+// password read from standard input.
+//
+// The server reads the file at startup and again on SIGHUP. A reload
+// builds a new table and swaps it in whole; logins already checking a
+// password finish against the table they started with.
+
+#define CREDENTIALS_FILE "credentials.txt"
+#define CREDENTIAL_ITERATIONS 100000    // For new lines: ~25 ms of one core per check
+#define CREDENTIAL_SALT_SIZE 16
+
+struct Credential {
+    std::string campus;
+    uint16_t id = 0;
+    uint32_t iterations = 0;
+    std::string salt;
+    uint8_t hash[SHA256_DIGEST_SIZE];
+
+    // Same id, iterations, salt and hash
+    bool sameAs(const Credential& other) const;
+};
+
+// Immutable once built; shared by every login that read it
+class CredentialTable {
+private:
+    std::vector<Credential> entries;    // File order
+    std::unordered_map<std::string, size_t> byName;
+
+public:
+    // Throws std::runtime_error for a repeated campus or id, or an id
+    // outside 1..maxId
+    CredentialTable(std::vector<Credential> credentials, uint16_t maxId);
+
+    // Throws std::runtime_error naming the file and line of a bad entry
+    static std::shared_ptr<const CredentialTable> load(const std::string& path, uint16_t maxId);
+
+    const Credential* find(const std::string& campus) const;    // Null if not listed
+    // Hashes the password; false for unknown campuses without hashing
+    bool verify(const std::string& campus, const std::string& password) const;
+
+    const std::vector<Credential>& all() const { return entries; }
+    size_t size() const { return entries.size(); }
+};
+
+// A credential with a fresh random salt. Throws if no salt can be drawn.
+Credential makeCredential(const std::string& campus, uint16_t id, const std::string& password,
+                          uint32_t iterations);
+std::string formatCredential(const Credential& credential);     // A line for the file
+
+#endif // CREDENTIALS_H
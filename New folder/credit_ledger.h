@@ -0,0 +1,189 @@
+#ifndef CREDIT_LEDGER_H
+#define CREDIT_LEDGER_H
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include <unordered_map>
+#include <utility>
+#include <cstdint>
+#include "campus_table.h"
+#include "protocol.h"
+
+// Credit-based flow control between campuses. A binary client that offers
+// "Credit:1" at login is given a window ("|CREDIT:<bytes>" in the AUTH
+// reply) for each campus it sends to. Every message and file chunk it
+// sends to one campus spends its size on the wire, header included; once
+// a window is spent the client holds further frames for that campus
+// itself instead of handing them to the server. One frame may overdraw
+// the window, so frames larger than it still go.
+//
+// The server counts what each sender has spent on each target and gives
+// it back ("CREDIT:<target id>:<bytes>", a control frame) once at least
+// half a window is owed and the target's backlog is at or below its low
+// watermark. A target that is offline, journaled or homed on another node
+// owes its senders nothing: they are paid back straight away. A sender
+// with window left is never dropped for congestion. The server checks the
+// window itself: a frame from a sender that has already spent it goes
+// through the watermarks like an uncredited one. A target's backlog thus
+// stays under its high watermark plus a window and a frame per credited
+// sender, however the senders behave.
+//
+// Frames for several campuses at once, topic fan-out and text clients
+// are not credited; the watermarks in outbound_queue.h still cover them.
+
+#define CREDIT_WINDOW (512 * 1024)      // Bytes in flight per sender and target
+#define CREDIT_MIN_WINDOW (16 * 1024)
+
+class CreditLedger {
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Owed {
+        uint32_t login = 0;     // Sender's login the bytes were spent under
+        uint32_t bytes = 0;
+    };
+
+    // By sender: negotiated at login. Each login starts a new count, so
+    // what an earlier connection spent is forgotten without visiting
+    // every target.
+    struct Sender {
+        std::atomic<bool> credited{false};
+        std::atomic<uint32_t> login{0};
+    };
+
+    // By target. Only senders that have spent on it take an entry.
+    struct Target {
+        std::mutex mutex;
+        std::unordered_map<uint16_t, Owed> owed;    // By sender
+        std::vector<uint16_t> due;      // Senders owed half a window or more
+        int64_t dueSince = 0;           // Clock ticks; when due became non-empty
+        std::atomic<bool> anyDue{false};
+    };
+
+    uint32_t window = CREDIT_WINDOW;
+    CampusTable<Sender> senders;
+    CampusTable<Target> targets;
+
+    // Caller holds target.mutex
+    uint32_t owedTo(Target& target, uint16_t sender, uint32_t login) {
+        auto it = target.owed.find(sender);
+        return it != target.owed.end() && it->second.login == login ? it->second.bytes : 0;
+    }
+
+public:
+    // Metrics
+    std::atomic<uint64_t> charged{0};       // Credited bytes routed
+    std::atomic<uint64_t> grants{0};        // CREDIT frames sent
+    std::atomic<uint64_t> exhausted{0};     // A sender spent its whole window
+    std::atomic<uint64_t> overdrawn{0};     // Frames sent with no window left
+    std::atomic<uint64_t> heldMicros{0};    // Credit due but held back for a backlogged target
+    std::atomic<uint64_t> longestHeldMicros{0};
+
+    // Before any campus logs in
+    void setWindow(uint32_t bytes) { window = bytes; }
+    uint32_t windowSize() const { return window; }
+
+    // At login: a new connection starts with full windows, so whatever the
+    // last one had spent is forgotten
+    void enable(uint16_t sender, bool on) {
+        if (sender == 0 || sender > MAX_CAMPUS_ID) return;
+        Sender& entry = senders.at(sender);
+        entry.login.fetch_add(1);
+        entry.credited.store(on);
+    }
+
+    bool isCredited(uint16_t sender) const {
+        const Sender* entry = senders.find(sender);
+        return entry && entry->credited.load(std::memory_order_relaxed);
+    }
+
+    // Records bytes a credited sender spent on target. True while target
+    // owes the sender a grant.
+    bool charge(uint16_t sender, uint16_t target, uint32_t bytes) {
+        const Sender* from = senders.find(sender);
+        if (!from || target == 0 || target > MAX_CAMPUS_ID) return false;
+        charged.fetch_add(bytes, std::memory_order_relaxed);
+        uint32_t login = from->login.load();
+
+        Target& to = targets.at(target);
+        std::lock_guard<std::mutex> lock(to.mutex);
+        Owed& owed = to.owed[sender];
+        if (owed.login != login) owed = {login, 0};
+        uint32_t before = owed.bytes;
+        uint32_t now = before + bytes;
+        owed.bytes = now;
+        if (before < window && now >= window) {
+            exhausted.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (now < window / 2) return false;
+        if (before < window / 2) {
+            if (to.due.empty()) {
+                to.dueSince = Clock::now().time_since_epoch().count();
+            }
+            to.due.push_back(sender);
+            to.anyDue.store(true);
+        }
+        return true;
+    }
+
+    // True while sender has window left for target, so its next frame may
+    // skip the watermarks. A client sends only then; one frame may take it
+    // past the window, but the next one is refused here.
+    bool hasWindow(uint16_t sender, uint16_t target) {
+        const Sender* from = senders.find(sender);
+        if (!from || target == 0) return false;
+        Target* to = targets.find(target);
+        if (!to) return target <= MAX_CAMPUS_ID;
+
+        std::lock_guard<std::mutex> lock(to->mutex);
+        if (owedTo(*to, sender, from->login.load()) < window) return true;
+        overdrawn.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    bool anyDue(uint16_t target) const {
+        const Target* entry = targets.find(target);
+        return entry && entry->anyDue.load();
+    }
+
+    // Takes everything target owes, as (sender, bytes) pairs. A grant
+    // still owed to a sender found later is not lost: charge() marks the
+    // target due again.
+    void collect(uint16_t target, std::vector<std::pair<uint16_t, uint32_t>>& grantsOut) {
+        grantsOut.clear();
+        Target* entry = target != 0 ? targets.find(target) : nullptr;
+        if (!entry) return;
+
+        std::lock_guard<std::mutex> lock(entry->mutex);
+        entry->anyDue.store(false);
+        if (entry->due.empty()) return;
+
+        uint64_t held = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+                            Clock::now().time_since_epoch() -
+                            Clock::duration(entry->dueSince)).count();
+        heldMicros.fetch_add(held, std::memory_order_relaxed);
+        uint64_t longest = longestHeldMicros.load(std::memory_order_relaxed);
+        while (held > longest &&
+               !longestHeldMicros.compare_exchange_weak(longest, held, std::memory_order_relaxed)) {
+        }
+
+        for (uint16_t sender : entry->due) {
+            // Senders that logged in again since have nothing owed; a
+            // sender listed twice is paid once
+            const Sender* from = senders.find(sender);
+            auto it = entry->owed.find(sender);
+            if (!from || it == entry->owed.end() || it->second.login != from->login.load() ||
+                it->second.bytes == 0) {
+                continue;
+            }
+            grantsOut.emplace_back(sender, it->second.bytes);
+            it->second.bytes = 0;
+        }
+        entry->due.clear();
+        grants.fetch_add(grantsOut.size(), std::memory_order_relaxed);
+    }
+};
+
+#endif // CREDIT_LEDGER_H
@@ -0,0 +1,44 @@
+#include "fanout.h"
+
+FanOut::FanOut(FrameType type, const std::string& source, uint16_t id,
+               const std::string& department, const char* data, size_t length,
+               uint16_t target)
+    : frameType(type), sourceCampus(source), sourceId(id), targetId(target), dept(department),
+      body(data), bodyLength(length), encodings(0) {
+}
+
+void FanOut::seed(Codec codec, SharedFrame frame) {
+    if (codec >= CODEC_COUNT || encoded[1 + codec]) return;
+    encoded[1 + codec] = std::move(frame);
+}
+
+const SharedFrame& FanOut::frameFor(int protocolVersion, Codec codec) {
+    if (codec >= CODEC_COUNT) codec = CODEC_NONE;
+    SharedFrame& frame = encoded[protocolVersion == PROTOCOL_BINARY ? 1 + codec : 0];
+    if (frame || (protocolVersion != PROTOCOL_BINARY && isTransferFrame(frameType))) {
+        return frame;
+    }
+
+    std::string bytes;
+    if (protocolVersion == PROTOCOL_BINARY) {
+        bytes = buildFrameHead(frameType, sourceId, targetId, dept, bodyLength);
+        bytes.append(body, bodyLength);
+        std::string compressed;
+        if (codec != CODEC_NONE && bodyLength >= COMPRESS_MIN_BYTES &&
+            compressFrame(bytes.data(), bytes.size(), codec, compressed)) {
+            bytes.swap(compressed);
+        }
+    } else {
+        if (frameType == FRAME_FILE) {
+            bytes = "FILE:FROM:" + sourceCampus + "|";
+        } else if (frameType == FRAME_BROADCAST) {
+            bytes = "BROADCAST:";
+        } else {
+            bytes = "FROM:" + sourceCampus + "|DEPT:" + dept + "|MSG:";
+        }
+        bytes.append(body, bodyLength);
+    }
+    frame = makeSharedFrame(std::move(bytes));
+    encodings++;
+    return frame;
+}
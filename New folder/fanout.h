@@ -0,0 +1,55 @@
+#ifndef FANOUT_H
+#define FANOUT_H
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include "protocol.h"
+#include "compression.h"
+#include "outbound_queue.h"
+
+// Encode-once fan-out for messages with several recipients: admin
+// broadcasts and sends to a list of campuses. Recipients differ only in
+// wire format (the text protocol, or binary frames in one of the codecs).
+// Each format is encoded the first time a recipient needs it, into one
+// immutable SharedFrame that every recipient of that format references,
+// so memory stays one copy per format however many campuses receive it.
+// Binary frames carry the same target id for everyone: 0, or for a
+// message published on one campus's topic, that campus.
+//
+// body is borrowed and must outlive the FanOut.
+class FanOut {
+private:
+    FrameType frameType;
+    std::string sourceCampus;
+    uint16_t sourceId;
+    uint16_t targetId;
+    std::string dept;
+    const char* body;
+    size_t bodyLength;
+    SharedFrame encoded[1 + CODEC_COUNT];   // Text, then binary in each codec
+    int encodings;
+
+public:
+    FanOut(FrameType type, const std::string& sourceCampus, uint16_t sourceId,
+           const std::string& department, const char* body, size_t bodyLength,
+           uint16_t targetId = 0);
+
+    // A binary frame already in codec (the sender's own compressed frame),
+    // sent as it is to recipients using that codec
+    void seed(Codec codec, SharedFrame frame);
+
+    // Null for the text protocol and transfer frames, which have no single
+    // encoding there (see CentralServer::relayLegacyFile)
+    const SharedFrame& frameFor(int protocolVersion, Codec codec);
+
+    FrameType type() const { return frameType; }
+    const std::string& source() const { return sourceCampus; }
+    uint16_t sender() const { return sourceId; }
+    const std::string& department() const { return dept; }
+    const char* data() const { return body; }
+    size_t length() const { return bodyLength; }
+    int encodingCount() const { return encodings; }
+};
+
+#endif // FANOUT_H
@@ -0,0 +1,558 @@
+#include "file_transfer.h"
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <unistd.h>
+
+void TransferAcks::expect(uint32_t transferId) {
+    std::lock_guard<std::mutex> lock(mutex);
+    expected[transferId].clear();
+}
+
+void TransferAcks::forget(uint32_t transferId) {
+    std::lock_guard<std::mutex> lock(mutex);
+    expected.erase(transferId);
+}
+
+void TransferAcks::post(const TransferFrame& ack) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = expected.find(ack.transferId);
+    if (it == expected.end()) return;
+    it->second.push_back(Ack{ack.value, ack.check});
+    arrived.notify_all();
+}
+
+bool TransferAcks::wait(uint32_t transferId, int timeoutMs, uint64_t& offset, uint32_t& status) {
+    std::unique_lock<std::mutex> lock(mutex);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    while (true) {
+        auto it = expected.find(transferId);
+        if (it == expected.end()) return false;
+        if (!it->second.empty()) {
+            offset = it->second.front().offset;
+            status = it->second.front().status;
+            it->second.pop_front();
+            return true;
+        }
+        if (arrived.wait_until(lock, deadline) == std::cv_status::timeout) {
+            return false;
+        }
+    }
+}
+
+uint32_t transferIdFor(const std::string& name, uint64_t size, int64_t modified) {
+    // FNV-1a over the name, size and mtime
+    uint32_t hash = 2166136261u;
+    auto mix = [&hash](const void* data, size_t length) {
+        const unsigned char* p = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < length; i++) {
+            hash = (hash ^ p[i]) * 16777619u;
+        }
+    };
+    mix(name.data(), name.size());
+    mix(&size, sizeof(size));
+    mix(&modified, sizeof(modified));
+    return hash ? hash : 1;
+}
+
+bool sendFileRange(int socket, const char* head, size_t headLength, int fd, uint64_t offset,
+                   size_t length) {
+    // MSG_MORE holds the headers back to share a segment with the data
+    for (size_t sent = 0; sent < headLength;) {
+        ssize_t n = send(socket, head + sent, headLength - sent, MSG_MORE | MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        sent += n;
+    }
+
+    off_t position = offset;
+    while (length > 0) {
+        ssize_t n = sendfile(socket, fd, &position, length);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        length -= n;
+    }
+    return true;
+}
+
+// The file being sent. Mapped when its data goes out with sendfile(), so
+// checksums read the page cache and the data never passes through a
+// buffer of ours; otherwise read through stream.
+struct SourceFile {
+    std::ifstream stream;
+    int fd = -1;
+    const char* mapped = nullptr;
+    uint64_t size = 0;
+
+    ~SourceFile() {
+        if (mapped) munmap(const_cast<char*>(mapped), size);
+        if (fd >= 0) close(fd);
+    }
+};
+
+// Compresses chunks for a transfer, giving up for a while after one that
+// does not shrink (archives, media) rather than paying for every chunk
+struct ChunkCompressor {
+    Codec codec = CODEC_NONE;
+    std::string out;
+    int skip = 0;
+
+    // Whether to try the next chunk
+    bool due() {
+        if (codec == CODEC_NONE) return false;
+        if (skip > 0) {
+            skip--;
+            return false;
+        }
+        return true;
+    }
+
+    bool compress(const char* frame, size_t length) {
+        if (compressFrame(frame, length, codec, out)) return true;
+        skip = TRANSFER_COMPRESS_SKIP;
+        return false;
+    }
+};
+
+// Sends [from, to) of the file as chunks. Unmapped, the chunk is read from
+// disk straight into the frame buffer, after the headers, so each chunk
+// costs one read, one CRC pass and one send.
+static bool sendChunks(SourceFile& file, uint64_t from, uint64_t to, uint16_t sourceId,
+                       uint16_t targetId, uint32_t transferId, std::vector<char>& frame,
+                       const FrameSender& sendFrame, const FileFrameSender& sendFromFile,
+                       ChunkCompressor& compressor, Sha256* sha, TransferReport& report) {
+    const size_t headSize = FRAME_HEADER_SIZE + TRANSFER_HEADER_SIZE;
+    if (!file.mapped) {
+        file.stream.clear();
+        file.stream.seekg(from);
+    }
+
+    for (uint64_t offset = from; offset < to;) {
+        size_t length = std::min<uint64_t>(FILE_CHUNK_SIZE, to - offset);
+        const char* data;
+        if (file.mapped) {
+            data = file.mapped + offset;
+        } else {
+            file.stream.read(frame.data() + headSize, length);
+            length = file.stream.gcount();
+            if (length == 0) {
+                report.error = "Read error at offset " + std::to_string(offset);
+                return false;
+            }
+            data = frame.data() + headSize;
+        }
+
+        if (sha) sha->update(data, length);
+        encodeTransferHead(frame.data(), FRAME_FILE_CHUNK, sourceId, targetId, transferId, offset,
+                           crc32c(data, length), length);
+
+        // Compression needs the chunk in one piece, which a mapped file is not
+        bool compressed = false;
+        if (compressor.due()) {
+            if (file.mapped) memcpy(frame.data() + headSize, data, length);
+            compressed = compressor.compress(frame.data(), headSize + length);
+        }
+
+        bool sent;
+        if (compressed) {
+            sent = sendFrame(compressor.out.data(), compressor.out.size());
+        } else if (file.mapped) {
+            sent = sendFromFile(frame.data(), headSize, file.fd, offset, length);
+        } else {
+            sent = sendFrame(frame.data(), headSize + length);
+        }
+        if (!sent) {
+            report.error = "Connection lost";
+            return false;
+        }
+        if (compressed) {
+            report.compressedFrom += headSize + length;
+            report.compressedTo += compressor.out.size();
+        } else if (file.mapped) {
+            report.zeroCopy += length;
+        }
+        offset += length;
+        report.transferred += length;
+    }
+    return true;
+}
+
+bool sendFileChunked(const std::string& path, const std::string& name, uint16_t sourceId,
+                     uint16_t targetId, const FrameSender& sendFrame, TransferAcks& acks,
+                     TransferReport& report, const FileFrameSender& sendFromFile, Codec codec) {
+    report.name = name;
+    report.ok = false;
+
+    struct stat info;
+    SourceFile file;
+    file.fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (file.fd < 0 || fstat(file.fd, &info) != 0) {
+        report.error = "Cannot open file: " + path;
+        return false;
+    }
+    uint64_t fileSize = info.st_size;
+    report.size = fileSize;
+
+    // Empty files and anything mmap refuses take the read path
+    if (sendFromFile && fileSize > 0) {
+        void* mapping = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, file.fd, 0);
+        if (mapping != MAP_FAILED) {
+            madvise(mapping, fileSize, MADV_SEQUENTIAL);
+            file.mapped = static_cast<const char*>(mapping);
+            file.size = fileSize;
+        }
+    }
+    if (!file.mapped) {
+        file.stream.open(path, std::ios::binary);
+        if (!file.stream.is_open()) {
+            report.error = "Cannot open file: " + path;
+            return false;
+        }
+    }
+
+    auto started = std::chrono::steady_clock::now();
+    uint32_t transferId = transferIdFor(name, fileSize, (int64_t)info.st_mtime);
+    acks.expect(transferId);
+
+    std::string begin = buildTransferFrame(FRAME_FILE_BEGIN, sourceId, targetId, transferId,
+                                           fileSize, 0, name.data(), name.size());
+    std::vector<char> frame(FRAME_HEADER_SIZE + TRANSFER_HEADER_SIZE + FILE_CHUNK_SIZE);
+    std::string end;
+    ChunkCompressor compressor;
+    compressor.codec = codec;
+
+    // Each attempt starts with BEGIN so the receiver can say where to pick
+    // up, whether this is a resend by the user or a RETRY. Chunks dropped
+    // under congestion cost a RETRY, so only retries that got no further
+    // count against the limit.
+    uint64_t furthest = 0;
+    for (int stalled = 0; stalled <= TRANSFER_MAX_RETRIES; stalled++) {
+        if (!sendFrame(begin.data(), begin.size())) {
+            report.error = "Connection lost";
+            break;
+        }
+
+        // No answer means a client that predates resume, and UNCONFIRMED
+        // means the server is storing or converting the file: either way
+        // send it all and expect nothing back
+        uint64_t offset = 0;
+        uint32_t status = TRANSFER_UNCONFIRMED;
+        bool answered = acks.wait(transferId, TRANSFER_ACK_TIMEOUT_MS, offset, status);
+        while (answered && status == TRANSFER_RETRY) {
+            // A verdict we stopped waiting for; the answer to BEGIN follows
+            answered = acks.wait(transferId, TRANSFER_ACK_TIMEOUT_MS, offset, status);
+        }
+        if (answered && status == TRANSFER_DONE) {
+            report.ok = true;
+            report.verified = true;
+            break;
+        }
+        bool confirmed = answered && status == TRANSFER_RESUME;
+        if (!confirmed || offset > fileSize) {
+            offset = 0;
+        }
+        if (offset > furthest) {
+            furthest = offset;
+            stalled = 0;
+        }
+
+        bool sent;
+        if (end.empty()) {
+            // The digest covers the whole file, including any part the
+            // receiver already has
+            report.resumedFrom = offset;
+            Sha256 sha;
+            if (file.mapped) {
+                sha.update(file.mapped, offset);
+            } else {
+                file.stream.seekg(0);
+            }
+            for (uint64_t hashed = file.mapped ? offset : 0; hashed < offset;) {
+                file.stream.read(frame.data(), std::min<uint64_t>(FILE_CHUNK_SIZE, offset - hashed));
+                size_t length = file.stream.gcount();
+                if (length == 0) {
+                    report.error = "Read error at offset " + std::to_string(hashed);
+                    break;
+                }
+                sha.update(frame.data(), length);
+                hashed += length;
+            }
+            sent = report.error.empty() &&
+                   sendChunks(file, offset, fileSize, sourceId, targetId, transferId, frame,
+                              sendFrame, sendFromFile, compressor, &sha, report);
+
+            uint8_t digest[SHA256_DIGEST_SIZE];
+            sha.finish(digest);
+            report.digest = Sha256::hex(digest);
+            end = buildTransferFrame(FRAME_FILE_END, sourceId, targetId, transferId, fileSize, 0,
+                                     (const char*)digest, sizeof(digest));
+        } else {
+            sent = sendChunks(file, offset, fileSize, sourceId, targetId, transferId, frame,
+                              sendFrame, sendFromFile, compressor, nullptr, report);
+        }
+        if (!sent) {
+            break;
+        }
+
+        if (!sendFrame(end.data(), end.size())) {
+            report.error = "Connection lost";
+            break;
+        }
+        if (!confirmed) {
+            report.ok = true;       // Sent, but nobody will say whether it arrived intact
+            break;
+        }
+        if (!acks.wait(transferId, TRANSFER_VERIFY_TIMEOUT_MS, offset, status)) {
+            // END was lost (dropped under congestion) or the receiver is
+            // still hashing: BEGIN again gets a RESUME or the late DONE
+            report.error = "No answer from the receiver";
+            continue;
+        }
+        if (status == TRANSFER_DONE) {
+            report.ok = true;
+            report.verified = true;
+            break;
+        }
+        report.error = "Receiver could not verify the file";
+    }
+    if (report.ok) {
+        report.error.clear();
+    }
+
+    acks.forget(transferId);
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                                   started).count();
+    return report.ok;
+}
+
+// Opens a transfer's partial file, picking up from its manifest when
+// there is one for the same file. On BEGIN a transfer always opens;
+// otherwise (chunks arriving after the receiver restarted) only if a
+// manifest exists.
+FileReceiver::Incoming* FileReceiver::open(uint16_t sourceId, const std::string& source,
+                                           uint32_t transferId, const std::string& name,
+                                           uint64_t size, bool begin) {
+    auto incoming = std::make_unique<Incoming>();
+    char idText[16];
+    snprintf(idText, sizeof(idText), "%08x", transferId);
+    incoming->manifestPath = ".received_" + source + "_" + idText + ".manifest";
+
+    // Manifest: NAME:<name>|SIZE:<bytes>|OFFSET:<verified bytes>
+    std::string manifestName;
+    uint64_t manifestSize = 0;
+    uint64_t manifestOffset = 0;
+    bool haveManifest = false;
+    std::ifstream manifest(incoming->manifestPath);
+    std::string line;
+    if (manifest.is_open() && std::getline(manifest, line)) {
+        size_t sizePos = line.find("|SIZE:");
+        size_t offsetPos = line.find("|OFFSET:");
+        if (line.find("NAME:") == 0 && sizePos != std::string::npos &&
+            offsetPos != std::string::npos) {
+            manifestName = line.substr(5, sizePos - 5);
+            manifestSize = strtoull(line.c_str() + sizePos + 6, nullptr, 10);
+            manifestOffset = strtoull(line.c_str() + offsetPos + 8, nullptr, 10);
+            haveManifest = manifestOffset <= manifestSize &&
+                           (!begin || (manifestName == name && manifestSize == size));
+        }
+    }
+    if (!begin && !haveManifest) {
+        return nullptr;
+    }
+
+    incoming->report.peer = source;
+    incoming->report.name = haveManifest ? manifestName : name;
+    incoming->report.size = haveManifest ? manifestSize : size;
+    incoming->started = std::chrono::steady_clock::now();
+
+    // Never let the sender pick a path outside the current directory
+    std::string baseName = incoming->report.name;
+    size_t lastSlash = baseName.find_last_of("/\\");
+    if (lastSlash != std::string::npos) {
+        baseName = baseName.substr(lastSlash + 1);
+    }
+    incoming->report.savedAs = "received_" + baseName;
+    incoming->partPath = incoming->report.savedAs + ".part";
+
+    // The part file must still hold everything the manifest vouches for
+    struct stat info;
+    uint64_t offset = 0;
+    if (haveManifest && stat(incoming->partPath.c_str(), &info) == 0 &&
+        (uint64_t)info.st_size >= manifestOffset) {
+        offset = manifestOffset;
+        if (truncate(incoming->partPath.c_str(), offset) != 0) {
+            offset = 0;
+        }
+    }
+
+    std::ios::openmode mode = std::ios::in | std::ios::out | std::ios::binary;
+    incoming->out.open(incoming->partPath, offset > 0 ? mode : mode | std::ios::trunc);
+    if (!incoming->out.is_open()) {
+        return nullptr;
+    }
+    incoming->out.seekp(offset);
+    incoming->verified = offset;
+    incoming->hashing = offset == 0;
+    incoming->report.resumedFrom = offset;
+    saveManifest(*incoming);
+
+    Incoming* result = incoming.get();
+    transfers[std::make_pair(sourceId, transferId)] = std::move(incoming);
+    return result;
+}
+
+// Written aside and renamed over the old one, so a crash never leaves a
+// torn manifest
+void FileReceiver::saveManifest(const Incoming& incoming) {
+    std::string temporary = incoming.manifestPath + ".tmp";
+    {
+        std::ofstream manifest(temporary, std::ios::trunc);
+        manifest << "NAME:" << incoming.report.name << "|SIZE:" << incoming.report.size
+                 << "|OFFSET:" << incoming.verified << "\n";
+    }
+    rename(temporary.c_str(), incoming.manifestPath.c_str());
+}
+
+// SHA-256 of a file on disk, for transfers that resumed part way through
+bool FileReceiver::fileDigest(const std::string& path, uint8_t digest[SHA256_DIGEST_SIZE]) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) return false;
+
+    Sha256 sha;
+    std::vector<char> buffer(FILE_CHUNK_SIZE);
+    while (file.read(buffer.data(), buffer.size()) || file.gcount() > 0) {
+        sha.update(buffer.data(), file.gcount());
+    }
+    sha.finish(digest);
+    return true;
+}
+
+void FileReceiver::acknowledge(const FrameSender& reply, uint16_t sourceId, uint32_t transferId,
+                               uint64_t offset, TransferStatus status) {
+    std::string ack = buildTransferFrame(FRAME_FILE_ACK, 0, sourceId, transferId, offset, status,
+                                         nullptr, 0);
+    reply(ack.data(), ack.size());
+}
+
+bool FileReceiver::handle(const Frame& frame, const CampusDirectory& directory,
+                          const FrameSender& reply, TransferReport& report) {
+    TransferFrame transfer;
+    if (!parseTransferFrame(frame, transfer) || frame.header.type == FRAME_FILE_ACK) {
+        return false;
+    }
+    uint16_t sourceId = frame.header.sourceId;
+    const std::string& source = directory.nameOf(sourceId);
+    auto key = std::make_pair(sourceId, transfer.transferId);
+
+    if (frame.header.type == FRAME_FILE_BEGIN) {
+        auto done = completed.find(key);
+        struct stat info;
+        if (done != completed.end() && stat(done->second.c_str(), &info) == 0 &&
+            (uint64_t)info.st_size == transfer.value) {
+            acknowledge(reply, sourceId, transfer.transferId, transfer.value, TRANSFER_DONE);
+            return false;
+        }
+        transfers.erase(key);
+        Incoming* incoming = open(sourceId, source, transfer.transferId,
+                                  std::string(transfer.data, transfer.length), transfer.value,
+                                  true);
+        if (!incoming) {
+            report = TransferReport();
+            report.peer = source;
+            report.name.assign(transfer.data, transfer.length);
+            report.error = "Cannot create received_" + report.name;
+            return true;
+        }
+        acknowledge(reply, sourceId, transfer.transferId, incoming->verified, TRANSFER_RESUME);
+        return false;
+    }
+
+    auto it = transfers.find(key);
+    Incoming* incoming = it != transfers.end() ? it->second.get()
+                                               : open(sourceId, source, transfer.transferId,
+                                                      "", 0, false);
+    if (!incoming) {
+        // Lost track of it (crashed before the manifest was written): ask
+        // the sender to start over. A duplicate END for a finished transfer
+        // gets this too, but its sender has stopped listening.
+        if (frame.header.type == FRAME_FILE_END) {
+            acknowledge(reply, sourceId, transfer.transferId, 0, TRANSFER_RETRY);
+        }
+        return false;
+    }
+
+    if (frame.header.type == FRAME_FILE_CHUNK) {
+        if (incoming->damaged || transfer.value + transfer.length <= incoming->verified) {
+            return false;   // Waiting for END, or a duplicate from a replay
+        }
+        if (transfer.value != incoming->verified ||
+            crc32c(transfer.data, transfer.length) != transfer.check) {
+            incoming->damaged = true;
+            return false;
+        }
+        incoming->out.write(transfer.data, transfer.length);
+        incoming->out.flush();
+        if (!incoming->out) {
+            incoming->damaged = true;
+            return false;
+        }
+        if (incoming->hashing) {
+            incoming->sha.update(transfer.data, transfer.length);
+        }
+        incoming->verified += transfer.length;
+        incoming->report.transferred += transfer.length;
+        saveManifest(*incoming);
+        return false;
+    }
+
+    // FILE_END: anything missing is asked for again. The sender answers
+    // with a new BEGIN and resumes from the verified offset.
+    if (incoming->damaged || incoming->verified != transfer.value) {
+        acknowledge(reply, sourceId, transfer.transferId, incoming->verified, TRANSFER_RETRY);
+        transfers.erase(key);
+        return false;
+    }
+
+    incoming->out.close();
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    bool hashed = incoming->hashing ? (incoming->sha.finish(digest), true)
+                                    : fileDigest(incoming->partPath, digest);
+    bool matches = hashed && transfer.length == SHA256_DIGEST_SIZE &&
+                   memcmp(digest, transfer.data, SHA256_DIGEST_SIZE) == 0;
+
+    report = incoming->report;
+    report.digest = Sha256::hex(digest);
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                                   incoming->started).count();
+
+    if (!matches) {
+        // Every chunk passed its CRC but the file is wrong: start over
+        remove(incoming->partPath.c_str());
+        remove(incoming->manifestPath.c_str());
+        transfers.erase(key);
+        acknowledge(reply, sourceId, transfer.transferId, 0, TRANSFER_RETRY);
+        report.error = "SHA-256 mismatch, transfer restarted";
+        return true;
+    }
+
+    if (rename(incoming->partPath.c_str(), report.savedAs.c_str()) != 0) {
+        report.error = "Cannot rename " + incoming->partPath;
+        transfers.erase(key);
+        return true;
+    }
+    remove(incoming->manifestPath.c_str());
+    transfers.erase(key);
+    completed[key] = report.savedAs;
+    acknowledge(reply, sourceId, transfer.transferId, report.size, TRANSFER_DONE);
+    report.ok = true;
+    report.verified = true;
+    return true;
+}
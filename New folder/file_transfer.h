@@ -0,0 +1,141 @@
+#ifndef FILE_TRANSFER_H
+#define FILE_TRANSFER_H
+
+#include <string>
+#include <map>
+#include <deque>
+#include <memory>
+#include <fstream>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <utility>
+#include <cstdint>
+#include "protocol.h"
+#include "checksum.h"
+#include "compression.h"
+
+// Chunked file transfer for binary protocol clients (see protocol.h). The
+// sender streams the file from disk in FILE_CHUNK_SIZE pieces and the
+// receiver writes each chunk to disk as it arrives, so neither side holds
+// the whole file and there is no size limit. Text protocol peers still
+// use the single hex-encoded FILE message.
+//
+// Every chunk carries a CRC32C and END carries the file's SHA-256. The
+// receiver keeps a manifest next to the partial file recording how much has
+// been verified, so a transfer cut off by either side dropping resumes from
+// there when the same file is sent again.
+
+#define TRANSFER_ACK_TIMEOUT_MS 5000    // Wait for the receiver before assuming an old client
+#define TRANSFER_VERIFY_TIMEOUT_MS 30000    // Wait for the verdict after END
+#define TRANSFER_MAX_RETRIES 3          // RETRYs or unanswered ENDs without progress before giving up
+#define TRANSFER_COMPRESS_SKIP 15       // Chunks sent as they are after one that did not compress
+
+// What a finished or failed transfer looked like, for display
+struct TransferReport {
+    std::string peer;           // The other campus
+    std::string name;
+    std::string savedAs;        // Receiver only
+    uint64_t size = 0;          // File size
+    uint64_t transferred = 0;   // Bytes sent or received this time
+    uint64_t resumedFrom = 0;   // Offset the transfer picked up from
+    uint64_t zeroCopy = 0;      // Sender only: bytes that went out with sendfile()
+    uint64_t compressedFrom = 0;    // Sender only: chunk payload bytes that went out compressed
+    uint64_t compressedTo = 0;      // and what they came to on the wire
+    double seconds = 0;
+    bool ok = false;
+    bool verified = false;      // SHA-256 checked by the receiver
+    std::string digest;         // SHA-256, hex
+    std::string error;
+
+    double megabytesPerSecond() const { return seconds > 0 ? transferred / seconds / 1e6 : 0; }
+};
+
+// Called with one complete frame; returns false if the connection failed
+typedef std::function<bool(const char* frame, size_t length)> FrameSender;
+
+// Called with a frame's headers and where its data lies in a file, so the
+// data can go from the page cache to the socket without a user-space copy
+typedef std::function<bool(const char* head, size_t headLength, int fd, uint64_t offset,
+                           size_t length)> FileFrameSender;
+
+// Sends head, then length bytes of fd from offset with sendfile(). The
+// caller serializes access to the socket.
+bool sendFileRange(int socket, const char* head, size_t headLength, int fd, uint64_t offset,
+                   size_t length);
+
+// FILE_ACK frames arrive on the receive thread while the sending thread
+// waits for them. Acks for transfers nobody is waiting on are dropped.
+class TransferAcks {
+private:
+    struct Ack {
+        uint64_t offset;
+        uint32_t status;
+    };
+
+    std::mutex mutex;
+    std::condition_variable arrived;
+    std::map<uint32_t, std::deque<Ack>> expected;
+
+public:
+    void expect(uint32_t transferId);
+    void forget(uint32_t transferId);
+    void post(const TransferFrame& ack);
+    bool wait(uint32_t transferId, int timeoutMs, uint64_t& offset, uint32_t& status);
+};
+
+// Same file (name, size, modification time) gives the same id, which is
+// what lets a resend resume
+uint32_t transferIdFor(const std::string& name, uint64_t size, int64_t modified);
+
+// Sends path as FILE_BEGIN, FILE_CHUNK..., FILE_END, resuming from wherever
+// the receiver says it got to and starting again after a RETRY. name is what
+// the receiver is told the file is called. With sendFromFile the file is
+// memory-mapped: checksums read the mapping and chunk data goes out through
+// sendFromFile, never through a read buffer. With a codec, chunks that
+// compress go out compressed through sendFrame instead; checksums are of
+// the original data.
+bool sendFileChunked(const std::string& path, const std::string& name, uint16_t sourceId,
+                     uint16_t targetId, const FrameSender& sendFrame, TransferAcks& acks,
+                     TransferReport& report, const FileFrameSender& sendFromFile = nullptr,
+                     Codec codec = CODEC_NONE);
+
+// Receiver side. Transfers are keyed by (source campus id, transfer id), so
+// several can be in flight at once. Data goes to received_<name>.part and
+// is renamed to received_<name> once its digest checks out.
+class FileReceiver {
+private:
+    struct Incoming {
+        std::fstream out;
+        TransferReport report;
+        std::string partPath;
+        std::string manifestPath;
+        uint64_t verified = 0;      // Bytes on disk that passed their CRC
+        bool damaged = false;       // Gap or bad CRC: ignore chunks until END
+        bool hashing = true;        // sha covers everything so far (not resumed)
+        Sha256 sha;
+        std::chrono::steady_clock::time_point started;
+    };
+
+    std::map<std::pair<uint16_t, uint32_t>, std::unique_ptr<Incoming>> transfers;
+    // Finished since startup, with where they were saved: a BEGIN for one
+    // whose file is still there (a sender that missed DONE) gets DONE again
+    std::map<std::pair<uint16_t, uint32_t>, std::string> completed;
+
+    Incoming* open(uint16_t sourceId, const std::string& source, uint32_t transferId,
+                   const std::string& name, uint64_t size, bool begin);
+    void saveManifest(const Incoming& incoming);
+    bool fileDigest(const std::string& path, uint8_t digest[SHA256_DIGEST_SIZE]);
+    void acknowledge(const FrameSender& reply, uint16_t sourceId, uint32_t transferId,
+                     uint64_t offset, TransferStatus status);
+
+public:
+    // Handles a FILE_BEGIN/CHUNK/END frame, answering through reply.
+    // Returns true when a transfer has just finished or failed; report then
+    // describes it.
+    bool handle(const Frame& frame, const CampusDirectory& directory, const FrameSender& reply,
+                TransferReport& report);
+};
+
+#endif // FILE_TRANSFER_H
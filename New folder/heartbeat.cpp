@@ -0,0 +1,45 @@
+#include "heartbeat.h"
+#include <cerrno>
+#include <cstring>
+
+bool parseHeartbeat(const char* data, size_t length, const char*& name, size_t& nameLength) {
+    if (length <= HEARTBEAT_PREFIX_LENGTH ||
+        memcmp(data, HEARTBEAT_PREFIX, HEARTBEAT_PREFIX_LENGTH) != 0) {
+        return false;
+    }
+
+    name = data + HEARTBEAT_PREFIX_LENGTH;
+    nameLength = length - HEARTBEAT_PREFIX_LENGTH;
+    while (nameLength > 0 && (name[nameLength - 1] == ' ' || name[nameLength - 1] == '\n' ||
+                              name[nameLength - 1] == '\r' || name[nameLength - 1] == '\t' ||
+                              name[nameLength - 1] == '\0')) {
+        nameLength--;
+    }
+    return nameLength > 0;
+}
+
+HeartbeatReceiver::HeartbeatReceiver() {
+    memset(messages, 0, sizeof(messages));
+    for (int i = 0; i < HEARTBEAT_BATCH; i++) {
+        parts[i].iov_base = buffers[i];
+        parts[i].iov_len = HEARTBEAT_DATAGRAM_SIZE;
+        messages[i].msg_hdr.msg_iov = &parts[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+    }
+}
+
+int HeartbeatReceiver::receive(int fd, bool wait) {
+    while (true) {
+        // The sender's address is not needed: the campus is named in the datagram
+        int received = recvmmsg(fd, messages, HEARTBEAT_BATCH,
+                                wait ? MSG_WAITFORONE : MSG_DONTWAIT, nullptr);
+        if (received >= 0) return received;
+        if (errno == EINTR) continue;
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+    }
+}
+
+size_t HeartbeatReceiver::length(int i) const {
+    if (messages[i].msg_hdr.msg_flags & MSG_TRUNC) return 0;
+    return messages[i].msg_len;
+}
@@ -0,0 +1,43 @@
+#ifndef HEARTBEAT_H
+#define HEARTBEAT_H
+
+#include <cstddef>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+// UDP heartbeats: "HEARTBEAT:<campus>", optionally followed by whitespace.
+// The receiver takes up to HEARTBEAT_BATCH datagrams per recvmmsg() into
+// fixed buffers, and the parser points into those buffers, so a batch is
+// handled without allocating.
+
+#define HEARTBEAT_PREFIX "HEARTBEAT:"
+#define HEARTBEAT_PREFIX_LENGTH 10
+#define HEARTBEAT_BATCH 64              // Datagrams per recvmmsg()
+#define HEARTBEAT_DATAGRAM_SIZE 128     // Longer datagrams are not heartbeats
+
+// Points name at the campus name inside data. False if data is not a
+// heartbeat.
+bool parseHeartbeat(const char* data, size_t length, const char*& name, size_t& nameLength);
+
+class HeartbeatReceiver {
+private:
+    struct mmsghdr messages[HEARTBEAT_BATCH];
+    struct iovec parts[HEARTBEAT_BATCH];
+    char buffers[HEARTBEAT_BATCH][HEARTBEAT_DATAGRAM_SIZE];
+
+public:
+    HeartbeatReceiver();
+    HeartbeatReceiver(const HeartbeatReceiver&) = delete;
+    HeartbeatReceiver& operator=(const HeartbeatReceiver&) = delete;
+
+    // One recvmmsg(). With wait, blocks until at least one datagram is
+    // there, then takes whatever else is queued. Returns the number
+    // received, 0 if none were waiting, or -1 on an error other than EINTR.
+    int receive(int fd, bool wait);
+
+    // Datagram i of the last batch; truncated ones report length 0
+    const char* data(int i) const { return buffers[i]; }
+    size_t length(int i) const;
+};
+
+#endif // HEARTBEAT_H
@@ -0,0 +1,311 @@
+#include "hex_codec.h"
+#include <cstring>
+#include <algorithm>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// ---- Scalar ----
+
+static const char hexDigits[] = "0123456789ABCDEF";
+
+// Digit value of each character, or -1
+struct HexValues {
+    int8_t value[256];
+
+    HexValues() {
+        memset(value, -1, sizeof(value));
+        for (int i = 0; i < 10; i++) value['0' + i] = i;
+        for (int i = 0; i < 6; i++) {
+            value['A' + i] = 10 + i;
+            value['a' + i] = 10 + i;
+        }
+    }
+};
+
+static const HexValues hexValues;
+
+void hexEncodeScalar(const void* data, size_t length, char* out) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < length; i++) {
+        out[2 * i] = hexDigits[p[i] >> 4];
+        out[2 * i + 1] = hexDigits[p[i] & 0x0F];
+    }
+}
+
+bool hexDecodeScalar(const char* hex, size_t length, void* out) {
+    if (length % 2 != 0) return false;
+    const uint8_t* in = reinterpret_cast<const uint8_t*>(hex);
+    uint8_t* q = static_cast<uint8_t*>(out);
+
+    // OR-ing the values together leaves the sign bit set if any was -1
+    int8_t bad = 0;
+    for (size_t i = 0; i < length / 2; i++) {
+        int8_t high = hexValues.value[in[2 * i]];
+        int8_t low = hexValues.value[in[2 * i + 1]];
+        bad |= high | low;
+        q[i] = (uint8_t)(((uint8_t)high << 4) | (low & 0x0F));
+    }
+    return bad >= 0;
+}
+
+#if defined(__x86_64__)
+
+// ---- SSE2 (baseline on x86-64) ----
+
+// Nibbles to ASCII: '0' + n, plus 7 more to skip from '9' to 'A'
+static inline __m128i nibblesToHex(__m128i nibbles) {
+    __m128i letters = _mm_and_si128(_mm_cmpgt_epi8(nibbles, _mm_set1_epi8(9)), _mm_set1_epi8(7));
+    return _mm_add_epi8(_mm_add_epi8(nibbles, _mm_set1_epi8('0')), letters);
+}
+
+void hexEncodeSse2(const void* data, size_t length, char* out) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    const __m128i mask = _mm_set1_epi8(0x0F);
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        __m128i high = nibblesToHex(_mm_and_si128(_mm_srli_epi16(in, 4), mask));
+        __m128i low = nibblesToHex(_mm_and_si128(in, mask));
+        // Interleave: byte k becomes high[k], low[k]
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * i), _mm_unpacklo_epi8(high, low));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * i + 16),
+                         _mm_unpackhi_epi8(high, low));
+    }
+    hexEncodeScalar(p + i, length - i, out + 2 * i);
+}
+
+// Digit values of 16 characters; valid gets 0xFF where the character is a
+// hex digit. Unsigned "x <= limit" is min(x, limit) == x.
+static inline __m128i hexToNibbles(__m128i chars, __m128i& valid) {
+    __m128i digit = _mm_sub_epi8(chars, _mm_set1_epi8('0'));
+    __m128i letter = _mm_sub_epi8(_mm_or_si128(chars, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+    __m128i isDigit = _mm_cmpeq_epi8(_mm_min_epu8(digit, _mm_set1_epi8(9)), digit);
+    __m128i isLetter = _mm_cmpeq_epi8(_mm_min_epu8(letter, _mm_set1_epi8(5)), letter);
+    valid = _mm_or_si128(isDigit, isLetter);
+    return _mm_or_si128(_mm_and_si128(digit, isDigit),
+                        _mm_and_si128(_mm_add_epi8(letter, _mm_set1_epi8(10)), isLetter));
+}
+
+// Each 16-bit lane holds a pair: high digit in its low byte (it came
+// first), low digit in its high byte. Leaves the byte in the low byte.
+static inline __m128i joinPairs(__m128i nibbles) {
+    __m128i high = _mm_and_si128(nibbles, _mm_set1_epi16(0x00FF));
+    __m128i low = _mm_srli_epi16(nibbles, 8);
+    return _mm_or_si128(_mm_slli_epi16(high, 4), low);
+}
+
+bool hexDecodeSse2(const char* hex, size_t length, void* out) {
+    if (length % 2 != 0) return false;
+    uint8_t* q = static_cast<uint8_t*>(out);
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m128i valid0, valid1;
+        __m128i first = hexToNibbles(_mm_loadu_si128(reinterpret_cast<const __m128i*>(hex + i)),
+                                     valid0);
+        __m128i second = hexToNibbles(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(hex + i + 16)), valid1);
+        if (_mm_movemask_epi8(_mm_and_si128(valid0, valid1)) != 0xFFFF) return false;
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(q + i / 2),
+                         _mm_packus_epi16(joinPairs(first), joinPairs(second)));
+    }
+    return hexDecodeScalar(hex + i, length - i, q + i / 2);
+}
+
+bool hexSse2Available() {
+    return true;
+}
+
+// ---- AVX2 ----
+//
+// The same steps on 32 bytes. Unpack and pack work within each 128-bit
+// half, so results are put back in order with a cross-lane permute.
+
+__attribute__((target("avx2")))
+static inline __m256i nibblesToHex256(__m256i nibbles) {
+    __m256i letters = _mm256_and_si256(_mm256_cmpgt_epi8(nibbles, _mm256_set1_epi8(9)),
+                                       _mm256_set1_epi8(7));
+    return _mm256_add_epi8(_mm256_add_epi8(nibbles, _mm256_set1_epi8('0')), letters);
+}
+
+__attribute__((target("avx2")))
+void hexEncodeAvx2(const void* data, size_t length, char* out) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    const __m256i mask = _mm256_set1_epi8(0x0F);
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i in = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+        __m256i high = nibblesToHex256(_mm256_and_si256(_mm256_srli_epi16(in, 4), mask));
+        __m256i low = nibblesToHex256(_mm256_and_si256(in, mask));
+        // lo holds bytes 0-7 and 16-23, hi bytes 8-15 and 24-31
+        __m256i lo = _mm256_unpacklo_epi8(high, low);
+        __m256i hi = _mm256_unpackhi_epi8(high, low);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 2 * i),
+                            _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 2 * i + 32),
+                            _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+    hexEncodeSse2(p + i, length - i, out + 2 * i);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i hexToNibbles256(__m256i chars, __m256i& valid) {
+    __m256i digit = _mm256_sub_epi8(chars, _mm256_set1_epi8('0'));
+    __m256i letter = _mm256_sub_epi8(_mm256_or_si256(chars, _mm256_set1_epi8(0x20)),
+                                     _mm256_set1_epi8('a'));
+    __m256i isDigit = _mm256_cmpeq_epi8(_mm256_min_epu8(digit, _mm256_set1_epi8(9)), digit);
+    __m256i isLetter = _mm256_cmpeq_epi8(_mm256_min_epu8(letter, _mm256_set1_epi8(5)), letter);
+    valid = _mm256_or_si256(isDigit, isLetter);
+    return _mm256_or_si256(_mm256_and_si256(digit, isDigit),
+                           _mm256_and_si256(_mm256_add_epi8(letter, _mm256_set1_epi8(10)),
+                                            isLetter));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i joinPairs256(__m256i nibbles) {
+    __m256i high = _mm256_and_si256(nibbles, _mm256_set1_epi16(0x00FF));
+    __m256i low = _mm256_srli_epi16(nibbles, 8);
+    return _mm256_or_si256(_mm256_slli_epi16(high, 4), low);
+}
+
+__attribute__((target("avx2")))
+bool hexDecodeAvx2(const char* hex, size_t length, void* out) {
+    if (length % 2 != 0) return false;
+    uint8_t* q = static_cast<uint8_t*>(out);
+    size_t i = 0;
+    for (; i + 64 <= length; i += 64) {
+        __m256i valid0, valid1;
+        __m256i first = hexToNibbles256(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(hex + i)), valid0);
+        __m256i second = hexToNibbles256(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(hex + i + 32)), valid1);
+        if (_mm256_movemask_epi8(_mm256_and_si256(valid0, valid1)) != -1) return false;
+        // Pack gives first.lo, second.lo, first.hi, second.hi in 64-bit units
+        __m256i packed = _mm256_packus_epi16(joinPairs256(first), joinPairs256(second));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(q + i / 2),
+                            _mm256_permute4x64_epi64(packed, 0xD8));
+    }
+    return hexDecodeSse2(hex + i, length - i, q + i / 2);
+}
+
+bool hexAvx2Available() {
+    return __builtin_cpu_supports("avx2");
+}
+
+#else
+
+void hexEncodeSse2(const void* data, size_t length, char* out) {
+    hexEncodeScalar(data, length, out);
+}
+
+void hexEncodeAvx2(const void* data, size_t length, char* out) {
+    hexEncodeScalar(data, length, out);
+}
+
+bool hexDecodeSse2(const char* hex, size_t length, void* out) {
+    return hexDecodeScalar(hex, length, out);
+}
+
+bool hexDecodeAvx2(const char* hex, size_t length, void* out) {
+    return hexDecodeScalar(hex, length, out);
+}
+
+bool hexSse2Available() {
+    return false;
+}
+
+bool hexAvx2Available() {
+    return false;
+}
+
+#endif
+
+// ---- Dispatch ----
+
+typedef void (*HexEncodeFunction)(const void*, size_t, char*);
+typedef bool (*HexDecodeFunction)(const char*, size_t, void*);
+
+static const HexEncodeFunction hexEncodeImpl =
+    hexAvx2Available() ? hexEncodeAvx2 : hexSse2Available() ? hexEncodeSse2 : hexEncodeScalar;
+static const HexDecodeFunction hexDecodeImpl =
+    hexAvx2Available() ? hexDecodeAvx2 : hexSse2Available() ? hexDecodeSse2 : hexDecodeScalar;
+
+const char* hexKernelName() {
+    return hexAvx2Available() ? "avx2" : hexSse2Available() ? "sse2" : "scalar";
+}
+
+void hexEncode(const void* data, size_t length, char* out) {
+    hexEncodeImpl(data, length, out);
+}
+
+std::string hexEncode(const void* data, size_t length) {
+    std::string out(2 * length, '\0');
+    hexEncodeImpl(data, length, &out[0]);
+    return out;
+}
+
+bool hexDecode(const char* hex, size_t length, void* out) {
+    return hexDecodeImpl(hex, length, out);
+}
+
+bool hexDecode(const char* hex, size_t length, std::string& out) {
+    out.resize(length / 2);
+    return hexDecodeImpl(hex, length, &out[0]);
+}
+
+// ---- Streaming ----
+
+HexEncoder::HexEncoder(const HexSink& sink) : sink(sink), block(2 * HEX_BLOCK_SIZE) {
+}
+
+bool HexEncoder::update(const void* data, size_t length) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    while (length > 0) {
+        size_t piece = std::min<size_t>(length, HEX_BLOCK_SIZE);
+        hexEncodeImpl(p, piece, block.data());
+        if (!sink(block.data(), 2 * piece)) return false;
+        p += piece;
+        length -= piece;
+    }
+    return true;
+}
+
+HexDecoder::HexDecoder(const HexSink& sink)
+    : sink(sink), block(HEX_BLOCK_SIZE), carry(0), carrying(false), failed(false) {
+}
+
+bool HexDecoder::update(const char* hex, size_t length) {
+    if (failed) return false;
+    if (length == 0) return true;
+
+    if (carrying) {
+        char pair[2] = {carry, hex[0]};
+        if (!hexDecodeImpl(pair, 2, block.data()) || !sink(block.data(), 1)) {
+            failed = true;
+            return false;
+        }
+        carrying = false;
+        hex++;
+        length--;
+    }
+
+    while (length >= 2) {
+        size_t piece = std::min<size_t>(length & ~(size_t)1, 2 * HEX_BLOCK_SIZE);
+        if (!hexDecodeImpl(hex, piece, block.data()) || !sink(block.data(), piece / 2)) {
+            failed = true;
+            return false;
+        }
+        hex += piece;
+        length -= piece;
+    }
+
+    if (length == 1) {
+        carry = hex[0];
+        carrying = true;
+    }
+    return true;
+}
+
+bool HexDecoder::finish() {
+    return !failed && !carrying;
+}
@@ -0,0 +1,70 @@
+#ifndef HEX_CODEC_H
+#define HEX_CODEC_H
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+
+// Hex encoding for the text protocol's FILE message ("...|DATA:<hex>").
+// Encoding writes uppercase digits, as text clients always have; decoding
+// accepts either case. The AVX2 kernels are used when the CPU has them,
+// checked once at startup, then SSE2 on x86-64 and a table elsewhere.
+
+#define HEX_BLOCK_SIZE (64 * 1024)  // Bytes per block in the streaming classes
+
+// Writes 2 * length characters to out
+void hexEncode(const void* data, size_t length, char* out);
+std::string hexEncode(const void* data, size_t length);
+
+// Decodes length characters (an even number) into length / 2 bytes at out.
+// Returns false on an odd length or a character that is not a hex digit;
+// out is then partly written.
+bool hexDecode(const char* hex, size_t length, void* out);
+bool hexDecode(const char* hex, size_t length, std::string& out);
+
+// The implementations, for benchmarks and tests
+void hexEncodeScalar(const void* data, size_t length, char* out);
+void hexEncodeSse2(const void* data, size_t length, char* out);
+void hexEncodeAvx2(const void* data, size_t length, char* out);
+bool hexDecodeScalar(const char* hex, size_t length, void* out);
+bool hexDecodeSse2(const char* hex, size_t length, void* out);
+bool hexDecodeAvx2(const char* hex, size_t length, void* out);
+bool hexSse2Available();
+bool hexAvx2Available();
+const char* hexKernelName();        // "avx2", "sse2" or "scalar"
+
+// Receives output a block at a time; returns false to stop
+typedef std::function<bool(const char* data, size_t length)> HexSink;
+
+// Encodes a stream fed in pieces of any size, handing the sink at most
+// 2 * HEX_BLOCK_SIZE characters at a time from a fixed buffer
+class HexEncoder {
+private:
+    HexSink sink;
+    std::vector<char> block;
+
+public:
+    explicit HexEncoder(const HexSink& sink);
+    bool update(const void* data, size_t length);  // False if the sink stopped
+};
+
+// Decodes a stream of hex fed in pieces of any size (a digit pair may be
+// split between pieces), handing the sink at most HEX_BLOCK_SIZE bytes at a
+// time from a fixed buffer
+class HexDecoder {
+private:
+    HexSink sink;
+    std::vector<char> block;
+    char carry;                 // First digit of a pair split between updates
+    bool carrying;
+    bool failed;
+
+public:
+    explicit HexDecoder(const HexSink& sink);
+    bool update(const char* hex, size_t length);   // False on a bad digit or a stopped sink
+    bool finish();              // False if a digit is left over or an update failed
+};
+
+#endif // HEX_CODEC_H
@@ -0,0 +1,526 @@
+#include "journal.h"
+#include <stdexcept>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+
+static void putU16(char* out, uint16_t value) {
+    uint16_t n = htons(value);
+    memcpy(out, &n, 2);
+}
+
+static void putU32(char* out, uint32_t value) {
+    uint32_t n = htonl(value);
+    memcpy(out, &n, 4);
+}
+
+static uint16_t getU16(const char* in) {
+    uint16_t n;
+    memcpy(&n, in, 2);
+    return ntohs(n);
+}
+
+static uint32_t getU32(const char* in) {
+    uint32_t n;
+    memcpy(&n, in, 4);
+    return ntohl(n);
+}
+
+static std::string systemError(const std::string& what, const std::string& path) {
+    return what + " " + path + ": " + strerror(errno);
+}
+
+static void makeDirectory(const std::string& path) {
+    if (mkdir(path.c_str(), 0700) < 0 && errno != EEXIST) {
+        throw std::runtime_error(systemError("Cannot create journal directory", path));
+    }
+}
+
+static void syncDirectory(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+}
+
+JournalSegment::~JournalSegment() {
+    if (data) {
+        munmap(data, capacity);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+size_t JournalSegment::consumed() const {
+    uint64_t offset;
+    memcpy(&offset, data + 8, 8);
+    return (size_t)offset;
+}
+
+void JournalSegment::setConsumed(size_t offset) {
+    uint64_t value = offset;
+    memcpy(data + 8, &value, 8);
+    consumedDirty = true;
+}
+
+Journal::Journal(const std::string& directory, uint64_t campusLimit)
+    : root(directory), campusLimit(campusLimit) {
+}
+
+Journal::~Journal() {
+    stop();
+}
+
+CampusJournal* Journal::find(uint16_t campusId) const {
+    const std::atomic<CampusJournal*>* slot = campuses.find(campusId);
+    return slot ? slot->load(std::memory_order_acquire) : nullptr;
+}
+
+std::shared_ptr<JournalSegment> Journal::openSegment(const std::string& path, uint64_t sequence) {
+    auto segment = std::make_shared<JournalSegment>();
+    segment->path = path;
+    segment->sequence = sequence;
+
+    segment->fd = ::open(path.c_str(), O_RDWR);
+    if (segment->fd < 0) {
+        throw std::runtime_error(systemError("Cannot open journal segment", path));
+    }
+
+    struct stat info;
+    if (fstat(segment->fd, &info) < 0 || (size_t)info.st_size < JOURNAL_SEGMENT_HEADER) {
+        throw std::runtime_error("Journal segment too short: " + path);
+    }
+    segment->capacity = info.st_size;
+
+    void* mapped = mmap(nullptr, segment->capacity, PROT_READ | PROT_WRITE, MAP_SHARED,
+                        segment->fd, 0);
+    if (mapped == MAP_FAILED) {
+        throw std::runtime_error(systemError("Cannot map journal segment", path));
+    }
+    segment->data = static_cast<char*>(mapped);
+
+    if (getU32(segment->data) != JOURNAL_SEGMENT_MAGIC) {
+        throw std::runtime_error("Not a journal segment: " + path);
+    }
+    return segment;
+}
+
+std::shared_ptr<JournalSegment> Journal::createSegment(CampusJournal& journal, size_t minimum) {
+    uint64_t sequence = journal.nextSequence++;
+    char name[32];
+    snprintf(name, sizeof(name), "/%020llu.seg", (unsigned long long)sequence);
+
+    auto segment = std::make_shared<JournalSegment>();
+    segment->path = journal.directory + name;
+    segment->sequence = sequence;
+    segment->capacity = std::max((size_t)JOURNAL_SEGMENT_SIZE, minimum + JOURNAL_SEGMENT_HEADER);
+
+    segment->fd = ::open(segment->path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (segment->fd < 0) {
+        throw std::runtime_error(systemError("Cannot create journal segment", segment->path));
+    }
+
+    // Reserve the blocks now: running out of disk under a mapping is SIGBUS
+    int error = posix_fallocate(segment->fd, 0, segment->capacity);
+    if (error != 0) {
+        errno = error;
+        unlink(segment->path.c_str());
+        throw std::runtime_error(systemError("Cannot allocate journal segment", segment->path));
+    }
+
+    void* mapped = mmap(nullptr, segment->capacity, PROT_READ | PROT_WRITE, MAP_SHARED,
+                        segment->fd, 0);
+    if (mapped == MAP_FAILED) {
+        unlink(segment->path.c_str());
+        throw std::runtime_error(systemError("Cannot map journal segment", segment->path));
+    }
+    segment->data = static_cast<char*>(mapped);
+
+    putU32(segment->data, JOURNAL_SEGMENT_MAGIC);
+    putU32(segment->data + 4, 0);
+    segment->setConsumed(JOURNAL_SEGMENT_HEADER);
+    syncDirectory(journal.directory);
+    return segment;
+}
+
+// Parses the record at offset. Returns false at the end of the written
+// data (zeroed space or a record that runs past the segment).
+bool Journal::readRecord(const JournalSegment& segment, size_t offset, JournalRecord& record,
+                         size_t& next) const {
+    if (offset + JOURNAL_RECORD_HEADER > segment.capacity) return false;
+
+    const char* header = segment.data + offset;
+    if (getU16(header) != JOURNAL_RECORD_MAGIC) return false;
+
+    size_t sourceLength = getU16(header + 4);
+    size_t deptLength = getU16(header + 6);
+    size_t bodyLength = getU32(header + 8);
+    size_t end = offset + JOURNAL_RECORD_HEADER + sourceLength + deptLength + bodyLength;
+    if (end > segment.capacity) return false;
+
+    const char* fields = header + JOURNAL_RECORD_HEADER;
+    record.type = (FrameType)(uint8_t)header[2];
+    record.sourceCampus.assign(fields, sourceLength);
+    record.department.assign(fields + sourceLength, deptLength);
+    record.body = fields + sourceLength + deptLength;
+    record.bodyLength = bodyLength;
+    record.nextOffset = end;
+    next = end;
+    return true;
+}
+
+void Journal::open(uint16_t campusId, const std::string& campusName) {
+    if (campusId == 0 || campusId > MAX_CAMPUS_ID) {
+        throw std::runtime_error("Journal has no slot for campus id " + std::to_string(campusId));
+    }
+    std::lock_guard<std::mutex> lock(openMutex);
+    if (find(campusId)) return;
+
+    makeDirectory(root);
+
+    auto journal = std::make_unique<CampusJournal>();
+    journal->campusName = campusName;
+    journal->directory = root + "/" + campusName;
+    makeDirectory(journal->directory);
+
+    // Recover segments left by a previous run, oldest first
+    std::vector<uint64_t> sequences;
+    DIR* dir = opendir(journal->directory.c_str());
+    if (!dir) {
+        throw std::runtime_error(systemError("Cannot read journal directory", journal->directory));
+    }
+    while (struct dirent* entry = readdir(dir)) {
+        const char* dot = strstr(entry->d_name, ".seg");
+        if (dot && dot[4] == '\0') {
+            sequences.push_back(strtoull(entry->d_name, nullptr, 10));
+        }
+    }
+    closedir(dir);
+    std::sort(sequences.begin(), sequences.end());
+
+    for (uint64_t sequence : sequences) {
+        char name[32];
+        snprintf(name, sizeof(name), "/%020llu.seg", (unsigned long long)sequence);
+        auto segment = openSegment(journal->directory + name, sequence);
+
+        // The first offset that does not parse is the end of the data
+        JournalRecord record;
+        size_t offset = JOURNAL_SEGMENT_HEADER;
+        size_t next;
+        while (readRecord(*segment, offset, record, next)) {
+            if (offset >= segment->consumed()) {
+                journal->records++;
+                journal->bytes += next - offset;
+            }
+            offset = next;
+        }
+        segment->writeOffset = offset;
+        segment->syncedOffset = offset;
+        segment->consumedDirty = false;
+
+        journal->segments.push_back(segment);
+        journal->nextSequence = sequence + 1;
+    }
+
+    dropConsumedSegments(*journal);
+    journal->pending = journal->records > 0;
+    journal->observer = observer;
+    campuses.at(campusId).store(journal.get(), std::memory_order_release);
+    opened.push_back(std::move(journal));
+}
+
+void Journal::start() {
+    if (!running.exchange(true)) {
+        commitThread = std::thread(&Journal::runCommits, this);
+    }
+}
+
+void Journal::stop() {
+    if (running.exchange(false) && commitThread.joinable()) {
+        commitThread.join();
+    }
+}
+
+bool Journal::pending(uint16_t campusId) const {
+    CampusJournal* journal = find(campusId);
+    return journal && journal->pending.load(std::memory_order_acquire);
+}
+
+JournalAppend Journal::append(uint16_t campusId, FrameType type, const std::string& sourceCampus,
+                              const std::string& department, const char* body, size_t bodyLength,
+                              bool onlyIfPending) {
+    CampusJournal* journal = find(campusId);
+    if (!journal) {
+        throw std::runtime_error("No journal for campus id " + std::to_string(campusId));
+    }
+
+    size_t size = JOURNAL_RECORD_HEADER + sourceCampus.size() + department.size() + bodyLength;
+
+    std::lock_guard<std::mutex> lock(journal->mutex);
+    if (onlyIfPending && !journal->pending.load(std::memory_order_relaxed)) {
+        return JournalAppend::NOT_PENDING;
+    }
+    if (campusLimit > 0 && journal->bytes.load(std::memory_order_relaxed) + size > campusLimit) {
+        journal->rejected++;
+        return JournalAppend::FULL;
+    }
+
+    if (journal->segments.empty() ||
+        journal->segments.back()->writeOffset + size > journal->segments.back()->capacity) {
+        journal->segments.push_back(createSegment(*journal, size));
+    }
+    JournalSegment& segment = *journal->segments.back();
+
+    char* out = segment.data + segment.writeOffset;
+    out[2] = (char)type;
+    out[3] = 0;
+    putU16(out + 4, (uint16_t)sourceCampus.size());
+    putU16(out + 6, (uint16_t)department.size());
+    putU32(out + 8, (uint32_t)bodyLength);
+    char* fields = out + JOURNAL_RECORD_HEADER;
+    memcpy(fields, sourceCampus.data(), sourceCampus.size());
+    memcpy(fields + sourceCampus.size(), department.data(), department.size());
+    memcpy(fields + sourceCampus.size() + department.size(), body, bodyLength);
+    putU16(out, JOURNAL_RECORD_MAGIC);     // Last, so a torn append reads as the end
+
+    segment.writeOffset += size;
+    journal->records++;
+    journal->bytes += size;
+    journal->pending.store(true, std::memory_order_release);
+
+    if (journal->observer) {
+        JournalRecord record{type, sourceCampus, department,
+                             fields + sourceCampus.size() + department.size(), bodyLength,
+                             segment.writeOffset};
+        journal->observer->appended(campusId, record);
+    }
+    return JournalAppend::STORED;
+}
+
+// Compaction: a segment whose records have all been delivered is deleted.
+// Caller holds the journal mutex.
+void Journal::dropConsumedSegments(CampusJournal& journal) {
+    while (!journal.segments.empty()) {
+        JournalSegment& front = *journal.segments.front();
+        if (front.consumed() < front.writeOffset) break;
+
+        unlink(front.path.c_str());
+        journal.segments.pop_front();
+    }
+}
+
+bool Journal::beginReplay(uint16_t campusId) {
+    CampusJournal* journal = find(campusId);
+    if (!journal) return false;
+
+    std::lock_guard<std::mutex> lock(journal->mutex);
+    if (journal->replaying || !journal->pending.load(std::memory_order_relaxed)) {
+        return false;
+    }
+    journal->replaying = true;
+    return true;
+}
+
+bool Journal::next(uint16_t campusId, JournalRecord& record,
+                   std::shared_ptr<JournalSegment>& holder) {
+    CampusJournal* journal = find(campusId);
+    if (!journal) return false;
+
+    std::lock_guard<std::mutex> lock(journal->mutex);
+    dropConsumedSegments(*journal);
+
+    size_t next;
+    while (!journal->segments.empty()) {
+        holder = journal->segments.front();
+        if (readRecord(*holder, holder->consumed(), record, next)) {
+            return true;
+        }
+        // Unreadable tail (torn write before a crash): skip the segment
+        holder->setConsumed(holder->writeOffset);
+        dropConsumedSegments(*journal);
+    }
+
+    // Drained; pending is cleared by finishReplay()
+    holder.reset();
+    journal->records = 0;
+    journal->bytes = 0;
+    journal->replaying = false;
+    return false;
+}
+
+void Journal::consume(uint16_t campusId, const JournalRecord& record) {
+    CampusJournal* journal = find(campusId);
+    if (!journal) return;
+
+    std::lock_guard<std::mutex> lock(journal->mutex);
+    if (journal->segments.empty()) return;
+
+    JournalSegment& front = *journal->segments.front();
+    size_t size = record.nextOffset - front.consumed();
+    front.setConsumed(record.nextOffset);
+    journal->records -= std::min<uint64_t>(1, journal->records);
+    journal->bytes -= std::min<uint64_t>(size, journal->bytes);
+
+    if (journal->observer) {
+        journal->observer->consumed(campusId);
+    }
+}
+
+bool Journal::finishReplay(uint16_t campusId) {
+    CampusJournal* journal = find(campusId);
+    if (!journal) return true;
+
+    std::lock_guard<std::mutex> lock(journal->mutex);
+    if (journal->replaying) {
+        return true;    // Another replay picked up the new records
+    }
+    dropConsumedSegments(*journal);
+    if (!journal->segments.empty()) {
+        return false;
+    }
+    // New messages go straight to the campus again
+    journal->pending.store(false, std::memory_order_release);
+    return true;
+}
+
+void Journal::abortReplay(uint16_t campusId) {
+    CampusJournal* journal = find(campusId);
+    if (!journal) return;
+
+    std::lock_guard<std::mutex> lock(journal->mutex);
+    journal->replaying = false;
+}
+
+void Journal::observe(const JournalObserver* observer) {
+    // Held throughout, so a campus opened meanwhile starts with this observer
+    std::lock_guard<std::mutex> openLock(openMutex);
+    this->observer = observer;
+
+    for (size_t campusId = 0; campusId < campuses.size(); campusId++) {
+        CampusJournal* entry = find(campusId);
+        if (!entry) continue;
+        CampusJournal& journal = *entry;
+        std::lock_guard<std::mutex> lock(journal.mutex);
+
+        // Under the same lock as the switch, so nothing is reported twice
+        // or missed
+        if (observer) {
+            for (const auto& segment : journal.segments) {
+                JournalRecord record;
+                size_t offset = segment->consumed();
+                size_t next;
+                while (offset < segment->writeOffset &&
+                       readRecord(*segment, offset, record, next)) {
+                    observer->appended(campusId, record);
+                    offset = next;
+                }
+            }
+        }
+        journal.observer = observer;
+    }
+}
+
+void Journal::discard(uint16_t campusId) {
+    CampusJournal* journal = find(campusId);
+    if (!journal) return;
+
+    std::lock_guard<std::mutex> lock(journal->mutex);
+    dropConsumedSegments(*journal);
+    while (!journal->segments.empty()) {
+        JournalSegment& front = *journal->segments.front();
+        JournalRecord record;
+        size_t next;
+        if (readRecord(front, front.consumed(), record, next)) {
+            journal->bytes -= std::min<uint64_t>(next - front.consumed(), journal->bytes);
+            journal->records -= std::min<uint64_t>(1, journal->records);
+            front.setConsumed(next);
+            break;
+        }
+        front.setConsumed(front.writeOffset);
+        dropConsumedSegments(*journal);
+    }
+
+    dropConsumedSegments(*journal);
+    if (journal->segments.empty() && !journal->replaying) {
+        journal->records = 0;
+        journal->bytes = 0;
+        journal->pending.store(false, std::memory_order_release);
+    }
+}
+
+void Journal::clear(uint16_t campusId) {
+    CampusJournal* journal = find(campusId);
+    if (!journal) return;
+
+    std::lock_guard<std::mutex> lock(journal->mutex);
+    for (const auto& segment : journal->segments) {
+        segment->setConsumed(segment->writeOffset);
+    }
+    dropConsumedSegments(*journal);
+    journal->records = 0;
+    journal->bytes = 0;
+    journal->pending.store(false, std::memory_order_release);
+}
+
+void Journal::recordReplay(uint16_t campusId, uint64_t records, uint64_t bytes, uint64_t micros) {
+    CampusJournal* journal = find(campusId);
+    if (!journal) return;
+
+    journal->replayedRecords = records;
+    journal->replayedBytes = bytes;
+    journal->replayMicros = micros;
+}
+
+// Group commit: everything appended (and every replay position advanced)
+// during one interval becomes durable with one msync per dirty segment
+void Journal::runCommits() {
+    struct Pending {
+        std::shared_ptr<JournalSegment> segment;
+        size_t from;
+        size_t to;
+    };
+
+    long pageSize = sysconf(_SC_PAGESIZE);
+    std::vector<Pending> batch;
+
+    while (running.load(std::memory_order_acquire)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(JOURNAL_COMMIT_INTERVAL_MS));
+
+        for (size_t campusId = 0; campusId < campuses.size(); campusId++) {
+            CampusJournal* entry = find(campusId);
+            if (!entry) continue;
+            CampusJournal& journal = *entry;
+            batch.clear();
+            {
+                std::lock_guard<std::mutex> lock(journal.mutex);
+                for (const auto& segment : journal.segments) {
+                    if (segment->writeOffset > segment->syncedOffset) {
+                        batch.push_back({segment, segment->syncedOffset, segment->writeOffset});
+                        segment->syncedOffset = segment->writeOffset;
+                    }
+                    if (segment->consumedDirty) {
+                        batch.push_back({segment, 0, JOURNAL_SEGMENT_HEADER});
+                        segment->consumedDirty = false;
+                    }
+                }
+            }
+
+            for (const Pending& range : batch) {
+                size_t start = range.from & ~(size_t)(pageSize - 1);
+                msync(range.segment->data + start, range.to - start, MS_SYNC);
+            }
+            if (!batch.empty()) {
+                commits++;
+            }
+        }
+    }
+}
@@ -0,0 +1,167 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+#include "protocol.h"
+#include "campus_table.h"
+
+#define JOURNAL_SEGMENT_SIZE (8 * 1024 * 1024)  // Larger records get a segment of their own
+#define JOURNAL_COMMIT_INTERVAL_MS 10           // Group commit: one sync per campus per interval
+#define JOURNAL_SEGMENT_MAGIC 0x4E554A31        // "NUJ1"
+#define JOURNAL_RECORD_MAGIC 0x4A52             // "JR"
+#define JOURNAL_SEGMENT_HEADER 16               // magic u32 | reserved u32 | consumed u64
+#define JOURNAL_RECORD_HEADER 12                // magic u16 | type u8 | pad u8 | source u16 | dept u16 | body u32
+#define JOURNAL_CAMPUS_LIMIT (256ULL * 1024 * 1024)     // Default undelivered bytes kept per campus
+
+// A stored message as read back from a segment. The pointers reference the
+// mapped segment and stay valid while the caller holds the segment.
+struct JournalRecord {
+    FrameType type;
+    std::string sourceCampus;
+    std::string department;
+    const char* body;
+    size_t bodyLength;
+    size_t nextOffset;      // Where the following record starts
+};
+
+// Replication hooks (see replication.h). Called under the campus's lock, so
+// appends and consumes are seen in journal order; they must not call back
+// into the journal.
+struct JournalObserver {
+    std::function<void(uint16_t campusId, const JournalRecord& record)> appended;
+    std::function<void(uint16_t campusId)> consumed;    // The oldest record was delivered
+};
+
+// One memory-mapped, append-only segment file. Records are written in
+// place; the header's consumed offset records replay progress so delivered
+// records are not sent again after a restart.
+struct JournalSegment {
+    std::string path;
+    int fd = -1;
+    char* data = nullptr;
+    size_t capacity = 0;
+    size_t writeOffset = JOURNAL_SEGMENT_HEADER;
+    size_t syncedOffset = 0;        // Bytes made durable by the last commit
+    bool consumedDirty = false;     // Header changed since the last commit
+    uint64_t sequence = 0;
+
+    ~JournalSegment();
+    size_t consumed() const;
+    void setConsumed(size_t offset);
+};
+
+// Per-campus journal state
+struct CampusJournal {
+    std::string campusName;
+    std::string directory;
+    std::mutex mutex;
+    std::deque<std::shared_ptr<JournalSegment>> segments;   // Oldest first
+    uint64_t nextSequence = 1;
+    bool replaying = false;
+    std::atomic<bool> pending{false};   // Undelivered records exist
+    std::atomic<uint64_t> records{0};   // Depth
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> rejected{0};  // Records refused at the limit
+    const JournalObserver* observer = nullptr;
+
+    // Last completed replay
+    std::atomic<uint64_t> replayedRecords{0};
+    std::atomic<uint64_t> replayedBytes{0};
+    std::atomic<uint64_t> replayMicros{0};
+};
+
+// What append() did with a record
+enum class JournalAppend {
+    STORED,
+    NOT_PENDING,    // onlyIfPending, and the campus had nothing undelivered
+    FULL            // The campus already holds its limit of undelivered bytes
+};
+
+// Store-and-forward journal for campuses that are offline. Messages for an
+// offline campus are appended to its segments; a commit thread syncs
+// everything appended in the last interval with one msync per campus
+// rather than one per message. When the campus comes back its records are
+// replayed in order, and segments are deleted as soon as they have been
+// fully delivered. Each campus may hold at most campusLimit undelivered
+// bytes, so one that never returns cannot fill the disk.
+//
+// Delivery is at-least-once: a crash between sending a record and the
+// next commit of the consumed offset replays that record again.
+class Journal {
+private:
+    std::string root;
+    CampusTable<std::atomic<CampusJournal*>> campuses;  // Indexed by campus id
+    std::vector<std::unique_ptr<CampusJournal>> opened;
+    std::mutex openMutex;               // open() and observe()
+    const JournalObserver* observer = nullptr;
+    std::atomic<bool> running{false};
+    std::thread commitThread;
+    std::atomic<uint64_t> commits{0};
+    uint64_t campusLimit;               // 0: no limit
+
+    CampusJournal* find(uint16_t campusId) const;
+    std::shared_ptr<JournalSegment> createSegment(CampusJournal& journal, size_t minimum);
+    std::shared_ptr<JournalSegment> openSegment(const std::string& path, uint64_t sequence);
+    bool readRecord(const JournalSegment& segment, size_t offset, JournalRecord& record,
+                    size_t& next) const;
+    void dropConsumedSegments(CampusJournal& journal);
+    void runCommits();
+
+public:
+    explicit Journal(const std::string& directory, uint64_t campusLimit = JOURNAL_CAMPUS_LIMIT);
+    ~Journal();
+
+    // Recovers the campus's existing segments. Safe while the journal runs;
+    // a campus already open is left as it is. Throws std::runtime_error on
+    // I/O errors or an id outside 1..MAX_CAMPUS_ID.
+    void open(uint16_t campusId, const std::string& campusName);
+    void start();
+    void stop();
+
+    bool pending(uint16_t campusId) const;
+
+    // Appends a record. With onlyIfPending, appends only while the campus
+    // still has undelivered records (so new messages queue behind a replay).
+    // A record that would take the campus past its limit is refused and
+    // counted. Throws std::runtime_error on I/O errors.
+    JournalAppend append(uint16_t campusId, FrameType type, const std::string& sourceCampus,
+                const std::string& department, const char* body, size_t bodyLength,
+                bool onlyIfPending = false);
+
+    // Replay, driven by one thread per campus at a time. beginReplay()
+    // returns false if there is nothing to replay or a replay is running.
+    // next() returns false once the journal is empty, which also ends the
+    // replay; holder keeps the record's memory mapped. The campus stays
+    // pending (new messages keep queueing) until finishReplay(), which
+    // returns false if more arrived meanwhile and another replay is needed.
+    bool beginReplay(uint16_t campusId);
+    bool next(uint16_t campusId, JournalRecord& record, std::shared_ptr<JournalSegment>& holder);
+    void consume(uint16_t campusId, const JournalRecord& record);
+    bool finishReplay(uint16_t campusId);
+    void abortReplay(uint16_t campusId);
+    void recordReplay(uint16_t campusId, uint64_t records, uint64_t bytes, uint64_t micros);
+
+    // Replication. observe() hands the observer every undelivered record,
+    // as if just appended, then reports appends and consumes as they
+    // happen; nullptr stops it. A standby mirrors the primary with
+    // discard() (drops the oldest record) and clear().
+    void observe(const JournalObserver* observer);
+    void discard(uint16_t campusId);
+    void clear(uint16_t campusId);
+
+    const CampusJournal* stats(uint16_t campusId) const { return find(campusId); }
+    uint64_t commitCount() const { return commits.load(); }
+    uint64_t limit() const { return campusLimit; }
+};
+
+#endif // JOURNAL_H
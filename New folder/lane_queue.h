@@ -0,0 +1,274 @@
+#ifndef LANE_QUEUE_H
+#define LANE_QUEUE_H
+
+#include <string>
+#include <memory>
+#include <deque>
+#include <atomic>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <sys/uio.h>
+#include "protocol.h"
+
+// Bytes ready for the wire, never modified once built. A message sent to
+// several campuses is one SharedFrame referenced from each of their queues.
+typedef std::shared_ptr<const std::string> SharedFrame;
+
+inline SharedFrame makeSharedFrame(std::string data) {
+    return std::make_shared<const std::string>(std::move(data));
+}
+
+// Priority lanes for the frames waiting to go to one campus. Everything
+// for a campus shares one TCP stream, so a short message queued behind a
+// file used to wait for the whole backlog. Frames now wait in four lanes
+// and only leave them when the socket takes more:
+//
+//   control    flow, credit, topic and redirect signals, transfer acks
+//   broadcast  admin broadcasts
+//   chat       department messages
+//   bulk       files; a chunked file is FILE_CHUNK_SIZE bytes per frame
+//
+// Control always goes first. In strict mode the other lanes do too, in
+// that order. In weighted mode they share the stream by LANE_WEIGHT_*
+// bytes (start-time fair queueing), so messages still overtake a file but
+// a steady flow of messages cannot starve it. Frames in one lane keep
+// their order, and a frame that has started on the wire is finished before
+// any other. FIFO mode keeps a single lane, as before lanes existed.
+//
+// Not thread safe: a reactor's connections are only touched by their
+// loop, and OutboundQueue holds its mutex.
+
+#define LANE_COUNT 4
+#define LANE_GATHER_MAX 16          // Frames handed to the kernel in one write
+#define LANE_WEIGHT_BROADCAST 4
+#define LANE_WEIGHT_CHAT 4
+#define LANE_WEIGHT_BULK 1
+
+enum Lane : uint8_t {
+    LANE_CONTROL = 0,
+    LANE_BROADCAST = 1,
+    LANE_CHAT = 2,
+    LANE_BULK = 3
+};
+
+enum class LaneMode {
+    FIFO,           // One lane: frames leave in the order they came
+    STRICT,         // Lower-numbered lanes always first
+    WEIGHTED        // Control first, the rest shared by weight
+};
+
+inline const char* laneModeName(LaneMode mode) {
+    switch (mode) {
+    case LaneMode::FIFO: return "fifo";
+    case LaneMode::STRICT: return "strict";
+    default: return "weighted";
+    }
+}
+
+inline const char* laneName(int lane) {
+    static const char* names[LANE_COUNT] = {"control", "broadcast", "chat", "bulk"};
+    return names[lane];
+}
+
+// Binary frames by type; text protocol lines by their prefix
+inline Lane laneOf(const char* data, size_t length) {
+    FrameHeader header;
+    if (length >= FRAME_HEADER_SIZE && decodeFrameHeader(data, header)) {
+        switch (header.type) {
+        case FRAME_MESSAGE: return LANE_CHAT;
+        case FRAME_BROADCAST: return LANE_BROADCAST;
+        case FRAME_FILE:
+        case FRAME_FILE_BEGIN:
+        case FRAME_FILE_CHUNK:
+        case FRAME_FILE_END: return LANE_BULK;
+        default: return LANE_CONTROL;
+        }
+    }
+    auto startsWith = [&](const char* prefix) {
+        size_t n = strlen(prefix);
+        return length >= n && memcmp(data, prefix, n) == 0;
+    };
+    if (startsWith("FROM:")) return LANE_CHAT;
+    if (startsWith("BROADCAST:")) return LANE_BROADCAST;
+    if (startsWith("FILE:")) return LANE_BULK;
+    return LANE_CONTROL;
+}
+
+// Shared by every campus's lanes
+struct LaneStats {
+    std::atomic<uint64_t> frames[LANE_COUNT];       // Written out, by lane, queued or not
+    std::atomic<uint64_t> bytes[LANE_COUNT];
+    std::atomic<uint64_t> overtook[LANE_COUNT];     // Went ahead of a frame queued before them
+
+    LaneStats() {
+        for (int i = 0; i < LANE_COUNT; i++) {
+            frames[i].store(0, std::memory_order_relaxed);
+            bytes[i].store(0, std::memory_order_relaxed);
+            overtook[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void count(int lane, size_t length) {
+        frames[lane].fetch_add(1, std::memory_order_relaxed);
+        bytes[lane].fetch_add(length, std::memory_order_relaxed);
+    }
+};
+
+class LaneQueue {
+private:
+    struct Entry {
+        SharedFrame frame;
+        uint64_t sequence;      // Arrival order across lanes
+        Lane lane;              // Where it is counted; FIFO mode stores every lane in 0
+    };
+
+    LaneMode mode = LaneMode::FIFO;
+    LaneStats* stats = nullptr;
+    std::deque<Entry> lanes[LANE_COUNT];
+    uint64_t pass[LANE_COUNT] = {};     // Weighted: virtual start of each lane's next frame
+    uint64_t virtualTime = 0;           // Start of the frame served last
+    uint64_t nextSequence = 0;
+    size_t queuedBytes = 0;
+    int started = -1;                   // Lane whose front frame is partly written
+    size_t startedBytes = 0;
+    int picked[LANE_GATHER_MAX];        // Lanes gather() took frames from, in order
+    int pickedCount = 0;
+
+    static uint64_t cost(int lane, size_t bytes) {
+        static const uint64_t weights[LANE_COUNT] = {1, LANE_WEIGHT_BROADCAST, LANE_WEIGHT_CHAT,
+                                                     LANE_WEIGHT_BULK};
+        return bytes / weights[lane] + 1;
+    }
+
+    // The lane to take a frame from next, given how many each has already
+    // given (taken) and their virtual times; -1 if all are empty
+    int pick(const uint64_t* passes, const size_t* taken) const {
+        if (started >= 0 && taken[started] == 0) return started;
+        int best = -1;
+        for (int lane = 0; lane < LANE_COUNT; lane++) {
+            if (taken[lane] >= lanes[lane].size()) continue;
+            if (lane == LANE_CONTROL || mode != LaneMode::WEIGHTED) return lane;
+            if (best < 0 || passes[lane] < passes[best]) best = lane;
+        }
+        return best;
+    }
+
+    // The front frame of lane is on the wire
+    void finish(int lane) {
+        Entry& head = lanes[lane].front();
+        if (stats) {
+            stats->count(head.lane, head.frame->size());
+            for (int other = 0; other < LANE_COUNT; other++) {
+                if (other != lane && !lanes[other].empty() &&
+                    lanes[other].front().sequence < head.sequence) {
+                    stats->overtook[head.lane].fetch_add(1, std::memory_order_relaxed);
+                    break;
+                }
+            }
+        }
+        virtualTime = pass[lane];
+        pass[lane] += cost(lane, head.frame->size());
+        lanes[lane].pop_front();
+        if (lane == started) {
+            started = -1;
+            startedBytes = 0;
+        }
+    }
+
+public:
+    void configure(LaneMode laneMode, LaneStats* laneStats) {
+        mode = laneMode;
+        stats = laneStats;
+    }
+
+    bool empty() const { return queuedBytes == 0; }
+    size_t bytes() const { return queuedBytes; }
+
+    // Returns the lane the frame waits in
+    int push(SharedFrame frame) {
+        if (frame->empty()) return -1;
+        Lane lane = laneOf(frame->data(), frame->size());
+        int index = mode == LaneMode::FIFO ? 0 : lane;
+        if (lanes[index].empty()) {
+            pass[index] = std::max(pass[index], virtualTime);
+        }
+        queuedBytes += frame->size();
+        lanes[index].push_back({std::move(frame), nextSequence++, lane});
+        return index;
+    }
+
+    // A frame the caller already wrote sent bytes of, straight to the
+    // socket; only while nothing else is queued
+    void pushStarted(SharedFrame frame, size_t sent) {
+        int index = push(std::move(frame));
+        if (index < 0) return;
+        started = index;
+        startedBytes = sent;
+        queuedBytes -= sent;
+    }
+
+    // Fills parts with up to max frames in the order they should go out,
+    // without taking them. consume() then takes what the kernel accepted.
+    // Frames pushed in between do not disturb it.
+    int gather(struct iovec* parts, int max) {
+        uint64_t passes[LANE_COUNT];
+        std::copy(pass, pass + LANE_COUNT, passes);
+        size_t taken[LANE_COUNT] = {};
+        pickedCount = 0;
+        max = std::min(max, LANE_GATHER_MAX);
+        while (pickedCount < max) {
+            int lane = pick(passes, taken);
+            if (lane < 0) break;
+            const std::string& data = *lanes[lane][taken[lane]].frame;
+            size_t skip = (lane == started && taken[lane] == 0) ? startedBytes : 0;
+            parts[pickedCount].iov_base = const_cast<char*>(data.data() + skip);
+            parts[pickedCount].iov_len = data.size() - skip;
+            passes[lane] += cost(lane, data.size());
+            taken[lane]++;
+            picked[pickedCount++] = lane;
+        }
+        return pickedCount;
+    }
+
+    void consume(size_t written) {
+        queuedBytes -= std::min(written, queuedBytes);
+        for (int i = 0; i < pickedCount && written > 0; i++) {
+            int lane = picked[i];
+            size_t skip = lane == started ? startedBytes : 0;
+            size_t left = lanes[lane].front().frame->size() - skip;
+            if (written < left) {
+                started = lane;
+                startedBytes = skip + written;
+                break;
+            }
+            written -= left;
+            finish(lane);
+        }
+        pickedCount = 0;
+    }
+
+    // Takes the next whole frame (threads mode writes each one fully)
+    bool take(SharedFrame& frame) {
+        size_t taken[LANE_COUNT] = {};
+        int lane = pick(pass, taken);
+        if (lane < 0) return false;
+        frame = lanes[lane].front().frame;
+        queuedBytes -= std::min(frame->size(), queuedBytes);
+        finish(lane);
+        return true;
+    }
+
+    void clear() {
+        for (std::deque<Entry>& lane : lanes) {
+            lane.clear();
+        }
+        queuedBytes = 0;
+        started = -1;
+        startedBytes = 0;
+        pickedCount = 0;
+    }
+};
+
+#endif // LANE_QUEUE_H
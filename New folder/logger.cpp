@@ -0,0 +1,185 @@
+#include "logger.h"
+#include <cstring>
+#include <strings.h>
+#include <chrono>
+
+static const char* levelNames[] = {"DEBUG", "INFO", "WARN", "ERROR"};
+
+// Marks the thread's ring abandoned on thread exit; the writer drains it
+// and then forgets it
+struct ThreadRingHolder {
+    std::shared_ptr<LogRing> ring;
+
+    ~ThreadRingHolder() {
+        if (ring) {
+            ring->abandoned.store(true, std::memory_order_release);
+        }
+    }
+};
+
+static thread_local ThreadRingHolder threadRingHolder;
+
+Logger::Logger() : coarseNow(time(nullptr)) {
+    writerThread = std::thread(&Logger::runWriter, this);
+}
+
+Logger& Logger::instance() {
+    static Logger* logger = new Logger();
+    return *logger;
+}
+
+bool Logger::openFile(const std::string& path) {
+    FILE* file = fopen(path.c_str(), "a");
+    if (!file) {
+        return false;
+    }
+    output.store(file);
+    return true;
+}
+
+int Logger::parseLevel(const std::string& name) {
+    for (int level = LOG_LEVEL_DEBUG; level <= LOG_LEVEL_ERROR; level++) {
+        if (strcasecmp(name.c_str(), levelNames[level]) == 0) {
+            return level;
+        }
+    }
+    return -1;
+}
+
+LogRing& Logger::threadRing() {
+    if (!threadRingHolder.ring) {
+        threadRingHolder.ring = std::make_shared<LogRing>();
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        rings.push_back(threadRingHolder.ring);
+    }
+    return *threadRingHolder.ring;
+}
+
+void Logger::write(int level, const char* message, size_t length) {
+    if (!enabled(level)) return;
+
+    LogRing& ring = threadRing();
+    uint64_t head = ring.head.load(std::memory_order_relaxed);
+    if (head - ring.tail.load(std::memory_order_acquire) >= LOG_RING_ENTRIES) {
+        // Writer is behind: never block the caller
+        ring.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    LogEntry& entry = ring.entries[head & (LOG_RING_ENTRIES - 1)];
+    entry.time = coarseNow.load(std::memory_order_relaxed);
+    entry.level = (uint8_t)level;
+    entry.fullLength = (uint32_t)length;
+    entry.length = (uint16_t)(length < LOG_MAX_MESSAGE ? length : LOG_MAX_MESSAGE);
+    memcpy(entry.text, message, entry.length);
+    ring.head.store(head + 1, std::memory_order_release);
+}
+
+void Logger::appendEntry(std::string& batch, const LogEntry& entry) {
+    // Same layout as the old ctime_r() output, reformatted once per second
+    if (entry.time != formattedSecond) {
+        struct tm parts;
+        localtime_r(&entry.time, &parts);
+        strftime(formattedTime, sizeof(formattedTime), "%a %b %d %H:%M:%S %Y", &parts);
+        formattedSecond = entry.time;
+    }
+
+    batch += '[';
+    batch += formattedTime;
+    batch += "] ";
+    if (entry.level != LOG_LEVEL_INFO) {
+        batch += levelNames[entry.level];
+        batch += ": ";
+    }
+    batch.append(entry.text, entry.length);
+    if (entry.fullLength > entry.length) {
+        batch += "... [" + std::to_string(entry.fullLength) + " bytes]";
+    }
+    batch += '\n';
+}
+
+// Moves everything queued so far into batch and forgets rings whose
+// threads have exited once they are empty
+void Logger::drain(std::string& batch) {
+    std::vector<std::shared_ptr<LogRing>> snapshot;
+    {
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        snapshot = rings;
+    }
+
+    bool prune = false;
+    uint64_t droppedNow = 0;
+    for (const auto& ring : snapshot) {
+        // Read abandoned first: every entry published before it is then visible
+        bool abandoned = ring->abandoned.load(std::memory_order_acquire);
+        uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+        uint64_t head = ring->head.load(std::memory_order_acquire);
+
+        for (; tail != head; tail++) {
+            appendEntry(batch, ring->entries[tail & (LOG_RING_ENTRIES - 1)]);
+        }
+        ring->tail.store(tail, std::memory_order_release);
+
+        uint64_t dropped = ring->dropped.load(std::memory_order_relaxed);
+        droppedNow += dropped - ring->droppedReported;
+        ring->droppedReported = dropped;
+        prune |= abandoned;
+    }
+
+    if (prune) {
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        for (size_t i = 0; i < rings.size();) {
+            if (rings[i]->abandoned.load(std::memory_order_acquire) &&
+                rings[i]->tail.load() == rings[i]->head.load()) {
+                rings[i] = rings.back();
+                rings.pop_back();
+            } else {
+                i++;
+            }
+        }
+    }
+
+    // Drops are reported in-band so gaps in the log are visible
+    if (droppedNow > 0) {
+        totalDropped.fetch_add(droppedNow, std::memory_order_relaxed);
+
+        LogEntry notice;
+        notice.time = coarseNow.load(std::memory_order_relaxed);
+        notice.level = LOG_LEVEL_WARN;
+        int length = snprintf(notice.text, sizeof(notice.text),
+                              "Logger dropped %llu messages (ring full)",
+                              (unsigned long long)droppedNow);
+        notice.length = (uint16_t)length;
+        notice.fullLength = (uint32_t)length;
+        appendEntry(batch, notice);
+    }
+}
+
+void Logger::runWriter() {
+    std::string batch;
+    while (running.load(std::memory_order_acquire)) {
+        coarseNow.store(time(nullptr), std::memory_order_relaxed);
+
+        batch.clear();
+        drain(batch);
+        if (!batch.empty()) {
+            FILE* out = output.load();
+            fwrite(batch.data(), 1, batch.size(), out);
+            fflush(out);
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(LOG_FLUSH_INTERVAL_MS));
+    }
+
+    batch.clear();
+    drain(batch);
+    FILE* out = output.load();
+    fwrite(batch.data(), 1, batch.size(), out);
+    fflush(out);
+}
+
+void Logger::shutdown() {
+    if (running.exchange(false) && writerThread.joinable()) {
+        writerThread.join();
+    }
+}
@@ -0,0 +1,121 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <cstdio>
+#include <cstdint>
+#include <ctime>
+
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_ERROR 3
+
+// Levels below this are compiled out entirely (their arguments are never
+// evaluated). Build with -DLOG_COMPILE_LEVEL=1 to strip per-message logs.
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+#define LOG_RING_ENTRIES 2048       // Per thread (power of two)
+#define LOG_MAX_MESSAGE 200         // Longer messages are truncated
+#define LOG_FLUSH_INTERVAL_MS 5     // Writer thread wakeup and clock resolution
+
+// One queued log line. Formatting (timestamp, truncation marker) happens on
+// the writer thread.
+struct LogEntry {
+    time_t time;
+    uint8_t level;
+    uint16_t length;        // Bytes stored in text
+    uint32_t fullLength;    // Bytes in the original message
+    char text[LOG_MAX_MESSAGE];
+};
+
+// Single-producer ring owned by one logging thread; only the writer
+// thread consumes it
+struct LogRing {
+    std::vector<LogEntry> entries{LOG_RING_ENTRIES};
+    alignas(64) std::atomic<uint64_t> head{0};     // Next slot to fill
+    alignas(64) std::atomic<uint64_t> tail{0};     // Next slot to write out
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<bool> abandoned{false};            // Owning thread has exited
+    uint64_t droppedReported = 0;                  // Writer thread only
+};
+
+// Asynchronous logger. Callers copy the message into their own thread's
+// ring and return; they never take a lock, format a time or touch the
+// output. A background thread drains the rings in batches. When a ring is
+// full the message is dropped and counted rather than blocking the caller.
+class Logger {
+private:
+    std::mutex ringsMutex;          // Registration only
+    std::vector<std::shared_ptr<LogRing>> rings;
+    std::atomic<int> minLevel{LOG_LEVEL_INFO};
+    std::atomic<time_t> coarseNow;
+    std::atomic<uint64_t> totalDropped{0};
+    std::atomic<bool> running{true};
+    std::atomic<FILE*> output{stdout};
+    std::thread writerThread;
+
+    // Writer thread state
+    time_t formattedSecond = 0;
+    char formattedTime[32] = "";
+
+    Logger();
+    LogRing& threadRing();
+    void runWriter();
+    void drain(std::string& batch);
+    void appendEntry(std::string& batch, const LogEntry& entry);
+
+public:
+    // Process-wide; lives until exit so late log calls stay safe
+    static Logger& instance();
+
+    bool openFile(const std::string& path);
+    void setLevel(int level) { minLevel.store(level, std::memory_order_relaxed); }
+    bool enabled(int level) const { return level >= minLevel.load(std::memory_order_relaxed); }
+
+    void write(int level, const char* message, size_t length);
+    void write(int level, const std::string& message) { write(level, message.data(), message.size()); }
+
+    uint64_t dropped() const { return totalDropped.load(std::memory_order_relaxed); }
+
+    // Writes out everything queued and stops the writer thread
+    void shutdown();
+
+    static int parseLevel(const std::string& name);
+};
+
+#define LOG_AT(level, message)                                                  \
+    do {                                                                        \
+        if (Logger::instance().enabled(level)) {                                \
+            Logger::instance().write(level, message);                           \
+        }                                                                       \
+    } while (0)
+
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(message) LOG_AT(LOG_LEVEL_DEBUG, message)
+#else
+#define LOG_DEBUG(message) do {} while (0)
+#endif
+
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_INFO
+#define LOG_INFO(message) LOG_AT(LOG_LEVEL_INFO, message)
+#else
+#define LOG_INFO(message) do {} while (0)
+#endif
+
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_WARN
+#define LOG_WARN(message) LOG_AT(LOG_LEVEL_WARN, message)
+#else
+#define LOG_WARN(message) do {} while (0)
+#endif
+
+#define LOG_ERROR(message) LOG_AT(LOG_LEVEL_ERROR, message)
+
+#endif // LOGGER_H
@@ -0,0 +1,62 @@
+#ifndef MPSC_QUEUE_H
+#define MPSC_QUEUE_H
+
+#include <atomic>
+
+// Intrusive lock-free multi-producer / single-consumer queue (Vyukov).
+// T must expose a `std::atomic<T*> next` member. Any thread may push();
+// only the owning thread may pop(). Nodes are owned by the caller.
+template <typename T>
+class MpscQueue {
+private:
+    std::atomic<T*> head;   // Producers swap themselves in here
+    T* tail;                // Consumer side
+    T stub;
+
+public:
+    MpscQueue() : head(&stub), tail(&stub) {
+        stub.next.store(nullptr, std::memory_order_relaxed);
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    void push(T* node) {
+        node->next.store(nullptr, std::memory_order_relaxed);
+        T* prev = head.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    // Returns nullptr when empty, or when a producer is midway through push()
+    // (the node becomes visible on the next call).
+    T* pop() {
+        T* current = tail;
+        T* next = current->next.load(std::memory_order_acquire);
+
+        if (current == &stub) {
+            if (next == nullptr) return nullptr;
+            tail = next;
+            current = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+
+        if (next != nullptr) {
+            tail = next;
+            return current;
+        }
+
+        if (current != head.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+
+        push(&stub);
+        next = current->next.load(std::memory_order_acquire);
+        if (next != nullptr) {
+            tail = next;
+            return current;
+        }
+        return nullptr;
+    }
+};
+
+#endif // MPSC_QUEUE_H
@@ -0,0 +1,211 @@
+#include "multicast.h"
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <cstdlib>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+static void putU16(char* out, uint16_t value) {
+    out[0] = (char)(value >> 8);
+    out[1] = (char)value;
+}
+
+static void putU32(char* out, uint32_t value) {
+    out[0] = (char)(value >> 24);
+    out[1] = (char)(value >> 16);
+    out[2] = (char)(value >> 8);
+    out[3] = (char)value;
+}
+
+static uint16_t getU16(const char* in) {
+    return (uint16_t)(((unsigned char)in[0] << 8) | (unsigned char)in[1]);
+}
+
+static uint32_t getU32(const char* in) {
+    return ((uint32_t)(unsigned char)in[0] << 24) | ((uint32_t)(unsigned char)in[1] << 16) |
+           ((uint32_t)(unsigned char)in[2] << 8) | (uint32_t)(unsigned char)in[3];
+}
+
+std::string encodeBroadcastPacket(BroadcastKind kind, uint32_t session, uint32_t sequence,
+                                  const std::string& text) {
+    std::string packet(MULTICAST_HEADER_SIZE, '\0');
+    putU16(&packet[0], MULTICAST_MAGIC);
+    packet[2] = (char)MULTICAST_VERSION;
+    packet[3] = (char)kind;
+    putU32(&packet[4], session);
+    putU32(&packet[8], sequence);
+    putU16(&packet[12], (uint16_t)text.size());
+    packet += text;
+    return packet;
+}
+
+bool decodeBroadcastPacket(const char* data, size_t length, BroadcastPacket& packet) {
+    if (length < MULTICAST_HEADER_SIZE || getU16(data) != MULTICAST_MAGIC ||
+        (uint8_t)data[2] != MULTICAST_VERSION) {
+        return false;
+    }
+    packet.kind = (uint8_t)data[3];
+    packet.session = getU32(data + 4);
+    packet.sequence = getU32(data + 8);
+    packet.length = getU16(data + 12);
+    packet.text = data + MULTICAST_HEADER_SIZE;
+    return (packet.kind == BROADCAST_DATA || packet.kind == BROADCAST_SYNC) &&
+           packet.length == length - MULTICAST_HEADER_SIZE;
+}
+
+std::string formatSequenceRange(uint32_t first, uint32_t last) {
+    return std::to_string(first) + "-" + std::to_string(last);
+}
+
+bool parseSequenceRange(const std::string& text, uint32_t& first, uint32_t& last) {
+    size_t dash = text.find('-');
+    if (dash == std::string::npos || dash == 0 || dash + 1 >= text.size()) return false;
+    first = (uint32_t)strtoul(text.c_str(), nullptr, 10);
+    last = (uint32_t)strtoul(text.c_str() + dash + 1, nullptr, 10);
+    return first != 0 && first <= last;
+}
+
+int openMulticastSender(int ttl, in_addr interfaceAddress, std::string& error) {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        error = strerror(errno);
+        return -1;
+    }
+
+    unsigned char hops = (unsigned char)ttl;
+    unsigned char loop = 1;     // Campuses on this host get it too
+    if (setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &hops, sizeof(hops)) < 0 ||
+        setsockopt(fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop)) < 0 ||
+        (interfaceAddress.s_addr != htonl(INADDR_ANY) &&
+         setsockopt(fd, IPPROTO_IP, IP_MULTICAST_IF, &interfaceAddress,
+                    sizeof(interfaceAddress)) < 0)) {
+        error = strerror(errno);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int openMulticastReceiver(const std::string& group, uint16_t port, in_addr interfaceAddress,
+                          std::string& error) {
+    struct ip_mreq membership;
+    memset(&membership, 0, sizeof(membership));
+    if (inet_pton(AF_INET, group.c_str(), &membership.imr_multiaddr) != 1 ||
+        !IN_MULTICAST(ntohl(membership.imr_multiaddr.s_addr))) {
+        error = "not a multicast group: " + group;
+        return -1;
+    }
+    membership.imr_interface = interfaceAddress;
+
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        error = strerror(errno);
+        return -1;
+    }
+
+    // Every campus on a host binds the same port; binding the group address
+    // keeps other traffic to that port out
+    int reuse = 1;
+    struct sockaddr_in local;
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_addr = membership.imr_multiaddr;
+    local.sin_port = htons(port);
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) < 0 ||
+        bind(fd, (struct sockaddr*)&local, sizeof(local)) < 0 ||
+        setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership)) < 0) {
+        error = strerror(errno);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+BroadcastHistory::BroadcastHistory() : nextSequence(1) {
+    // Differs across restarts, so clients never mix two servers' sequences
+    sessionId = (uint32_t)time(nullptr) ^ ((uint32_t)getpid() << 16);
+    if (sessionId == 0) sessionId = 1;
+}
+
+uint32_t BroadcastHistory::next() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return nextSequence;
+}
+
+uint32_t BroadcastHistory::append(const std::string& text) {
+    std::lock_guard<std::mutex> lock(mutex);
+    texts.push_back(text);
+    if (texts.size() > MULTICAST_HISTORY) {
+        texts.pop_front();
+    }
+    return nextSequence++;
+}
+
+bool BroadcastHistory::find(uint32_t sequence, std::string& text) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    uint32_t oldest = nextSequence - (uint32_t)texts.size();
+    if (sequence < oldest || sequence >= nextSequence) return false;
+    text = texts[sequence - oldest];
+    return true;
+}
+
+BroadcastTracker::BroadcastTracker() : sessionId(0), expected(1) {
+}
+
+void BroadcastTracker::reset(uint32_t session, uint32_t next) {
+    sessionId = session;
+    expected = next;
+    missing.clear();
+}
+
+// Only the newest MULTICAST_HISTORY can still be repaired; asks in ranges
+// of at most MULTICAST_NACK_MAX
+void BroadcastTracker::markMissing(uint32_t first, uint32_t last,
+                                   std::vector<std::pair<uint32_t, uint32_t>>& nacks) {
+    if (last - first >= MULTICAST_HISTORY) {
+        first = last - MULTICAST_HISTORY + 1;
+    }
+    for (uint32_t start = first; start <= last;) {
+        uint32_t end = std::min<uint32_t>(last, start + MULTICAST_NACK_MAX - 1);
+        nacks.push_back({start, end});
+        for (uint32_t sequence = start; sequence <= end; sequence++) {
+            missing.insert(sequence);
+        }
+        if (end == last) break;
+        start = end + 1;
+    }
+}
+
+bool BroadcastTracker::receive(const BroadcastPacket& packet,
+                               std::vector<std::pair<uint32_t, uint32_t>>& nacks) {
+    if (sessionId == 0 || packet.session != sessionId || packet.sequence == 0) return false;
+
+    if (packet.kind == BROADCAST_SYNC) {
+        if (packet.sequence >= expected) {
+            markMissing(expected, packet.sequence, nacks);
+            expected = packet.sequence + 1;
+        }
+        return false;
+    }
+
+    if (packet.sequence >= expected) {
+        if (packet.sequence > expected) {
+            markMissing(expected, packet.sequence - 1, nacks);
+        }
+        expected = packet.sequence + 1;
+        return true;
+    }
+    // Late or duplicate: show it only if it was still missing
+    return missing.erase(packet.sequence) > 0;
+}
+
+bool BroadcastTracker::repaired(uint32_t sequence) {
+    return missing.erase(sequence) > 0;
+}
+
+void BroadcastTracker::lost(uint32_t first, uint32_t last) {
+    missing.erase(missing.lower_bound(first), missing.upper_bound(last));
+}
@@ -0,0 +1,116 @@
+#ifndef MULTICAST_H
+#define MULTICAST_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <set>
+#include <mutex>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+#include <netinet/in.h>
+
+// Admin broadcasts over IP multicast.
+//
+// Binary clients that can join the group add "Mcast:1," to their AUTH
+// line. The server answers "|MCAST:<group>:<port>:<session>:<next>", where
+// next is the sequence number of the next broadcast. Each broadcast is one
+// datagram to the group:
+//   magic u16 | version u8 | kind u8 | session u32 | sequence u32 |
+//   length u16 | reserved u16 | text
+// While there have been broadcasts, the server also sends a SYNC datagram
+// every few seconds carrying the latest sequence, so a lost last packet is
+// noticed too. A client that sees a gap asks for the missing sequences on
+// its TCP session with a control frame, "NACK:<first>-<last>". The server
+// answers each one it still has with "BCAST:<sequence>:<text>", and the
+// rest with "BCAST-LOST:<first>-<last>". A client that cannot join the
+// group sends "MCAST-LEAVE:<next>" and is switched back to TCP, with the
+// broadcasts from next on repaired. Other campuses keep getting broadcasts
+// as TCP frames.
+
+#define MULTICAST_GROUP "239.255.42.1"
+#define MULTICAST_PORT 8082
+#define MULTICAST_TTL 1                 // Stay on the local network
+#define MULTICAST_MAGIC 0x4E42          // "NB"
+#define MULTICAST_VERSION 1
+#define MULTICAST_HEADER_SIZE 16
+#define MULTICAST_MAX_TEXT 1200         // Longer broadcasts go over TCP
+#define MULTICAST_HISTORY 1024          // Broadcasts the server keeps for repair
+#define MULTICAST_NACK_MAX 256          // Sequences one NACK may ask for
+#define MULTICAST_SYNC_MS 2000
+
+enum BroadcastKind : uint8_t {
+    BROADCAST_DATA = 1,     // A broadcast; text is the message
+    BROADCAST_SYNC = 2      // No text; sequence is the latest broadcast
+};
+
+struct BroadcastPacket {
+    uint8_t kind = 0;
+    uint32_t session = 0;
+    uint32_t sequence = 0;
+    const char* text = nullptr;     // Points into the datagram
+    size_t length = 0;
+};
+
+std::string encodeBroadcastPacket(BroadcastKind kind, uint32_t session, uint32_t sequence,
+                                  const std::string& text);
+bool decodeBroadcastPacket(const char* data, size_t length, BroadcastPacket& packet);
+
+// "<first>-<last>", as carried by NACK and BCAST-LOST
+std::string formatSequenceRange(uint32_t first, uint32_t last);
+bool parseSequenceRange(const std::string& text, uint32_t& first, uint32_t& last);
+
+// Sockets. The sender leaves through interfaceAddress (INADDR_ANY: the
+// routing table decides); the receiver joins the group on it. Both return
+// -1 with error set on failure.
+int openMulticastSender(int ttl, in_addr interfaceAddress, std::string& error);
+int openMulticastReceiver(const std::string& group, uint16_t port, in_addr interfaceAddress,
+                          std::string& error);
+
+// Server side: numbers broadcasts and keeps the last MULTICAST_HISTORY of
+// them for repair
+class BroadcastHistory {
+private:
+    mutable std::mutex mutex;
+    uint32_t sessionId;
+    uint32_t nextSequence;
+    std::deque<std::string> texts;      // Sequences nextSequence - size() .. nextSequence - 1
+
+public:
+    BroadcastHistory();
+
+    uint32_t session() const { return sessionId; }
+    uint32_t next() const;
+    uint32_t append(const std::string& text);   // Returns its sequence
+    bool find(uint32_t sequence, std::string& text) const;
+};
+
+// Client side: notices gaps and duplicates in what arrives by multicast
+// and by repair. Not thread-safe.
+class BroadcastTracker {
+private:
+    uint32_t sessionId;
+    uint32_t expected;              // Next sequence not yet seen or asked for
+    std::set<uint32_t> missing;     // Asked for, not yet repaired
+
+    void markMissing(uint32_t first, uint32_t last,
+                     std::vector<std::pair<uint32_t, uint32_t>>& nacks);
+
+public:
+    BroadcastTracker();
+
+    void reset(uint32_t session, uint32_t next);
+    uint32_t session() const { return sessionId; }
+
+    // A multicast packet. Appends ranges to ask for to nacks. Returns true
+    // if the packet carries a broadcast that should be shown.
+    bool receive(const BroadcastPacket& packet,
+                 std::vector<std::pair<uint32_t, uint32_t>>& nacks);
+    // A repair over TCP; true if it was still missing
+    bool repaired(uint32_t sequence);
+    void lost(uint32_t first, uint32_t last);
+    size_t outstanding() const { return missing.size(); }
+};
+
+#endif // MULTICAST_H
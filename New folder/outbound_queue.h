@@ -0,0 +1,214 @@
+#ifndef OUTBOUND_QUEUE_H
+#define OUTBOUND_QUEUE_H
+
+#include <string>
+#include <memory>
+#include <set>
+#include <vector>
+#include <algorithm>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "lane_queue.h"
+
+// Bytes accepted for one campus that the kernel has not taken yet. Routers
+// call admit() before queueing; once the backlog reaches the high watermark
+// the campus is paused and further messages are dropped until the I/O layer
+// drains it below the low watermark. Senders that hit a paused campus are
+// remembered so they can be told when it resumes.
+//
+// In threads mode the queued data itself lives here, in priority lanes
+// (lane_queue.h), and is drained by the campus's writer thread. Reactor
+// modes keep the data in the connection's lanes and only use the
+// accounting. Cluster links and the standby keep one FIFO lane.
+//
+// Threads mode also lets another campus's reader thread write to the socket
+// itself for a while (the zero-copy file relay), but only when nothing is
+// queued, so nothing is overtaken; the writer thread waits until it is done.
+
+class OutboundQueue {
+private:
+    size_t highWatermark;
+    size_t lowWatermark;
+
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::condition_variable resumedSignal;  // Paused campus drained, or closed
+    LaneQueue pending;                  // Threads mode only
+    size_t queuedBytes;
+    size_t peakBytes;
+    bool paused;
+    bool closed;
+    bool direct;                        // A reader thread owns the socket
+    std::set<std::string> waitingSenders;
+
+public:
+    // Metrics
+    std::atomic<uint64_t> messages{0};      // Accepted for delivery
+    std::atomic<uint64_t> deferred{0};      // Could not go to the kernel immediately
+    std::atomic<uint64_t> dropped{0};       // Rejected while paused
+
+    OutboundQueue(size_t high, size_t low, LaneMode lanes = LaneMode::FIFO,
+                  LaneStats* laneStats = nullptr)
+        : highWatermark(high), lowWatermark(low), queuedBytes(0), peakBytes(0), paused(false),
+          closed(false), direct(false) {
+        pending.configure(lanes, laneStats);
+    }
+
+    // Returns false (and counts a drop) if the campus is paused. newlyBlocked
+    // is set the first time a given sender is turned away, so it is told to
+    // pause only once.
+    bool admit(const std::string& sender, bool& newlyBlocked) {
+        std::lock_guard<std::mutex> lock(mutex);
+        newlyBlocked = false;
+        if (!paused) {
+            messages++;
+            return true;
+        }
+        dropped++;
+        if (!sender.empty()) {
+            newlyBlocked = waitingSenders.insert(sender).second;
+        }
+        return false;
+    }
+
+    // A sender with credit (credit_ledger.h) left in its window is never
+    // turned away; the caller has checked the window
+    void admitCredited() {
+        messages++;
+    }
+
+    // Journal replay: admits unless paused, without remembering a sender
+    bool tryAdmit() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (paused) return false;
+        messages++;
+        return true;
+    }
+
+    // Journal replay: waits until a paused campus drains to its low
+    // watermark. False if it was closed or is still paused after timeout.
+    bool waitResumed(std::chrono::milliseconds timeout) {
+        std::unique_lock<std::mutex> lock(mutex);
+        resumedSignal.wait_for(lock, timeout, [this] { return closed || !paused; });
+        return !closed && !paused;
+    }
+
+    void add(size_t bytes) {
+        std::lock_guard<std::mutex> lock(mutex);
+        addLocked(bytes);
+    }
+
+    // Returns the senders to notify if this release resumed the campus
+    std::vector<std::string> release(size_t bytes) {
+        std::lock_guard<std::mutex> lock(mutex);
+        queuedBytes -= std::min(bytes, queuedBytes);
+
+        std::vector<std::string> resumed;
+        if (paused && queuedBytes <= lowWatermark) {
+            paused = false;
+            resumedSignal.notify_all();
+            resumed.assign(waitingSenders.begin(), waitingSenders.end());
+            waitingSenders.clear();
+        }
+        return resumed;
+    }
+
+    // At or below the low watermark: credit held back for this campus can
+    // go out
+    bool drained() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return queuedBytes <= lowWatermark;
+    }
+
+    // For a resumed session (session_token.h), whose new queue starts out
+    // empty: the senders this queue turned away, to be told it resumed
+    std::vector<std::string> takeWaitingSenders() {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<std::string> senders(waitingSenders.begin(), waitingSenders.end());
+        waitingSenders.clear();
+        return senders;
+    }
+
+    // Threads mode: hand data to the writer thread
+    void push(SharedFrame data) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (closed) return;
+        if (!pending.empty() || direct) {
+            deferred++;
+        }
+        addLocked(data->size());
+        pending.push(std::move(data));
+        ready.notify_one();
+    }
+
+    // Threads mode: blocks until data is available; false once closed
+    bool pop(SharedFrame& data) {
+        std::unique_lock<std::mutex> lock(mutex);
+        ready.wait(lock, [this] { return closed || (!pending.empty() && !direct); });
+        if (closed) return false;
+        return pending.take(data);
+    }
+
+    // Like pop(), but takes up to max frames at once so they can go out in
+    // one write
+    bool popBatch(std::vector<SharedFrame>& batch, size_t max) {
+        std::unique_lock<std::mutex> lock(mutex);
+        ready.wait(lock, [this] { return closed || (!pending.empty() && !direct); });
+        if (closed) return false;
+        SharedFrame data;
+        while (batch.size() < max && pending.take(data)) {
+            batch.push_back(std::move(data));
+        }
+        return true;
+    }
+
+    // Threads mode: false unless the campus is idle (nothing queued or being
+    // written). Counts as an accepted message.
+    bool beginDirect() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (closed || direct || queuedBytes > 0 || !pending.empty()) {
+            return false;
+        }
+        direct = true;
+        messages++;
+        return true;
+    }
+
+    void endDirect() {
+        std::lock_guard<std::mutex> lock(mutex);
+        direct = false;
+        ready.notify_all();
+    }
+
+    // Waits out a direct write, so the socket stays open until it is done
+    void close() {
+        std::unique_lock<std::mutex> lock(mutex);
+        ready.wait(lock, [this] { return !direct; });
+        closed = true;
+        pending.clear();
+        ready.notify_all();
+        resumedSignal.notify_all();
+    }
+
+    void snapshot(size_t& bytes, size_t& peak, bool& isPaused) {
+        std::lock_guard<std::mutex> lock(mutex);
+        bytes = queuedBytes;
+        peak = peakBytes;
+        isPaused = paused;
+    }
+
+private:
+    void addLocked(size_t bytes) {
+        queuedBytes += bytes;
+        peakBytes = std::max(peakBytes, queuedBytes);
+        if (queuedBytes >= highWatermark) {
+            paused = true;
+        }
+    }
+};
+
+#endif // OUTBOUND_QUEUE_H
@@ -0,0 +1,408 @@
+#include "protocol.h"
+#include <cstring>
+#include <arpa/inet.h>
+
+static const char* departments[] = {"General", "Admissions", "Academics", "IT", "Sports"};
+static const size_t departmentCount = sizeof(departments) / sizeof(departments[0]);
+
+static void putU16(char* out, uint16_t value) {
+    value = htons(value);
+    memcpy(out, &value, 2);
+}
+
+static void putU32(char* out, uint32_t value) {
+    value = htonl(value);
+    memcpy(out, &value, 4);
+}
+
+static void putU64(char* out, uint64_t value) {
+    putU32(out, (uint32_t)(value >> 32));
+    putU32(out + 4, (uint32_t)value);
+}
+
+static uint16_t getU16(const char* in) {
+    uint16_t value;
+    memcpy(&value, in, 2);
+    return ntohs(value);
+}
+
+static uint32_t getU32(const char* in) {
+    uint32_t value;
+    memcpy(&value, in, 4);
+    return ntohl(value);
+}
+
+static uint64_t getU64(const char* in) {
+    return ((uint64_t)getU32(in) << 32) | getU32(in + 4);
+}
+
+void encodeFrameHeader(const FrameHeader& header, char* out) {
+    putU16(out, FRAME_MAGIC);
+    out[2] = PROTOCOL_BINARY;
+    out[3] = header.type;
+    out[4] = header.flags;
+    out[5] = header.reserved;
+    putU16(out + 6, header.sourceId);
+    putU16(out + 8, header.targetId);
+    putU16(out + 10, header.deptId);
+    putU32(out + 12, header.payloadLength);
+}
+
+std::string encodeFrame(const FrameHeader& header, const char* payload, size_t length) {
+    FrameHeader copy = header;
+    copy.payloadLength = length;
+
+    std::string frame(FRAME_HEADER_SIZE + length, '\0');
+    encodeFrameHeader(copy, &frame[0]);
+    if (length > 0) {
+        memcpy(&frame[FRAME_HEADER_SIZE], payload, length);
+    }
+    return frame;
+}
+
+bool decodeFrameHeader(const char* data, FrameHeader& header) {
+    if (getU16(data) != FRAME_MAGIC || (uint8_t)data[2] != PROTOCOL_BINARY) {
+        return false;
+    }
+    uint32_t length = getU32(data + 12);
+    if (length > MAX_FRAME_PAYLOAD) {
+        return false;
+    }
+
+    header.type = data[3];
+    header.flags = data[4];
+    header.reserved = data[5];
+    header.sourceId = getU16(data + 6);
+    header.targetId = getU16(data + 8);
+    header.deptId = getU16(data + 10);
+    header.payloadLength = length;
+    return true;
+}
+
+static FrameDecoder::Status parseFrame(const char* data, size_t available, Frame& frame) {
+    if (available < FRAME_HEADER_SIZE) {
+        return FrameDecoder::NEED_MORE;
+    }
+    if (!decodeFrameHeader(data, frame.header)) {
+        return FrameDecoder::MALFORMED;
+    }
+    if (available < FRAME_HEADER_SIZE + (size_t)frame.header.payloadLength) {
+        return FrameDecoder::NEED_MORE;
+    }
+    frame.payload = data + FRAME_HEADER_SIZE;
+    return FrameDecoder::FRAME_READY;
+}
+
+FrameDecoder::FrameDecoder()
+    : readPos(0), writePos(0), external(nullptr), externalLength(0), externalPos(0) {
+}
+
+void FrameDecoder::ensureSpace(size_t bytes) {
+    // Slide unread bytes to the front before growing
+    if (readPos > 0) {
+        size_t pending = writePos - readPos;
+        if (pending > 0) {
+            memmove(buffer.data(), buffer.data() + readPos, pending);
+        }
+        readPos = 0;
+        writePos = pending;
+    }
+    if (buffer.size() - writePos < bytes) {
+        buffer.resize(writePos + bytes);
+    }
+}
+
+// Only called before new data is taken in: frames returned by next()
+// point into the buffer until then
+void FrameDecoder::releaseIfDrained() {
+    if (readPos == writePos && buffer.capacity() > DECODER_KEEP_SIZE) {
+        std::vector<char>(DECODER_BUFFER_SIZE).swap(buffer);
+        readPos = writePos = 0;
+    }
+}
+
+char* FrameDecoder::prepare(size_t minimumSpace) {
+    releaseIfDrained();
+    if (buffer.size() - writePos < minimumSpace) {
+        ensureSpace(minimumSpace);
+    }
+    return buffer.data() + writePos;
+}
+
+void FrameDecoder::commit(size_t bytes) {
+    writePos += bytes;
+}
+
+void FrameDecoder::feed(const char* data, size_t length) {
+    if (buffered() > 0) {
+        // Completing an earlier partial frame: has to go through the buffer
+        memcpy(prepare(length), data, length);
+        commit(length);
+        return;
+    }
+    releaseIfDrained();
+    readPos = writePos = 0;
+    external = data;
+    externalLength = length;
+    externalPos = 0;
+}
+
+FrameDecoder::Status FrameDecoder::next(Frame& frame) {
+    if (external) {
+        Status status = parseFrame(external + externalPos, externalLength - externalPos, frame);
+        if (status == FRAME_READY) {
+            externalPos += FRAME_HEADER_SIZE + frame.header.payloadLength;
+            if (externalPos == externalLength) {
+                external = nullptr;
+            }
+            return FRAME_READY;
+        }
+        if (status == MALFORMED) {
+            return MALFORMED;
+        }
+
+        // Keep the partial tail for the next read
+        size_t rest = externalLength - externalPos;
+        const char* tail = external + externalPos;
+        external = nullptr;
+        memcpy(prepare(rest), tail, rest);
+        commit(rest);
+        return NEED_MORE;
+    }
+
+    Status status = parseFrame(buffer.data() + readPos, writePos - readPos, frame);
+    if (status == FRAME_READY) {
+        readPos += FRAME_HEADER_SIZE + frame.header.payloadLength;
+        if (readPos == writePos) {
+            readPos = writePos = 0;
+        }
+    }
+    return status;
+}
+
+bool FrameDecoder::partial(FrameHeader& header, const char*& data, size_t& length) const {
+    length = writePos - readPos;
+    if (external || length < FRAME_HEADER_SIZE) {
+        return false;
+    }
+    data = buffer.data() + readPos;
+    return decodeFrameHeader(data, header) &&
+           length < FRAME_HEADER_SIZE + (size_t)header.payloadLength;
+}
+
+void FrameDecoder::dropPartial() {
+    readPos = writePos = 0;
+}
+
+void CampusDirectory::assign(uint16_t id, const std::string& name) {
+    if (id >= names.size()) {
+        names.resize(id + 1);
+    }
+    names[id] = name;
+}
+
+uint16_t CampusDirectory::idOf(const std::string& name) const {
+    for (size_t id = 1; id < names.size(); id++) {
+        if (names[id] == name) return (uint16_t)id;
+    }
+    return 0;
+}
+
+const std::string& CampusDirectory::nameOf(uint16_t id) const {
+    static const std::string unknown;
+    return id < names.size() ? names[id] : unknown;
+}
+
+std::string CampusDirectory::serialize() const {
+    std::string text;
+    for (size_t id = 1; id < names.size(); id++) {
+        if (names[id].empty()) continue;
+        if (!text.empty()) text += ",";
+        text += std::to_string(id) + "=" + names[id];
+    }
+    return text;
+}
+
+void CampusDirectory::parse(const std::string& text) {
+    size_t start = 0;
+    while (start < text.size()) {
+        size_t end = text.find(',', start);
+        if (end == std::string::npos) end = text.size();
+
+        std::string entry = text.substr(start, end - start);
+        size_t eq = entry.find('=');
+        if (eq != std::string::npos) {
+            assign((uint16_t)atoi(entry.substr(0, eq).c_str()), entry.substr(eq + 1));
+        }
+        start = end + 1;
+    }
+}
+
+uint16_t departmentId(const std::string& name) {
+    for (size_t i = 0; i < departmentCount; i++) {
+        if (name == departments[i]) return (uint16_t)i;
+    }
+    return DEPT_INLINE;
+}
+
+std::string departmentName(uint16_t id) {
+    return id < departmentCount ? departments[id] : "";
+}
+
+std::string buildFrameHead(FrameType type, uint16_t sourceId, uint16_t targetId,
+                           const std::string& department, size_t bodyLength) {
+    FrameHeader header;
+    header.type = type;
+    header.sourceId = sourceId;
+    header.targetId = targetId;
+
+    // Only department messages carry a department
+    header.deptId = (type == FRAME_MESSAGE) ? departmentId(department) : 0;
+    std::string inlineDept;
+    if (header.deptId == DEPT_INLINE) {
+        header.flags |= FLAG_DEPT_INLINE;
+        inlineDept = department + "\n";
+    }
+    header.payloadLength = inlineDept.size() + bodyLength;
+
+    std::string head(FRAME_HEADER_SIZE, '\0');
+    encodeFrameHeader(header, &head[0]);
+    return head + inlineDept;
+}
+
+std::string buildFrame(FrameType type, uint16_t sourceId, uint16_t targetId,
+                       const std::string& department, const std::string& body) {
+    return buildFrameHead(type, sourceId, targetId, department, body.size()) + body;
+}
+
+void encodeTransferHead(char* out, FrameType type, uint16_t sourceId, uint16_t targetId,
+                        uint32_t transferId, uint64_t value, uint32_t check, size_t dataLength) {
+    FrameHeader header;
+    header.type = type;
+    header.sourceId = sourceId;
+    header.targetId = targetId;
+    header.payloadLength = TRANSFER_HEADER_SIZE + dataLength;
+    encodeFrameHeader(header, out);
+
+    putU32(out + FRAME_HEADER_SIZE, transferId);
+    putU64(out + FRAME_HEADER_SIZE + 4, value);
+    putU32(out + FRAME_HEADER_SIZE + 12, check);
+}
+
+std::string buildTransferFrame(FrameType type, uint16_t sourceId, uint16_t targetId,
+                               uint32_t transferId, uint64_t value, uint32_t check,
+                               const char* data, size_t dataLength) {
+    std::string frame(FRAME_HEADER_SIZE + TRANSFER_HEADER_SIZE + dataLength, '\0');
+    encodeTransferHead(&frame[0], type, sourceId, targetId, transferId, value, check, dataLength);
+    if (dataLength > 0) {
+        memcpy(&frame[FRAME_HEADER_SIZE + TRANSFER_HEADER_SIZE], data, dataLength);
+    }
+    return frame;
+}
+
+bool parseTransferFrame(const Frame& frame, TransferFrame& transfer) {
+    if (!isTransferFrame(frame.header.type) || frame.header.payloadLength < TRANSFER_HEADER_SIZE) {
+        return false;
+    }
+    transfer.transferId = getU32(frame.payload);
+    transfer.value = getU64(frame.payload + 4);
+    transfer.check = getU32(frame.payload + 12);
+    transfer.data = frame.payload + TRANSFER_HEADER_SIZE;
+    transfer.length = frame.header.payloadLength - TRANSFER_HEADER_SIZE;
+    return true;
+}
+
+size_t splitMessagePayload(const Frame& frame, std::string& department) {
+    const char* payload = frame.payload;
+    size_t length = frame.header.payloadLength;
+
+    if (!(frame.header.flags & FLAG_DEPT_INLINE)) {
+        department = departmentName(frame.header.deptId);
+        return 0;
+    }
+
+    const char* newline = static_cast<const char*>(memchr(payload, '\n', length));
+    if (!newline) {
+        department.assign(payload, length);
+        return length;
+    }
+    department.assign(payload, newline - payload);
+    return newline - payload + 1;
+}
+
+std::string frameToText(const Frame& frame, const CampusDirectory& directory) {
+    const std::string& source = directory.nameOf(frame.header.sourceId);
+
+    switch (frame.header.type) {
+    case FRAME_MESSAGE: {
+        std::string department;
+        size_t bodyOffset = splitMessagePayload(frame, department);
+        return "FROM:" + source + "|DEPT:" + department + "|MSG:" +
+               std::string(frame.payload + bodyOffset, frame.header.payloadLength - bodyOffset);
+    }
+    case FRAME_FILE:
+        return "FILE:FROM:" + source + "|" +
+               std::string(frame.payload, frame.header.payloadLength);
+    case FRAME_BROADCAST:
+        return "BROADCAST:" + std::string(frame.payload, frame.header.payloadLength);
+    default:
+        return std::string(frame.payload, frame.header.payloadLength);
+    }
+}
+
+bool parseAuthReply(const char* data, size_t length, AuthReply& reply) {
+    std::string text(data, length);
+    size_t lineEnd = text.find('\n');
+    std::string line = text.substr(0, lineEnd);
+
+    if (line.find("AUTH:SUCCESS") != 0) {
+        // Cluster mode: "AUTH:REDIRECT:<host>:<port>", the campus's home node
+        if (line.find("AUTH:REDIRECT:") == 0) {
+            reply.redirect = line.substr(14);
+            reply.redirect.erase(reply.redirect.find_last_not_of(" \r\n") + 1);
+        }
+        reply.success = false;
+        return false;
+    }
+    reply.success = true;
+    if (lineEnd != std::string::npos) {
+        reply.leftover = text.substr(lineEnd + 1);
+    }
+
+    // Fields: |PROTO:2|ID:3|COMPRESS:lz4|MCAST:239.255.42.1:8082:<session>:<next>
+    // |SESSION:<token>|RESUMED:1|CREDIT:<bytes>|DIR:1=CFD,...
+    size_t pos = line.find('|');
+    while (pos != std::string::npos) {
+        size_t end = line.find('|', pos + 1);
+        std::string field = line.substr(pos + 1, end == std::string::npos ? std::string::npos
+                                                                          : end - pos - 1);
+        if (field.find("PROTO:") == 0) {
+            reply.protocolVersion = atoi(field.c_str() + 6);
+        } else if (field.find("ID:") == 0) {
+            reply.campusId = (uint16_t)atoi(field.c_str() + 3);
+        } else if (field.find("COMPRESS:") == 0) {
+            reply.compression = field.substr(9);
+        } else if (field.find("MCAST:") == 0) {
+            size_t portPos = field.find(':', 6);
+            size_t sessionPos = portPos == std::string::npos ? portPos : field.find(':', portPos + 1);
+            size_t nextPos = sessionPos == std::string::npos ? sessionPos
+                                                             : field.find(':', sessionPos + 1);
+            if (nextPos != std::string::npos) {
+                reply.multicastGroup = field.substr(6, portPos - 6);
+                reply.multicastPort = (uint16_t)atoi(field.c_str() + portPos + 1);
+                reply.multicastSession = (uint32_t)strtoul(field.c_str() + sessionPos + 1, nullptr, 10);
+                reply.multicastNext = (uint32_t)strtoul(field.c_str() + nextPos + 1, nullptr, 10);
+            }
+        } else if (field.find("SESSION:") == 0) {
+            reply.session = field.substr(8);
+        } else if (field.find("RESUMED:") == 0) {
+            reply.resumed = atoi(field.c_str() + 8) == 1;
+        } else if (field.find("CREDIT:") == 0) {
+            reply.creditWindow = (uint32_t)strtoul(field.c_str() + 7, nullptr, 10);
+        } else if (field.find("DIR:") == 0) {
+            reply.directory.parse(field.substr(4));
+        }
+        pos = end;
+    }
+    return true;
+}
@@ -0,0 +1,228 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Binary framing protocol shared by the server and both clients.
+//
+// Version 1 is the original text protocol ("TO:...|DEPT:...|MSG:...").
+// A client asks for version 2 by prefixing its AUTH line with "Proto:2,";
+// the server then answers "AUTH:SUCCESS|PROTO:2|ID:<id>|DIR:<id>=<name>,...\n"
+// and both directions switch to length-prefixed frames. Old servers ignore
+// the prefix and answer plain "AUTH:SUCCESS", so the client stays on text.
+//
+// Frame header (16 bytes, network byte order):
+//   magic u16 | version u8 | type u8 | flags u8 | reserved u8 |
+//   source u16 | target u16 | department u16 | payload length u32
+
+#define PROTOCOL_TEXT 1
+#define PROTOCOL_BINARY 2
+#define FRAME_MAGIC 0x4E55              // "NU"
+#define FRAME_HEADER_SIZE 16
+#define LEGACY_FILE_MAX 1000000         // Largest file sent whole, hex-encoded, in one FILE message
+#define MAX_FRAME_PAYLOAD (2 * LEGACY_FILE_MAX + 64 * 1024)    // That message plus its name and department
+
+enum FrameType : uint8_t {
+    FRAME_MESSAGE = 1,      // Department message, payload is the text
+    FRAME_FILE = 2,         // File, payload is "NAME:...|SIZE:...|DATA:<hex>"
+    FRAME_BROADCAST = 3,    // Admin broadcast, payload is the text
+    FRAME_CONTROL = 4,      // Server <-> client control, payload is text
+    FRAME_FILE_BEGIN = 5,   // Chunked file: transfer header (file size) + file name
+    FRAME_FILE_CHUNK = 6,   // Chunked file: transfer header (offset) + raw bytes
+    FRAME_FILE_END = 7,     // Chunked file: transfer header (file size) + SHA-256
+    FRAME_FILE_ACK = 8      // Receiver -> sender: transfer header (offset, status)
+};
+
+enum FrameFlags : uint8_t {
+    FLAG_DEPT_INLINE = 0x01,    // Department not in the fixed table; payload
+                                // starts with "<department>\n"
+    FLAG_COMPRESSED = 0x02      // Payload is compressed (see compression.h)
+};
+
+#define DEPT_INLINE 0xFFFF
+
+// Target id for a frame meant for several campuses: the list the sender
+// last gave in a "TARGETS:<id>,<id>,..." control frame. The server sends
+// the recipients the frame with target id 0.
+#define TARGET_LIST 0xFFFF
+
+struct FrameHeader {
+    uint8_t type = 0;
+    uint8_t flags = 0;
+    uint8_t reserved = 0;
+    uint16_t sourceId = 0;
+    uint16_t targetId = 0;
+    uint16_t deptId = 0;
+    uint32_t payloadLength = 0;
+};
+
+// A decoded frame. payload points into the decoder's buffer (or the
+// caller's buffer passed to feed()) and stays valid until the decoder is
+// next written to.
+struct Frame {
+    FrameHeader header;
+    const char* payload = nullptr;
+};
+
+void encodeFrameHeader(const FrameHeader& header, char* out);
+// Checks and decodes FRAME_HEADER_SIZE bytes; false if they are not a header
+bool decodeFrameHeader(const char* data, FrameHeader& header);
+std::string encodeFrame(const FrameHeader& header, const char* payload, size_t length);
+
+// Chunked file transfer. Each FILE_BEGIN/CHUNK/END/ACK payload starts with
+// a transfer header: transfer id u32 | value u64 | check u32. value is the
+// file size for BEGIN and END and a byte offset for CHUNK and ACK; check is
+// the chunk's CRC32C for CHUNK and the status for ACK. END carries the
+// SHA-256 of the whole file.
+//
+// Transfer ids are picked by the sender from the file's name, size and
+// modification time, so sending the same file again reuses the id. The
+// receiver answers BEGIN with an ACK saying where to resume from, and END
+// with DONE or RETRY; after a RETRY the sender starts again with BEGIN. The
+// server answers BEGIN with UNCONFIRMED when it relays or stores the file
+// instead.
+#define TRANSFER_HEADER_SIZE 16
+#define FILE_CHUNK_SIZE (128 * 1024)
+
+enum TransferStatus : uint32_t {
+    TRANSFER_RESUME = 0,        // Answer to BEGIN: send from offset
+    TRANSFER_DONE = 1,          // Answer to END: file verified and saved
+    TRANSFER_RETRY = 2,         // Answer to END: send BEGIN again (offset: verified so far)
+    TRANSFER_UNCONFIRMED = 3    // From the server: no answers will follow
+};
+
+struct TransferFrame {
+    uint32_t transferId = 0;
+    uint64_t value = 0;             // Size or offset
+    uint32_t check = 0;             // CRC32C or status
+    const char* data = nullptr;     // Name (BEGIN), file bytes (CHUNK) or digest (END)
+    size_t length = 0;
+};
+
+inline bool isTransferFrame(uint8_t type) {
+    return type == FRAME_FILE_BEGIN || type == FRAME_FILE_CHUNK || type == FRAME_FILE_END ||
+           type == FRAME_FILE_ACK;
+}
+
+// What send credit (credit_ledger.h) is spent on: messages and file chunks
+// for one campus. The rest of a transfer is a few bytes, and an ack held
+// for credit could stall the other side's transfer.
+inline bool spendsCredit(const FrameHeader& header) {
+    return (header.type == FRAME_MESSAGE || header.type == FRAME_FILE_CHUNK) &&
+           header.targetId != 0 && header.targetId != TARGET_LIST;
+}
+
+// Writes the frame and transfer headers for dataLength bytes of data to
+// out, which needs FRAME_HEADER_SIZE + TRANSFER_HEADER_SIZE bytes
+void encodeTransferHead(char* out, FrameType type, uint16_t sourceId, uint16_t targetId,
+                        uint32_t transferId, uint64_t value, uint32_t check, size_t dataLength);
+std::string buildTransferFrame(FrameType type, uint16_t sourceId, uint16_t targetId,
+                               uint32_t transferId, uint64_t value, uint32_t check,
+                               const char* data, size_t dataLength);
+bool parseTransferFrame(const Frame& frame, TransferFrame& transfer);
+
+// Incremental decoder that copes with frames split across reads and with
+// several frames arriving in one read. The buffer grows only as a frame's
+// bytes arrive, and goes back to DECODER_BUFFER_SIZE once a large frame
+// has been drained, so an idle connection does not keep it.
+#define DECODER_BUFFER_SIZE 4096
+#define DECODER_KEEP_SIZE (2 * FILE_CHUNK_SIZE)     // Larger buffers are released when empty
+
+class FrameDecoder {
+private:
+    std::vector<char> buffer;   // Partial data carried between reads
+    size_t readPos;
+    size_t writePos;
+
+    // Caller-owned input handed to feed(), parsed in place
+    const char* external;
+    size_t externalLength;
+    size_t externalPos;
+
+    void ensureSpace(size_t bytes);
+    void releaseIfDrained();
+
+public:
+    enum Status { FRAME_READY, NEED_MORE, MALFORMED };
+
+    FrameDecoder();
+
+    // Direct-read path: recv() straight into prepare(), then commit()
+    char* prepare(size_t minimumSpace);
+    void commit(size_t bytes);
+
+    // Borrowed-buffer path: frames wholly inside data are returned without
+    // copying; only a trailing partial frame is copied. Drain next() before
+    // reusing data.
+    void feed(const char* data, size_t length);
+
+    Status next(Frame& frame);
+    size_t buffered() const { return writePos - readPos; }
+
+    // Direct-read path, after next() returned NEED_MORE: the header of a
+    // frame whose payload has only partly arrived, and the bytes of it
+    // received so far (header included). Lets the server splice the rest of
+    // a file chunk between sockets itself; dropPartial() then forgets it.
+    bool partial(FrameHeader& header, const char*& data, size_t& length) const;
+    void dropPartial();
+};
+
+// Campus name <-> numeric id table, announced by the server during AUTH
+class CampusDirectory {
+private:
+    std::vector<std::string> names;     // Index is the id; 0 means "none"
+
+public:
+    void assign(uint16_t id, const std::string& name);
+    uint16_t idOf(const std::string& name) const;
+    const std::string& nameOf(uint16_t id) const;
+    size_t size() const { return names.size(); }
+
+    std::string serialize() const;      // "1=CFD,2=KARACHI,..."
+    void parse(const std::string& text);
+};
+
+// Fixed department table; unknown names return DEPT_INLINE
+uint16_t departmentId(const std::string& name);
+std::string departmentName(uint16_t id);
+
+// Header (plus any inline department) for a frame whose body is sent
+// separately, e.g. with writev
+std::string buildFrameHead(FrameType type, uint16_t sourceId, uint16_t targetId,
+                           const std::string& department, size_t bodyLength);
+std::string buildFrame(FrameType type, uint16_t sourceId, uint16_t targetId,
+                       const std::string& department, const std::string& body);
+
+// Extracts the department of a FRAME_MESSAGE and returns the offset of the
+// message body within the payload
+size_t splitMessagePayload(const Frame& frame, std::string& department);
+
+// Renders a frame in the text protocol ("FROM:...|DEPT:...|MSG:...",
+// "FILE:FROM:...|...", "BROADCAST:...") for version 1 peers and for the
+// clients' display code.
+std::string frameToText(const Frame& frame, const CampusDirectory& directory);
+
+// Client side of the handshake
+struct AuthReply {
+    bool success = false;
+    int protocolVersion = PROTOCOL_TEXT;
+    uint16_t campusId = 0;
+    CampusDirectory directory;
+    std::string compression;    // Codec the server picked (compression.h), empty for none
+    std::string multicastGroup; // Broadcast group to join (multicast.h), empty for TCP only
+    uint16_t multicastPort = 0;
+    uint32_t multicastSession = 0;
+    uint32_t multicastNext = 0; // First broadcast that will arrive by multicast
+    std::string leftover;       // Bytes after the reply line (first frames)
+    std::string redirect;       // "<host>:<port>" to log in at instead (cluster.h)
+    std::string session;        // Token to resume this session with (session_token.h)
+    bool resumed = false;       // This login resumed the session its token came from
+    uint32_t creditWindow = 0;  // Send credit per target campus (credit_ledger.h); 0: none
+};
+
+bool parseAuthReply(const char* data, size_t length, AuthReply& reply);
+
+#endif // PROTOCOL_H
@@ -0,0 +1,43 @@
+#ifndef REPLICATION_H
+#define REPLICATION_H
+
+// Hot standby. The primary is started with "--standby=<address>", naming
+// the one host a standby may replicate from; the standby with
+// "--standby-of=<host>:<port>", the primary's campus port. The standby
+// dials the primary on port + REPLICATION_PORT_OFFSET and announces itself
+// with "STANDBY\n"; after that the link carries binary protocol frames one
+// way, primary to standby:
+//
+//   - every record the primary journals for an offline campus, as the
+//     frame a forwarded message would be (real source and target ids)
+//   - "RESET" and "SYNCED" control frames around the snapshot sent when a
+//     standby connects: which campuses are connected and everything still
+//     journaled
+//   - "UP:<id>" and "DOWN:<id>" when a campus logs in or drops
+//   - "CONSUMED:<id>" when the oldest record of a campus is delivered
+//   - "PING" every REPLICATION_PING_MS
+//
+// so the standby's journal holds what the primary's does. While the link is
+// up the standby answers every login with "AUTH:REDIRECT:" to the primary.
+// When the link drops and the primary cannot be dialled again, or it stays
+// silent for REPLICATION_TIMEOUT_MS, the standby takes over: it accepts
+// campuses and replays what was stored for them. Clients started with
+// "--server=PRIMARY,STANDBY" go down the list when their connection drops.
+//
+// Messages the primary had already handed to a connected campus are not
+// replicated; any still queued there when it dies are lost. A primary that
+// comes back must be restarted as a standby of the new one.
+
+#define REPLICATION_PORT_OFFSET 3
+#define REPLICATION_PING_MS 200         // Keeps the link busy so a dead end is noticed
+#define REPLICATION_TIMEOUT_MS 1000     // Silence after which the standby takes over
+#define REPLICATION_RETRY_MS 200        // Standby dialling a primary that is not up yet
+#define REPLICATION_QUEUE_HIGH (64 * 1024 * 1024)  // Backlog that drops the standby, which resyncs
+#define REPLICATION_QUEUE_LOW (16 * 1024 * 1024)
+#define REPLICATION_BATCH 64            // Frames per write to the standby
+#define REPLICATION_LINGER_US 1000      // After a short batch, time for the next to fill
+#define FAILOVER_RETRY_MS 10            // Clients: first wait between rounds of their server
+#define FAILOVER_RETRY_MAX_MS 500       // list, doubling up to this
+#define FAILOVER_GIVE_UP_MS 30000
+
+#endif // REPLICATION_H
@@ -2,265 +2,1968 @@
 #include <sstream>
 #include <algorithm>
 #include <iomanip>
+#include <cerrno>
+#include <chrono>
+#include <fcntl.h>
+#include <csignal>
+#include <netinet/tcp.h>
 
-CentralServer::CentralServer() : tcpSocket(-1), udpSocket(-1), isRunning(false) {
+// Monotonic milliseconds for heartbeat deadlines
+static uint64_t livenessNow() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+thread_local uint16_t CentralServer::creditedTarget = 0;
+
+CentralServer::CentralServer(const ServerConfig& cfg)
+    : tcpSocket(-1), udpSocket(-1), multicastSocket(-1), peerSocket(-1), replicationSocket(-1), journal(cfg.journalDirectory, cfg.journalLimit), isRunning(false), config(cfg),
+      liveness(0, cfg.suspectMillis, cfg.deadMillis, livenessNow()),
+      sessions(cfg.sessionTtl) {
+    credits.setWindow(cfg.creditWindow);
     loadCredentials();
 }
 
-CentralServer::~CentralServer() {
-    stop();
+CentralServer::~CentralServer() {
+    stop();
+}
+
+// Reads the credentials file and brings the server in line with it: new
+// campuses get their id, journal and directory entry, and campuses whose
+// entry changed or was removed lose their sessions. Throws before changing
+// anything if the file is bad or would renumber a campus. Logins see the
+// new table only once everything else is in place.
+void CentralServer::loadCredentials() {
+    std::lock_guard<std::mutex> lock(credentialsMutex);
+    std::shared_ptr<const CredentialTable> table =
+        CredentialTable::load(config.credentialsFile, MAX_CAMPUS_ID);
+    std::shared_ptr<const CredentialTable> previous = std::atomic_load(&credentials);
+
+    // Binary protocol ids: stable for the lifetime of the process
+    for (const Credential& entry : table->all()) {
+        uint16_t known = registry.idOf(entry.campus);
+        if (known != 0 && known != entry.id) {
+            throw std::runtime_error("Campus " + entry.campus + " has id " +
+                                     std::to_string(known) + " here, not " +
+                                     std::to_string(entry.id));
+        }
+        if (known == 0 && !registry.nameOf(entry.id).empty()) {
+            throw std::runtime_error("Id " + std::to_string(entry.id) + " of " + entry.campus +
+                                     " already belongs to " + registry.nameOf(entry.id));
+        }
+    }
+
+    // New campuses go into the registry last and all at once, so with
+    // thousands listed there is one name index and one topic rebuild
+    std::vector<std::pair<std::string, uint16_t>> fresh;
+    std::vector<uint16_t> freshIds;
+    int added = 0;
+    int changed = 0;
+    int removed = 0;
+    for (const Credential& entry : table->all()) {
+        const Credential* old = previous ? previous->find(entry.campus) : nullptr;
+        if (registry.idOf(entry.campus) == 0) {
+            journal.open(entry.id, entry.campus);
+            fresh.emplace_back(entry.campus, entry.id);
+            freshIds.push_back(entry.id);
+            added++;
+        } else if (!old) {
+            added++;    // Removed by an earlier reload, back under its old id
+        } else if (!old->sameAs(entry)) {
+            sessions.revoke(entry.id);
+            changed++;
+        }
+    }
+    if (!fresh.empty()) {
+        topics.reset(freshIds);
+        registry.addCampuses(fresh);
+    }
+    if (previous) {
+        for (const Credential& entry : previous->all()) {
+            if (!table->find(entry.campus)) {
+                sessions.revoke(entry.id);
+                removed++;
+            }
+        }
+    }
+
+    // Every campus ever listed keeps its id, so messages journaled for a
+    // removed one still name it
+    CampusDirectory directory;
+    for (uint16_t id = 1; id <= registry.maxId(); id++) {
+        if (!registry.nameOf(id).empty()) {
+            directory.assign(id, registry.nameOf(id));
+        }
+    }
+    std::atomic_store(&campusDirectory,
+                      std::make_shared<const std::string>(directory.serialize()));
+    std::atomic_store(&credentials, table);
+
+    if (!previous) {
+        logEvent("Campus credentials loaded from " + config.credentialsFile + ": " +
+                 std::to_string(table->size()) + " campuses");
+        return;
+    }
+    logEvent("Campus credentials reloaded from " + config.credentialsFile + ": " +
+             std::to_string(table->size()) + " campuses, " + std::to_string(added) +
+             " added, " + std::to_string(changed) + " changed, " + std::to_string(removed) +
+             " removed");
+    if (added > 0 && !peers.empty()) {
+        updateMembership();     // New campuses need a home node
+    }
+}
+
+// SIGHUP. A bad file leaves the running table as it was.
+void CentralServer::reloadCredentials() {
+    try {
+        loadCredentials();
+        credentialReloads++;
+    } catch (const std::exception& e) {
+        LOG_ERROR(std::string("Credentials not reloaded, keeping the old ones: ") + e.what());
+    }
+}
+
+void CentralServer::initializeTCPSocket() {
+    // Multiple reactors each bind their own listener to the same port
+    bool reusePort = config.ioMode == IOMode::MULTI_REACTOR;
+    tcpSocket = createListeningSocket(reusePort, config.tcpPort);
+
+    logEvent("TCP socket initialized on port " + std::to_string(config.tcpPort));
+}
+
+int CentralServer::createListeningSocket(bool reusePort, uint16_t port) {
+    int listenSocket = socket(AF_INET, SOCK_STREAM, 0);
+    if (listenSocket < 0) {
+        throw std::runtime_error("Failed to create TCP socket");
+    }
+
+    int opt = 1;
+    setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    if (reusePort && setsockopt(listenSocket, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+        close(listenSocket);
+        throw std::runtime_error("SO_REUSEPORT not supported");
+    }
+
+    struct sockaddr_in serverAddr;
+    memset(&serverAddr, 0, sizeof(serverAddr));
+    serverAddr.sin_family = AF_INET;
+    serverAddr.sin_addr.s_addr = INADDR_ANY;
+    serverAddr.sin_port = htons(port);
+
+    if (bind(listenSocket, (struct sockaddr*)&serverAddr, sizeof(serverAddr)) < 0) {
+        close(listenSocket);
+        throw std::runtime_error("TCP bind failed");
+    }
+
+    if (listen(listenSocket, MAX_CLIENTS) < 0) {
+        close(listenSocket);
+        throw std::runtime_error("TCP listen failed");
+    }
+
+    return listenSocket;
+}
+
+// Campus connections: short messages go out at once instead of waiting on
+// Nagle, and with lanes the kernel holds little unsent data, so a message
+// queued behind a file can still be sent ahead of it
+void CentralServer::prepareCampusSocket(int fd) {
+    if (config.laneMode == LaneMode::FIFO) return;
+    int noDelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+    int lowWater = LANE_NOTSENT_LOWAT;
+    if (setsockopt(fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &lowWater, sizeof(lowWater)) < 0) {
+        LOG_DEBUG("TCP_NOTSENT_LOWAT not supported; lanes only order what the kernel refuses");
+    }
+}
+
+void CentralServer::initializeUDPSocket() {
+    udpSocket = socket(AF_INET, SOCK_DGRAM, 0);
+    if (udpSocket < 0) {
+        throw std::runtime_error("Failed to create UDP socket");
+    }
+
+    struct sockaddr_in serverAddr;
+    memset(&serverAddr, 0, sizeof(serverAddr));
+    serverAddr.sin_family = AF_INET;
+    serverAddr.sin_addr.s_addr = INADDR_ANY;
+    serverAddr.sin_port = htons(config.tcpPort + 1);
+
+    if (bind(udpSocket, (struct sockaddr*)&serverAddr, sizeof(serverAddr)) < 0) {
+        throw std::runtime_error("UDP bind failed");
+    }
+
+    // Thousands of campuses can beat in the same instant; each datagram
+    // costs far more buffer than its few bytes
+    int receiveBuffer = UDP_RECEIVE_BUFFER;
+    if (setsockopt(udpSocket, SOL_SOCKET, SO_RCVBUF, &receiveBuffer, sizeof(receiveBuffer)) < 0) {
+        LOG_WARN("Could not enlarge the UDP receive buffer");
+    }
+
+    logEvent("UDP socket initialized on port " + std::to_string(config.tcpPort + 1));
+}
+
+void CentralServer::initializeMulticast() {
+    if (config.multicastGroup == "none") {
+        logEvent("Multicast disabled; broadcasts go over TCP");
+        return;
+    }
+
+    memset(&multicastAddr, 0, sizeof(multicastAddr));
+    multicastAddr.sin_family = AF_INET;
+    multicastAddr.sin_port = htons(config.multicastPort);
+    if (inet_pton(AF_INET, config.multicastGroup.c_str(), &multicastAddr.sin_addr) != 1 ||
+        !IN_MULTICAST(ntohl(multicastAddr.sin_addr.s_addr))) {
+        throw std::runtime_error("Not a multicast group: " + config.multicastGroup);
+    }
+
+    struct in_addr interfaceAddress;
+    interfaceAddress.s_addr = htonl(INADDR_ANY);
+    if (!config.multicastInterface.empty() &&
+        inet_pton(AF_INET, config.multicastInterface.c_str(), &interfaceAddress) != 1) {
+        throw std::runtime_error("Bad multicast interface address: " + config.multicastInterface);
+    }
+
+    std::string error;
+    multicastSocket = openMulticastSender(config.multicastTtl, interfaceAddress, error);
+    if (multicastSocket < 0) {
+        // Not fatal: every campus still gets broadcasts over TCP
+        LOG_WARN("Multicast unavailable (" + error + "); broadcasts go over TCP");
+        return;
+    }
+
+    logEvent("Broadcasts multicast to " + config.multicastGroup + ":" +
+             std::to_string(config.multicastPort) + " (TTL " +
+             std::to_string(config.multicastTtl) + ")");
+}
+
+// PBKDF2 (credentials.h): slow by design, so the time it takes is kept
+bool CentralServer::authenticateClient(const CredentialTable& table, const std::string& campusName,
+                                       const std::string& password) {
+    if (!table.find(campusName)) return false;
+
+    auto started = std::chrono::steady_clock::now();
+    bool valid = table.verify(campusName, password);
+    passwordMicros += std::chrono::duration_cast<std::chrono::microseconds>(
+                          std::chrono::steady_clock::now() - started).count();
+    passwordChecks++;
+    return valid;
+}
+
+// Parses the AUTH line and checks its token or password. Touches no
+// connection or campus state, so the reactor modes run it on the auth pool.
+LoginCheck CentralServer::checkLogin(const std::string& authMsg) {
+    LoginCheck check;
+    size_t protoPos = authMsg.find("Proto:");
+    size_t tokenPos = authMsg.find("Token:");
+    size_t campusPos = authMsg.find("Campus:");
+    size_t passPos = authMsg.find("Pass:");
+
+    if (campusPos == std::string::npos || passPos == std::string::npos) {
+        return check;
+    }
+    check.parsed = true;
+
+    check.campusName = authMsg.substr(campusPos + 7, passPos - campusPos - 8);
+    std::string password = authMsg.substr(passPos + 5);
+    
+    // Remove any trailing whitespace
+    check.campusName.erase(check.campusName.find_last_not_of(" \n\r\t") + 1);
+    password.erase(password.find_last_not_of(" \n\r\t") + 1);
+
+    if (protoPos != std::string::npos && atoi(authMsg.c_str() + protoPos + 6) >= PROTOCOL_BINARY) {
+        check.protocolVersion = PROTOCOL_BINARY;
+    }
+
+    // A token from this campus's current session stands in for the password,
+    // as long as the campus is still listed. Only binary clients are given one.
+    std::shared_ptr<const CredentialTable> table = std::atomic_load(&credentials);
+    if (check.protocolVersion == PROTOCOL_BINARY && tokenPos != std::string::npos &&
+        tokenPos < campusPos && table->find(check.campusName)) {
+        size_t tokenEnd = authMsg.find(',', tokenPos);
+        check.resumed = sessions.verify(authMsg.substr(tokenPos + 6, tokenEnd - tokenPos - 6),
+                                        registry.idOf(check.campusName), time(nullptr));
+    }
+
+    check.accepted = check.resumed || authenticateClient(*table, check.campusName, password);
+    return check;
+}
+
+bool CentralServer::processAuthentication(int clientSocket, const std::string& clientIP,
+                                          const std::string& authMsg, std::string& campusName,
+                                          std::string& response, int& protocolVersion,
+                                          int reactorIndex, const LoginCheck* checked) {
+    // Parse authentication: "AUTH:Campus:LAHORE,Pass:NU-LHR-123", optionally
+    // preceded by "Proto:2," from clients that speak the binary protocol and
+    // "Compress:lz4/deflate," from those that can compress and "Mcast:1,"
+    // from those that can join the broadcast group and "Token:<token>,"
+    // from those resuming a session and "Credit:1," from those that keep
+    // to send credit (credit_ledger.h). The reactor modes have checked it
+    // already, off the loop.
+    LoginCheck check = checked ? *checked : checkLogin(authMsg);
+    size_t compressPos = authMsg.find("Compress:");
+    size_t multicastPos = authMsg.find("Mcast:");
+    size_t creditPos = authMsg.find("Credit:");
+    size_t campusPos = authMsg.find("Campus:");
+    
+    if (!check.parsed) {
+        response.clear();
+        return false;
+    }
+
+    campusName = check.campusName;
+    protocolVersion = check.protocolVersion;
+    uint16_t campusId = registry.idOf(campusName);
+    bool resumed = check.resumed;
+
+    if (!check.accepted) {
+        response = "AUTH:FAILED";
+        logEvent("Authentication failed for campus " + campusName);
+        return false;
+    }
+
+    // Hot standby: campuses log in at the primary while it is up
+    if (replication.standbyMode) {
+        response = "AUTH:REDIRECT:" + config.primaryHost + ":" + std::to_string(config.primaryPort);
+        logEvent("Campus " + campusName + " sent to the primary");
+        return false;
+    }
+
+    // Cluster mode: a campus logs in at its home node
+    std::string home;
+    if (redirectFor(campusId, home)) {
+        response = "AUTH:REDIRECT:" + home;
+        logEvent("Campus " + campusName + " redirected to its home node " + home);
+        return false;
+    }
+
+    Codec codec = CODEC_NONE;
+    if (protocolVersion == PROTOCOL_BINARY && compressPos != std::string::npos &&
+        compressPos < campusPos) {
+        size_t listStart = compressPos + 9;
+        size_t listEnd = authMsg.find(',', listStart);
+        codec = chooseCodec(authMsg.substr(listStart, listEnd - listStart), config.compression);
+    }
+
+    bool multicast = protocolVersion == PROTOCOL_BINARY && multicastSocket >= 0 &&
+                     multicastPos != std::string::npos && multicastPos < campusPos &&
+                     atoi(authMsg.c_str() + multicastPos + 6) == 1;
+    bool credited = protocolVersion == PROTOCOL_BINARY && config.creditWindow > 0 &&
+                    creditPos != std::string::npos && creditPos < campusPos &&
+                    atoi(authMsg.c_str() + creditPos + 7) == 1;
+
+    if (protocolVersion == PROTOCOL_BINARY) {
+        // Newline-terminated so the client can split it from the first frames.
+        // Broadcasts numbered from MCAST's last field on are sent by multicast.
+        response = "AUTH:SUCCESS|PROTO:2|ID:" + std::to_string(campusId) +
+                   (codec != CODEC_NONE ? "|COMPRESS:" + std::string(codecName(codec)) : "");
+        if (multicast) {
+            response += "|MCAST:" + config.multicastGroup + ":" +
+                        std::to_string(config.multicastPort) + ":" +
+                        std::to_string(broadcasts.session()) + ":" +
+                        std::to_string(broadcasts.next());
+        }
+        std::string token = resumed ? sessions.renew(campusId, time(nullptr))
+                                    : sessions.begin(campusId, time(nullptr));
+        if (!token.empty()) {
+            response += "|SESSION:" + token + (resumed ? "|RESUMED:1" : "");
+        }
+        if (credited) {
+            response += "|CREDIT:" + std::to_string(credits.windowSize());
+        }
+        response += "|DIR:" + *std::atomic_load(&campusDirectory) + "\n";
+    } else {
+        response = "AUTH:SUCCESS";
+    }
+
+    std::shared_ptr<OutboundQueue> previous;
+    if (resumed) {
+        CampusRegistry::ReadGuard guard;
+        const ClientInfo* info = registry.lookup(campusId);
+        if (info) previous = info->outbound;
+    }
+    
+    credits.enable(campusId, credited);
+
+    // Publish client info; routers see it on their next lookup
+    registry.publish({clientSocket, campusName, clientIP, true, reactorIndex, campusId,
+                      protocolVersion,
+                      std::make_shared<OutboundQueue>(config.queueHighWatermark,
+                                                      config.queueLowWatermark, config.laneMode,
+                                                      &laneStats),
+                      codec, multicast});
+    liveness.track(campusId, livenessNow());
+    if (resumed) {
+        // Same session: its lists and subscriptions stand, and senders its
+        // old queue paused can go on
+        if (previous) {
+            std::vector<std::string> waiting = previous->takeWaitingSenders();
+            if (!waiting.empty()) {
+                notifyResumed(campusName, waiting);
+            }
+        }
+    } else {
+        {
+            // A list from an earlier session means nothing to this one
+            std::lock_guard<std::mutex> lock(targetListMutex);
+            targetLists.erase(campusId);
+        }
+        topics.reset(campusId);
+    }
+    replicateCampus(campusId, true);
+    noteFailoverLogin(campusId);
+    returnCredits(campusId);    // Held back for its last connection's backlog
+    
+    logEvent("Campus " + campusName +
+             (resumed ? " resumed its session" : " authenticated successfully") + " from " +
+             clientIP + (codec != CODEC_NONE ? " (" + std::string(codecName(codec)) + ")" : ""));
+    return true;
+}
+
+static void openRelayPipe(RelayPipe& relay) {
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0) {
+        LOG_WARN("No relay pipe (" + std::string(strerror(errno)) + "), file chunks will be copied");
+        return;
+    }
+    fcntl(fds[1], F_SETPIPE_SZ, RELAY_PIPE_SIZE);
+    int capacity = fcntl(fds[1], F_GETPIPE_SZ);
+
+    relay.readFd = fds[0];
+    relay.writeFd = fds[1];
+    relay.capacity = capacity > 0 ? capacity : 0;
+}
+
+static void closeRelayPipe(RelayPipe& relay) {
+    if (relay.readFd >= 0) close(relay.readFd);
+    if (relay.writeFd >= 0) close(relay.writeFd);
+    relay.readFd = relay.writeFd = -1;
+    relay.capacity = 0;
+}
+
+void CentralServer::handleTCPClient(int clientSocket, std::string clientIP) {
+    char buffer[BUFFER_SIZE];
+    std::string campusName;
+
+    // Receive authentication message
+    memset(buffer, 0, BUFFER_SIZE);
+    int bytesRead = recv(clientSocket, buffer, BUFFER_SIZE - 1, 0);
+    
+    if (bytesRead <= 0) {
+        close(clientSocket);
+        return;
+    }
+
+    std::string response;
+    int protocolVersion = PROTOCOL_TEXT;
+    bool authenticated = processAuthentication(clientSocket, clientIP, std::string(buffer),
+                                               campusName, response, protocolVersion);
+    if (!response.empty()) {
+        send(clientSocket, response.c_str(), response.length(), 0);
+    }
+    if (!authenticated) {
+        close(clientSocket);
+        return;
+    }
+
+    // Outbound data goes through this campus's queue and writer thread, so a
+    // slow reader never blocks the threads routing to it
+    uint16_t campusId = registry.idOf(campusName);
+    std::shared_ptr<OutboundQueue> outbound;
+    {
+        CampusRegistry::ReadGuard guard;
+        outbound = registry.lookup(campusId)->outbound;
+    }
+    std::thread writerThread(&CentralServer::runCampusWriter, this, clientSocket, outbound,
+                             campusName, campusId);
+
+    // Anything stored while the campus was offline goes out first
+    startReplay(campusId);
+
+    // Binary protocol: frames may span reads or share one
+    if (protocolVersion == PROTOCOL_BINARY) {
+        FrameDecoder decoder;
+        RelayPipe relay;
+        openRelayPipe(relay);
+
+        while (isRunning) {
+            bytesRead = recv(clientSocket, decoder.prepare(BUFFER_SIZE), BUFFER_SIZE, 0);
+            threadStats.countSyscall();
+
+            if (bytesRead <= 0) {
+                logEvent("Campus " + campusName + " disconnected");
+                break;
+            }
+            decoder.commit(bytesRead);
+            if (!processFrames(decoder, campusName, campusId, threadStats)) {
+                break;
+            }
+            if (!relayChunkZeroCopy(clientSocket, relay, decoder, campusName, campusId)) {
+                logEvent("Campus " + campusName + " disconnected");
+                break;
+            }
+        }
+        closeRelayPipe(relay);
+    }
+
+    // Handle messages from this client
+    while (isRunning && protocolVersion == PROTOCOL_TEXT) {
+        bytesRead = recv(clientSocket, buffer, BUFFER_SIZE - 1, 0);
+        threadStats.countSyscall();
+        
+        if (bytesRead <= 0) {
+            logEvent("Campus " + campusName + " disconnected");
+            break;
+        }
+
+        LOG_DEBUG("Message received from " + campusName + " (" + std::to_string(bytesRead) +
+                 " bytes)");
+        parseAndRouteMessage(buffer, bytesRead, campusName);
+        threadStats.countMessage();
+    }
+
+    // Cleanup
+    if (registry.deactivate(campusId, clientSocket, -1)) {
+        liveness.forget(campusId);
+        replicateCampus(campusId, false);
+    }
+    shutdown(clientSocket, SHUT_RDWR);     // Unblocks a writer stuck on a full socket
+    outbound->close();
+    writerThread.join();
+    close(clientSocket);
+}
+
+void CentralServer::runCampusWriter(int clientSocket, std::shared_ptr<OutboundQueue> queue,
+                                    std::string campusName, uint16_t campusId) {
+    SharedFrame data;
+    while (queue->pop(data)) {
+        struct iovec part;
+        part.iov_base = const_cast<char*>(data->data());
+        part.iov_len = data->size();
+        struct iovec* next = &part;
+        int count = 1;
+
+        if (writeParts(clientSocket, next, count, threadStats) < 0) {
+            queue->close();     // The reader thread sees the broken socket and cleans up
+            break;
+        }
+
+        std::vector<std::string> resumed = queue->release(data->size());
+        if (!resumed.empty()) {
+            notifyResumed(campusName, resumed);
+        }
+        returnCredits(campusId);
+    }
+}
+
+// Threads mode zero-copy relay. When the decoder is left holding the start
+// of a FILE_CHUNK for an idle binary campus, the rest of the payload is
+// spliced from this socket into the relay pipe and from the pipe into the
+// target's socket, never entering user space. The whole remainder is
+// pulled into the pipe before anything goes to the target, so a sender
+// dropping mid-chunk cannot leave the target a torn frame. Anything else
+// (journal, text campus, queued data, another codec) falls back to the
+// normal copy path. An idle campus has nothing in its lanes for the chunk
+// to overtake; frames queued meanwhile wait behind it, as they would
+// behind a chunk taken from the bulk lane.
+// Returns false if the sender's connection failed.
+bool CentralServer::relayChunkZeroCopy(int clientSocket, RelayPipe& relay, FrameDecoder& decoder,
+                                       const std::string& sourceCampus, uint16_t sourceId) {
+    FrameHeader header;
+    const char* head;
+    size_t received;
+    if (relay.capacity == 0 || !decoder.partial(header, head, received) ||
+        header.type != FRAME_FILE_CHUNK) {
+        return true;
+    }
+    size_t remaining = FRAME_HEADER_SIZE + header.payloadLength - received;
+    if (remaining < RELAY_MIN_BYTES || remaining > relay.capacity) {
+        return true;
+    }
+
+    // A compressed chunk can only go to a campus using the same codec, named
+    // by the payload's first byte
+    Codec codec = CODEC_NONE;
+    if (header.flags & FLAG_COMPRESSED) {
+        if (received == FRAME_HEADER_SIZE) {
+            return true;
+        }
+        codec = (Codec)(uint8_t)head[FRAME_HEADER_SIZE];
+    }
+
+    auto spliceable = [this, codec](const ClientInfo* target) {
+        return target && target->isActive && target->protocolVersion == PROTOCOL_BINARY &&
+               target->outbound && !journal.pending(target->campusId) &&
+               (codec == CODEC_NONE || target->codec == codec);
+    };
+    {
+        CampusRegistry::ReadGuard guard;
+        if (!spliceable(registry.lookup(header.targetId))) {
+            return true;
+        }
+    }
+
+    for (size_t pulled = 0; pulled < remaining;) {
+        ssize_t moved = splice(clientSocket, nullptr, relay.writeFd, nullptr, remaining - pulled,
+                               SPLICE_F_MOVE);
+        threadStats.countSyscall();
+        if (moved < 0 && errno == EINTR) continue;
+        if (moved <= 0) return false;
+        pulled += moved;
+    }
+
+    // The target's socket is ours only while its queue is empty; its fd
+    // stays open until endDirect()
+    int targetFd = -1;
+    std::shared_ptr<OutboundQueue> outbound;
+    {
+        CampusRegistry::ReadGuard guard;
+        const ClientInfo* target = registry.lookup(header.targetId);
+        if (spliceable(target) && target->outbound->beginDirect()) {
+            targetFd = target->tcpSocket;
+            outbound = target->outbound;
+        }
+    }
+
+    if (!outbound) {
+        // Fallback: back into the decoder, then routed like any other frame
+        char* into = decoder.prepare(remaining);
+        for (size_t copied = 0; copied < remaining;) {
+            ssize_t got = read(relay.readFd, into + copied, remaining - copied);
+            threadStats.countSyscall();
+            if (got < 0 && errno == EINTR) continue;
+            if (got <= 0) return false;
+            copied += got;
+        }
+        decoder.commit(remaining);
+        return processFrames(decoder, sourceCampus, sourceId, threadStats);
+    }
+
+    // Fresh header (the source id comes from the login), then whatever of
+    // the payload was already read, then the pipe
+    header.sourceId = sourceId;
+    char rewritten[FRAME_HEADER_SIZE];
+    encodeFrameHeader(header, rewritten);
+    struct iovec parts[2];
+    parts[0].iov_base = rewritten;
+    parts[0].iov_len = FRAME_HEADER_SIZE;
+    parts[1].iov_base = const_cast<char*>(head + FRAME_HEADER_SIZE);
+    parts[1].iov_len = received - FRAME_HEADER_SIZE;
+    struct iovec* next = parts;
+    int count = parts[1].iov_len > 0 ? 2 : 1;
+
+    size_t pushed = 0;
+    bool sent = writeParts(targetFd, next, count, threadStats) >= 0;
+    while (sent && pushed < remaining) {
+        ssize_t moved = splice(relay.readFd, nullptr, targetFd, nullptr, remaining - pushed,
+                               SPLICE_F_MOVE);
+        threadStats.countSyscall();
+        if (moved < 0 && errno == EINTR) continue;
+        if (moved <= 0) {
+            sent = false;
+            break;
+        }
+        pushed += moved;
+    }
+
+    if (!sent) {
+        // The target got part of a frame: its stream is unusable. Empty the
+        // pipe for the next chunk and let the target's thread clean up.
+        char discard[BUFFER_SIZE];
+        while (pushed < remaining) {
+            ssize_t got = read(relay.readFd, discard,
+                               std::min(sizeof(discard), remaining - pushed));
+            if (got < 0 && errno == EINTR) continue;
+            if (got <= 0) break;
+            pushed += got;
+        }
+        shutdown(targetFd, SHUT_RDWR);
+        LOG_WARN("File chunk from " + sourceCampus + " lost: " +
+                 registry.nameOf(header.targetId) + " connection failed");
+    } else {
+        threadStats.countRelay(remaining, received - FRAME_HEADER_SIZE);
+        LOG_DEBUG("File chunk spliced from " + sourceCampus + " to " +
+                  registry.nameOf(header.targetId) + " (" +
+                  std::to_string(header.payloadLength) + " bytes)");
+    }
+    outbound->endDirect();
+    if (chargeCredit(header)) {
+        returnCredits(header.targetId);
+    }
+
+    decoder.dropPartial();
+    threadStats.countMessage();
+    return true;
+}
+
+void CentralServer::parseAndRouteMessage(const char* message, size_t length,
+                                         const std::string& sourceCampus) {
+    // Only the routing header is parsed; the payload is forwarded straight
+    // from the receive buffer
+    const char* end = message + length;
+
+    // Topic subscriptions: "SUB:KARACHI/*,*/Admissions"
+    if (length >= 4 && memcmp(message, "SUB:", 4) == 0) {
+        handleSubscription(registry.idOf(sourceCampus), std::string(message + 4, length - 4),
+                           sourceCampus);
+        return;
+    }
+
+    // Check if it's a file transfer: "FILE:TO:KARACHI|NAME:doc.txt|SIZE:123|DATA:...",
+    // or "FILE:TO:KARACHI,LAHORE|..." for several campuses
+    if (length >= 8 && memcmp(message, "FILE:TO:", 8) == 0) {
+        const char* namePos = static_cast<const char*>(memmem(message, length, "|NAME:", 6));
+        if (!namePos) return;
+        
+        std::string targetCampus(message + 8, namePos - message - 8);
+        const char* fileData = namePos + 1; // Everything after TO:
+        
+        // Find target campus socket
+        CampusRegistry::ReadGuard guard;
+        if (targetCampus.find(',') != std::string::npos) {
+            FanOut file(FRAME_FILE, sourceCampus, registry.idOf(sourceCampus), "", fileData,
+                        end - fileData);
+            routeToMany(parseTargetList(targetCampus), file);
+            return;
+        }
+        uint16_t targetId = registry.idOf(targetCampus);
+        const ClientInfo* target = registry.lookup(targetId);
+
+        PeerLink* home = (!target || !target->isActive) ? remoteHome(targetId) : nullptr;
+        if (home) {
+            if (!forwardRouted(*home, FRAME_FILE, registry.idOf(sourceCampus), targetId, "",
+                               fileData, end - fileData)) {
+                LOG_WARN("File from " + sourceCampus + " dropped: link to " + home->node.name +
+                         " is congested or down");
+            }
+            return;
+        }
+        if (storeForward(target, targetId, FRAME_FILE, sourceCampus, "", fileData,
+                         end - fileData)) {
+            return;
+        }
+        if (target && target->isActive) {
+            if (!deliverRouted(*target, FRAME_FILE, sourceCampus, "", fileData, end - fileData)) {
+                LOG_WARN("File from " + sourceCampus + " dropped: " + targetCampus + " is congested");
+                return;
+            }
+            LOG_DEBUG("File routed from " + sourceCampus + " to " + targetCampus);
+        } else {
+            LOG_WARN("Target campus " + targetCampus + " not connected for file transfer");
+        }
+        return;
+    }
+    
+    // Regular message format: "TO:KARACHI|DEPT:Admissions|MSG:Hello from Lahore"
+    const char* toPos = static_cast<const char*>(memmem(message, length, "TO:", 3));
+    const char* deptPos = static_cast<const char*>(memmem(message, length, "|DEPT:", 6));
+    const char* msgPos = deptPos ? static_cast<const char*>(memmem(deptPos, end - deptPos, "|MSG:", 5))
+                                 : nullptr;
+
+    if (!toPos || !deptPos || !msgPos || toPos > deptPos) {
+        return;
+    }
+
+    std::string targetCampus(toPos + 3, deptPos - toPos - 3);
+    std::string targetDept(deptPos + 6, msgPos - deptPos - 6);
+    const char* msgContent = msgPos + 5;
+
+    // Find target campus socket
+    CampusRegistry::ReadGuard guard;
+    if (targetCampus.find(',') != std::string::npos) {
+        FanOut routed(FRAME_MESSAGE, sourceCampus, registry.idOf(sourceCampus), targetDept,
+                      msgContent, end - msgContent);
+        routeToMany(parseTargetList(targetCampus), routed);
+        return;
+    }
+    uint16_t targetId = registry.idOf(targetCampus);
+    if (targetId != 0 && !topics.direct(targetId)) {
+        FanOut published(FRAME_MESSAGE, sourceCampus, registry.idOf(sourceCampus), targetDept,
+                         msgContent, end - msgContent, targetId);
+        routeToMany({targetId}, published);
+        return;
+    }
+    const ClientInfo* target = registry.lookup(targetId);
+
+    PeerLink* home = (!target || !target->isActive) ? remoteHome(targetId) : nullptr;
+    if (home) {
+        if (!forwardRouted(*home, FRAME_MESSAGE, registry.idOf(sourceCampus), targetId,
+                           targetDept, msgContent, end - msgContent)) {
+            LOG_WARN("Message from " + sourceCampus + " dropped: link to " + home->node.name +
+                     " is congested or down");
+        }
+        return;
+    }
+    if (storeForward(target, targetId, FRAME_MESSAGE, sourceCampus, targetDept, msgContent,
+                     end - msgContent)) {
+        return;
+    }
+    if (target && target->isActive) {
+        if (!deliverRouted(*target, FRAME_MESSAGE, sourceCampus, targetDept, msgContent,
+                           end - msgContent)) {
+            LOG_WARN("Message from " + sourceCampus + " dropped: " + targetCampus +
+                     " is congested");
+            return;
+        }
+        LOG_DEBUG("Message routed from " + sourceCampus + " to " + targetCampus);
+    } else {
+        LOG_WARN("Target campus " + targetCampus + " not connected");
+    }
+}
+
+// Routes every complete frame in the decoder. Returns false if the stream
+// is corrupt and the connection should be dropped.
+bool CentralServer::processFrames(FrameDecoder& decoder, const std::string& sourceCampus,
+                                  uint16_t sourceId, IOStats& stats) {
+    Frame frame;
+    FrameDecoder::Status status;
+
+    while ((status = decoder.next(frame)) == FrameDecoder::FRAME_READY) {
+        // The sender's id comes from its login, never from the frame
+        frame.header.sourceId = sourceId;
+        bool credited = credits.isCredited(sourceId) && spendsCredit(frame.header);
+        // Past its window a sender goes through the watermarks, but what
+        // it spends is still charged so grants match the client's count
+        bool withinWindow = credited && credits.hasWindow(sourceId, frame.header.targetId);
+        creditedTarget = withinWindow ? frame.header.targetId : 0;
+        routeFrame(frame, sourceCampus);
+        creditedTarget = 0;
+        if (credited && chargeCredit(frame.header)) {
+            returnCredits(frame.header.targetId);
+        }
+        stats.countMessage();
+    }
+
+    if (status == FrameDecoder::MALFORMED) {
+        LOG_WARN("Malformed frame from " + sourceCampus + ", dropping connection");
+        return false;
+    }
+    return true;
+}
+
+void CentralServer::routeFrame(Frame& frame, const std::string& sourceCampus) {
+    if (frame.header.type == FRAME_CONTROL) {
+        handleControlFrame(frame, sourceCampus);
+        return;
+    }
+    if (frame.header.type != FRAME_MESSAGE && frame.header.type != FRAME_FILE &&
+        !isTransferFrame(frame.header.type)) {
+        LOG_WARN("Ignoring frame type " + std::to_string(frame.header.type) + " from " +
+                 sourceCampus);
+        return;
+    }
+    if (frame.header.targetId == TARGET_LIST) {
+        routeFrameToMany(frame, sourceCampus);
+        return;
+    }
+    if (frame.header.type == FRAME_MESSAGE && frame.header.targetId != 0 &&
+        !topics.direct(frame.header.targetId)) {
+        routeFrameTo(frame, sourceCampus, {frame.header.targetId});
+        return;
+    }
+
+    const std::string& targetCampus = registry.nameOf(frame.header.targetId);
+    const char* what = frame.header.type == FRAME_MESSAGE ? "Message" : "File";
+
+    CampusRegistry::ReadGuard guard;
+    const ClientInfo* target = registry.lookup(frame.header.targetId);
+
+    // A campus homed on another node gets the frame as it arrived, compressed
+    // or not; its home expands, stores or converts it as needed
+    PeerLink* home = (!target || !target->isActive) ? remoteHome(frame.header.targetId)
+                                                    : nullptr;
+    if (home) {
+        std::string bytes(FRAME_HEADER_SIZE, '\0');
+        encodeFrameHeader(frame.header, &bytes[0]);
+        bytes.append(frame.payload, frame.header.payloadLength);
+        if (!forwardFrame(*home, makeSharedFrame(std::move(bytes)))) {
+            LOG_WARN(std::string(what) + " from " + sourceCampus + " dropped: link to " +
+                     home->node.name + " is congested or down");
+        }
+        return;
+    }
+
+    // Acks are only useful to a sender that is still waiting
+    if (frame.header.type == FRAME_FILE_ACK && (!target || !target->isActive)) {
+        LOG_DEBUG("Dropping transfer ack from " + sourceCampus + ": " + targetCampus +
+                  " not connected");
+        return;
+    }
+
+    // A compressed frame goes through untouched to a live binary campus that
+    // negotiated the same codec. Everywhere else (journal, text campus,
+    // another codec) it is expanded first.
+    static thread_local std::string expanded;
+    bool inflated = false;
+    if ((frame.header.flags & FLAG_COMPRESSED) &&
+        !(target && target->isActive && target->protocolVersion == PROTOCOL_BINARY &&
+          target->codec == frameCodec(frame) && !journal.pending(frame.header.targetId))) {
+        if (!inflateFrame(frame, expanded)) {
+            LOG_WARN(std::string(what) + " from " + sourceCampus +
+                     " dropped: corrupt compressed payload");
+            return;
+        }
+        inflated = true;
+    }
+
+    if (!target || !target->isActive || journal.pending(frame.header.targetId)) {
+        std::string department;
+        size_t bodyOffset = 0;
+        if (frame.header.type == FRAME_MESSAGE) {
+            bodyOffset = splitMessagePayload(frame, department);
+        }
+        if (storeForward(target, frame.header.targetId, (FrameType)frame.header.type,
+                         sourceCampus, department, frame.payload + bodyOffset,
+                         frame.header.payloadLength - bodyOffset)) {
+            if (frame.header.type == FRAME_FILE_BEGIN) {
+                sendUnconfirmed(frame, sourceCampus);
+            }
+            return;
+        }
+    }
+    if (!target || !target->isActive) {
+        LOG_WARN("Target campus " + (targetCampus.empty() ? std::to_string(frame.header.targetId)
+                                                          : targetCampus) + " not connected");
+        return;
+    }
+
+    bool delivered = true;
+    if (target->protocolVersion == PROTOCOL_BINARY) {
+        // Same payload, fresh header: only the source id differs, unless the
+        // payload was expanded above and goes out in the target's codec.
+        // BEGIN, END and ACK are tiny and losing one stalls a transfer until
+        // a timeout, so congestion only ever drops chunks.
+        bool transferControl = isTransferFrame(frame.header.type) &&
+                               frame.header.type != FRAME_FILE_CHUNK;
+        delivered = transferControl || admitOutbound(*target, sourceCampus);
+        static thread_local std::string recompressed;
+        if (delivered && inflated && target->codec != CODEC_NONE &&
+            compressFrame(frame.header, frame.payload, frame.header.payloadLength,
+                          target->codec, recompressed)) {
+            deliverToCampus(*target, recompressed, nullptr, 0);
+        } else if (delivered) {
+            std::string header(FRAME_HEADER_SIZE, '\0');
+            encodeFrameHeader(frame.header, &header[0]);
+            deliverToCampus(*target, header, frame.payload, frame.header.payloadLength);
+        }
+        if (delivered) {
+            if (frame.header.type == FRAME_FILE_CHUNK) {
+                statsForThread().countRelay(0, frame.header.payloadLength);
+            }
+        }
+    } else {
+        std::string department;
+        size_t bodyOffset = 0;
+        if (frame.header.type == FRAME_MESSAGE) {
+            bodyOffset = splitMessagePayload(frame, department);
+        }
+        delivered = deliverRouted(*target, (FrameType)frame.header.type, sourceCampus,
+                                  department, frame.payload + bodyOffset,
+                                  frame.header.payloadLength - bodyOffset);
+        if (delivered && frame.header.type == FRAME_FILE_BEGIN) {
+            sendUnconfirmed(frame, sourceCampus);
+        }
+    }
+    if (!delivered) {
+        LOG_WARN(std::string(what) + " from " + sourceCampus + " dropped: " + targetCampus +
+                 " is congested");
+        return;
+    }
+    LOG_DEBUG(std::string(what) + " routed from " + sourceCampus + " to " + targetCampus +
+             " (" + std::to_string(frame.header.payloadLength) + " bytes)");
+}
+
+// Sends a routed message in whichever protocol the target negotiated. Only
+// the routing header is built here; the body goes out from the caller's
+// buffer without being copied. Returns false if the target is congested.
+bool CentralServer::deliverRouted(const ClientInfo& target, FrameType type,
+                                  const std::string& sourceCampus, const std::string& department,
+                                  const char* body, size_t bodyLength) {
+    if (!admitOutbound(target, sourceCampus)) {
+        return false;
+    }
+    sendRouted(target, type, sourceCampus, department, body, bodyLength);
+    return true;
+}
+
+// Builds the routing header for the target's protocol and hands it and the
+// body to the I/O layer. Admission is the caller's job.
+void CentralServer::sendRouted(const ClientInfo& target, FrameType type,
+                               const std::string& sourceCampus, const std::string& department,
+                               const char* body, size_t bodyLength) {
+    std::string head;
+    if (target.protocolVersion == PROTOCOL_BINARY) {
+        head = buildFrameHead(type, registry.idOf(sourceCampus), target.campusId,
+                              department, bodyLength);
+        if (target.codec != CODEC_NONE && bodyLength >= COMPRESS_MIN_BYTES) {
+            // Compression wants the payload in one piece
+            static thread_local std::string frame, compressed;
+            frame.assign(head);
+            frame.append(body, bodyLength);
+            if (compressFrame(frame.data(), frame.size(), target.codec, compressed)) {
+                deliverToCampus(target, compressed, nullptr, 0);
+                return;
+            }
+        }
+    } else if (isTransferFrame(type)) {
+        relayLegacyFile(target, type, sourceCampus, body, bodyLength);
+        return;
+    } else if (type == FRAME_FILE) {
+        head = "FILE:FROM:" + sourceCampus + "|";
+    } else if (type == FRAME_BROADCAST) {
+        head = "BROADCAST:";
+    } else {
+        head = "FROM:" + sourceCampus + "|DEPT:" + department + "|MSG:";
+    }
+    deliverToCampus(target, head, body, bodyLength);
+}
+
+// Queues one message for several campuses, encoded once per wire format
+// (see fanout.h). Admission works as for single sends. Caller holds a
+// registry read guard. Returns how many campuses it was queued for.
+size_t CentralServer::fanOut(FanOut& message, const std::vector<const ClientInfo*>& targets) {
+    bool transferControl = isTransferFrame(message.type()) && message.type() != FRAME_FILE_CHUNK;
+    size_t queued = 0;
+    int encodingsBefore = message.encodingCount();
+
+    for (const ClientInfo* target : targets) {
+        if (!transferControl && !admitOutbound(*target, message.source())) {
+            LOG_WARN("Fan-out from " + (message.source().empty() ? "admin" : message.source()) +
+                     " to " + target->campusName + " dropped: campus is congested");
+            continue;
+        }
+        const SharedFrame& frame = message.frameFor(target->protocolVersion, target->codec);
+        if (frame) {
+            deliverToCampus(*target, frame);
+        } else {
+            relayLegacyFile(*target, message.type(), message.source(), message.data(),
+                            message.length());
+        }
+        queued++;
+    }
+
+    fanOutMessages.fetch_add(1, std::memory_order_relaxed);
+    fanOutDeliveries.fetch_add(queued, std::memory_order_relaxed);
+    fanOutEncodings.fetch_add(message.encodingCount() - encodingsBefore,
+                              std::memory_order_relaxed);
+    return queued;
+}
+
+// One message for a list of campuses: connected ones get it through the
+// fan-out, known offline ones in their journals. A message is published on
+// each target's topic too: a connected target gets it only if subscribed,
+// and other subscribers get it live (never from a journal). Caller holds a
+// registry read guard.
+void CentralServer::routeToMany(const std::vector<uint16_t>& targetIds, FanOut& message) {
+    bool published = message.type() == FRAME_MESSAGE;
+    TopicIndex::Subscribers subscribers;
+    if (published) {
+        for (uint16_t targetId : targetIds) {
+            subscribers |= topics.match(targetId, message.department());
+        }
+        topicPublishes.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    std::vector<const ClientInfo*> live;
+    live.reserve(targetIds.size());
+    for (uint16_t targetId : targetIds) {
+        const ClientInfo* target = registry.lookup(targetId);
+        PeerLink* home = (!target || !target->isActive) ? remoteHome(targetId) : nullptr;
+        if (home) {
+            // Its home applies its own subscriptions
+            if (!forwardRouted(*home, message.type(), message.sender(), targetId,
+                               message.department(), message.data(), message.length())) {
+                LOG_WARN("Fan-out to " + registry.nameOf(targetId) + " dropped: link to " +
+                         home->node.name + " is congested or down");
+            }
+            continue;
+        }
+        if (!target || !target->isActive || journal.pending(targetId)) {
+            if (storeForward(target, targetId, message.type(), message.source(),
+                             message.department(), message.data(), message.length())) {
+                continue;
+            }
+        }
+        if (!target || !target->isActive) {
+            LOG_WARN("Target campus " + registry.nameOf(targetId) + " not connected");
+            continue;
+        }
+        if (published && !subscribers.contains(targetId)) {
+            topicFiltered.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        live.push_back(target);
+    }
+
+    // Subscribers that were not addressed; the sender has its own copy
+    CampusSet addressed(subscribers.empty() ? std::vector<uint16_t>() : targetIds);
+    for (uint16_t subscriberId : subscribers) {
+        if (subscriberId == message.sender() || addressed.contains(subscriberId)) continue;
+        const ClientInfo* subscriber = registry.lookup(subscriberId);
+        if (subscriber && subscriber->isActive) {
+            live.push_back(subscriber);
+            topicExtra.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    size_t queued = fanOut(message, live);
+    LOG_DEBUG("Fan-out from " + message.source() + " to " + std::to_string(queued) + " of " +
+              std::to_string(targetIds.size()) + " campuses (" +
+              std::to_string(message.length()) + " bytes)");
+}
+
+// A binary frame addressed to TARGET_LIST. Transfers to several campuses
+// are unconfirmed, as stored ones are: the sender is told so at BEGIN and
+// the receivers' answers are not collected.
+void CentralServer::routeFrameToMany(Frame& frame, const std::string& sourceCampus) {
+    std::vector<uint16_t> targetIds;
+    {
+        std::lock_guard<std::mutex> lock(targetListMutex);
+        auto list = targetLists.find(frame.header.sourceId);
+        if (list != targetLists.end()) targetIds = list->second;
+    }
+    if (targetIds.empty() || frame.header.type == FRAME_FILE_ACK) {
+        LOG_WARN("Frame from " + sourceCampus + " for a target list it never sent, dropped");
+        return;
+    }
+    frame.header.targetId = 0;
+    routeFrameTo(frame, sourceCampus, targetIds);
+}
+
+// A binary frame through the fan-out: for a list of campuses, or for a
+// message whose topic has subscribers other than its target. The frame's
+// target id is what recipients see.
+void CentralServer::routeFrameTo(Frame& frame, const std::string& sourceCampus,
+                                 const std::vector<uint16_t>& targetIds) {
+    // Expanded once for the other codecs; campuses using the sender's codec
+    // get the frame as it arrived
+    static thread_local std::string expanded;
+    SharedFrame original;
+    Codec codec = CODEC_NONE;
+    if (frame.header.flags & FLAG_COMPRESSED) {
+        codec = frameCodec(frame);
+        std::string bytes(FRAME_HEADER_SIZE, '\0');
+        encodeFrameHeader(frame.header, &bytes[0]);
+        bytes.append(frame.payload, frame.header.payloadLength);
+        original = makeSharedFrame(std::move(bytes));
+        if (!inflateFrame(frame, expanded)) {
+            LOG_WARN("Frame from " + sourceCampus + " dropped: corrupt compressed payload");
+            return;
+        }
+    }
+
+    std::string department;
+    size_t bodyOffset = 0;
+    if (frame.header.type == FRAME_MESSAGE) {
+        bodyOffset = splitMessagePayload(frame, department);
+    }
+
+    CampusRegistry::ReadGuard guard;
+    if (frame.header.type == FRAME_FILE_BEGIN) {
+        sendUnconfirmed(frame, sourceCampus);
+    }
+    FanOut message((FrameType)frame.header.type, sourceCampus, frame.header.sourceId, department,
+                   frame.payload + bodyOffset, frame.header.payloadLength - bodyOffset,
+                   frame.header.targetId);
+    if (original) {
+        message.seed(codec, original);
+    }
+    routeToMany(targetIds, message);
+}
+
+// "LAHORE,KARACHI" as campus ids, without unknown names or repeats
+std::vector<uint16_t> CentralServer::parseTargetList(const std::string& names) {
+    std::vector<uint16_t> targetIds;
+    size_t start = 0;
+    while (start <= names.size()) {
+        size_t comma = names.find(',', start);
+        if (comma == std::string::npos) comma = names.size();
+        std::string name = names.substr(start, comma - start);
+        start = comma + 1;
+        if (name.empty()) continue;
+
+        uint16_t targetId = registry.idOf(name);
+        if (targetId == 0) {
+            LOG_WARN("Unknown campus " + name + " in target list");
+        } else if (std::find(targetIds.begin(), targetIds.end(), targetId) == targetIds.end()) {
+            targetIds.push_back(targetId);
+        }
+    }
+    return targetIds;
+}
+
+// Converts a chunked transfer for a text protocol client: chunks are
+// collected and the file goes out as one hex FILE message at FILE_END.
+// Files over LEGACY_FILE_LIMIT are dropped, as are transfers with gaps or
+// bad checksums.
+void CentralServer::relayLegacyFile(const ClientInfo& target, FrameType type,
+                                    const std::string& sourceCampus, const char* body,
+                                    size_t bodyLength) {
+    Frame frame;
+    frame.header.type = type;
+    frame.header.payloadLength = bodyLength;
+    frame.payload = body;
+    TransferFrame transfer;
+    if (!parseTransferFrame(frame, transfer) || type == FRAME_FILE_ACK) return;
+
+    auto key = std::make_tuple(target.campusId, sourceCampus, transfer.transferId);
+    std::string message;
+    {
+        std::lock_guard<std::mutex> lock(legacyMutex);
+        if (type == FRAME_FILE_BEGIN) {
+            if (transfer.value > LEGACY_FILE_LIMIT) {
+                LOG_WARN("File from " + sourceCampus + " (" + std::to_string(transfer.value) +
+                         " bytes) too large for text client " + target.campusName);
+                return;
+            }
+            LegacyTransfer& legacy = legacyTransfers[key];
+            legacy.name.assign(transfer.data, transfer.length);
+            legacy.data.clear();
+            legacy.data.reserve(transfer.value);
+            return;
+        }
+
+        auto it = legacyTransfers.find(key);
+        if (it == legacyTransfers.end()) return;
+        LegacyTransfer& legacy = it->second;
+
+        if (type == FRAME_FILE_CHUNK) {
+            if (transfer.value != legacy.data.size() ||
+                legacy.data.size() + transfer.length > LEGACY_FILE_LIMIT ||
+                crc32c(transfer.data, transfer.length) != transfer.check) {
+                LOG_WARN("File from " + sourceCampus + " for " + target.campusName +
+                         " dropped: bad chunk at offset " + std::to_string(transfer.value));
+                legacyTransfers.erase(it);
+                return;
+            }
+            legacy.data.append(transfer.data, transfer.length);
+            return;
+        }
+
+        uint8_t digest[SHA256_DIGEST_SIZE];
+        Sha256 sha;
+        sha.update(legacy.data.data(), legacy.data.size());
+        sha.finish(digest);
+        if (transfer.value != legacy.data.size() || transfer.length != SHA256_DIGEST_SIZE ||
+            memcmp(digest, transfer.data, SHA256_DIGEST_SIZE) != 0) {
+            LOG_WARN("File from " + sourceCampus + " for " + target.campusName +
+                     " dropped: incomplete or corrupt");
+            legacyTransfers.erase(it);
+            return;
+        }
+
+        message = "FILE:FROM:" + sourceCampus + "|NAME:" + legacy.name +
+                  "|SIZE:" + std::to_string(legacy.data.size()) + "|DATA:";
+        size_t start = message.size();
+        message.resize(start + legacy.data.size() * 2);
+        hexEncode(legacy.data.data(), legacy.data.size(), &message[start]);
+        legacyTransfers.erase(it);
+    }
+    deliverToCampus(target, message);
+}
+
+// Tells the sender of a chunked file that no receiver will answer: the
+// file is being stored for later or converted for a text client. Caller
+// holds a registry read guard.
+void CentralServer::sendUnconfirmed(const Frame& begin, const std::string& sourceCampus) {
+    TransferFrame transfer;
+    const ClientInfo* sender = registry.lookup(sourceCampus);
+    if (!parseTransferFrame(begin, transfer) || !sender || !sender->isActive) {
+        return;
+    }
+    std::string ack = buildTransferFrame(FRAME_FILE_ACK, begin.header.targetId, sender->campusId,
+                                         transfer.transferId, 0, TRANSFER_UNCONFIRMED, nullptr, 0);
+    deliverToCampus(*sender, ack);
+}
+
+// Store-and-forward: journals a message for a known campus that is offline,
+// or that is online but still replaying its journal (so new messages stay
+// behind the old ones). Returns true if the message was handled here.
+// Caller holds a registry read guard.
+bool CentralServer::storeForward(const ClientInfo* target, uint16_t targetId, FrameType type,
+                                 const std::string& sourceCampus, const std::string& department,
+                                 const char* body, size_t bodyLength) {
+    if (targetId == 0) return false;
+
+    bool online = target && target->isActive;
+    if (online && !journal.pending(targetId)) {
+        return false;
+    }
+
+    try {
+        JournalAppend result = journal.append(targetId, type, sourceCampus, department, body,
+                                              bodyLength, online);
+        if (result == JournalAppend::NOT_PENDING) {
+            return false;   // Replay finished meanwhile: deliver directly
+        }
+        if (result == JournalAppend::FULL) {
+            LOG_WARN("Message from " + sourceCampus + " for " + registry.nameOf(targetId) +
+                     " dropped: journal full");
+            return true;
+        }
+    } catch (const std::exception& e) {
+        LOG_ERROR(std::string("Journal write failed: ") + e.what());
+        return !online;
+    }
+    LOG_DEBUG("Stored message from " + sourceCampus + " for " + registry.nameOf(targetId) +
+              " (" + std::to_string(bodyLength) + " bytes)");
+    return true;
+}
+
+void CentralServer::startReplay(uint16_t campusId) {
+    if (journal.pending(campusId)) {
+        std::thread(&CentralServer::replayJournal, this, campusId).detach();
+    }
+}
+
+// Once pending clears, new messages go straight to the campus, so it is
+// cleared on the campus's own loop: behind everything this replay handed
+// over, which may still be waiting in the loop's inbox. Threads mode keeps
+// one FIFO per campus and needs no hop.
+void CentralServer::finishReplay(uint16_t campusId) {
+    auto finish = [this, campusId]() {
+        if (!journal.finishReplay(campusId)) {
+            startReplay(campusId);
+        }
+    };
+
+    int reactorIndex = -1;
+    {
+        CampusRegistry::ReadGuard guard;
+        const ClientInfo* target = registry.lookup(campusId);
+        if (target && target->isActive) {
+            reactorIndex = target->reactorIndex;
+        }
+    }
+    if (config.ioMode == IOMode::THREADS || reactorIndex < 0 ||
+        reactorIndex >= (int)reactors.size()) {
+        finish();
+        return;
+    }
+
+    ReactorMessage* message = new ReactorMessage();
+    message->task = finish;
+    postToReactor(*reactors[reactorIndex], message);
+}
+
+// Sends a reconnected campus everything journaled for it, oldest first and
+// as fast as its outbound queue takes it. Runs on its own thread.
+void CentralServer::replayJournal(uint16_t campusId) {
+    const std::string& campusName = registry.nameOf(campusId);
+
+    while (journal.beginReplay(campusId)) {
+        auto started = std::chrono::steady_clock::now();
+        uint64_t records = 0;
+        uint64_t bytes = 0;
+        bool interrupted = false;
+
+        JournalRecord record;
+        std::shared_ptr<JournalSegment> holder;
+        while (!interrupted && journal.next(campusId, record, holder)) {
+            bool sent = false;
+            while (!sent && isRunning) {
+                std::shared_ptr<OutboundQueue> congested;
+                {
+                    CampusRegistry::ReadGuard guard;
+                    const ClientInfo* target = registry.lookup(campusId);
+                    if (!target || !target->isActive) break;
+
+                    if (target->outbound && !target->outbound->tryAdmit()) {
+                        congested = target->outbound;
+                    } else {
+                        sendRouted(*target, record.type, record.sourceCampus, record.department,
+                                   record.body, record.bodyLength);
+                        sent = true;
+                    }
+                }
+                if (congested) {
+                    // Wait for the campus to drain rather than dropping stored
+                    // data. The timeout catches a campus that went away or
+                    // came back with a new queue.
+                    congested->waitResumed(std::chrono::milliseconds(REPLAY_DRAIN_WAIT_MS));
+                }
+            }
+
+            if (!sent) {
+                interrupted = true;
+                break;
+            }
+            journal.consume(campusId, record);
+            records++;
+            bytes += record.bodyLength;
+        }
+
+        uint64_t micros = std::chrono::duration_cast<std::chrono::microseconds>(
+                              std::chrono::steady_clock::now() - started).count();
+        if (records > 0) {
+            journal.recordReplay(campusId, records, bytes, micros);
+            double seconds = micros / 1e6;
+            LOG_INFO("Replayed " + std::to_string(records) + " stored messages (" +
+                     std::to_string(bytes) + " bytes) to " + campusName + " in " +
+                     std::to_string(seconds) + " s, " +
+                     std::to_string((uint64_t)(seconds > 0 ? records / seconds : records)) +
+                     " msg/s");
+        }
+        if (!interrupted) {
+            finishReplay(campusId);
+            return;
+        }
+
+        journal.abortReplay(campusId);
+        LOG_INFO("Replay to " + campusName + " interrupted, " +
+                 std::to_string(journal.stats(campusId)->records.load()) + " messages kept");
+
+        // A reconnect during the interruption found this replay still
+        // running and left it to us
+        CampusRegistry::ReadGuard guard;
+        const ClientInfo* target = registry.lookup(campusId);
+        if (!isRunning || !target || !target->isActive) {
+            return;
+        }
+    }
+}
+
+// Backpressure: refuses a message for a congested campus and, the first
+// time a given sender runs into it, tells that sender to pause. Caller
+// holds a registry read guard.
+bool CentralServer::admitOutbound(const ClientInfo& target, const std::string& sourceCampus) {
+    if (!target.outbound) return true;
+    if (target.campusId == creditedTarget) {
+        target.outbound->admitCredited();
+        return true;
+    }
+
+    bool newlyBlocked = false;
+    if (target.outbound->admit(sourceCampus, newlyBlocked)) {
+        return true;
+    }
+    if (newlyBlocked) {
+        LOG_WARN("Campus " + target.campusName + " congested, pausing " + sourceCampus);
+        sendFlowSignal(sourceCampus, "PAUSE", target.campusName);
+    }
+    return false;
+}
+
+// Flow control signals ("FLOW:PAUSE:<campus>", "FLOW:RESUME:<campus>") go
+// out as control frames, so only binary protocol senders receive them.
+// Caller holds a registry read guard.
+void CentralServer::sendFlowSignal(const std::string& senderCampus, const std::string& signal,
+                                   const std::string& targetCampus) {
+    const ClientInfo* sender = registry.lookup(senderCampus);
+    if (!sender || !sender->isActive || sender->protocolVersion != PROTOCOL_BINARY) {
+        return;
+    }
+    std::string frame = buildFrame(FRAME_CONTROL, 0, sender->campusId, "",
+                                   "FLOW:" + signal + ":" + targetCampus);
+    deliverToCampus(*sender, frame);
+}
+
+// Charges a routed frame to its sender's credit for the target. True if
+// the target now owes the sender a grant.
+bool CentralServer::chargeCredit(const FrameHeader& header) {
+    if (!credits.isCredited(header.sourceId) || !spendsCredit(header)) {
+        return false;
+    }
+    return credits.charge(header.sourceId, header.targetId,
+                          FRAME_HEADER_SIZE + header.payloadLength);
+}
+
+// Gives senders back the credit they spent on a campus ("CREDIT:<target
+// id>:<bytes>") once its backlog is at or below the low watermark, or at
+// once if nothing is queued for it here. Called after routing to it and
+// whenever its queue is released, with no registry guard held.
+void CentralServer::returnCredits(uint16_t targetId) {
+    if (!credits.anyDue(targetId)) return;
+
+    static thread_local std::vector<std::pair<uint16_t, uint32_t>> grants;
+    CampusRegistry::ReadGuard guard;
+    const ClientInfo* target = registry.lookup(targetId);
+    if (target && target->isActive && target->outbound && !journal.pending(targetId) &&
+        !target->outbound->drained()) {
+        return;     // Its next release tries again
+    }
+    credits.collect(targetId, grants);
+    for (const auto& grant : grants) {
+        const ClientInfo* sender = registry.lookup(grant.first);
+        if (!sender || !sender->isActive || sender->protocolVersion != PROTOCOL_BINARY) {
+            continue;   // Logs in again with a full window
+        }
+        std::string frame = buildFrame(FRAME_CONTROL, 0, grant.first, "",
+                                       "CREDIT:" + std::to_string(targetId) + ":" +
+                                       std::to_string(grant.second));
+        deliverToCampus(*sender, frame);
+    }
+}
+
+// Called by the I/O layer once a campus drains below its low watermark
+void CentralServer::notifyResumed(const std::string& targetCampus,
+                                  const std::vector<std::string>& senders) {
+    logEvent("Campus " + targetCampus + " drained, resuming senders");
+
+    CampusRegistry::ReadGuard guard;
+    for (const std::string& sender : senders) {
+        sendFlowSignal(sender, "RESUME", targetCampus);
+    }
+}
+
+void CentralServer::handleUDPMessages() {
+    HeartbeatReceiver batch;
+
+    while (isRunning) {
+        int received = batch.receive(udpSocket, true);
+        threadStats.countSyscall();
+
+        if (received > 0) {
+            processHeartbeats(batch, received);
+        }
+    }
+}
+
+// Resolves a batch of datagrams to campus ids in place, without allocating
+void CentralServer::processHeartbeats(const HeartbeatReceiver& batch, int count) {
+    uint32_t ids[HEARTBEAT_BATCH];
+    size_t known = 0;
+    for (int i = 0; i < count; i++) {
+        const char* name;
+        size_t nameLength;
+        if (!parseHeartbeat(batch.data(i), batch.length(i), name, nameLength)) continue;
+
+        uint16_t id = registry.idOf(name, nameLength);
+        if (id != 0) {
+            ids[known++] = id;
+        }
+    }
+    recordHeartbeats(ids, known);
+}
+
+void CentralServer::processHeartbeat(const char* data, size_t length) {
+    const char* name;
+    size_t nameLength;
+    if (!parseHeartbeat(data, length, name, nameLength)) return;
+
+    uint32_t id = registry.idOf(name, nameLength);
+    if (id != 0) {
+        recordHeartbeats(&id, 1);
+    }
+}
+
+// One clock read for the whole batch: atomic stores into the campuses'
+// slots, then O(1) moves of their deadlines under one liveness lock
+void CentralServer::recordHeartbeats(const uint32_t* ids, size_t count) {
+    if (count == 0) return;
+    heartbeatBatches.fetch_add(1, std::memory_order_relaxed);
+
+    time_t now = time(nullptr);
+    for (size_t i = 0; i < count; i++) {
+        registry.touchHeartbeat((uint16_t)ids[i], now);
+    }
+
+    static thread_local std::vector<uint32_t> resumed;
+    resumed.clear();
+    liveness.heartbeat(ids, count, livenessNow(), resumed);
+    for (uint32_t id : resumed) {
+        LOG_INFO("Heartbeat from " + registry.nameOf(id) + " resumed");
+    }
 }
 
-void CentralServer::loadCredentials() {
-    // Initialize campus credentials (Campus:Password)
-    campusCredentials["LAHORE"] = "NU-LHR-123";
-    campusCredentials["KARACHI"] = "NU-KHI-123";
-    campusCredentials["PESHAWAR"] = "NU-PWR-123";
-    campusCredentials["CFD"] = "NU-CFD-123";
-    campusCredentials["MULTAN"] = "NU-MLN-123";
-    
-    logEvent("Campus credentials loaded successfully");
-}
+// Sends parts with as few syscalls as the kernel allows, advancing parts
+// and count past what was written. Stops early only if a non-blocking
+// socket is full. Returns bytes written, or -1 on error.
+ssize_t CentralServer::writeParts(int fd, struct iovec*& parts, int& count, IOStats& stats) {
+    ssize_t total = 0;
+    while (count > 0) {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = parts;
+        msg.msg_iovlen = count;
 
-void CentralServer::initializeTCPSocket() {
-    tcpSocket = socket(AF_INET, SOCK_STREAM, 0);
-    if (tcpSocket < 0) {
-        throw std::runtime_error("Failed to create TCP socket");
+        ssize_t sent = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        stats.countSyscall();
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            return -1;
+        }
+        total += sent;
+
+        // Drop fully written parts and trim a partially written one
+        while (count > 0 && (size_t)sent >= parts->iov_len) {
+            sent -= parts->iov_len;
+            parts++;
+            count--;
+        }
+        if (count > 0) {
+            parts->iov_base = static_cast<char*>(parts->iov_base) + sent;
+            parts->iov_len -= sent;
+        }
     }
+    return total;
+}
 
-    int opt = 1;
-    setsockopt(tcpSocket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+// head is the (rewritten) routing header; body, if any, is sent after it
+// straight from the caller's buffer
+void CentralServer::deliverToCampus(const ClientInfo& target, const std::string& head,
+                                    const char* body, size_t bodyLength) {
+    struct iovec parts[2];
+    parts[0].iov_base = const_cast<char*>(head.data());
+    parts[0].iov_len = head.size();
+    parts[1].iov_base = const_cast<char*>(body);
+    parts[1].iov_len = bodyLength;
+    int count = bodyLength > 0 ? 2 : 1;
 
-    struct sockaddr_in serverAddr;
-    memset(&serverAddr, 0, sizeof(serverAddr));
-    serverAddr.sin_family = AF_INET;
-    serverAddr.sin_addr.s_addr = INADDR_ANY;
-    serverAddr.sin_port = htons(TCP_PORT);
+    if (config.ioMode == IOMode::THREADS) {
+        // The campus's writer thread does the (blocking) send
+        if (target.outbound) {
+            std::string data;
+            data.reserve(head.size() + bodyLength);
+            data.append(head);
+            data.append(body, bodyLength);
+            target.outbound->push(makeSharedFrame(std::move(data)));
+        }
+        return;
+    }
 
-    if (bind(tcpSocket, (struct sockaddr*)&serverAddr, sizeof(serverAddr)) < 0) {
-        throw std::runtime_error("TCP bind failed");
+    // Reactor modes: only the owning loop touches a connection, so hand the
+    // bytes over unless we are already running on that loop
+    if (target.reactorIndex < 0 || target.reactorIndex >= (int)reactors.size()) {
+        return;
     }
+    Reactor& owner = *reactors[target.reactorIndex];
 
-    if (listen(tcpSocket, MAX_CLIENTS) < 0) {
-        throw std::runtime_error("TCP listen failed");
+    if (currentReactor() == &owner) {
+        auto it = owner.connections.find(target.tcpSocket);
+        if (it != owner.connections.end()) {
+            queueWrite(owner, *it->second, parts, count);
+        }
+        return;
     }
 
-    logEvent("TCP socket initialized on port " + std::to_string(TCP_PORT));
+    // Crossing threads: the body must outlive the caller's receive buffer
+    std::string data;
+    data.reserve(head.size() + bodyLength);
+    data.append(head);
+    data.append(body, bodyLength);
+    postFrame(owner, target, makeSharedFrame(std::move(data)));
 }
 
-void CentralServer::initializeUDPSocket() {
-    udpSocket = socket(AF_INET, SOCK_DGRAM, 0);
-    if (udpSocket < 0) {
-        throw std::runtime_error("Failed to create UDP socket");
+// Queues a frame shared with other campuses; only the reference is copied
+void CentralServer::deliverToCampus(const ClientInfo& target, const SharedFrame& frame) {
+    if (config.ioMode == IOMode::THREADS) {
+        if (target.outbound) {
+            target.outbound->push(frame);
+        }
+        return;
     }
 
-    struct sockaddr_in serverAddr;
-    memset(&serverAddr, 0, sizeof(serverAddr));
-    serverAddr.sin_family = AF_INET;
-    serverAddr.sin_addr.s_addr = INADDR_ANY;
-    serverAddr.sin_port = htons(UDP_PORT);
+    if (target.reactorIndex < 0 || target.reactorIndex >= (int)reactors.size()) {
+        return;
+    }
+    Reactor& owner = *reactors[target.reactorIndex];
 
-    if (bind(udpSocket, (struct sockaddr*)&serverAddr, sizeof(serverAddr)) < 0) {
-        throw std::runtime_error("UDP bind failed");
+    if (currentReactor() == &owner) {
+        auto it = owner.connections.find(target.tcpSocket);
+        if (it != owner.connections.end()) {
+            queueWrite(owner, *it->second, frame);
+        }
+        return;
     }
+    postFrame(owner, target, frame);
+}
 
-    logEvent("UDP socket initialized on port " + std::to_string(UDP_PORT));
+void CentralServer::postFrame(Reactor& owner, const ClientInfo& target, SharedFrame frame) {
+    ReactorMessage* message = new ReactorMessage();
+    message->fd = target.tcpSocket;
+    message->campusName = target.campusName;
+    message->campusId = target.campusId;
+    message->data = std::move(frame);
+    message->outbound = target.outbound;
+    if (message->outbound) {
+        message->outbound->add(message->data->size());
+    }
+    postToReactor(owner, message);
 }
 
-bool CentralServer::authenticateClient(const std::string& campusName, const std::string& password) {
-    auto it = campusCredentials.find(campusName);
-    if (it != campusCredentials.end() && it->second == password) {
-        return true;
+void CentralServer::monitorHeartbeats() {
+    const int sweepTicks = 15000 / LIVENESS_TICK_MS;  // Replay and reclaim every 15 seconds
+    const int syncTicks = MULTICAST_SYNC_MS / LIVENESS_TICK_MS;
+    const int pingTicks = CLUSTER_PING_MS / LIVENESS_TICK_MS;
+    const int standbyPingTicks = REPLICATION_PING_MS / LIVENESS_TICK_MS;
+    int ticks = 0;
+    std::vector<uint32_t> suspects;
+    std::vector<uint32_t> dead;
+
+    // SIGHUP is blocked in every thread (see main) and taken here
+    sigset_t hangup;
+    sigemptyset(&hangup);
+    sigaddset(&hangup, SIGHUP);
+
+    while (isRunning) {
+        usleep(LIVENESS_TICK_MS * 1000);
+
+        sigset_t pending;
+        int signalNumber;
+        if (sigpending(&pending) == 0 && sigismember(&pending, SIGHUP) &&
+            sigwait(&hangup, &signalNumber) == 0) {
+            reloadCredentials();
+        }
+
+        // Only the deadlines due this tick are touched, however many
+        // campuses are connected
+        suspects.clear();
+        dead.clear();
+        liveness.poll(livenessNow(), suspects, dead);
+        for (uint32_t id : suspects) {
+            int silent = difftime(time(nullptr), registry.lastHeartbeat(id));
+            LOG_WARN("No heartbeat from " + registry.nameOf(id) + " for " +
+                     std::to_string(silent) + " seconds");
+        }
+        for (uint32_t id : dead) {
+            expireCampus(id);
+        }
+
+        if (++ticks % syncTicks == 0) {
+            sendBroadcastSync();
+        }
+        if (ticks % pingTicks == 0) {
+            pingPeers();
+        }
+        if (ticks % standbyPingTicks == 0) {
+            pingStandby();
+        }
+        if (ticks < sweepTicks) continue;
+        ticks = 0;
+
+        {
+            CampusRegistry::ReadGuard guard;
+            for (uint16_t id = 1; id <= registry.maxId(); id++) {
+                const ClientInfo* campus = registry.lookup(id);
+                if (campus && campus->isActive) {
+                    // Picks up messages stored after a replay had finished
+                    startReplay(id);
+                }
+            }
+        }
+
+        // Frees entries retired since the last connect or disconnect
+        registry.reclaim();
     }
-    return false;
 }
 
-void CentralServer::handleTCPClient(int clientSocket, std::string clientIP) {
-    char buffer[BUFFER_SIZE];
+// Takes a campus whose heartbeats stopped offline, so new messages go to its
+// journal, and closes its connection on the thread that owns it
+void CentralServer::expireCampus(uint16_t campusId) {
+    int fd = -1;
+    int reactorIndex = -1;
     std::string campusName;
-
-    // Receive authentication message
-    memset(buffer, 0, BUFFER_SIZE);
-    int bytesRead = recv(clientSocket, buffer, BUFFER_SIZE - 1, 0);
-    
-    if (bytesRead <= 0) {
-        close(clientSocket);
-        return;
+    {
+        CampusRegistry::ReadGuard guard;
+        const ClientInfo* campus = registry.lookup(campusId);
+        if (!campus || !campus->isActive) return;
+        fd = campus->tcpSocket;
+        reactorIndex = campus->reactorIndex;
+        campusName = campus->campusName;
     }
+    if (!registry.deactivate(campusId, fd, reactorIndex)) return;   // Already gone
+    replicateCampus(campusId, false);
 
-    std::string authMsg(buffer);
-    
-    // Parse authentication: "AUTH:Campus:LAHORE,Pass:NU-LHR-123"
-    size_t campusPos = authMsg.find("Campus:");
-    size_t passPos = authMsg.find("Pass:");
-    
-    if (campusPos != std::string::npos && passPos != std::string::npos) {
-        campusName = authMsg.substr(campusPos + 7, passPos - campusPos - 8);
-        std::string password = authMsg.substr(passPos + 5);
-        
-        // Remove any trailing whitespace
-        campusName.erase(campusName.find_last_not_of(" \n\r\t") + 1);
-        password.erase(password.find_last_not_of(" \n\r\t") + 1);
+    int silent = difftime(time(nullptr), registry.lastHeartbeat(campusId));
+    logEvent("Campus " + campusName + " sent no heartbeat for " + std::to_string(silent) +
+             " seconds; closing its connection");
 
-        if (authenticateClient(campusName, password)) {
-            std::string response = "AUTH:SUCCESS";
-            send(clientSocket, response.c_str(), response.length(), 0);
-            
-            // Store client info
-            {
-                std::lock_guard<std::mutex> lock(clientMutex);
-                connectedCampuses[campusName] = {clientSocket, campusName, clientIP, time(nullptr), true};
+    if (reactorIndex >= 0 && reactorIndex < (int)reactors.size()) {
+        Reactor& owner = *reactors[reactorIndex];
+        ReactorMessage* message = new ReactorMessage();
+        message->task = [this, &owner, fd, campusName]() {
+            // The fd may have been closed and reused by another campus meanwhile
+            auto it = owner.connections.find(fd);
+            if (it != owner.connections.end() && it->second->campusName == campusName) {
+                closeConnection(owner, fd);
             }
-            
-            logEvent("Campus " + campusName + " authenticated successfully from " + clientIP);
-        } else {
-            std::string response = "AUTH:FAILED";
-            send(clientSocket, response.c_str(), response.length(), 0);
-            logEvent("Authentication failed for campus " + campusName);
-            close(clientSocket);
-            return;
-        }
+        };
+        postToReactor(owner, message);
     } else {
-        close(clientSocket);
-        return;
+        // Threads mode: the campus's reader sees end of stream and cleans up
+        shutdown(fd, SHUT_RDWR);
     }
+}
 
-    // Handle messages from this client
-    while (isRunning) {
-        memset(buffer, 0, BUFFER_SIZE);
-        bytesRead = recv(clientSocket, buffer, BUFFER_SIZE - 1, 0);
-        
-        if (bytesRead <= 0) {
-            logEvent("Campus " + campusName + " disconnected");
-            break;
+// One datagram to the multicast group reaches every campus that joined it;
+// the others get a TCP frame each
+void CentralServer::broadcastMessage(const std::string& message) {
+    bool multicast = multicastSocket >= 0 && message.size() <= MULTICAST_MAX_TEXT;
+    if (multicast) {
+        // Only the admin console broadcasts, so the number is still free
+        // after the send. A failed send goes to everyone over TCP instead and
+        // uses up no number, so members see no gap.
+        uint32_t sequence = broadcasts.next();
+        std::string packet = encodeBroadcastPacket(BROADCAST_DATA, broadcasts.session(),
+                                                   sequence, message);
+        statsForThread().countSyscall();
+        if (sendto(multicastSocket, packet.data(), packet.size(), 0,
+                   (struct sockaddr*)&multicastAddr, sizeof(multicastAddr)) < 0) {
+            LOG_WARN("Multicast send failed (" + std::string(strerror(errno)) +
+                     "); broadcasting over TCP");
+            multicast = false;
+        } else {
+            broadcasts.append(message);
+            multicastPackets.fetch_add(1, std::memory_order_relaxed);
         }
-
-        std::string message(buffer);
-        logEvent("Message received from " + campusName + ": " + message);
-        parseAndRouteMessage(message, campusName);
     }
 
-    // Cleanup
+    size_t overTcp;
     {
-        std::lock_guard<std::mutex> lock(clientMutex);
-        connectedCampuses[campusName].isActive = false;
+        CampusRegistry::ReadGuard guard;
+        std::vector<const ClientInfo*> targets;
+        for (uint16_t id = 1; id <= registry.maxId(); id++) {
+            const ClientInfo* campus = registry.lookup(id);
+            if (campus && campus->isActive && !(multicast && campus->multicast)) {
+                targets.push_back(campus);
+            }
+        }
+        FanOut broadcast(FRAME_BROADCAST, "", 0, "", message.data(), message.size());
+        overTcp = fanOut(broadcast, targets);
     }
-    close(clientSocket);
+
+    forwardBroadcast(message);
+
+    logEvent("Broadcast message sent to all campuses (" +
+             std::string(multicast ? "multicast, " : "") + std::to_string(overTcp) +
+             " over TCP)");
 }
 
-void CentralServer::parseAndRouteMessage(const std::string& message, const std::string& sourceCampus) {
-    // Check if it's a file transfer: "FILE:TO:KARACHI|NAME:doc.txt|SIZE:123|DATA:..."
-    if (message.find("FILE:TO:") == 0) {
-        size_t namePos = message.find("|NAME:");
-        if (namePos == std::string::npos) return;
-        
-        std::string targetCampus = message.substr(8, namePos - 8);
-        std::string fileData = message.substr(namePos + 1); // Everything after TO:
-        
-        // Find target campus socket
-        std::lock_guard<std::mutex> lock(clientMutex);
-        auto it = connectedCampuses.find(targetCampus);
-        
-        if (it != connectedCampuses.end() && it->second.isActive) {
-            std::string routedFile = "FILE:FROM:" + sourceCampus + "|" + fileData;
-            send(it->second.tcpSocket, routedFile.c_str(), routedFile.length(), 0);
-            logEvent("File routed from " + sourceCampus + " to " + targetCampus);
-        } else {
-            logEvent("Target campus " + targetCampus + " not connected for file transfer");
+// Lets members notice a lost last broadcast without waiting for the next
+void CentralServer::sendBroadcastSync() {
+    uint32_t latest = broadcasts.next() - 1;
+    if (multicastSocket < 0 || latest == 0) return;
+
+    std::string packet = encodeBroadcastPacket(BROADCAST_SYNC, broadcasts.session(), latest, "");
+    sendto(multicastSocket, packet.data(), packet.size(), 0, (struct sockaddr*)&multicastAddr,
+           sizeof(multicastAddr));
+    multicastPackets.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Control frames from clients:
+//   "TARGETS:<id>,<id>,..." campuses for the frames it sends to TARGET_LIST
+//   "SUB:<topic>,<topic>"   replaces its topic subscriptions
+//   "NACK:<first>-<last>"   resend broadcasts missed on the multicast group
+//   "MCAST-LEAVE:<next>"    the group could not be joined; switch to TCP
+//                           and resend everything from next on
+void CentralServer::handleControlFrame(const Frame& frame, const std::string& sourceCampus) {
+    std::string text(frame.payload, frame.header.payloadLength);
+    if (text.find("TARGETS:") == 0) {
+        std::vector<uint16_t> targetIds;
+        std::stringstream ids(text.substr(8));
+        std::string id;
+        while (std::getline(ids, id, ',')) {
+            uint16_t targetId = (uint16_t)atoi(id.c_str());
+            if (targetId != 0 && targetId <= registry.maxId() &&
+                std::find(targetIds.begin(), targetIds.end(), targetId) == targetIds.end()) {
+                targetIds.push_back(targetId);
+            }
         }
+        std::lock_guard<std::mutex> lock(targetListMutex);
+        targetLists[frame.header.sourceId].swap(targetIds);
+        return;
+    }
+    if (text.find("SUB:") == 0) {
+        handleSubscription(frame.header.sourceId, text.substr(4), sourceCampus);
         return;
     }
-    
-    // Regular message format: "TO:KARACHI|DEPT:Admissions|MSG:Hello from Lahore"
-    size_t toPos = message.find("TO:");
-    size_t deptPos = message.find("|DEPT:");
-    size_t msgPos = message.find("|MSG:");
 
-    if (toPos == std::string::npos || deptPos == std::string::npos || msgPos == std::string::npos) {
+    uint32_t first = 0, last = 0;
+    bool leaving = text.find("MCAST-LEAVE:") == 0;
+    if (leaving) {
+        first = (uint32_t)strtoul(text.c_str() + 12, nullptr, 10);
+    } else if (text.find("NACK:") != 0 || !parseSequenceRange(text.substr(5), first, last)) {
+        LOG_WARN("Ignoring control frame from " + sourceCampus);
         return;
     }
 
-    std::string targetCampus = message.substr(toPos + 3, deptPos - toPos - 3);
-    std::string targetDept = message.substr(deptPos + 6, msgPos - deptPos - 6);
-    std::string msgContent = message.substr(msgPos + 5);
+    CampusRegistry::ReadGuard guard;
+    const ClientInfo* source = registry.lookup(frame.header.sourceId);
+    if (!source || !source->isActive) return;
 
-    // Find target campus socket
-    std::lock_guard<std::mutex> lock(clientMutex);
-    auto it = connectedCampuses.find(targetCampus);
-    
-    if (it != connectedCampuses.end() && it->second.isActive) {
-        std::string routedMsg = "FROM:" + sourceCampus + "|DEPT:" + targetDept + "|MSG:" + msgContent;
-        send(it->second.tcpSocket, routedMsg.c_str(), routedMsg.length(), 0);
-        logEvent("Message routed from " + sourceCampus + " to " + targetCampus);
-    } else {
-        logEvent("Target campus " + targetCampus + " not connected");
+    if (leaving) {
+        // Later broadcasts come over TCP; older ones are repaired below.
+        // Read the latest only after switching, so none falls in between.
+        if (registry.leaveMulticast(source->campusId, source->tcpSocket)) {
+            LOG_WARN(sourceCampus + " could not join the broadcast group; using TCP");
+        }
+        last = broadcasts.next() - 1;
+        if (first == 0 || first > last) return;
+        if (last - first >= MULTICAST_HISTORY) {
+            first = last - MULTICAST_HISTORY + 1;
+        }
+    } else if (last - first >= MULTICAST_NACK_MAX) {
+        last = first + MULTICAST_NACK_MAX - 1;
     }
-}
-
-void CentralServer::handleUDPMessages() {
-    char buffer[BUFFER_SIZE];
-    struct sockaddr_in clientAddr;
-    socklen_t addrLen = sizeof(clientAddr);
 
-    while (isRunning) {
-        memset(buffer, 0, BUFFER_SIZE);
-        int bytesRead = recvfrom(udpSocket, buffer, BUFFER_SIZE - 1, 0,
-                                 (struct sockaddr*)&clientAddr, &addrLen);
-        
-        if (bytesRead > 0) {
-            std::string message(buffer);
-            
-            // Check if it's a heartbeat message: "HEARTBEAT:LAHORE"
-            if (message.find("HEARTBEAT:") != std::string::npos) {
-                std::string campusName = message.substr(10);
-                campusName.erase(campusName.find_last_not_of(" \n\r\t") + 1);
-                
-                std::lock_guard<std::mutex> lock(clientMutex);
-                if (connectedCampuses.find(campusName) != connectedCampuses.end()) {
-                    connectedCampuses[campusName].lastHeartbeat = time(nullptr);
-                }
-            }
+    uint32_t lostFrom = 0;
+    std::string broadcast;
+    for (uint32_t sequence = first; sequence <= last; sequence++) {
+        if (broadcasts.find(sequence, broadcast)) {
+            deliverToCampus(*source, buildFrame(FRAME_CONTROL, 0, source->campusId, "",
+                                                "BCAST:" + std::to_string(sequence) + ":" +
+                                                    broadcast));
+            broadcastRepairs.fetch_add(1, std::memory_order_relaxed);
+        } else if (lostFrom == 0) {
+            lostFrom = sequence;
         }
+        if (lostFrom != 0 && (sequence == last || broadcasts.find(sequence + 1, broadcast))) {
+            deliverToCampus(*source, buildFrame(FRAME_CONTROL, 0, source->campusId, "",
+                                                "BCAST-LOST:" +
+                                                    formatSequenceRange(lostFrom, sequence)));
+            lostFrom = 0;
+        }
+        if (sequence == UINT32_MAX) break;
     }
+    LOG_DEBUG("Repaired broadcasts " + formatSequenceRange(first, last) + " for " + sourceCampus);
 }
 
-void CentralServer::monitorHeartbeats() {
-    while (isRunning) {
-        sleep(15); // Check every 15 seconds
-        
-        std::lock_guard<std::mutex> lock(clientMutex);
-        time_t currentTime = time(nullptr);
-        
-        for (auto& campus : connectedCampuses) {
-            if (campus.second.isActive) {
-                int timeSinceHeartbeat = difftime(currentTime, campus.second.lastHeartbeat);
-                if (timeSinceHeartbeat > 30) {
-                    logEvent("WARNING: No heartbeat from " + campus.first + " for " + 
-                            std::to_string(timeSinceHeartbeat) + " seconds");
-                }
+// "SUB:KARACHI/*,*/Admissions" replaces a campus's subscriptions (see
+// topic_index.h). Binary campuses are told which patterns were kept.
+void CentralServer::handleSubscription(uint16_t campusId, const std::string& list,
+                                       const std::string& sourceCampus) {
+    if (campusId == 0) return;
+
+    std::vector<Topic> requested;
+    std::stringstream patterns(list);
+    std::string pattern, campus;
+    while (std::getline(patterns, pattern, ',')) {
+        Topic topic;
+        if (!parseTopic(pattern, campus, topic.department)) {
+            if (pattern.find_first_not_of(" \t\r\n") != std::string::npos) {
+                LOG_WARN("Ignoring topic \"" + pattern + "\" from " + sourceCampus);
+            }
+            continue;
+        }
+        std::transform(campus.begin(), campus.end(), campus.begin(), ::toupper);
+        if (campus != TOPIC_WILDCARD) {
+            topic.campus = registry.idOf(campus);
+            if (topic.campus == 0) {
+                LOG_WARN("Unknown campus in topic " + pattern + " from " + sourceCampus);
+                continue;
             }
         }
+        requested.push_back(topic);
     }
-}
 
-void CentralServer::broadcastUDPMessage(const std::string& message) {
-    std::string broadcastMsg = "BROADCAST:" + message;
-    
-    std::lock_guard<std::mutex> lock(clientMutex);
-    
-    for (const auto& campus : connectedCampuses) {
-        if (campus.second.isActive) {
-            // Send directly to the client's TCP socket as a special message
-            std::string tcpBroadcast = "BROADCAST:" + message;
-            send(campus.second.tcpSocket, tcpBroadcast.c_str(), tcpBroadcast.length(), 0);
-        }
+    std::string kept;
+    for (const Topic& topic : topics.subscribe(campusId, requested)) {
+        kept += (kept.empty() ? "" : ",") +
+                (topic.campus == 0 ? std::string(TOPIC_WILDCARD) : registry.nameOf(topic.campus)) +
+                "/" + topic.department;
+    }
+    LOG_INFO(sourceCampus + " subscribed to " + (kept.empty() ? "nothing" : kept));
+
+    CampusRegistry::ReadGuard guard;
+    const ClientInfo* source = registry.lookup(campusId);
+    if (source && source->isActive && source->protocolVersion == PROTOCOL_BINARY) {
+        deliverToCampus(*source, buildFrame(FRAME_CONTROL, 0, campusId, "", "TOPICS:" + kept));
     }
-    
-    logEvent("Broadcast message sent to all campuses");
 }
 
 void CentralServer::displayConnectedCampuses() {
-    std::lock_guard<std::mutex> lock(clientMutex);
+    CampusRegistry::ReadGuard guard;
     
     std::cout << "\n========== Connected Campuses ==========\n";
     std::cout << std::left << std::setw(15) << "Campus" 
@@ -268,10 +1971,264 @@ void CentralServer::displayConnectedCampuses() {
               << std::setw(10) << "Status" << "\n";
     std::cout << "----------------------------------------\n";
     
-    for (const auto& campus : connectedCampuses) {
-        std::cout << std::left << std::setw(15) << campus.first
-                  << std::setw(20) << campus.second.ipAddress
-                  << std::setw(10) << (campus.second.isActive ? "ONLINE" : "OFFLINE") << "\n";
+    for (uint16_t id = 1; id <= registry.maxId(); id++) {
+        const ClientInfo* campus = registry.lookup(id);
+        if (!campus) continue;
+
+        std::cout << std::left << std::setw(15) << campus->campusName
+                  << std::setw(20) << campus->ipAddress
+                  << std::setw(10)
+                  << (!campus->isActive ? "OFFLINE"
+                      : liveness.state(id) == LivenessTracker::SUSPECT ? "SUSPECT"
+                                                                      : "ONLINE")
+                  << "\n";
+    }
+    std::cout << "========================================\n\n";
+}
+
+IOStats& CentralServer::statsForThread() {
+    Reactor* reactor = currentReactor();
+    return reactor ? reactor->stats : threadStats;
+}
+
+void CentralServer::displayStatistics() {
+    static const char* modeNames[] = {"threads", "epoll", "multi-reactor", "io_uring"};
+
+    uint64_t syscalls = threadStats.syscalls.load();
+    uint64_t messages = threadStats.messages.load();
+
+    std::cout << "\n============ I/O Statistics ============\n";
+    std::cout << "Backend: " << modeNames[(int)config.ioMode] << "\n";
+    for (const auto& reactor : reactors) {
+        uint64_t reactorSyscalls = reactor->stats.syscalls.load();
+        uint64_t reactorMessages = reactor->stats.messages.load();
+        std::cout << "  Reactor " << reactor->index << ": " << reactorMessages << " messages, "
+                  << reactorSyscalls << " syscalls\n";
+        syscalls += reactorSyscalls;
+        messages += reactorMessages;
+    }
+    uint64_t spliced = threadStats.splicedBytes.load();
+    uint64_t copied = threadStats.copiedBytes.load();
+    for (const auto& reactor : reactors) {
+        spliced += reactor->stats.splicedBytes.load();
+        copied += reactor->stats.copiedBytes.load();
+    }
+    std::cout << "Messages received: " << messages << "\n";
+    std::cout << "Syscalls:          " << syscalls << "\n";
+    if (messages > 0) {
+        std::cout << "Syscalls/message:  " << std::fixed << std::setprecision(2)
+                  << (double)syscalls / messages << "\n";
+    }
+    std::cout << "File chunk bytes:  " << spliced << " zero-copy, " << copied << " copied\n";
+    std::cout << "Log lines dropped: " << Logger::instance().dropped() << "\n";
+    uint64_t heartbeats = liveness.heartbeats.load();
+    uint64_t batches = heartbeatBatches.load();
+    std::cout << "Heartbeats:        " << heartbeats << " received in " << batches
+              << " batches (" << std::fixed << std::setprecision(1)
+              << (batches > 0 ? (double)heartbeats / batches : 0.0) << " per batch), "
+              << liveness.tracked() << " campuses tracked, " << liveness.suspected.load()
+              << " suspected, " << liveness.recovered.load() << " recovered, "
+              << liveness.expired.load() << " expired\n";
+    std::cout << std::fixed << std::setprecision(1)
+              << "                   (suspect after " << liveness.suspectMillis() / 1000.0
+              << " s, closed after " << liveness.deadMillis() / 1000.0 << " s)\n";
+    std::cout << "Fan-out:           " << fanOutMessages.load() << " messages to "
+              << fanOutDeliveries.load() << " campuses from " << fanOutEncodings.load()
+              << " encodings\n";
+    std::cout << "Topics:            " << topics.size() << " subscriptions, "
+              << topicPublishes.load() << " messages routed by topic, " << topicExtra.load()
+              << " to other subscribers, " << topicFiltered.load() << " not subscribed\n";
+    if (multicastSocket >= 0) {
+        std::cout << "Multicast:         " << multicastPackets.load() << " packets to "
+                  << config.multicastGroup << ":" << config.multicastPort << ", "
+                  << broadcasts.next() - 1 << " broadcasts, " << broadcastRepairs.load()
+                  << " repaired over TCP\n";
+    } else {
+        std::cout << "Multicast:         off (broadcasts go over TCP)\n";
+    }
+
+    if (!peers.empty()) {
+        std::vector<int> homed(config.cluster.size());
+        for (uint16_t id = 1; id <= registry.maxId(); id++) {
+            int home = homeOf(id);
+            if (home >= 0 && home < (int)homed.size()) homed[home]++;
+        }
+        std::cout << "\nCluster (this node: " << config.cluster[config.nodeIndex].name
+                  << ", campuses homed here: " << homed[config.nodeIndex] << "):\n";
+        std::cout << std::left << std::setw(12) << "Node" << std::setw(8) << "Link"
+                  << std::setw(8) << "Homed" << std::setw(12) << "Forwarded"
+                  << std::setw(12) << "Received" << "Dropped\n";
+        for (const auto& link : peers) {
+            if (!link) continue;
+            std::cout << std::setw(12) << link->node.name << std::setw(8)
+                      << (link->up ? "up" : "down") << std::setw(8) << homed[link->index]
+                      << std::setw(12) << link->forwarded.load() << std::setw(12)
+                      << link->received.load() << link->dropped.load() << "\n";
+        }
+    }
+
+    if (!config.primaryHost.empty() || !config.standbyAddress.empty()) {
+        std::cout << "\nReplication:\n";
+        std::string primary = config.primaryHost + ":" + std::to_string(config.primaryPort);
+        if (replication.standbyMode) {
+            int connectedThere = 0;
+            for (size_t id = 1; id < replication.primaryCampuses.size(); id++) {
+                connectedThere += replication.primaryCampuses.find(id)->load();
+            }
+            std::cout << "  Standby of " << primary << ", link "
+                      << (replication.linkUp ? "up" : "down") << ", "
+                      << replication.mirrored.load() << " records mirrored, " << connectedThere
+                      << " campuses connected there\n";
+        } else if (!config.primaryHost.empty()) {
+            int64_t millis = replication.failoverMillis.load();
+            std::lock_guard<std::mutex> lock(replication.mutex);
+            std::cout << "  Took over from " << primary << "; failover ";
+            if (millis >= 0) {
+                std::cout << millis << " ms\n";
+            } else {
+                std::cout << "waiting for " << replication.awaiting.size() << " campuses\n";
+            }
+        }
+        if (!config.standbyAddress.empty() && !replication.standbyMode) {
+            size_t queued = 0, peak = 0;
+            bool paused = false;
+            std::lock_guard<std::mutex> lock(replication.mutex);
+            if (replication.standby) {
+                replication.standby->snapshot(queued, peak, paused);
+            }
+            std::cout << "  Standby " << config.standbyAddress << ": "
+                      << (replication.standby ? "attached" : "not attached") << ", "
+                      << replication.frames.load() << " frames (" << replication.bytes.load()
+                      << " bytes) sent, " << queued << " bytes queued, "
+                      << replication.resyncs.load() << " resyncs\n";
+        }
+    }
+
+    std::shared_ptr<const CredentialTable> table = std::atomic_load(&credentials);
+    uint64_t checks = passwordChecks.load();
+    std::cout << "\nCredentials (" << config.credentialsFile << ", " << table->size()
+              << " campuses, reloaded " << credentialReloads.load() << " times): " << checks
+              << " passwords hashed";
+    if (checks > 0) {
+        std::cout << ", " << std::fixed << std::setprecision(2)
+                  << passwordMicros.load() / 1000.0 / checks << " ms each";
+    }
+    if (authPool.size() > 0) {
+        std::cout << "; " << authPool.backlog() << " logins waiting for one of "
+                  << authPool.size() << " auth threads";
+    }
+    std::cout << "\n";
+
+    if (sessions.enabled()) {
+        std::cout << "\nSessions (tokens valid " << sessions.ttl() << " s): "
+                  << sessions.issued.load() << " tokens issued, " << sessions.resumed.load()
+                  << " logins resumed, " << sessions.rejected.load() << " tokens rejected\n";
+    }
+
+    std::cout << "\nCompression (allowed: " << config.compression << "):\n";
+    std::cout << std::left << std::setw(10) << "Codec" << std::setw(10) << "Frames"
+              << std::setw(10) << "Bypassed" << std::setw(14) << "Bytes in" << std::setw(14)
+              << "Bytes out" << std::setw(8) << "Ratio" << std::setw(14) << "Compress"
+              << "Decompress\n";
+    for (int id = 1; id < CODEC_COUNT; id++) {
+        Codec codec = (Codec)id;
+        if (!codecAvailable(codec)) continue;
+
+        // Speeds are of original bytes; compress time includes bypassed tries
+        const CodecStats& totals = codecStats(codec);
+        uint64_t bytesIn = totals.bytesIn.load();
+        uint64_t bytesOut = totals.bytesOut.load();
+        uint64_t compressNanos = totals.compressNanos.load();
+        uint64_t decompressNanos = totals.decompressNanos.load();
+        std::cout << std::left << std::setw(10) << codecName(codec) << std::setw(10)
+                  << totals.frames.load() << std::setw(10) << totals.bypassed.load()
+                  << std::setw(14) << bytesIn << std::setw(14) << bytesOut << std::fixed
+                  << std::setprecision(2) << std::setw(8)
+                  << (bytesOut > 0 ? (double)bytesIn / bytesOut : 0.0) << std::setprecision(1)
+                  << std::setw(14)
+                  << (compressNanos > 0 ? bytesIn * 1e3 / compressNanos : 0.0)
+                  << (decompressNanos > 0 ? totals.inflatedBytes.load() * 1e3 / decompressNanos
+                                          : 0.0)
+                  << "\n";
+    }
+    std::cout << "(speeds in MB/s)\n";
+
+    std::cout << "\nOutbound queues (high " << config.queueHighWatermark << ", low "
+              << config.queueLowWatermark << " bytes):\n";
+    std::cout << std::left << std::setw(12) << "Campus" << std::setw(10) << "Queued"
+              << std::setw(10) << "Peak" << std::setw(10) << "Messages" << std::setw(10)
+              << "Deferred" << std::setw(10) << "Dropped" << "State\n";
+    {
+        CampusRegistry::ReadGuard guard;
+        for (uint16_t id = 1; id <= registry.maxId(); id++) {
+            const ClientInfo* campus = registry.lookup(id);
+            if (!campus || !campus->outbound) continue;
+
+            OutboundQueue* queue = campus->outbound.get();
+
+            size_t queued, peak;
+            bool paused;
+            queue->snapshot(queued, peak, paused);
+            std::cout << std::left << std::setw(12) << campus->campusName << std::setw(10) << queued
+                      << std::setw(10) << peak << std::setw(10) << queue->messages.load()
+                      << std::setw(10) << queue->deferred.load() << std::setw(10)
+                      << queue->dropped.load() << (paused ? "PAUSED" : "OK") << "\n";
+        }
+    }
+    if (config.creditWindow > 0) {
+        int creditedSenders = 0;
+        {
+            CampusRegistry::ReadGuard guard;
+            for (uint16_t id = 1; id <= registry.maxId(); id++) {
+                const ClientInfo* campus = registry.lookup(id);
+                creditedSenders += campus && campus->isActive && credits.isCredited(id);
+            }
+        }
+        std::cout << "Send credit (" << config.creditWindow << "-byte windows, "
+                  << creditedSenders << " credited senders): " << credits.charged.load()
+                  << " bytes charged, " << credits.grants.load() << " grants; windows spent "
+                  << credits.exhausted.load() << " times, overdrawn by "
+                  << credits.overdrawn.load() << " frames; credit held for backlogged campuses "
+                  << std::fixed << std::setprecision(1) << credits.heldMicros.load() / 1000.0
+                  << " ms in all, longest " << credits.longestHeldMicros.load() / 1000.0
+                  << " ms\n";
+    }
+
+    std::cout << "\nPriority lanes (" << laneModeName(config.laneMode) << "):\n";
+    std::cout << std::left << std::setw(12) << "Lane" << std::setw(12) << "Frames"
+              << std::setw(14) << "Bytes" << "Sent ahead of older frames\n";
+    for (int lane = 0; lane < LANE_COUNT; lane++) {
+        std::cout << std::left << std::setw(12) << laneName(lane) << std::setw(12)
+                  << laneStats.frames[lane].load() << std::setw(14)
+                  << laneStats.bytes[lane].load() << laneStats.overtook[lane].load() << "\n";
+    }
+
+    std::cout << "\nStore-and-forward journal (" << journal.commitCount() << " group commits, ";
+    if (journal.limit() > 0) {
+        std::cout << "up to " << journal.limit() << " bytes per campus):\n";
+    } else {
+        std::cout << "no limit per campus):\n";
+    }
+    std::cout << std::left << std::setw(12) << "Campus" << std::setw(10) << "Stored"
+              << std::setw(12) << "Bytes" << std::setw(10) << "Dropped" << "Last replay\n";
+    for (uint16_t id = 1; id <= registry.maxId(); id++) {
+        const CampusJournal* stats = journal.stats(id);
+        if (!stats) continue;
+
+        std::cout << std::left << std::setw(12) << stats->campusName << std::setw(10)
+                  << stats->records.load() << std::setw(12) << stats->bytes.load()
+                  << std::setw(10) << stats->rejected.load();
+        uint64_t replayed = stats->replayedRecords.load();
+        if (replayed > 0) {
+            double seconds = stats->replayMicros.load() / 1e6;
+            std::cout << replayed << " msgs in " << std::fixed << std::setprecision(3) << seconds
+                      << " s (" << std::setprecision(1)
+                      << (seconds > 0 ? stats->replayedBytes.load() / seconds / 1e6 : 0.0)
+                      << " MB/s)";
+        } else {
+            std::cout << "-";
+        }
+        std::cout << "\n";
     }
     std::cout << "========================================\n\n";
 }
@@ -282,12 +2239,15 @@ void CentralServer::adminConsole() {
     std::cout << "  1. View connected campuses\n";
     std::cout << "  2. Broadcast message\n";
     std::cout << "  3. Exit\n";
+    std::cout << "  4. View statistics\n";
     std::cout << "=================================\n\n";
 
     std::string input;
     while (isRunning) {
         std::cout << "Admin> ";
-        std::getline(std::cin, input);
+        if (!std::getline(std::cin, input)) {
+            break;      // No console (stdin closed); the server keeps running
+        }
 
         if (input == "1") {
             displayConnectedCampuses();
@@ -295,10 +2255,12 @@ void CentralServer::adminConsole() {
             std::cout << "Enter broadcast message: ";
             std::string msg;
             std::getline(std::cin, msg);
-            broadcastUDPMessage(msg);
+            broadcastMessage(msg);
         } else if (input == "3") {
             stop();
             break;
+        } else if (input == "4") {
+            displayStatistics();
         }
     }
 }
@@ -306,12 +2268,59 @@ void CentralServer::adminConsole() {
 void CentralServer::start() {
     try {
         isRunning = true;
+        journal.start();
         
         initializeTCPSocket();
         initializeUDPSocket();
+        initializeMulticast();
+        if (!config.cluster.empty()) {
+            initializeCluster();
+        }
+        initializeReplication();
         
         logEvent("Central Server (ISLAMABAD) started successfully");
 
+        if (config.ioMode != IOMode::THREADS) {
+            authPool.start(config.authThreads > 0
+                               ? config.authThreads
+                               : (int)std::max(1u, std::thread::hardware_concurrency()));
+        }
+
+        if (config.ioMode == IOMode::URING) {
+            std::string error;
+            if (initializeUring(error)) {
+                std::thread heartbeatThread(&CentralServer::monitorHeartbeats, this);
+                heartbeatThread.detach();
+
+                std::thread adminThread(&CentralServer::adminConsole, this);
+                adminThread.detach();
+
+                runUringLoop();
+                return;
+            }
+            logEvent("io_uring unavailable (" + error + "), falling back to epoll");
+            config.ioMode = IOMode::EPOLL;
+        }
+
+        if (config.ioMode != IOMode::THREADS) {
+            int count = 1;
+            if (config.ioMode == IOMode::MULTI_REACTOR) {
+                count = config.reactorCount > 0 ? config.reactorCount
+                                                : (int)std::max(1u, std::thread::hardware_concurrency());
+            }
+            initializeReactors(count);
+
+            std::thread heartbeatThread(&CentralServer::monitorHeartbeats, this);
+            heartbeatThread.detach();
+
+            std::thread adminThread(&CentralServer::adminConsole, this);
+            adminThread.detach();
+
+            // Reactor 0 runs on this thread and also owns the UDP socket
+            runReactors();
+            return;
+        }
+
         // Start UDP handler thread
         std::thread udpThread(&CentralServer::handleUDPMessages, this);
         udpThread.detach();
@@ -330,16 +2339,18 @@ void CentralServer::start() {
             socklen_t addrLen = sizeof(clientAddr);
             
             int clientSocket = accept(tcpSocket, (struct sockaddr*)&clientAddr, &addrLen);
+            threadStats.countSyscall();
             
             if (clientSocket < 0) {
                 if (isRunning) {
-                    logEvent("Error accepting connection");
+                    LOG_ERROR("Error accepting connection");
                 }
                 continue;
             }
 
             std::string clientIP = inet_ntoa(clientAddr.sin_addr);
             logEvent("New connection from " + clientIP);
+            prepareCampusSocket(clientSocket);
 
             // Handle client in a new thread
             std::thread clientThread(&CentralServer::handleTCPClient, this, clientSocket, clientIP);
@@ -359,28 +2370,282 @@ void CentralServer::stop() {
     if (udpSocket >= 0) {
         close(udpSocket);
     }
+    if (multicastSocket >= 0) {
+        close(multicastSocket);
+        multicastSocket = -1;
+    }
+    if (peerSocket >= 0) {
+        shutdown(peerSocket, SHUT_RDWR);    // Wakes the peer listener
+        close(peerSocket);
+        peerSocket = -1;
+    }
+    if (replicationSocket >= 0) {
+        shutdown(replicationSocket, SHUT_RDWR);     // Wakes the replication listener
+        close(replicationSocket);
+        replicationSocket = -1;
+    }
+    {
+        std::lock_guard<std::mutex> lock(replication.mutex);
+        if (replication.standby) {
+            replication.standby->close();
+        }
+    }
+    for (auto& reactor : reactors) {
+        if (reactor->wakeupFd >= 0) {
+            wakeReactor(*reactor);
+        }
+    }
+    authPool.stop();
+    journal.stop();
     
     logEvent("Central Server shutting down");
 }
 
+// Queues the event for the logger thread; never blocks on output
 void CentralServer::logEvent(const std::string& event) {
-    time_t now = time(nullptr);
-    char timeStr[26];
-    ctime_r(&now, timeStr);
-    timeStr[24] = '\0'; // Remove newline
-    
-    std::cout << "[" << timeStr << "] " << event << std::endl;
+    LOG_INFO(event);
 }
 
 // Main function
-int main() {
+int main(int argc, char* argv[]) {
+    // splice() has no MSG_NOSIGNAL: a campus dropping mid-relay must fail
+    // the call, not kill the server
+    signal(SIGPIPE, SIG_IGN);
+
+    // SIGHUP rereads the credentials file. Blocked before any thread starts,
+    // so every thread inherits the mask and the heartbeat monitor takes it.
+    sigset_t hangup;
+    sigemptyset(&hangup);
+    sigaddset(&hangup, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &hangup, nullptr);
+
+    ServerConfig config;
+    std::string nodeName;
+    std::string hashFor;
+    uint32_t iterations = CREDENTIAL_ITERATIONS;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--io=threads") {
+            config.ioMode = IOMode::THREADS;
+        } else if (arg == "--io=epoll") {
+            config.ioMode = IOMode::EPOLL;
+        } else if (arg == "--io=multi") {
+            config.ioMode = IOMode::MULTI_REACTOR;
+        } else if (arg == "--io=uring") {
+            config.ioMode = IOMode::URING;
+        } else if (arg.find("--reactors=") == 0) {
+            config.reactorCount = atoi(arg.c_str() + 11);
+        } else if (arg.find("--queue-high=") == 0) {
+            config.queueHighWatermark = strtoull(arg.c_str() + 13, nullptr, 10);
+        } else if (arg.find("--queue-low=") == 0) {
+            config.queueLowWatermark = strtoull(arg.c_str() + 12, nullptr, 10);
+        } else if (arg.find("--log-level=") == 0 && Logger::parseLevel(arg.substr(12)) >= 0) {
+            Logger::instance().setLevel(Logger::parseLevel(arg.substr(12)));
+        } else if (arg.find("--journal-dir=") == 0) {
+            config.journalDirectory = arg.substr(14);
+        } else if (arg.find("--journal-limit=") == 0) {
+            config.journalLimit = strtoull(arg.c_str() + 16, nullptr, 10);
+        } else if (arg.find("--compress=") == 0) {
+            config.compression = arg.substr(11);
+        } else if (arg.find("--suspect-after=") == 0) {
+            config.suspectMillis = (uint64_t)(strtod(arg.c_str() + 16, nullptr) * 1000);
+        } else if (arg.find("--dead-after=") == 0) {
+            config.deadMillis = (uint64_t)(strtod(arg.c_str() + 13, nullptr) * 1000);
+        } else if (arg.find("--mcast-group=") == 0) {
+            config.multicastGroup = arg.substr(14);
+        } else if (arg.find("--mcast-port=") == 0) {
+            int port = atoi(arg.c_str() + 13);
+            config.multicastPort = (port > 0 && port <= 65535) ? port : 0;
+        } else if (arg.find("--mcast-ttl=") == 0) {
+            config.multicastTtl = atoi(arg.c_str() + 12);
+        } else if (arg.find("--mcast-if=") == 0) {
+            config.multicastInterface = arg.substr(11);
+        } else if (arg.find("--port=") == 0) {
+            int port = atoi(arg.c_str() + 7);
+            config.tcpPort = (port > 0 && port < 65535) ? port : 0;
+        } else if (arg.find("--cluster=") == 0) {
+            std::string error;
+            if (!parseClusterSpec(arg.substr(10), config.cluster, error)) {
+                std::cout << "--cluster: " << error << "\n";
+                return 1;
+            }
+        } else if (arg.find("--node=") == 0) {
+            nodeName = arg.substr(7);
+        } else if (arg.find("--standby=") == 0) {
+            struct in_addr address;
+            config.standbyAddress = arg.substr(10);
+            if (inet_pton(AF_INET, config.standbyAddress.c_str(), &address) != 1) {
+                std::cout << "--standby wants an IPv4 address\n";
+                return 1;
+            }
+        } else if (arg.find("--standby-of=") == 0) {
+            if (!parseHostPort(arg.substr(13), config.primaryHost, config.primaryPort) ||
+                config.primaryPort > 65535 - REPLICATION_PORT_OFFSET) {
+                std::cout << "--standby-of wants ADDRESS:PORT\n";
+                return 1;
+            }
+        } else if (arg.find("--session-ttl=") == 0) {
+            config.sessionTtl = atoi(arg.c_str() + 14);
+            if (config.sessionTtl < 0) {
+                std::cout << "--session-ttl must be 0 or more seconds\n";
+                return 1;
+            }
+        } else if (arg.find("--credentials=") == 0) {
+            config.credentialsFile = arg.substr(14);
+        } else if (arg.find("--auth-threads=") == 0) {
+            config.authThreads = atoi(arg.c_str() + 15);
+            if (config.authThreads < 0) {
+                std::cout << "--auth-threads must be 0 or more\n";
+                return 1;
+            }
+        } else if (arg.find("--credit-window=") == 0) {
+            long bytes = atol(arg.c_str() + 16);
+            if (bytes != 0 && (bytes < CREDIT_MIN_WINDOW || bytes > 64L * 1024 * 1024)) {
+                std::cout << "--credit-window must be 0 or " << CREDIT_MIN_WINDOW
+                          << " bytes to 64 MB\n";
+                return 1;
+            }
+            config.creditWindow = (uint32_t)bytes;
+        } else if (arg == "--lanes=weighted") {
+            config.laneMode = LaneMode::WEIGHTED;
+        } else if (arg == "--lanes=strict") {
+            config.laneMode = LaneMode::STRICT;
+        } else if (arg == "--lanes=fifo") {
+            config.laneMode = LaneMode::FIFO;
+        } else if (arg.find("--hash-password=") == 0) {
+            hashFor = arg.substr(16);
+        } else if (arg.find("--iterations=") == 0) {
+            long count = atol(arg.c_str() + 13);
+            if (count <= 0 || count > 0xFFFFFFFFL) {
+                std::cout << "--iterations must be 1 or more\n";
+                return 1;
+            }
+            iterations = (uint32_t)count;
+        } else if (arg.find("--log-file=") == 0) {
+            if (!Logger::instance().openFile(arg.substr(11))) {
+                std::cout << "Cannot open log file " << arg.substr(11) << "\n";
+                return 1;
+            }
+        } else {
+            std::cout << "Usage: ./server [--io=epoll|multi|uring|threads] [--reactors=N]\n";
+            std::cout << "                [--queue-high=BYTES] [--queue-low=BYTES]\n";
+            std::cout << "                [--log-level=LEVEL] [--log-file=PATH] [--journal-dir=PATH]\n";
+            std::cout << "                [--journal-limit=BYTES] [--compress=CODECS|none]\n";
+            std::cout << "                [--suspect-after=SECONDS] [--dead-after=SECONDS]\n";
+            std::cout << "                [--mcast-group=ADDRESS|none] [--mcast-port=PORT]\n";
+            std::cout << "                [--mcast-ttl=HOPS] [--mcast-if=ADDRESS]\n";
+            std::cout << "                [--port=PORT] [--cluster=NAME@ADDRESS:PORT,... --node=NAME]\n";
+            std::cout << "                [--standby=ADDRESS] [--standby-of=ADDRESS:PORT]\n";
+            std::cout << "                [--session-ttl=SECONDS] [--credentials=PATH] [--auth-threads=N]\n";
+            std::cout << "                [--credit-window=BYTES] [--lanes=weighted|strict|fifo]\n";
+            std::cout << "       ./server --hash-password=CAMPUS:ID [--iterations=N] < password\n";
+            std::cout << "  --io=epoll     Single event-driven reactor (default)\n";
+            std::cout << "  --io=multi     One reactor per core with SO_REUSEPORT listeners\n";
+            std::cout << "  --io=uring     io_uring completion loop (falls back to epoll)\n";
+            std::cout << "  --io=threads   One thread per campus (fallback)\n";
+            std::cout << "  --reactors=N   Reactor count for --io=multi (default: core count)\n";
+            std::cout << "  --queue-high=BYTES  Per-campus backlog that pauses senders (default 4 MB)\n";
+            std::cout << "  --queue-low=BYTES   Backlog at which senders resume (default 1 MB)\n";
+            std::cout << "  --log-level=LEVEL   debug, info (default), warn or error\n";
+            std::cout << "  --log-file=PATH     Append the log to PATH instead of stdout\n";
+            std::cout << "  --journal-dir=PATH  Where messages for offline campuses are kept (default ./journal)\n";
+            std::cout << "  --journal-limit=BYTES  Undelivered bytes kept per campus (default 256 MB; 0: no limit)\n";
+            std::cout << "  --compress=CODECS   Codecs clients may pick, e.g. lz4/deflate (default: all built in)\n";
+            std::cout << "  --suspect-after=SECONDS  Heartbeat silence that marks a campus suspect (default 30)\n";
+            std::cout << "  --dead-after=SECONDS     Silence after which its connection is closed (default 60)\n";
+            std::cout << "  --mcast-group=ADDRESS    Group for admin broadcasts (default 239.255.42.1; none: TCP only)\n";
+            std::cout << "  --mcast-port=PORT        Its UDP port (default 8082)\n";
+            std::cout << "  --mcast-ttl=HOPS         Router hops broadcasts may cross (default 1)\n";
+            std::cout << "  --mcast-if=ADDRESS       Local address to send them from (default: by route)\n";
+            std::cout << "  --port=PORT              Campus TCP port; heartbeats use the next one (default 8080)\n";
+            std::cout << "  --cluster=NAME@ADDRESS:PORT,...  All nodes of a federation, the same list on each\n";
+            std::cout << "  --node=NAME              This server's entry in --cluster (its port replaces --port)\n";
+            std::cout << "  --standby=ADDRESS        Host whose standby may replicate from this server\n";
+            std::cout << "  --standby-of=ADDRESS:PORT  Run as hot standby of that primary, taking over when it is lost\n";
+            std::cout << "  --session-ttl=SECONDS    How long a reconnecting campus may resume its session (default 600; 0: never)\n";
+            std::cout << "  --credentials=PATH       Campus credentials file, reread on SIGHUP (default ./credentials.txt)\n";
+            std::cout << "  --auth-threads=N         Threads hashing login passwords off the event loops (default: core count)\n";
+            std::cout << "  --credit-window=BYTES    Send credit per sender and target campus (default 512 KB; 0: none)\n";
+            std::cout << "  --lanes=MODE             Order of frames waiting for a campus: weighted (default), strict or fifo\n";
+            std::cout << "  --hash-password=CAMPUS:ID  Print a credentials line for the password on standard input\n";
+            std::cout << "  --iterations=N           PBKDF2 iterations for that line (default 100000)\n";
+            return 1;
+        }
+    }
+
+    if (!hashFor.empty()) {
+        size_t colon = hashFor.rfind(':');
+        int id = colon == std::string::npos ? 0 : atoi(hashFor.c_str() + colon + 1);
+        std::string password;
+        if (colon == 0 || colon == std::string::npos || id <= 0 || id > MAX_CAMPUS_ID) {
+            std::cout << "--hash-password wants CAMPUS:ID, the id 1-" << MAX_CAMPUS_ID << "\n";
+            return 1;
+        }
+        if (!std::getline(std::cin, password) || password.empty()) {
+            std::cout << "No password on standard input\n";
+            return 1;
+        }
+        password.erase(password.find_last_not_of(" \n\r\t") + 1);  // As logins read it
+        std::cout << formatCredential(makeCredential(hashFor.substr(0, colon), (uint16_t)id,
+                                                     password, iterations))
+                  << "\n";
+        return 0;
+    }
+
+    if (config.queueLowWatermark >= config.queueHighWatermark) {
+        std::cout << "--queue-low must be below --queue-high\n";
+        return 1;
+    }
+    if (config.suspectMillis < LIVENESS_TICK_MS || config.deadMillis <= config.suspectMillis) {
+        std::cout << "--dead-after must be above --suspect-after, and both at least 0.1\n";
+        return 1;
+    }
+    if (config.multicastPort == 0 || config.multicastTtl < 0 ||
+        config.multicastTtl > 255) {
+        std::cout << "--mcast-port must be 1-65535 and --mcast-ttl 0-255\n";
+        return 1;
+    }
+    if (config.tcpPort == 0) {
+        std::cout << "--port must be 1-65534\n";
+        return 1;
+    }
+    if (config.tcpPort > 65535 - REPLICATION_PORT_OFFSET) {
+        std::cout << "--port must leave room for the replication port above it\n";
+        return 1;
+    }
+    if ((!config.standbyAddress.empty() || !config.primaryHost.empty()) &&
+        (!config.cluster.empty() || !nodeName.empty())) {
+        std::cout << "--standby and --standby-of are for a single server, not a cluster\n";
+        return 1;
+    }
+    if (!config.cluster.empty() || !nodeName.empty()) {
+        for (size_t i = 0; i < config.cluster.size(); i++) {
+            if (config.cluster[i].name == nodeName) {
+                config.nodeIndex = (int)i;
+                config.tcpPort = config.cluster[i].port;
+            }
+        }
+        if (config.nodeIndex < 0) {
+            std::cout << "--cluster and --node go together, and the node must be in the list\n";
+            return 1;
+        }
+    }
+
     std::cout << "========================================\n";
     std::cout << "   NU-Information Exchange System\n";
     std::cout << "   Central Server - ISLAMABAD Campus\n";
     std::cout << "========================================\n\n";
 
-    CentralServer server;
-    server.start();
+    try {
+        CentralServer server(config);
+        server.start();
+    } catch (const std::exception& e) {
+        std::cout << "Error: " << e.what() << "\n";
+        Logger::instance().shutdown();
+        return 1;
+    }
 
+    Logger::instance().shutdown();
     return 0;
 }
@@ -4,60 +4,414 @@
 #include <iostream>
 #include <string>
 #include <map>
+#include <set>
 #include <vector>
 #include <thread>
 #include <mutex>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+#include <tuple>
+#include <chrono>
 #include <cstring>
 #include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <ctime>
+#include "mpsc_queue.h"
+#include "uring.h"
+#include "protocol.h"
+#include "outbound_queue.h"
+#include "campus_registry.h"
+#include "logger.h"
+#include "journal.h"
+#include "checksum.h"
+#include "compression.h"
+#include "hex_codec.h"
+#include "timer_wheel.h"
+#include "heartbeat.h"
+#include "multicast.h"
+#include "fanout.h"
+#include "topic_index.h"
+#include "cluster.h"
+#include "replication.h"
+#include "session_token.h"
+#include "credentials.h"
+#include "worker_pool.h"
+#include "credit_ledger.h"
 
 #define TCP_PORT 8080
-#define UDP_PORT 8081
 #define BUFFER_SIZE 4096
 #define MAX_CLIENTS 10
+#define MAX_EPOLL_EVENTS 64
+#define URING_ENTRIES 256
+#define URING_BUFFER_COUNT 256      // Provided receive buffers (power of two)
+#define MAX_SEND_PARTS 4            // iovecs per routed message (header pieces + payload)
+#define QUEUE_HIGH_WATERMARK (4 * 1024 * 1024)  // Default per-campus outbound backlog limits
+#define QUEUE_LOW_WATERMARK (1024 * 1024)
+#define JOURNAL_DIRECTORY "journal"         // Default store-and-forward location
+#define REPLAY_DRAIN_WAIT_MS 100           // Longest replay waits for a congested campus between checks
+#define LEGACY_FILE_LIMIT (8 * 1024 * 1024)     // Largest chunked file converted for text clients
+#define RELAY_PIPE_SIZE (256 * 1024)    // Zero-copy relay pipe; must hold a whole file chunk
+#define RELAY_MIN_BYTES (16 * 1024)     // Shorter payload remainders are just copied
+#define UDP_RECEIVE_BUFFER (4 * 1024 * 1024)    // Room for heartbeat bursts (kernel may cap it)
+#define LANE_NOTSENT_LOWAT (64 * 1024)  // Unsent bytes the kernel may hold, so lanes decide the rest
 
-// Campus credentials structure
-struct CampusCredentials {
+// I/O strategy, selected at startup
+enum class IOMode {
+    THREADS,        // Legacy: one blocking thread per campus
+    EPOLL,          // Edge-triggered epoll reactor on a single thread
+    MULTI_REACTOR,  // One reactor per core, each with a SO_REUSEPORT listener
+    URING           // io_uring completion loop; falls back to EPOLL if unsupported
+};
+
+// Syscall and message counters used to compare the I/O backends
+struct IOStats {
+    std::atomic<uint64_t> syscalls{0};
+    std::atomic<uint64_t> messages{0};
+
+    // File chunk payloads relayed to binary campuses: moved between sockets
+    // by the kernel, or through the server's own buffers
+    std::atomic<uint64_t> splicedBytes{0};
+    std::atomic<uint64_t> copiedBytes{0};
+
+    void countSyscall(uint64_t n = 1) { syscalls.fetch_add(n, std::memory_order_relaxed); }
+    void countMessage() { messages.fetch_add(1, std::memory_order_relaxed); }
+    void countRelay(uint64_t spliced, uint64_t copied) {
+        splicedBytes.fetch_add(spliced, std::memory_order_relaxed);
+        copiedBytes.fetch_add(copied, std::memory_order_relaxed);
+    }
+};
+
+// Server startup options
+struct ServerConfig {
+    IOMode ioMode = IOMode::EPOLL;
+    uint16_t tcpPort = TCP_PORT;    // Heartbeats arrive on the next port up
+    int reactorCount = 0;       // MULTI_REACTOR only; 0 = one per core
+    size_t queueHighWatermark = QUEUE_HIGH_WATERMARK;
+    size_t queueLowWatermark = QUEUE_LOW_WATERMARK;
+    std::string journalDirectory = JOURNAL_DIRECTORY;
+    uint64_t journalLimit = JOURNAL_CAMPUS_LIMIT;   // Undelivered bytes per campus; 0: no limit
+    std::string compression = availableCodecs();   // Codecs clients may pick, "a/b"; "none" disables
+    uint64_t suspectMillis = LIVENESS_SUSPECT_MS;   // Heartbeat silence before a campus is suspect
+    uint64_t deadMillis = LIVENESS_DEAD_MS;         // ... and before its connection is closed
+    std::string multicastGroup = MULTICAST_GROUP;   // Admin broadcasts; "none" sends them over TCP
+    uint16_t multicastPort = MULTICAST_PORT;
+    int multicastTtl = MULTICAST_TTL;
+    std::string multicastInterface;     // Address of the outgoing interface; empty: routing decides
+    std::vector<ClusterNode> cluster;   // Empty: a single server
+    int nodeIndex = -1;                 // This server's entry in cluster
+    std::string standbyAddress;         // Primary: the host a standby may replicate from
+    std::string primaryHost;            // Standby: the primary it mirrors until taking over
+    uint16_t primaryPort = 0;
+    int sessionTtl = SESSION_TOKEN_TTL;     // Seconds; 0: no session tokens
+    std::string credentialsFile = CREDENTIALS_FILE;     // Reread on SIGHUP
+    int authThreads = 0;        // Reactor modes: threads checking passwords; 0 = one per core
+    uint32_t creditWindow = CREDIT_WINDOW;  // Send credit per sender and target; 0: none given
+    LaneMode laneMode = LaneMode::WEIGHTED;     // Order of frames waiting for a campus
+};
+
+// The slow half of a login, safe on any thread: the AUTH line parsed and
+// the token or password checked
+struct LoginCheck {
+    bool parsed = false;        // Had a campus and a password
+    bool accepted = false;      // Token or password good
+    bool resumed = false;       // By token
     std::string campusName;
-    std::string password;
+    int protocolVersion = PROTOCOL_TEXT;
 };
 
-// Client information structure
-struct ClientInfo {
-    int tcpSocket;
+// Per-connection state used by the reactor
+struct Connection {
+    enum class ReadState { AWAITING_AUTH, AUTHENTICATING, ACTIVE };
+
+    int fd = -1;
+    uint64_t serial = 0;        // Tells a login's connection from a later one on the same fd
+    std::string clientIP;
     std::string campusName;
-    std::string ipAddress;
-    time_t lastHeartbeat;
-    bool isActive;
+    ReadState readState = ReadState::AWAITING_AUTH;
+    int protocolVersion = PROTOCOL_TEXT;
+    uint16_t campusId = 0;
+    FrameDecoder decoder;       // Binary protocol only
+    std::shared_ptr<OutboundQueue> outbound;    // Backlog accounting once authenticated
+    LaneQueue lanes;            // Frames the kernel has not accepted yet, by priority
+    bool closing = false;       // Write failed; close is queued on the loop
+
+    // io_uring only: at most one send and one receive in flight. The frames
+    // a send points into stay in lanes until its completion.
+    struct msghdr sendHeader;
+    struct iovec sendParts[LANE_GATHER_MAX];
+    bool sendPending = false;
+    bool recvPending = false;
+};
+
+// Work handed to a reactor by another thread: either bytes for one of its
+// connections or an arbitrary task to run on the loop
+struct ReactorMessage {
+    std::atomic<ReactorMessage*> next;
+    int fd = -1;
+    std::string campusName;     // Guards against fd reuse after a close
+    uint16_t campusId = 0;
+    SharedFrame data;
+    std::shared_ptr<OutboundQueue> outbound;    // Released when data is written or dropped
+    std::function<void()> task;
+};
+
+// A chunked transfer being reassembled for a text protocol client, which
+// only understands the single hex-encoded FILE message
+struct LegacyTransfer {
+    std::string name;
+    std::string data;
+};
+
+// Threads mode: the pipe a campus's reader thread splices file chunk
+// payloads through on their way to another campus's socket
+struct RelayPipe {
+    int readFd = -1;
+    int writeFd = -1;
+    size_t capacity = 0;        // 0: no pipe, every chunk is copied
+};
+
+// Cluster mode: the link to another node. Frames for campuses homed there
+// are queued here and written by the link's own thread.
+struct PeerLink {
+    ClusterNode node;
+    int index = 0;
+    OutboundQueue outbound{CLUSTER_QUEUE_HIGH, CLUSTER_QUEUE_LOW};
+    std::atomic<bool> up{false};
+    std::atomic<uint64_t> forwarded{0};     // Frames sent to it
+    std::atomic<uint64_t> received{0};      // Frames it sent us
+    std::atomic<uint64_t> dropped{0};       // Link congested or down
+};
+
+// Hot standby (see replication.h). The primary queues everything the
+// standby must mirror here, in the order it happened; the standby keeps
+// what the primary reported until it takes over.
+struct ReplicationState {
+    // Primary
+    std::mutex mutex;
+    std::shared_ptr<OutboundQueue> standby;     // Null while no standby is attached
+    std::atomic<uint64_t> frames{0};            // Sent to the standby
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> resyncs{0};           // Standby dropped for falling behind
+
+    // Standby
+    std::atomic<bool> standbyMode{false};       // Still mirroring; logins go to the primary
+    std::atomic<bool> linkUp{false};
+    CampusTable<std::atomic<bool>> primaryCampuses;     // Connected there, as last reported
+    std::atomic<uint64_t> mirrored{0};          // Records received
+
+    // After taking over: campuses that were connected at the primary and
+    // have not logged in here yet (guarded by mutex)
+    std::set<uint16_t> awaiting;
+    std::chrono::steady_clock::time_point tookOver;
+    std::atomic<int64_t> failoverMillis{-1};    // Until the last of them was back
+};
+
+// Event loop state. Each reactor owns its listener, its epoll instance and
+// its connections; other threads reach it only through the inbox, which is
+// drained when wakeupFd (an eventfd) fires.
+struct Reactor {
+    int index = 0;
+    int epollFd = -1;
+    int wakeupFd = -1;
+    int listenFd = -1;
+    std::thread thread;
+    std::unordered_map<int, std::unique_ptr<Connection>> connections;
+    MpscQueue<ReactorMessage> inbox;
+    std::atomic<bool> wakePending{false};
+    IOStats stats;
 };
 
 class CentralServer {
 private:
     int tcpSocket;
     int udpSocket;
-    std::map<std::string, ClientInfo> connectedCampuses;
-    std::map<std::string, std::string> campusCredentials;
-    std::mutex clientMutex;
+    int multicastSocket;                // -1 when broadcasts go over TCP only
+    struct sockaddr_in multicastAddr;
+    BroadcastHistory broadcasts;        // Sequence numbers and repair copies
+    std::atomic<uint64_t> multicastPackets{0};
+    std::atomic<uint64_t> broadcastRepairs{0};
+    std::mutex targetListMutex;
+    std::unordered_map<uint16_t, std::vector<uint16_t>> targetLists;   // Per sender, from TARGETS control frames
+    std::atomic<uint64_t> fanOutMessages{0};
+    std::atomic<uint64_t> fanOutDeliveries{0};
+    std::atomic<uint64_t> fanOutEncodings{0};
+    TopicIndex topics;                  // Department subscriptions, by campus id
+    std::atomic<uint64_t> topicPublishes{0};    // Messages routed through the index
+    std::atomic<uint64_t> topicFiltered{0};     // Not sent: addressee not subscribed
+    std::atomic<uint64_t> topicExtra{0};        // Sent to subscribers not addressed
+    std::vector<std::unique_ptr<PeerLink>> peers;   // By node index; null for this node
+    int peerSocket;                     // Listener for other nodes; -1 outside cluster mode
+    std::mutex membershipMutex;
+    CampusTable<std::atomic<int>> campusHomes;  // Node index + 1 of each campus's home; 0 until placed
+    static thread_local bool onPeerLink;    // Routing a frame another node forwarded
+    ReplicationState replication;
+    int replicationSocket;              // Primary: listener for the standby; -1 otherwise
+    JournalObserver replicaObserver;    // Feeds journal changes to the standby
+    static thread_local bool sendingSnapshot;   // Snapshot waits for the link rather than dropping it
+    std::shared_ptr<const CredentialTable> credentials;     // Swapped whole by a reload
+    std::shared_ptr<const std::string> campusDirectory;     // "1=CFD,2=KARACHI,..." for AUTH replies
+    std::mutex credentialsMutex;        // One reload at a time
+    std::atomic<uint64_t> credentialReloads{0};
+    std::atomic<uint64_t> passwordChecks{0};
+    std::atomic<uint64_t> passwordMicros{0};    // Spent hashing, all checks together
+    WorkerPool authPool;                // Reactor modes: password checks off the loops
+    std::atomic<uint64_t> connectionSerials{0};
+    CreditLedger credits;               // Send credit owed to senders, by target
+    static thread_local uint16_t creditedTarget;    // Routing a frame its sender had credit for
+    LaneStats laneStats;                // Frames written to campuses, by priority lane
+    CampusRegistry registry;            // Connected campuses, read without locks
+    Journal journal;                    // Store-and-forward for offline campuses
     bool isRunning;
+    ServerConfig config;
+    LivenessTracker liveness;           // Heartbeat deadlines, by campus id
+    SessionTokens sessions;             // Resumption tokens for reconnecting campuses
+    std::atomic<uint64_t> heartbeatBatches{0};  // Batches of heartbeats applied
+    std::vector<std::unique_ptr<Reactor>> reactors;
+    std::unique_ptr<IoUring> uring;
+    IOStats threadStats;        // Threads mode and non-reactor threads
+    std::mutex legacyMutex;
+    std::map<std::tuple<uint16_t, std::string, uint32_t>, LegacyTransfer> legacyTransfers;
 
     // Private methods
     void initializeTCPSocket();
+    int createListeningSocket(bool reusePort, uint16_t port);
+    void prepareCampusSocket(int fd);
     void initializeUDPSocket();
+    void initializeMulticast();
     void loadCredentials();
-    bool authenticateClient(const std::string& campusName, const std::string& password);
+    void reloadCredentials();
+    bool authenticateClient(const CredentialTable& table, const std::string& campusName,
+                            const std::string& password);
+    LoginCheck checkLogin(const std::string& authMsg);
+    bool processAuthentication(int clientSocket, const std::string& clientIP,
+                               const std::string& authMsg, std::string& campusName,
+                               std::string& response, int& protocolVersion,
+                               int reactorIndex = -1, const LoginCheck* checked = nullptr);
     void handleTCPClient(int clientSocket, std::string clientIP);
     void handleUDPMessages();
+    void processHeartbeats(const HeartbeatReceiver& batch, int count);
+    void processHeartbeat(const char* data, size_t length);
+    void recordHeartbeats(const uint32_t* ids, size_t count);
+    void deliverToCampus(const ClientInfo& target, const std::string& head,
+                         const char* body = nullptr, size_t bodyLength = 0);
+    void deliverToCampus(const ClientInfo& target, const SharedFrame& frame);
+    void postFrame(Reactor& owner, const ClientInfo& target, SharedFrame frame);
+    size_t fanOut(FanOut& message, const std::vector<const ClientInfo*>& targets);
+    void routeToMany(const std::vector<uint16_t>& targetIds, FanOut& message);
+    void routeFrameToMany(Frame& frame, const std::string& sourceCampus);
+    void routeFrameTo(Frame& frame, const std::string& sourceCampus,
+                      const std::vector<uint16_t>& targetIds);
+    std::vector<uint16_t> parseTargetList(const std::string& names);
+    bool deliverRouted(const ClientInfo& target, FrameType type, const std::string& sourceCampus,
+                       const std::string& department, const char* body, size_t bodyLength);
+    void sendRouted(const ClientInfo& target, FrameType type, const std::string& sourceCampus,
+                    const std::string& department, const char* body, size_t bodyLength);
+    bool admitOutbound(const ClientInfo& target, const std::string& sourceCampus);
+    void relayLegacyFile(const ClientInfo& target, FrameType type, const std::string& sourceCampus,
+                         const char* body, size_t bodyLength);
+    void sendUnconfirmed(const Frame& begin, const std::string& sourceCampus);
+    bool storeForward(const ClientInfo* target, uint16_t targetId, FrameType type,
+                      const std::string& sourceCampus, const std::string& department,
+                      const char* body, size_t bodyLength);
+    void startReplay(uint16_t campusId);
+    void replayJournal(uint16_t campusId);
+    void finishReplay(uint16_t campusId);
+    void sendFlowSignal(const std::string& senderCampus, const std::string& signal,
+                        const std::string& targetCampus);
+    void notifyResumed(const std::string& targetCampus, const std::vector<std::string>& senders);
+    bool chargeCredit(const FrameHeader& header);
+    void returnCredits(uint16_t targetId);
+    void runCampusWriter(int clientSocket, std::shared_ptr<OutboundQueue> queue,
+                         std::string campusName, uint16_t campusId);
+    bool relayChunkZeroCopy(int clientSocket, RelayPipe& relay, FrameDecoder& decoder,
+                            const std::string& sourceCampus, uint16_t sourceId);
+    ssize_t writeParts(int fd, struct iovec*& parts, int& count, IOStats& stats);
     void monitorHeartbeats();
-    void parseAndRouteMessage(const std::string& message, const std::string& sourceCampus);
-    void broadcastUDPMessage(const std::string& message);
+    void expireCampus(uint16_t campusId);
+    void parseAndRouteMessage(const char* message, size_t length, const std::string& sourceCampus);
+    bool processFrames(FrameDecoder& decoder, const std::string& sourceCampus, uint16_t sourceId,
+                       IOStats& stats);
+    void routeFrame(Frame& frame, const std::string& sourceCampus);
+    void broadcastMessage(const std::string& message);
+    void sendBroadcastSync();
+    void handleControlFrame(const Frame& frame, const std::string& sourceCampus);
+    void handleSubscription(uint16_t campusId, const std::string& list,
+                            const std::string& sourceCampus);
     void displayConnectedCampuses();
+    void displayStatistics();
     void adminConsole();
+    IOStats& statsForThread();
+
+    // Reactor modes (server_reactor.cpp)
+    void initializeReactors(int count);
+    void runReactors();
+    void runReactor(Reactor& reactor);
+    void acceptConnections(Reactor& reactor);
+    void drainUDPSocket();
+    void handleReadable(Reactor& reactor, Connection& conn);
+    bool processIncoming(Reactor& reactor, Connection& conn, char* buffer, int length);
+    void beginLogin(Reactor& reactor, Connection& conn, const std::string& authMsg);
+    void finishLogin(Reactor& reactor, int fd, uint64_t serial, const std::string& authMsg,
+                     const LoginCheck& check);
+    void handleWritable(Reactor& reactor, Connection& conn);
+    void queueWrite(Reactor& reactor, Connection& conn, const char* data, size_t length);
+    void queueWrite(Reactor& reactor, Connection& conn, const struct iovec* parts, int count);
+    void queueWrite(Reactor& reactor, Connection& conn, const SharedFrame& frame);
+    void queueUnsent(Connection& conn, SharedFrame frame, size_t sent);
+    void failWrite(Reactor& reactor, Connection& conn);
+    void releaseOutbound(Connection& conn, size_t bytes);
+    void closeConnection(Reactor& reactor, int fd);
+    void postToReactor(Reactor& reactor, ReactorMessage* message);
+    void drainInbox(Reactor& reactor);
+    void wakeReactor(Reactor& reactor);
+    Reactor* currentReactor();
+    void setCurrentReactor(Reactor* reactor);
+
+    // Cluster mode (server_cluster.cpp)
+    void initializeCluster();
+    void runPeerListener();
+    void handlePeerLink(int peerFd, std::string peerIP);
+    void runPeerLink(PeerLink& link);
+    void updateMembership();
+    void pingPeers();
+    int homeOf(uint16_t campusId) const;
+    PeerLink* remoteHome(uint16_t campusId);
+    bool forwardFrame(PeerLink& link, SharedFrame frame);
+    bool forwardRouted(PeerLink& link, FrameType type, uint16_t sourceId, uint16_t targetId,
+                       const std::string& department, const char* body, size_t bodyLength);
+    void forwardBroadcast(const std::string& message);
+    bool redirectFor(uint16_t campusId, std::string& address);
+    static bool writeFully(int fd, const char* data, size_t length);
+
+    // Hot standby (server_replication.cpp)
+    void initializeReplication();
+    void openReplicationListener();
+    void runReplicationListener();
+    void serveStandby(int standbyFd, const std::string& standbyIP);
+    void replicate(SharedFrame frame);
+    void replicateCampus(uint16_t campusId, bool connected);
+    void pingStandby();
+    void runStandby();
+    bool mirrorPrimary(int primaryFd);
+    void applyReplicated(const Frame& frame, bool& synced);
+    void takeOver(const std::string& reason);
+    void noteFailoverLogin(uint16_t campusId);
+
+    // io_uring mode (server_uring.cpp)
+    bool initializeUring(std::string& error);
+    void runUringLoop();
+    void uringSubmitSend(Connection& conn);
+    bool uringReadyToClose(Connection& conn);
+    struct io_uring_sqe* uringSqe();
 
 public:
-    CentralServer();
+    CentralServer(const ServerConfig& cfg = ServerConfig());
     ~CentralServer();
     void start();
     void stop();
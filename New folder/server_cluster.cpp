@@ -0,0 +1,306 @@
+#include "server.h"
+#include <cerrno>
+#include <netinet/tcp.h>
+
+// Cluster mode: links to the other nodes, campus placement and forwarding
+// (see cluster.h)
+
+thread_local bool CentralServer::onPeerLink = false;
+
+bool CentralServer::writeFully(int fd, const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t sent = send(fd, data, length, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += sent;
+        length -= sent;
+    }
+    return true;
+}
+
+void CentralServer::initializeCluster() {
+    const ClusterNode& self = config.cluster[config.nodeIndex];
+
+    peers.resize(config.cluster.size());
+    for (size_t i = 0; i < config.cluster.size(); i++) {
+        if ((int)i == config.nodeIndex) continue;
+        peers[i].reset(new PeerLink());
+        peers[i]->node = config.cluster[i];
+        peers[i]->index = (int)i;
+    }
+
+    uint16_t peerPort = self.port + CLUSTER_PEER_PORT_OFFSET;
+    peerSocket = createListeningSocket(false, peerPort);
+    logEvent("Cluster node " + self.name + " of " + std::to_string(config.cluster.size()) +
+             ", peer links on port " + std::to_string(peerPort));
+
+    // Until other nodes answer, every campus is homed here
+    updateMembership();
+
+    std::thread listenerThread(&CentralServer::runPeerListener, this);
+    listenerThread.detach();
+    for (auto& link : peers) {
+        if (link) {
+            std::thread linkThread(&CentralServer::runPeerLink, this, std::ref(*link));
+            linkThread.detach();
+        }
+    }
+}
+
+// Dials one node and writes everything queued for it. While the link is
+// down the node is out of the ring; frames queued before it went down are
+// sent once it is back, and its home node sorts them out.
+void CentralServer::runPeerLink(PeerLink& link) {
+    struct sockaddr_in peerAddr;
+    memset(&peerAddr, 0, sizeof(peerAddr));
+    peerAddr.sin_family = AF_INET;
+    peerAddr.sin_port = htons(link.node.port + CLUSTER_PEER_PORT_OFFSET);
+    inet_pton(AF_INET, link.node.host.c_str(), &peerAddr.sin_addr);
+
+    std::string hello = "PEER:" + config.cluster[config.nodeIndex].name + "\n";
+    bool reported = false;
+
+    while (isRunning) {
+        int peerFd = socket(AF_INET, SOCK_STREAM, 0);
+        if (peerFd < 0 || connect(peerFd, (struct sockaddr*)&peerAddr, sizeof(peerAddr)) < 0 ||
+            !writeFully(peerFd, hello.data(), hello.size())) {
+            if (peerFd >= 0) close(peerFd);
+            if (!reported) {
+                LOG_WARN("Cluster node " + link.node.name + " unreachable, retrying every " +
+                         std::to_string(CLUSTER_RETRY_MS) + " ms");
+                reported = true;
+            }
+            usleep(CLUSTER_RETRY_MS * 1000);
+            continue;
+        }
+        reported = false;
+
+        // Forwarded messages are small and latency matters more than packing
+        int noDelay = 1;
+        setsockopt(peerFd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+        link.up = true;
+        logEvent("Cluster link to " + link.node.name + " up");
+        updateMembership();
+
+        SharedFrame frame;
+        while (isRunning && link.outbound.pop(frame)) {
+            bool written = writeFully(peerFd, frame->data(), frame->size());
+            link.outbound.release(frame->size());
+            if (!written) break;
+        }
+
+        link.up = false;
+        close(peerFd);
+        logEvent("Cluster link to " + link.node.name + " down");
+        updateMembership();
+    }
+}
+
+void CentralServer::runPeerListener() {
+    while (isRunning) {
+        struct sockaddr_in peerAddr;
+        socklen_t addrLen = sizeof(peerAddr);
+        int peerFd = accept(peerSocket, (struct sockaddr*)&peerAddr, &addrLen);
+        if (peerFd < 0) {
+            if (isRunning && errno != EINTR) {
+                LOG_ERROR("Error accepting peer link");
+            }
+            continue;
+        }
+
+        std::thread peerThread(&CentralServer::handlePeerLink, this, peerFd,
+                               std::string(inet_ntoa(peerAddr.sin_addr)));
+        peerThread.detach();
+    }
+}
+
+// Frames another node forwarded. They are routed like a campus's own, with
+// the source id the frame carries, but never forwarded again.
+void CentralServer::handlePeerLink(int peerFd, std::string peerIP) {
+    FrameDecoder decoder;
+    std::string hello;
+    char buffer[BUFFER_SIZE];
+
+    // "PEER:<name>\n"; frames may follow in the same read
+    size_t lineEnd;
+    while ((lineEnd = hello.find('\n')) == std::string::npos && hello.size() < BUFFER_SIZE) {
+        int bytesRead = recv(peerFd, buffer, sizeof(buffer), 0);
+        if (bytesRead <= 0) {
+            close(peerFd);
+            return;
+        }
+        hello.append(buffer, bytesRead);
+    }
+
+    // A node is known by its name and the address it was configured with
+    PeerLink* link = nullptr;
+    if (lineEnd != std::string::npos && hello.compare(0, 5, "PEER:") == 0) {
+        std::string name = hello.substr(5, lineEnd - 5);
+        for (auto& candidate : peers) {
+            if (candidate && candidate->node.name == name && candidate->node.host == peerIP) {
+                link = candidate.get();
+            }
+        }
+    }
+    if (!link) {
+        LOG_WARN("Rejected peer link from " + peerIP + ": not a cluster node");
+        close(peerFd);
+        return;
+    }
+    logEvent("Cluster node " + link->node.name + " connected from " + peerIP);
+
+    size_t leftover = hello.size() - lineEnd - 1;
+    memcpy(decoder.prepare(leftover), hello.data() + lineEnd + 1, leftover);
+    decoder.commit(leftover);
+
+    onPeerLink = true;
+    while (isRunning) {
+        Frame frame;
+        FrameDecoder::Status status;
+        while ((status = decoder.next(frame)) == FrameDecoder::FRAME_READY) {
+            if (frame.header.type == FRAME_CONTROL) continue;     // Pings
+            link->received.fetch_add(1, std::memory_order_relaxed);
+            if (frame.header.type == FRAME_BROADCAST) {
+                broadcastMessage(std::string(frame.payload, frame.header.payloadLength));
+            } else {
+                routeFrame(frame, registry.nameOf(frame.header.sourceId));
+                threadStats.countMessage();
+            }
+        }
+        if (status == FrameDecoder::MALFORMED) {
+            LOG_WARN("Malformed frame from cluster node " + link->node.name + ", dropping link");
+            break;
+        }
+
+        int bytesRead = recv(peerFd, decoder.prepare(BUFFER_SIZE), BUFFER_SIZE, 0);
+        threadStats.countSyscall();
+        if (bytesRead <= 0) break;
+        decoder.commit(bytesRead);
+    }
+
+    logEvent("Cluster node " + link->node.name + " disconnected");
+    close(peerFd);
+}
+
+// Rebuilds the ring from this node and every node whose link is up, then
+// moves campuses connected here that now belong elsewhere
+void CentralServer::updateMembership() {
+    std::lock_guard<std::mutex> lock(membershipMutex);
+
+    HashRing ring;
+    std::string members = config.cluster[config.nodeIndex].name;
+    ring.add(config.nodeIndex, members);
+    for (auto& link : peers) {
+        if (link && link->up) {
+            ring.add(link->index, link->node.name);
+            members += ", " + link->node.name;
+        }
+    }
+
+    int movedAway = 0;
+    int homedHere = 0;
+    for (uint16_t id = 1; id <= registry.maxId(); id++) {
+        int home = ring.ownerOf(registry.nameOf(id));
+        if (campusHomes.at(id).exchange(home + 1) != home + 1 && home != config.nodeIndex) {
+            movedAway++;
+        }
+        homedHere += home == config.nodeIndex;
+    }
+    logEvent("Cluster members: " + members + "; " + std::to_string(homedHere) +
+             " campuses homed here, " + std::to_string(movedAway) + " moved away");
+
+    CampusRegistry::ReadGuard guard;
+    for (uint16_t id = 1; id <= registry.maxId(); id++) {
+        const ClientInfo* campus = registry.lookup(id);
+        std::string address;
+        if (!campus || !campus->isActive || !redirectFor(id, address)) continue;
+
+        if (campus->protocolVersion == PROTOCOL_BINARY) {
+            deliverToCampus(*campus, buildFrame(FRAME_CONTROL, 0, id, "", "REDIRECT:" + address));
+        } else {
+            deliverToCampus(*campus, "REDIRECT:" + address);
+        }
+        logEvent("Campus " + campus->campusName + " now homed on " +
+                 config.cluster[homeOf(id)].name + ", redirected");
+    }
+}
+
+// Keeps idle links busy enough that a dead node fails a write
+void CentralServer::pingPeers() {
+    SharedFrame ping = makeSharedFrame(buildFrame(FRAME_CONTROL, 0, 0, "", "PING"));
+    for (auto& link : peers) {
+        if (link && link->up) {
+            link->outbound.push(ping);
+        }
+    }
+}
+
+// Campuses not yet placed on the ring are taken to be homed here
+int CentralServer::homeOf(uint16_t campusId) const {
+    const std::atomic<int>* home = campusHomes.find(campusId);
+    int placed = home ? home->load(std::memory_order_relaxed) : 0;
+    return placed > 0 ? placed - 1 : config.nodeIndex;
+}
+
+// The link to a campus's home, if that is another node and it is up. The
+// caller has found the campus not connected here. Frames that arrived over
+// a peer link are never sent on, so nodes that briefly disagree about a
+// home cannot bounce a frame between them.
+PeerLink* CentralServer::remoteHome(uint16_t campusId) {
+    if (peers.empty() || onPeerLink || campusId == 0) {
+        return nullptr;
+    }
+    int home = homeOf(campusId);
+    if (home == config.nodeIndex || home < 0 || home >= (int)peers.size()) {
+        return nullptr;
+    }
+    PeerLink* link = peers[home].get();
+    return link && link->up ? link : nullptr;
+}
+
+bool CentralServer::forwardFrame(PeerLink& link, SharedFrame frame) {
+    bool newlyBlocked;
+    if (!link.up || !link.outbound.admit("", newlyBlocked)) {
+        link.dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    link.outbound.push(std::move(frame));
+    link.forwarded.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool CentralServer::forwardRouted(PeerLink& link, FrameType type, uint16_t sourceId,
+                                  uint16_t targetId, const std::string& department,
+                                  const char* body, size_t bodyLength) {
+    std::string frame = buildFrameHead(type, sourceId, targetId, department, bodyLength);
+    frame.append(body, bodyLength);
+    return forwardFrame(link, makeSharedFrame(std::move(frame)));
+}
+
+// Admin broadcasts reach the campuses on every node
+void CentralServer::forwardBroadcast(const std::string& message) {
+    if (peers.empty() || onPeerLink) return;
+
+    SharedFrame frame = makeSharedFrame(buildFrame(FRAME_BROADCAST, 0, 0, "", message));
+    for (auto& link : peers) {
+        if (link && link->up && !forwardFrame(*link, frame)) {
+            LOG_WARN("Broadcast not forwarded to cluster node " + link->node.name);
+        }
+    }
+}
+
+// "<host>:<port>" of a campus's home when that is another node that is up
+bool CentralServer::redirectFor(uint16_t campusId, std::string& address) {
+    if (peers.empty() || campusId == 0) return false;
+
+    int home = homeOf(campusId);
+    if (home == config.nodeIndex || home < 0 || home >= (int)peers.size() || !peers[home] ||
+        !peers[home]->up) {
+        return false;
+    }
+    address = peers[home]->node.host + ":" + std::to_string(peers[home]->node.port);
+    return true;
+}
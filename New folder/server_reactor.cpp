@@ -0,0 +1,527 @@
+#include "server.h"
+#include <fcntl.h>
+#include <cerrno>
+#include <sys/eventfd.h>
+#include <algorithm>
+
+// Edge-triggered epoll reactors for CentralServer. Every reactor owns a
+// non-blocking listener (SO_REUSEPORT when there are several, so the kernel
+// spreads accepts across them), its campus connections and an eventfd used
+// to wake it when another reactor or the admin console posts to its inbox.
+// Reactor 0 additionally serves the UDP heartbeat socket.
+
+static thread_local Reactor* loopReactor = nullptr;
+
+static void setNonBlocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        throw std::runtime_error("Failed to make socket non-blocking");
+    }
+}
+
+static void addToEpoll(int epollFd, int fd, uint32_t events) {
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.fd = fd;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        throw std::runtime_error("epoll_ctl ADD failed");
+    }
+}
+
+Reactor* CentralServer::currentReactor() {
+    return loopReactor;
+}
+
+void CentralServer::setCurrentReactor(Reactor* reactor) {
+    loopReactor = reactor;
+}
+
+void CentralServer::initializeReactors(int count) {
+    setNonBlocking(udpSocket);
+
+    for (int i = 0; i < count; i++) {
+        std::unique_ptr<Reactor> reactor(new Reactor());
+        reactor->index = i;
+
+        reactor->epollFd = epoll_create1(EPOLL_CLOEXEC);
+        if (reactor->epollFd < 0) {
+            throw std::runtime_error("Failed to create epoll instance");
+        }
+
+        reactor->wakeupFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (reactor->wakeupFd < 0) {
+            throw std::runtime_error("Failed to create wakeup eventfd");
+        }
+
+        // Reactor 0 reuses the listener bound in initializeTCPSocket()
+        reactor->listenFd = (i == 0) ? tcpSocket : createListeningSocket(true, config.tcpPort);
+        setNonBlocking(reactor->listenFd);
+
+        addToEpoll(reactor->epollFd, reactor->listenFd, EPOLLIN | EPOLLET);
+        addToEpoll(reactor->epollFd, reactor->wakeupFd, EPOLLIN | EPOLLET);
+        if (i == 0) {
+            addToEpoll(reactor->epollFd, udpSocket, EPOLLIN | EPOLLET);
+        }
+
+        reactors.push_back(std::move(reactor));
+    }
+
+    logEvent("Epoll reactors initialized: " + std::to_string(count));
+}
+
+void CentralServer::runReactors() {
+    for (size_t i = 1; i < reactors.size(); i++) {
+        Reactor& reactor = *reactors[i];
+        reactor.thread = std::thread(&CentralServer::runReactor, this, std::ref(reactor));
+    }
+
+    runReactor(*reactors[0]);
+
+    for (size_t i = 1; i < reactors.size(); i++) {
+        wakeReactor(*reactors[i]);
+        reactors[i]->thread.join();
+    }
+    for (auto& reactor : reactors) {
+        close(reactor->wakeupFd);
+        reactor->wakeupFd = -1;
+    }
+}
+
+void CentralServer::runReactor(Reactor& reactor) {
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+    loopReactor = &reactor;
+
+    while (isRunning) {
+        int count = epoll_wait(reactor.epollFd, events, MAX_EPOLL_EVENTS, -1);
+        reactor.stats.countSyscall();
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            LOG_ERROR("epoll_wait failed");
+            break;
+        }
+
+        for (int i = 0; i < count; i++) {
+            int fd = events[i].data.fd;
+            uint32_t mask = events[i].events;
+
+            if (fd == reactor.listenFd) {
+                acceptConnections(reactor);
+            } else if (fd == udpSocket && reactor.index == 0) {
+                drainUDPSocket();
+            } else if (fd == reactor.wakeupFd) {
+                uint64_t value;
+                while (read(reactor.wakeupFd, &value, sizeof(value)) > 0) {
+                    reactor.stats.countSyscall();
+                }
+                reactor.stats.countSyscall();
+                drainInbox(reactor);
+            } else {
+                auto it = reactor.connections.find(fd);
+                if (it == reactor.connections.end()) continue;
+
+                if (mask & (EPOLLERR | EPOLLHUP)) {
+                    closeConnection(reactor, fd);
+                    continue;
+                }
+                if (mask & EPOLLOUT) {
+                    handleWritable(reactor, *it->second);
+                }
+                if (mask & (EPOLLIN | EPOLLRDHUP)) {
+                    handleReadable(reactor, *it->second);
+                }
+            }
+        }
+    }
+
+    // Tear down whatever is still open
+    std::vector<int> openFds;
+    for (const auto& entry : reactor.connections) {
+        openFds.push_back(entry.first);
+    }
+    for (int fd : openFds) {
+        closeConnection(reactor, fd);
+    }
+    drainInbox(reactor);
+    if (reactor.index != 0) {
+        close(reactor.listenFd);    // Reactor 0's listener is closed by stop()
+    }
+    close(reactor.epollFd);
+    reactor.epollFd = -1;
+    loopReactor = nullptr;
+}
+
+void CentralServer::acceptConnections(Reactor& reactor) {
+    while (true) {
+        struct sockaddr_in clientAddr;
+        socklen_t addrLen = sizeof(clientAddr);
+
+        int clientSocket = accept4(reactor.listenFd, (struct sockaddr*)&clientAddr, &addrLen,
+                                   SOCK_NONBLOCK | SOCK_CLOEXEC);
+        reactor.stats.countSyscall();
+        if (clientSocket < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK && isRunning) {
+                LOG_ERROR("Error accepting connection");
+            }
+            return;
+        }
+
+        std::string clientIP = inet_ntoa(clientAddr.sin_addr);
+        logEvent("New connection from " + clientIP + " on reactor " + std::to_string(reactor.index));
+
+        std::unique_ptr<Connection> conn(new Connection());
+        conn->fd = clientSocket;
+        conn->serial = ++connectionSerials;
+        conn->clientIP = clientIP;
+        conn->lanes.configure(config.laneMode, &laneStats);
+        prepareCampusSocket(clientSocket);
+
+        try {
+            addToEpoll(reactor.epollFd, clientSocket, EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET);
+        } catch (const std::exception& e) {
+            logEvent(std::string("Dropping connection: ") + e.what());
+            close(clientSocket);
+            continue;
+        }
+        reactor.connections[clientSocket] = std::move(conn);
+    }
+}
+
+void CentralServer::drainUDPSocket() {
+    HeartbeatReceiver batch;
+
+    while (true) {
+        int received = batch.receive(udpSocket, false);
+        reactors[0]->stats.countSyscall();
+        if (received <= 0) {
+            return;     // Socket drained
+        }
+        processHeartbeats(batch, received);
+
+        // A short batch emptied the socket; the next datagram raises a new edge
+        if (received < HEARTBEAT_BATCH) {
+            return;
+        }
+    }
+}
+
+void CentralServer::handleReadable(Reactor& reactor, Connection& conn) {
+    char buffer[BUFFER_SIZE];
+    int fd = conn.fd;
+
+    // Edge-triggered: keep reading until the kernel reports EAGAIN
+    while (true) {
+        // Binary connections read straight into their frame decoder
+        bool binary = conn.protocolVersion == PROTOCOL_BINARY;
+        char* target = binary ? conn.decoder.prepare(BUFFER_SIZE) : buffer;
+        int bytesRead = recv(fd, target, binary ? BUFFER_SIZE : BUFFER_SIZE - 1, 0);
+        reactor.stats.countSyscall();
+
+        if (bytesRead < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+            closeConnection(reactor, fd);
+            return;
+        }
+        if (bytesRead == 0) {
+            if (!conn.campusName.empty()) {
+                logEvent("Campus " + conn.campusName + " disconnected");
+            }
+            closeConnection(reactor, fd);
+            return;
+        }
+
+        if (binary) {
+            conn.decoder.commit(bytesRead);
+            if (!processFrames(conn.decoder, conn.campusName, conn.campusId, reactor.stats)) {
+                closeConnection(reactor, fd);
+                return;
+            }
+        } else if (!processIncoming(reactor, conn, buffer, bytesRead)) {
+            return;
+        }
+    }
+}
+
+// Shared by the epoll and io_uring loops. buffer must have room for a
+// terminating NUL after length bytes. Returns false once the connection
+// has been closed.
+bool CentralServer::processIncoming(Reactor& reactor, Connection& conn, char* buffer, int length) {
+    if (conn.protocolVersion == PROTOCOL_BINARY) {
+        // Frames are parsed in place; only a trailing partial frame is copied
+        conn.decoder.feed(buffer, length);
+        if (!processFrames(conn.decoder, conn.campusName, conn.campusId, reactor.stats)) {
+            closeConnection(reactor, conn.fd);
+            return false;
+        }
+        return true;
+    }
+
+    buffer[length] = '\0';
+
+    if (conn.readState == Connection::ReadState::AWAITING_AUTH) {
+        conn.readState = Connection::ReadState::AUTHENTICATING;
+        beginLogin(reactor, conn, std::string(buffer));
+    } else if (conn.readState == Connection::ReadState::AUTHENTICATING) {
+        // Clients wait for the AUTH reply before sending anything else
+        logEvent("Dropping connection from " + conn.clientIP + ": data before its login was answered");
+        closeConnection(reactor, conn.fd);
+        return false;
+    } else {
+        LOG_DEBUG("Message received from " + conn.campusName + " (" + std::to_string(length) +
+                 " bytes)");
+        parseAndRouteMessage(buffer, length, conn.campusName);
+        reactor.stats.countMessage();
+    }
+    return true;
+}
+
+// Hashing a password takes milliseconds, which would stall every campus on
+// the loop, so the check runs on the auth pool and the login is finished
+// back on the loop
+void CentralServer::beginLogin(Reactor& reactor, Connection& conn, const std::string& authMsg) {
+    int fd = conn.fd;
+    uint64_t serial = conn.serial;
+    authPool.post([this, &reactor, fd, serial, authMsg]() {
+        LoginCheck check = checkLogin(authMsg);
+        ReactorMessage* message = new ReactorMessage();
+        message->task = [this, &reactor, fd, serial, authMsg, check]() {
+            finishLogin(reactor, fd, serial, authMsg, check);
+        };
+        postToReactor(reactor, message);
+    });
+}
+
+void CentralServer::finishLogin(Reactor& reactor, int fd, uint64_t serial,
+                                const std::string& authMsg, const LoginCheck& check) {
+    // The connection may have closed, and its fd been reused, meanwhile
+    auto it = reactor.connections.find(fd);
+    if (it == reactor.connections.end() || it->second->serial != serial) return;
+    Connection& conn = *it->second;
+
+    std::string campusName;
+    std::string response;
+    int protocolVersion = PROTOCOL_TEXT;
+    bool authenticated = processAuthentication(conn.fd, conn.clientIP, authMsg, campusName,
+                                               response, protocolVersion, reactor.index, &check);
+    if (authenticated) {
+        conn.campusName = campusName;
+        conn.campusId = registry.idOf(campusName);
+        conn.protocolVersion = protocolVersion;
+        conn.readState = Connection::ReadState::ACTIVE;
+
+        // Attach before the reply so its bytes are accounted like any other
+        CampusRegistry::ReadGuard guard;
+        const ClientInfo* campus = registry.lookup(conn.campusId);
+        if (campus) {
+            conn.outbound = campus->outbound;
+        }
+    }
+    if (!response.empty()) {
+        queueWrite(reactor, conn, response.c_str(), response.length());
+    }
+    if (!authenticated) {
+        closeConnection(reactor, conn.fd);
+        return;
+    }
+    startReplay(conn.campusId);
+}
+
+// Hands the kernel frames in lane order until it takes no more. With
+// TCP_NOTSENT_LOWAT it only holds a little unsent data, so whatever is
+// queued meanwhile is still ordered here.
+void CentralServer::handleWritable(Reactor& reactor, Connection& conn) {
+    while (!conn.lanes.empty()) {
+        struct iovec parts[LANE_GATHER_MAX];
+        int count = conn.lanes.gather(parts, LANE_GATHER_MAX);
+        struct iovec* next = parts;
+        ssize_t sent = writeParts(conn.fd, next, count, reactor.stats);
+        if (sent < 0) {
+            failWrite(reactor, conn);
+            return;
+        }
+        conn.lanes.consume(sent);
+        releaseOutbound(conn, sent);
+        if (count > 0) {
+            return;     // Wait for EPOLLOUT
+        }
+    }
+}
+
+void CentralServer::failWrite(Reactor& reactor, Connection& conn) {
+    // Callers may be iterating routing state, so close from the loop instead
+    conn.closing = true;
+    conn.lanes.clear();
+    ReactorMessage* message = new ReactorMessage();
+    int fd = conn.fd;
+    message->task = [this, &reactor, fd]() { closeConnection(reactor, fd); };
+    postToReactor(reactor, message);
+}
+
+// Runs on the owning loop with no locks held
+void CentralServer::releaseOutbound(Connection& conn, size_t bytes) {
+    if (!conn.outbound || bytes == 0) return;
+
+    std::vector<std::string> resumed = conn.outbound->release(bytes);
+    if (!resumed.empty()) {
+        notifyResumed(conn.campusName, resumed);
+    }
+    returnCredits(conn.campusId);
+}
+
+void CentralServer::queueWrite(Reactor& reactor, Connection& conn, const char* data, size_t length) {
+    struct iovec part;
+    part.iov_base = const_cast<char*>(data);
+    part.iov_len = length;
+    queueWrite(reactor, conn, &part, 1);
+}
+
+void CentralServer::queueWrite(Reactor& reactor, Connection& conn, const struct iovec* parts,
+                               int count) {
+    if (conn.closing) return;
+
+    // The direct write copies the parts into a fixed array. A frame in more
+    // pieces is a caller bug; sending part of it would tear the stream.
+    if (count > MAX_SEND_PARTS) {
+        LOG_ERROR("Frame for " + conn.campusName + " not sent: " + std::to_string(count) +
+                  " parts, at most " + std::to_string(MAX_SEND_PARTS) + " allowed");
+        return;
+    }
+    ssize_t sent = 0;
+
+    // Nothing queued: write straight from the caller's buffers with one
+    // sendmsg. Otherwise the frame waits in its lane for the EPOLLOUT edge.
+    // io_uring sends complete later, so they always go through the lanes.
+    if (config.ioMode != IOMode::URING && conn.lanes.empty()) {
+        struct iovec pending[MAX_SEND_PARTS];
+        std::copy(parts, parts + count, pending);
+        struct iovec* next = pending;
+        int left = count;
+        sent = writeParts(conn.fd, next, left, reactor.stats);
+        if (sent < 0) {
+            failWrite(reactor, conn);
+            return;
+        }
+        if (left == 0) {
+            laneStats.count(laneOf(static_cast<const char*>(parts[0].iov_base), parts[0].iov_len),
+                            sent);
+            return;
+        }
+    }
+
+    // Keep the whole frame; the lanes skip what the kernel already took
+    std::string data;
+    for (int i = 0; i < count; i++) {
+        data.append(static_cast<const char*>(parts[i].iov_base), parts[i].iov_len);
+    }
+    queueUnsent(conn, makeSharedFrame(std::move(data)), sent);
+}
+
+void CentralServer::queueWrite(Reactor& reactor, Connection& conn, const SharedFrame& frame) {
+    if (conn.closing) return;
+
+    ssize_t sent = 0;
+    if (config.ioMode != IOMode::URING && conn.lanes.empty()) {
+        struct iovec part;
+        part.iov_base = const_cast<char*>(frame->data());
+        part.iov_len = frame->size();
+        struct iovec* next = &part;
+        int count = 1;
+        sent = writeParts(conn.fd, next, count, reactor.stats);
+        if (sent < 0) {
+            failWrite(reactor, conn);
+            return;
+        }
+        if (count == 0) {
+            laneStats.count(laneOf(frame->data(), frame->size()), sent);
+            return;
+        }
+    }
+    queueUnsent(conn, frame, sent);
+}
+
+// What the kernel did not take counts against the campus's outbound
+// backlog until handleWritable (or the send completion) flushes it
+void CentralServer::queueUnsent(Connection& conn, SharedFrame frame, size_t sent) {
+    bool backlogged = !conn.lanes.empty();
+    size_t remaining = frame->size() - sent;
+    if (sent > 0) {
+        conn.lanes.pushStarted(std::move(frame), sent);
+    } else {
+        conn.lanes.push(std::move(frame));
+    }
+    if (conn.outbound && remaining > 0) {
+        conn.outbound->add(remaining);
+        if (backlogged || config.ioMode != IOMode::URING) {
+            conn.outbound->deferred++;
+        }
+    }
+
+    if (config.ioMode == IOMode::URING && !conn.sendPending) {
+        uringSubmitSend(conn);
+    }
+}
+
+void CentralServer::closeConnection(Reactor& reactor, int fd) {
+    auto it = reactor.connections.find(fd);
+    if (it == reactor.connections.end()) return;
+
+    // io_uring: the fd must outlive any operation still in flight on it
+    if (config.ioMode == IOMode::URING && !uringReadyToClose(*it->second)) return;
+
+    if (it->second->campusId != 0 &&
+        registry.deactivate(it->second->campusId, fd, reactor.index)) {
+        liveness.forget(it->second->campusId);
+        replicateCampus(it->second->campusId, false);
+    }
+
+    if (reactor.epollFd >= 0) {
+        epoll_ctl(reactor.epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    }
+    close(fd);
+    reactor.connections.erase(it);
+}
+
+void CentralServer::postToReactor(Reactor& reactor, ReactorMessage* message) {
+    reactor.inbox.push(message);
+
+    // Coalesce wakeups: only the first post after a drain pays for the write
+    if (!reactor.wakePending.exchange(true)) {
+        wakeReactor(reactor);
+    }
+}
+
+void CentralServer::drainInbox(Reactor& reactor) {
+    reactor.wakePending.store(false);
+
+    while (ReactorMessage* message = reactor.inbox.pop()) {
+        if (message->task) {
+            message->task();
+        } else {
+            auto it = reactor.connections.find(message->fd);
+            // The fd may have been closed and reused by another campus meanwhile
+            if (it != reactor.connections.end() && it->second->campusName == message->campusName) {
+                queueWrite(reactor, *it->second, message->data);
+            }
+
+            // In-flight accounting ends here; queueWrite re-added any unsent part
+            if (message->outbound) {
+                std::vector<std::string> resumed = message->outbound->release(message->data->size());
+                if (!resumed.empty()) {
+                    notifyResumed(message->campusName, resumed);
+                }
+                returnCredits(message->campusId);
+            }
+        }
+        delete message;
+    }
+}
+
+void CentralServer::wakeReactor(Reactor& reactor) {
+    uint64_t one = 1;
+    statsForThread().countSyscall();
+    if (write(reactor.wakeupFd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        LOG_ERROR("Failed to wake reactor " + std::to_string(reactor.index));
+    }
+}
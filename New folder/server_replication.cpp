@@ -0,0 +1,404 @@
+#include "server.h"
+#include <cerrno>
+#include <netinet/tcp.h>
+
+// Hot standby: the primary's end of the replication link and the standby's
+// (see replication.h)
+
+thread_local bool CentralServer::sendingSnapshot = false;
+
+static SharedFrame controlFrame(const std::string& text) {
+    return makeSharedFrame(buildFrame(FRAME_CONTROL, 0, 0, "", text));
+}
+
+void CentralServer::initializeReplication() {
+    // While a standby is attached every journal change is passed to it
+    replicaObserver.appended = [this](uint16_t campusId, const JournalRecord& record) {
+        std::string frame = buildFrameHead(record.type, registry.idOf(record.sourceCampus),
+                                           campusId, record.department, record.bodyLength);
+        frame.append(record.body, record.bodyLength);
+        replicate(makeSharedFrame(std::move(frame)));
+    };
+    replicaObserver.consumed = [this](uint16_t campusId) {
+        replicate(controlFrame("CONSUMED:" + std::to_string(campusId)));
+    };
+
+    if (!config.primaryHost.empty()) {
+        replication.standbyMode = true;
+        logEvent("Standby of " + config.primaryHost + ":" + std::to_string(config.primaryPort) +
+                 ", campuses are sent there until it is lost");
+        std::thread standbyThread(&CentralServer::runStandby, this);
+        standbyThread.detach();
+    } else if (!config.standbyAddress.empty()) {
+        openReplicationListener();
+    }
+}
+
+void CentralServer::openReplicationListener() {
+    uint16_t port = config.tcpPort + REPLICATION_PORT_OFFSET;
+    replicationSocket = createListeningSocket(false, port);
+    logEvent("Standby " + config.standbyAddress + " may replicate on port " +
+             std::to_string(port));
+
+    std::thread listenerThread(&CentralServer::runReplicationListener, this);
+    listenerThread.detach();
+}
+
+// One standby at a time, served on this thread, so one that reconnects gets
+// its snapshot only after the old link is torn down
+void CentralServer::runReplicationListener() {
+    while (isRunning) {
+        struct sockaddr_in standbyAddr;
+        socklen_t addrLen = sizeof(standbyAddr);
+        int standbyFd = accept(replicationSocket, (struct sockaddr*)&standbyAddr, &addrLen);
+        if (standbyFd < 0) {
+            if (isRunning && errno != EINTR) {
+                LOG_ERROR("Error accepting replication link");
+            }
+            continue;
+        }
+
+        std::string standbyIP = inet_ntoa(standbyAddr.sin_addr);
+        if (standbyIP != config.standbyAddress) {
+            LOG_WARN("Rejected replication link from " + standbyIP + ": not the standby");
+            close(standbyFd);
+            continue;
+        }
+        serveStandby(standbyFd, standbyIP);
+    }
+}
+
+// Sends the standby a snapshot, then every change, until the link fails or
+// the standby falls too far behind
+void CentralServer::serveStandby(int standbyFd, const std::string& standbyIP) {
+    struct timeval timeout = {REPLICATION_TIMEOUT_MS / 1000, (REPLICATION_TIMEOUT_MS % 1000) * 1000};
+    setsockopt(standbyFd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    char hello[8];
+    if (recv(standbyFd, hello, sizeof(hello), MSG_WAITALL) != (ssize_t)sizeof(hello) ||
+        memcmp(hello, "STANDBY\n", sizeof(hello)) != 0) {
+        LOG_WARN("Rejected replication link from " + standbyIP + ": no STANDBY hello");
+        close(standbyFd);
+        return;
+    }
+    int noDelay = 1;
+    setsockopt(standbyFd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+    auto queue = std::make_shared<OutboundQueue>(REPLICATION_QUEUE_HIGH, REPLICATION_QUEUE_LOW);
+    queue->push(controlFrame("RESET"));
+    {
+        std::lock_guard<std::mutex> lock(replication.mutex);
+        replication.standby = queue;
+    }
+    logEvent("Standby connected from " + standbyIP + ", sending snapshot");
+
+    std::atomic<bool> writing{true};
+    std::thread writer([this, standbyFd, queue, &writing]() {
+        // Whatever queued up while the last write was going out leaves in
+        // one sendmsg()
+        std::vector<SharedFrame> batch;
+        std::vector<struct iovec> parts;
+        while (queue->popBatch(batch, REPLICATION_BATCH)) {
+            size_t bytes = 0;
+            parts.clear();
+            for (const SharedFrame& frame : batch) {
+                parts.push_back({const_cast<char*>(frame->data()), frame->size()});
+                bytes += frame->size();
+            }
+            struct iovec* next = parts.data();
+            int count = (int)parts.size();
+            bool written = writeParts(standbyFd, next, count, threadStats) >= 0;
+            queue->release(bytes);
+            if (!written) break;
+            replication.frames.fetch_add(batch.size(), std::memory_order_relaxed);
+            replication.bytes.fetch_add(bytes, std::memory_order_relaxed);
+
+            // Under a stream of stores, waking for every record would cost
+            // the routing threads more than the writes themselves
+            if (batch.size() < REPLICATION_BATCH) {
+                usleep(REPLICATION_LINGER_US);
+            }
+            batch.clear();
+        }
+        {
+            std::lock_guard<std::mutex> lock(replication.mutex);
+            if (replication.standby == queue) {
+                replication.standby.reset();
+            }
+        }
+        writing = false;
+    });
+
+    // Campus logins from here on are queued behind these; one that drops
+    // meanwhile may be reported up after its DOWN, which only skews the
+    // standby's failover count
+    sendingSnapshot = true;
+    {
+        CampusRegistry::ReadGuard guard;
+        for (uint16_t id = 1; id <= registry.maxId(); id++) {
+            const ClientInfo* campus = registry.lookup(id);
+            if (campus && campus->isActive) {
+                replicate(controlFrame("UP:" + std::to_string(id)));
+            }
+        }
+    }
+    journal.observe(&replicaObserver);
+    replicate(controlFrame("SYNCED"));
+    sendingSnapshot = false;
+
+    while (writing && isRunning) {
+        usleep(REPLICATION_PING_MS * 1000);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(replication.mutex);
+        if (replication.standby == queue) {
+            replication.standby.reset();
+        }
+    }
+    journal.observe(nullptr);
+    queue->close();
+    shutdown(standbyFd, SHUT_RDWR);
+    writer.join();
+    close(standbyFd);
+    logEvent("Standby " + standbyIP + " disconnected");
+}
+
+void CentralServer::replicate(SharedFrame frame) {
+    std::shared_ptr<OutboundQueue> queue;
+    {
+        std::lock_guard<std::mutex> lock(replication.mutex);
+        queue = replication.standby;
+    }
+    if (!queue) return;
+
+    if (sendingSnapshot) {
+        // However much is journaled, the snapshot never outgrows the queue;
+        // it ends early if the link fails meanwhile (the writer detaches it)
+        size_t queued, peak;
+        bool paused;
+        queue->snapshot(queued, peak, paused);
+        while (paused && isRunning) {
+            {
+                std::lock_guard<std::mutex> lock(replication.mutex);
+                if (replication.standby != queue) return;
+            }
+            usleep(1000);
+            queue->snapshot(queued, peak, paused);
+        }
+        queue->push(std::move(frame));
+        return;
+    }
+
+    bool newlyBlocked;
+    if (!queue->admit("", newlyBlocked)) {
+        // Too far behind to catch up from here: it reconnects and starts over
+        std::lock_guard<std::mutex> lock(replication.mutex);
+        if (replication.standby == queue) {
+            replication.standby.reset();
+            replication.resyncs.fetch_add(1, std::memory_order_relaxed);
+            LOG_WARN("Standby fell " + std::to_string(REPLICATION_QUEUE_HIGH) +
+                     " bytes behind, dropping it for a fresh snapshot");
+            queue->close();
+        }
+        return;
+    }
+    queue->push(std::move(frame));
+}
+
+// Registry changes, so the standby knows whom to expect after a failover
+void CentralServer::replicateCampus(uint16_t campusId, bool connected) {
+    if (config.standbyAddress.empty()) return;
+    replicate(controlFrame((connected ? "UP:" : "DOWN:") + std::to_string(campusId)));
+}
+
+void CentralServer::pingStandby() {
+    if (config.standbyAddress.empty()) return;
+    replicate(controlFrame("PING"));
+}
+
+// Mirrors the primary until it is lost, then takes over. A primary that is
+// not up yet at startup is waited for; once mirrored, failing to dial it
+// again, or a link that goes silent before the snapshot is through, means
+// it is gone.
+void CentralServer::runStandby() {
+    struct sockaddr_in primaryAddr;
+    memset(&primaryAddr, 0, sizeof(primaryAddr));
+    primaryAddr.sin_family = AF_INET;
+    primaryAddr.sin_port = htons(config.primaryPort + REPLICATION_PORT_OFFSET);
+    inet_pton(AF_INET, config.primaryHost.c_str(), &primaryAddr.sin_addr);
+
+    const std::string primary = config.primaryHost + ":" + std::to_string(config.primaryPort);
+    bool everSynced = false;
+    bool reported = false;
+
+    while (isRunning) {
+        int primaryFd = socket(AF_INET, SOCK_STREAM, 0);
+        if (primaryFd < 0 ||
+            connect(primaryFd, (struct sockaddr*)&primaryAddr, sizeof(primaryAddr)) < 0 ||
+            !writeFully(primaryFd, "STANDBY\n", 8)) {
+            if (primaryFd >= 0) close(primaryFd);
+            if (everSynced) {
+                takeOver("unreachable");
+                return;
+            }
+            if (!reported) {
+                LOG_WARN("Primary " + primary + " unreachable, retrying every " +
+                         std::to_string(REPLICATION_RETRY_MS) + " ms");
+                reported = true;
+            }
+            usleep(REPLICATION_RETRY_MS * 1000);
+            continue;
+        }
+        reported = false;
+
+        struct timeval timeout = {REPLICATION_TIMEOUT_MS / 1000,
+                                  (REPLICATION_TIMEOUT_MS % 1000) * 1000};
+        setsockopt(primaryFd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        replication.linkUp = true;
+        bool synced = mirrorPrimary(primaryFd);
+        replication.linkUp = false;
+        close(primaryFd);
+
+        if (!isRunning) return;
+        if (everSynced && !synced) {
+            takeOver("silent");
+            return;
+        }
+        everSynced |= synced;
+        LOG_WARN("Replication link to primary " + primary + " lost, redialling");
+    }
+}
+
+// Applies what the primary sends until the link drops or goes quiet for
+// REPLICATION_TIMEOUT_MS. Returns whether the snapshot got through.
+bool CentralServer::mirrorPrimary(int primaryFd) {
+    FrameDecoder decoder;
+    bool synced = false;
+
+    while (isRunning) {
+        Frame frame;
+        FrameDecoder::Status status;
+        while ((status = decoder.next(frame)) == FrameDecoder::FRAME_READY) {
+            applyReplicated(frame, synced);
+        }
+        if (status == FrameDecoder::MALFORMED) {
+            LOG_WARN("Malformed frame on the replication link, dropping it");
+            break;
+        }
+
+        int bytesRead = recv(primaryFd, decoder.prepare(BUFFER_SIZE), BUFFER_SIZE, 0);
+        if (bytesRead < 0 && errno == EINTR) continue;
+        if (bytesRead <= 0) break;
+        decoder.commit(bytesRead);
+    }
+    return synced;
+}
+
+void CentralServer::applyReplicated(const Frame& frame, bool& synced) {
+    if (frame.header.type != FRAME_CONTROL) {
+        // A stored message: into this server's journal for the same campus
+        std::string department;
+        size_t offset = 0;
+        if (frame.header.type == FRAME_MESSAGE) {
+            offset = splitMessagePayload(frame, department);
+        }
+        try {
+            // The primary only passes on what fitted its own limit, so this
+            // is refused only if the standby was given a smaller one
+            JournalAppend result = journal.append(frame.header.targetId,
+                                                  (FrameType)frame.header.type,
+                                                  registry.nameOf(frame.header.sourceId),
+                                                  department, frame.payload + offset,
+                                                  frame.header.payloadLength - offset);
+            if (result == JournalAppend::FULL) {
+                LOG_WARN("Mirrored message for " + registry.nameOf(frame.header.targetId) +
+                         " dropped: journal full");
+                return;
+            }
+            replication.mirrored.fetch_add(1, std::memory_order_relaxed);
+        } catch (const std::exception& e) {
+            LOG_ERROR(std::string("Journal write failed on standby: ") + e.what());
+        }
+        return;
+    }
+
+    std::string text(frame.payload, frame.header.payloadLength);
+    size_t colon = text.find(':');
+    uint16_t campusId = colon == std::string::npos ? 0 : (uint16_t)atoi(text.c_str() + colon + 1);
+    std::string verb = text.substr(0, colon);
+    bool known = campusId > 0 && campusId <= MAX_CAMPUS_ID;
+
+    if (verb == "CONSUMED" && known) {
+        journal.discard(campusId);
+    } else if (verb == "UP" && known) {
+        replication.primaryCampuses.at(campusId) = true;
+    } else if (verb == "DOWN" && known) {
+        replication.primaryCampuses.at(campusId) = false;
+    } else if (verb == "RESET") {
+        // The snapshot that follows replaces whatever was mirrored before
+        for (uint16_t id = 1; id <= registry.maxId(); id++) {
+            journal.clear(id);
+        }
+        for (size_t id = 1; id < replication.primaryCampuses.size(); id++) {
+            *replication.primaryCampuses.find(id) = false;
+        }
+        synced = false;
+    } else if (verb == "SYNCED") {
+        uint64_t stored = 0;
+        for (uint16_t id = 1; id <= registry.maxId(); id++) {
+            stored += journal.stats(id) ? journal.stats(id)->records.load() : 0;
+        }
+        logEvent("In sync with primary, " + std::to_string(stored) + " stored messages mirrored");
+        synced = true;
+    }
+}
+
+// The standby becomes the server: logins are accepted here and campuses
+// get what was stored for them as they come back
+void CentralServer::takeOver(const std::string& reason) {
+    size_t expected = 0;
+    {
+        std::lock_guard<std::mutex> lock(replication.mutex);
+        replication.awaiting.clear();
+        for (size_t id = 1; id < replication.primaryCampuses.size(); id++) {
+            if (*replication.primaryCampuses.find(id)) {
+                replication.awaiting.insert((uint16_t)id);
+            }
+        }
+        expected = replication.awaiting.size();
+        replication.tookOver = std::chrono::steady_clock::now();
+        if (expected == 0) {
+            replication.failoverMillis = 0;
+        }
+    }
+    replication.standbyMode = false;
+
+    uint64_t stored = 0;
+    for (uint16_t id = 1; id <= registry.maxId(); id++) {
+        stored += journal.stats(id) ? journal.stats(id)->records.load() : 0;
+    }
+    LOG_WARN("Primary " + config.primaryHost + ":" + std::to_string(config.primaryPort) + " " +
+             reason + ", taking over with " + std::to_string(stored) +
+             " stored messages; " + std::to_string(expected) + " campuses were connected there");
+
+    if (!config.standbyAddress.empty()) {
+        openReplicationListener();
+    }
+}
+
+// Failover time: from taking over until the last campus that was connected
+// at the primary has logged in here
+void CentralServer::noteFailoverLogin(uint16_t campusId) {
+    if (config.primaryHost.empty()) return;
+
+    std::lock_guard<std::mutex> lock(replication.mutex);
+    if (replication.awaiting.erase(campusId) == 0 || !replication.awaiting.empty()) return;
+
+    int64_t millis = std::chrono::duration_cast<std::chrono::milliseconds>(
+                         std::chrono::steady_clock::now() - replication.tookOver).count();
+    replication.failoverMillis = millis;
+    logEvent("Failover complete: every campus connected at the primary is back after " +
+             std::to_string(millis) + " ms");
+}
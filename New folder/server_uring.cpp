@@ -0,0 +1,282 @@
+#include "server.h"
+#include <cerrno>
+#include <sys/eventfd.h>
+
+// io_uring backend for CentralServer. A single completion loop drives
+// accept, receives from a provided buffer ring, sends and UDP recvmsg for
+// heartbeats. All SQEs queued while handling one batch of completions go
+// to the kernel in the next io_uring_enter, so one syscall typically
+// carries many sends and re-armed receives.
+
+// user_data layout: operation in the top byte, fd in the low 32 bits
+enum UringOp : uint64_t {
+    OP_ACCEPT = 1,
+    OP_RECV = 2,
+    OP_SEND = 3,
+    OP_UDP_RECV = 4,
+    OP_WAKEUP = 5
+};
+
+static uint64_t packUserData(UringOp op, int fd) {
+    return ((uint64_t)op << 56) | (uint32_t)fd;
+}
+
+bool CentralServer::initializeUring(std::string& error) {
+    std::unique_ptr<IoUring> ring(new IoUring());
+    if (!ring->init(URING_ENTRIES, error)) {
+        return false;
+    }
+    // Provided buffer rings need Linux 5.19+; treat their absence as "unsupported"
+    if (!ring->registerBufferRing(0, URING_BUFFER_COUNT, BUFFER_SIZE, error)) {
+        return false;
+    }
+
+    std::unique_ptr<Reactor> reactor(new Reactor());
+    reactor->index = 0;
+    reactor->listenFd = tcpSocket;
+    reactor->wakeupFd = eventfd(0, EFD_CLOEXEC);
+    if (reactor->wakeupFd < 0) {
+        error = "Failed to create wakeup eventfd";
+        return false;
+    }
+
+    reactors.push_back(std::move(reactor));
+    uring = std::move(ring);
+
+    logEvent("io_uring backend initialized");
+    return true;
+}
+
+struct io_uring_sqe* CentralServer::uringSqe() {
+    struct io_uring_sqe* sqe = uring->getSqe();
+    if (!sqe) {
+        // Submission ring full: hand what we have to the kernel first
+        uring->submitAndWait(0);
+        reactors[0]->stats.countSyscall();
+        sqe = uring->getSqe();
+    }
+    return sqe;
+}
+
+void CentralServer::uringSubmitSend(Connection& conn) {
+    // Point one sendmsg at the next frames in lane order. They stay in the
+    // lanes, untouched, until the kernel reports completion.
+    int count = conn.lanes.gather(conn.sendParts, LANE_GATHER_MAX);
+    if (count == 0) return;
+
+    struct io_uring_sqe* sqe = uringSqe();
+    if (!sqe) return;
+
+    memset(&conn.sendHeader, 0, sizeof(conn.sendHeader));
+    conn.sendHeader.msg_iov = conn.sendParts;
+    conn.sendHeader.msg_iovlen = count;
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = conn.fd;
+    sqe->addr = reinterpret_cast<unsigned long>(&conn.sendHeader);
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = packUserData(OP_SEND, conn.fd);
+    conn.sendPending = true;
+}
+
+bool CentralServer::uringReadyToClose(Connection& conn) {
+    conn.closing = true;
+    if (conn.sendPending) {
+        return false;       // Closed when the send completes
+    }
+    if (conn.recvPending) {
+        shutdown(conn.fd, SHUT_RDWR);   // Forces the pending receive to complete
+        return false;
+    }
+    return true;
+}
+
+void CentralServer::runUringLoop() {
+    Reactor& reactor = *reactors[0];
+    setCurrentReactor(&reactor);
+
+    struct sockaddr_in acceptAddr;
+    socklen_t acceptAddrLen = sizeof(acceptAddr);
+
+    // UDP heartbeats: one recvmsg kept armed with stable storage
+    char udpBuffer[BUFFER_SIZE];
+    struct sockaddr_in udpAddr;
+    struct iovec udpIov;
+    struct msghdr udpMsg;
+    uint64_t wakeupValue;
+
+    auto armAccept = [&]() {
+        struct io_uring_sqe* sqe = uringSqe();
+        if (!sqe) return;
+        acceptAddrLen = sizeof(acceptAddr);
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->fd = tcpSocket;
+        sqe->addr = reinterpret_cast<unsigned long>(&acceptAddr);
+        sqe->addr2 = reinterpret_cast<unsigned long>(&acceptAddrLen);
+        sqe->accept_flags = SOCK_CLOEXEC;
+        sqe->user_data = packUserData(OP_ACCEPT, tcpSocket);
+    };
+
+    auto armRecv = [&](Connection& conn) {
+        struct io_uring_sqe* sqe = uringSqe();
+        if (!sqe) return;
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = conn.fd;
+        sqe->len = BUFFER_SIZE - 1;     // Leave room for the NUL processIncoming adds
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = uring->group();
+        sqe->user_data = packUserData(OP_RECV, conn.fd);
+        conn.recvPending = true;
+    };
+
+    auto armUdp = [&]() {
+        struct io_uring_sqe* sqe = uringSqe();
+        if (!sqe) return;
+        udpIov.iov_base = udpBuffer;
+        udpIov.iov_len = BUFFER_SIZE - 1;
+        memset(&udpMsg, 0, sizeof(udpMsg));
+        udpMsg.msg_name = &udpAddr;
+        udpMsg.msg_namelen = sizeof(udpAddr);
+        udpMsg.msg_iov = &udpIov;
+        udpMsg.msg_iovlen = 1;
+        sqe->opcode = IORING_OP_RECVMSG;
+        sqe->fd = udpSocket;
+        sqe->addr = reinterpret_cast<unsigned long>(&udpMsg);
+        sqe->len = 1;
+        sqe->user_data = packUserData(OP_UDP_RECV, udpSocket);
+    };
+
+    auto armWakeup = [&]() {
+        struct io_uring_sqe* sqe = uringSqe();
+        if (!sqe) return;
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = reactor.wakeupFd;
+        sqe->addr = reinterpret_cast<unsigned long>(&wakeupValue);
+        sqe->len = sizeof(wakeupValue);
+        sqe->user_data = packUserData(OP_WAKEUP, reactor.wakeupFd);
+    };
+
+    armAccept();
+    armUdp();
+    armWakeup();
+
+    while (isRunning) {
+        int ret = uring->submitAndWait(1);
+        reactor.stats.countSyscall();
+        if (ret < 0) {
+            LOG_ERROR("io_uring_enter failed: " + std::string(strerror(errno)));
+            break;
+        }
+
+        while (struct io_uring_cqe* cqe = uring->peekCqe()) {
+            uint64_t userData = cqe->user_data;
+            int result = cqe->res;
+            unsigned flags = cqe->flags;
+            uring->cqeSeen();
+
+            UringOp op = (UringOp)(userData >> 56);
+            int fd = (int)(uint32_t)userData;
+
+            switch (op) {
+            case OP_ACCEPT: {
+                if (result >= 0) {
+                    std::string clientIP = inet_ntoa(acceptAddr.sin_addr);
+                    logEvent("New connection from " + clientIP);
+
+                    std::unique_ptr<Connection> conn(new Connection());
+                    conn->fd = result;
+                    conn->serial = ++connectionSerials;
+                    conn->clientIP = clientIP;
+                    conn->lanes.configure(config.laneMode, &laneStats);
+                    prepareCampusSocket(result);
+                    Connection& ref = *conn;
+                    reactor.connections[result] = std::move(conn);
+                    armRecv(ref);
+                } else if (isRunning) {
+                    LOG_ERROR("Error accepting connection");
+                }
+                if (isRunning) armAccept();
+                break;
+            }
+            case OP_RECV: {
+                auto it = reactor.connections.find(fd);
+                if (it == reactor.connections.end()) break;
+                Connection& conn = *it->second;
+                conn.recvPending = false;
+
+                if (result == -ENOBUFS) {
+                    // Buffer ring momentarily exhausted; try again
+                    armRecv(conn);
+                    break;
+                }
+                if (result <= 0 || !(flags & IORING_CQE_F_BUFFER)) {
+                    if (result == 0 && !conn.campusName.empty() && !conn.closing) {
+                        logEvent("Campus " + conn.campusName + " disconnected");
+                    }
+                    closeConnection(reactor, fd);
+                    break;
+                }
+
+                unsigned short bufferId = flags >> IORING_CQE_BUFFER_SHIFT;
+                bool open = conn.closing ||
+                            processIncoming(reactor, conn, uring->buffer(bufferId), result);
+                uring->recycleBuffer(bufferId);
+
+                if (open) {
+                    it = reactor.connections.find(fd);
+                    if (it == reactor.connections.end()) break;
+                    if (it->second->closing) {
+                        closeConnection(reactor, fd);
+                    } else {
+                        armRecv(*it->second);
+                    }
+                }
+                break;
+            }
+            case OP_SEND: {
+                auto it = reactor.connections.find(fd);
+                if (it == reactor.connections.end()) break;
+                Connection& conn = *it->second;
+                conn.sendPending = false;
+
+                if (result < 0) {
+                    conn.lanes.clear();
+                    closeConnection(reactor, fd);
+                    break;
+                }
+
+                conn.lanes.consume(result);
+                releaseOutbound(conn, result);
+
+                if (conn.closing) {
+                    closeConnection(reactor, fd);
+                } else {
+                    uringSubmitSend(conn);
+                }
+                break;
+            }
+            case OP_UDP_RECV:
+                if (result > 0) {
+                    processHeartbeat(udpBuffer, result);
+                }
+                if (isRunning) armUdp();
+                break;
+            case OP_WAKEUP:
+                drainInbox(reactor);
+                if (isRunning) armWakeup();
+                break;
+            }
+        }
+    }
+
+    // Outstanding operations die with the ring; just release the sockets
+    for (auto& entry : reactor.connections) {
+        close(entry.first);
+    }
+    reactor.connections.clear();
+    drainInbox(reactor);
+    close(reactor.wakeupFd);
+    reactor.wakeupFd = -1;
+    setCurrentReactor(nullptr);
+    uring.reset();
+}
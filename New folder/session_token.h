@@ -0,0 +1,65 @@
+#ifndef SESSION_TOKEN_H
+#define SESSION_TOKEN_H
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <ctime>
+#include <cstdint>
+#include <cstddef>
+#include "checksum.h"
+#include "campus_table.h"
+
+// Session resumption. A binary campus that logs in is given a token in the
+// AUTH reply, "|SESSION:<token>". When its connection drops it offers the
+// token with the next login, "AUTH:Proto:2,Token:<token>,Campus:...". A
+// valid token skips the password check and resumes the session: the topic
+// subscriptions and target lists the campus had are kept, and the reply
+// says "|RESUMED:1" so the client does not send them again. Anything else
+// (no token, a forged, expired or superseded one, another server's) falls
+// back to the password, as before.
+//
+// A token is "<campus id>.<expiry>.<generation>.<MAC>": the expiry in Unix
+// seconds, the campus's session generation, and the first half of an
+// HMAC-SHA256 over the rest under a key drawn when the server starts, in
+// hex. A password login starts a new generation, so only the latest
+// session's tokens resume. Resuming renews the token with a later expiry.
+
+#define SESSION_TOKEN_TTL 600           // Seconds a token stays valid
+#define SESSION_KEY_SIZE 32
+#define SESSION_MAC_SIZE 16             // Bytes of the MAC kept in a token
+
+class SessionTokens {
+private:
+    HmacSha256 mac;
+    int ttlSeconds;
+    CampusTable<std::atomic<uint32_t>> generations;     // Indexed by campus id
+
+    std::string sign(uint16_t campusId, time_t expires, uint32_t generation) const;
+
+public:
+    // Metrics
+    std::atomic<uint64_t> issued{0};
+    std::atomic<uint64_t> resumed{0};
+    std::atomic<uint64_t> rejected{0};      // Offered but not valid
+
+    // Throws if no key can be drawn. ttl 0 turns tokens off.
+    explicit SessionTokens(int ttl);
+
+    bool enabled() const { return ttlSeconds > 0; }
+    int ttl() const { return ttlSeconds; }
+
+    // A password login: a new generation, so older tokens stop resuming
+    std::string begin(uint16_t campusId, time_t now);
+    // A resumed login: same generation, later expiry
+    std::string renew(uint16_t campusId, time_t now);
+    // Its password changed or it was removed: the campus's tokens stop
+    // resuming
+    void revoke(uint16_t campusId);
+
+    // True if token belongs to campusId's current session and has not
+    // expired. Counts a resume or a rejection.
+    bool verify(const std::string& token, uint16_t campusId, time_t now);
+};
+
+#endif // SESSION_TOKEN_H
@@ -0,0 +1,216 @@
+#include "timer_wheel.h"
+#include <algorithm>
+
+// ---- TimerWheel ----
+
+TimerWheel::TimerWheel(uint32_t capacity, uint64_t startTick)
+    : nodes(capacity), current(startTick), armedCount(0) {
+    for (uint32_t& head : heads) {
+        head = NIL;
+    }
+}
+
+void TimerWheel::grow(uint32_t capacity) {
+    if (capacity > nodes.size()) {
+        nodes.resize(capacity);
+    }
+}
+
+// Files a node by how far its deadline is from the next tick to run: within
+// 64 ticks on level 0, within 64 * 64 on level 1, and so on
+void TimerWheel::link(uint32_t id) {
+    Node& node = nodes[id];
+    if (node.deadline < current) {
+        node.deadline = current;
+    }
+    uint64_t delta = node.deadline - current;
+    if (delta >= WHEEL_SPAN) {
+        delta = WHEEL_SPAN - 1;
+        node.deadline = current + delta;
+    }
+
+    int level = 0;
+    while (level < WHEEL_LEVELS - 1 && delta >= ((uint64_t)1 << ((level + 1) * WHEEL_BITS))) {
+        level++;
+    }
+    uint32_t slot = level * WHEEL_SLOTS +
+                    (uint32_t)((node.deadline >> (level * WHEEL_BITS)) & (WHEEL_SLOTS - 1));
+
+    node.slot = slot;
+    node.prev = NIL;
+    node.next = heads[slot];
+    if (node.next != NIL) {
+        nodes[node.next].prev = id;
+    }
+    heads[slot] = id;
+}
+
+void TimerWheel::unlink(uint32_t id) {
+    Node& node = nodes[id];
+    if (node.prev != NIL) {
+        nodes[node.prev].next = node.next;
+    } else {
+        heads[node.slot] = node.next;
+    }
+    if (node.next != NIL) {
+        nodes[node.next].prev = node.prev;
+    }
+    node.prev = NIL;
+    node.next = NIL;
+    node.slot = NIL;
+}
+
+// Moves the slot of level that the wheel has just reached down to the
+// levels below. True if that was slot 0, so the level above is due too.
+bool TimerWheel::cascade(int level) {
+    uint32_t index = (uint32_t)((current >> (level * WHEEL_BITS)) & (WHEEL_SLOTS - 1));
+    uint32_t slot = level * WHEEL_SLOTS + index;
+
+    uint32_t id = heads[slot];
+    heads[slot] = NIL;
+    while (id != NIL) {
+        uint32_t next = nodes[id].next;
+        link(id);
+        id = next;
+    }
+    return index == 0;
+}
+
+void TimerWheel::schedule(uint32_t id, uint64_t deadline) {
+    if (id >= nodes.size()) return;
+
+    if (nodes[id].slot != NIL) {
+        unlink(id);
+    } else {
+        armedCount++;
+    }
+    nodes[id].deadline = deadline;
+    link(id);
+}
+
+void TimerWheel::cancel(uint32_t id) {
+    if (!armed(id)) return;
+    unlink(id);
+    armedCount--;
+}
+
+size_t TimerWheel::advance(uint64_t tick, const std::function<void(uint32_t id)>& expired) {
+    if (armedCount == 0) {
+        if (tick >= current) {
+            current = tick + 1;
+        }
+        return 0;
+    }
+
+    size_t fired = 0;
+    while (current <= tick) {
+        uint32_t index = (uint32_t)(current & (WHEEL_SLOTS - 1));
+        if (index == 0) {
+            for (int level = 1; level < WHEEL_LEVELS && cascade(level); level++) {
+            }
+        }
+
+        // Timers rescheduled from the callback land on a later tick
+        current++;
+        while (heads[index] != NIL) {
+            uint32_t id = heads[index];
+            unlink(id);
+            armedCount--;
+            fired++;
+            expired(id);
+        }
+    }
+    return fired;
+}
+
+// ---- LivenessTracker ----
+
+LivenessTracker::LivenessTracker(uint32_t capacity, uint64_t suspectMillis, uint64_t deadMillis,
+                                 uint64_t startMillis)
+    : wheel(capacity, startMillis / LIVENESS_TICK_MS), states(capacity, UNTRACKED) {
+    // Whole ticks, at least one apart, so suspect always comes before dead
+    suspectTicks = suspectMillis / LIVENESS_TICK_MS;
+    if (suspectTicks == 0) suspectTicks = 1;
+    deadTicks = deadMillis / LIVENESS_TICK_MS;
+    if (deadTicks <= suspectTicks) deadTicks = suspectTicks + 1;
+}
+
+void LivenessTracker::track(uint32_t id, uint64_t nowMillis) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (id >= states.size()) {
+        // Doubling, so campuses added one by one cost few copies
+        size_t capacity = std::max<size_t>((size_t)id + 1, states.size() * 2);
+        states.resize(capacity, UNTRACKED);
+        wheel.grow((uint32_t)capacity);
+    }
+    states[id] = ALIVE;
+    wheel.schedule(id, tickOf(nowMillis) + suspectTicks);
+}
+
+void LivenessTracker::forget(uint32_t id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (id >= states.size()) return;
+    states[id] = UNTRACKED;
+    wheel.cancel(id);
+}
+
+LivenessTracker::State LivenessTracker::heartbeat(uint32_t id, uint64_t nowMillis) {
+    heartbeats.fetch_add(1, std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (id >= states.size() || states[id] == UNTRACKED) return UNTRACKED;
+
+    State previous = (State)states[id];
+    if (previous == SUSPECT) {
+        recovered.fetch_add(1, std::memory_order_relaxed);
+    }
+    states[id] = ALIVE;
+    wheel.schedule(id, tickOf(nowMillis) + suspectTicks);
+    return previous;
+}
+
+void LivenessTracker::heartbeat(const uint32_t* ids, size_t count, uint64_t nowMillis,
+                                std::vector<uint32_t>& resumed) {
+    heartbeats.fetch_add(count, std::memory_order_relaxed);
+    uint64_t deadline = tickOf(nowMillis) + suspectTicks;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < count; i++) {
+        uint32_t id = ids[i];
+        if (id >= states.size() || states[id] == UNTRACKED) continue;
+        if (states[id] == SUSPECT) {
+            recovered.fetch_add(1, std::memory_order_relaxed);
+            resumed.push_back(id);
+        }
+        states[id] = ALIVE;
+        wheel.schedule(id, deadline);
+    }
+}
+
+LivenessTracker::State LivenessTracker::state(uint32_t id) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return id < states.size() ? (State)states[id] : UNTRACKED;
+}
+
+size_t LivenessTracker::tracked() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return wheel.size();
+}
+
+size_t LivenessTracker::poll(uint64_t nowMillis, std::vector<uint32_t>& newlySuspect,
+                             std::vector<uint32_t>& dead) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return wheel.advance(tickOf(nowMillis), [&](uint32_t id) {
+        if (states[id] == ALIVE) {
+            // The rest of the dead threshold, counted from the last heartbeat
+            states[id] = SUSPECT;
+            wheel.schedule(id, wheel.now() - 1 + (deadTicks - suspectTicks));
+            suspected.fetch_add(1, std::memory_order_relaxed);
+            newlySuspect.push_back(id);
+        } else {
+            states[id] = UNTRACKED;
+            expired.fetch_add(1, std::memory_order_relaxed);
+            dead.push_back(id);
+        }
+    });
+}
@@ -0,0 +1,119 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+
+// Hierarchical timer wheel. Timers are identified by a dense id, and each
+// id has at most one deadline. Scheduling, rescheduling and cancelling
+// unlink and relink one node, so they cost the same however many timers
+// are armed. Level 0 holds the next 64 ticks, one slot per tick; each level
+// above holds 64 times the span of the one below and is cascaded down a
+// slot at a time as the wheel turns. A tick therefore only touches the
+// timers that expire in it, plus a share of those being cascaded.
+
+#define WHEEL_LEVELS 4
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_SPAN ((uint64_t)1 << (WHEEL_LEVELS * WHEEL_BITS))     // Ticks; later deadlines are clamped
+
+class TimerWheel {
+private:
+    static const uint32_t NIL = 0xFFFFFFFF;
+
+    struct Node {
+        uint32_t prev = NIL;
+        uint32_t next = NIL;
+        uint32_t slot = NIL;    // Index into heads, NIL when not armed
+        uint64_t deadline = 0;
+    };
+
+    std::vector<Node> nodes;    // Index is the id
+    uint32_t heads[WHEEL_LEVELS * WHEEL_SLOTS];
+    uint64_t current;           // Next tick to run
+    size_t armedCount;
+
+    void link(uint32_t id);
+    void unlink(uint32_t id);
+    bool cascade(int level);
+
+public:
+    explicit TimerWheel(uint32_t capacity, uint64_t startTick = 0);
+
+    // Makes ids below capacity usable; never shrinks
+    void grow(uint32_t capacity);
+
+    // Arms id to fire at the given tick, replacing any earlier deadline.
+    // Deadlines already passed fire on the next tick.
+    void schedule(uint32_t id, uint64_t deadline);
+    void cancel(uint32_t id);
+    bool armed(uint32_t id) const { return id < nodes.size() && nodes[id].slot != NIL; }
+
+    // Runs every tick up to and including tick, calling expired for each
+    // timer that comes due. expired may schedule or cancel any timer.
+    // An empty wheel skips straight to tick. Returns how many fired.
+    size_t advance(uint64_t tick, const std::function<void(uint32_t id)>& expired);
+
+    uint64_t now() const { return current; }
+    size_t size() const { return armedCount; }
+    uint32_t capacity() const { return (uint32_t)nodes.size(); }
+};
+
+#define LIVENESS_TICK_MS 100        // Wheel resolution
+#define LIVENESS_SUSPECT_MS 30000   // Default silence before a campus is suspect
+#define LIVENESS_DEAD_MS 60000      // Default silence before it is dropped
+
+// Heartbeat deadlines for every connected endpoint. A heartbeat pushes the
+// endpoint's deadline back; an endpoint silent for suspectMillis becomes
+// suspect, and one silent for deadMillis is reported dead and forgotten.
+// Times are milliseconds on any monotonic clock the caller chooses.
+class LivenessTracker {
+public:
+    enum State : uint8_t {
+        UNTRACKED = 0,
+        ALIVE = 1,
+        SUSPECT = 2
+    };
+
+private:
+    mutable std::mutex mutex;   // Held for O(1) work only
+    TimerWheel wheel;
+    std::vector<uint8_t> states;
+    uint64_t suspectTicks;
+    uint64_t deadTicks;         // Counted from the last heartbeat
+
+    uint64_t tickOf(uint64_t millis) const { return millis / LIVENESS_TICK_MS; }
+
+public:
+    std::atomic<uint64_t> heartbeats{0};
+    std::atomic<uint64_t> suspected{0};
+    std::atomic<uint64_t> recovered{0};
+    std::atomic<uint64_t> expired{0};
+
+    LivenessTracker(uint32_t capacity, uint64_t suspectMillis, uint64_t deadMillis,
+                    uint64_t startMillis = 0);
+
+    uint64_t suspectMillis() const { return suspectTicks * LIVENESS_TICK_MS; }
+    uint64_t deadMillis() const { return deadTicks * LIVENESS_TICK_MS; }
+
+    void track(uint32_t id, uint64_t nowMillis);     // Connected: alive from now; grows for id
+    void forget(uint32_t id);                        // Disconnected
+    // Returns the previous state; heartbeats from untracked ids are ignored
+    State heartbeat(uint32_t id, uint64_t nowMillis);
+    // A batch under one lock; appends the ids that were suspect to resumed
+    void heartbeat(const uint32_t* ids, size_t count, uint64_t nowMillis,
+                   std::vector<uint32_t>& resumed);
+    State state(uint32_t id) const;
+    size_t tracked() const;
+
+    // Advances to nowMillis and appends the ids that became suspect and the
+    // ids that died (no longer tracked). Returns the number of timers fired.
+    size_t poll(uint64_t nowMillis, std::vector<uint32_t>& newlySuspect,
+                std::vector<uint32_t>& dead);
+};
+
+#endif // TIMER_WHEEL_H
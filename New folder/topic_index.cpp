@@ -0,0 +1,183 @@
+#include "topic_index.h"
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <cctype>
+#include <set>
+#include <utility>
+
+static void trim(std::string& text) {
+    text.erase(0, text.find_first_not_of(" \t\r\n"));
+    text.erase(text.find_last_not_of(" \t\r\n") + 1);
+}
+
+static void toLower(const std::string& text, std::string& lower) {
+    lower.resize(text.size());
+    for (size_t i = 0; i < text.size(); i++) {
+        lower[i] = (char)tolower((unsigned char)text[i]);
+    }
+}
+
+bool parseTopic(const std::string& text, std::string& campus, std::string& department) {
+    size_t slash = text.find('/');
+    if (slash == std::string::npos || text.find('/', slash + 1) != std::string::npos) {
+        return false;
+    }
+    campus = text.substr(0, slash);
+    department = text.substr(slash + 1);
+    trim(campus);
+    trim(department);
+    // Commas and bars would not survive the list and message formats
+    return !campus.empty() && !department.empty() &&
+           department.size() <= TOPIC_MAX_DEPARTMENT &&
+           department.find_first_of(",|") == std::string::npos;
+}
+
+CampusSet::CampusSet(std::vector<uint16_t> unsorted) : ids(std::move(unsorted)) {
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+}
+
+void CampusSet::insert(uint16_t id) {
+    if (ids.empty() || ids.back() < id) {
+        ids.push_back(id);
+        return;
+    }
+    auto it = std::lower_bound(ids.begin(), ids.end(), id);
+    if (*it != id) ids.insert(it, id);
+}
+
+bool CampusSet::contains(uint16_t id) const {
+    return std::binary_search(ids.begin(), ids.end(), id);
+}
+
+CampusSet& CampusSet::operator|=(const CampusSet& other) {
+    if (other.ids.empty()) return *this;
+    if (ids.empty()) {
+        ids = other.ids;
+        return *this;
+    }
+    std::vector<uint16_t> merged;
+    merged.reserve(ids.size() + other.ids.size());
+    std::set_union(ids.begin(), ids.end(), other.ids.begin(), other.ids.end(),
+                   std::back_inserter(merged));
+    ids.swap(merged);
+    return *this;
+}
+
+TopicIndex::TopicIndex() {
+    std::shared_ptr<Snapshot> empty = std::make_shared<Snapshot>();
+    empty->campuses.resize(1);
+    current = std::move(empty);
+}
+
+std::vector<Topic> TopicIndex::subscribe(uint16_t subscriber, const std::vector<Topic>& topics) {
+    std::vector<Topic> kept;
+    if (subscriber == 0 || subscriber > MAX_CAMPUS_ID) return kept;
+
+    std::set<std::pair<uint16_t, std::string>> seen;
+    std::string lower;
+    for (const Topic& topic : topics) {
+        if (kept.size() >= TOPIC_MAX_PER_SUBSCRIBER) break;
+        if (topic.campus > MAX_CAMPUS_ID) continue;
+
+        toLower(topic.department, lower);
+        if (seen.insert({topic.campus, lower}).second) {
+            kept.push_back(topic);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(writerMutex);
+    if (subscriber >= lists.size()) lists.resize(subscriber + 1);
+    lists[subscriber] = kept;
+    rebuild();
+    return kept;
+}
+
+void TopicIndex::reset(uint16_t subscriber) {
+    reset(std::vector<uint16_t>(1, subscriber));
+}
+
+void TopicIndex::reset(const std::vector<uint16_t>& subscribers) {
+    std::lock_guard<std::mutex> lock(writerMutex);
+    for (uint16_t subscriber : subscribers) {
+        if (subscriber == 0 || subscriber > MAX_CAMPUS_ID) continue;
+
+        Topic own;
+        own.campus = subscriber;
+        own.department = TOPIC_WILDCARD;
+        if (subscriber >= lists.size()) lists.resize(subscriber + 1);
+        lists[subscriber].assign(1, own);
+    }
+    rebuild();
+}
+
+// Caller holds writerMutex
+void TopicIndex::rebuild() {
+    std::shared_ptr<Snapshot> next = std::make_shared<Snapshot>();
+    size_t campusCount = std::max<size_t>(lists.size(), 1);
+    for (const std::vector<Topic>& list : lists) {
+        for (const Topic& topic : list) {
+            campusCount = std::max<size_t>(campusCount, (size_t)topic.campus + 1);
+        }
+    }
+    next->campuses.resize(campusCount);
+    next->direct.resize(campusCount);
+    std::vector<Subscribers> named(campusCount);     // Whose patterns name each campus
+    std::string key;
+
+    // In ascending subscriber order, so every insert is an append
+    for (size_t subscriber = 0; subscriber < lists.size(); subscriber++) {
+        for (const Topic& topic : lists[subscriber]) {
+            Node& node = next->campuses[topic.campus];
+            if (topic.department == TOPIC_WILDCARD) {
+                node.any.insert((uint16_t)subscriber);
+            } else {
+                toLower(topic.department, key);
+                node.departments[key].insert((uint16_t)subscriber);
+            }
+            named[topic.campus].insert((uint16_t)subscriber);
+            next->subscriptions++;
+        }
+    }
+
+    for (size_t campus = 1; campus < lists.size(); campus++) {
+        const std::vector<Topic>& own = lists[campus];
+        bool ownOnly = own.size() == 1 && own[0].campus == campus &&
+                       own[0].department == TOPIC_WILDCARD;
+        if (ownOnly && named[campus].only((uint16_t)campus) && named[0].only((uint16_t)campus)) {
+            next->direct[campus] = true;
+        }
+    }
+
+    std::atomic_store(&current, std::shared_ptr<const Snapshot>(std::move(next)));
+}
+
+void TopicIndex::lookup(const Node& node, const std::string& key, Subscribers& matched) {
+    matched |= node.any;
+    if (node.departments.empty()) return;
+    auto it = node.departments.find(key);
+    if (it != node.departments.end()) matched |= it->second;
+}
+
+TopicIndex::Subscribers TopicIndex::match(uint16_t campus, const std::string& department) const {
+    static thread_local std::string key;
+    toLower(department, key);
+
+    std::shared_ptr<const Snapshot> snapshot = std::atomic_load(&current);
+    Subscribers matched;
+    lookup(snapshot->campuses[0], key, matched);
+    if (campus != 0 && campus < snapshot->campuses.size()) {
+        lookup(snapshot->campuses[campus], key, matched);
+    }
+    return matched;
+}
+
+bool TopicIndex::direct(uint16_t campus) const {
+    std::shared_ptr<const Snapshot> snapshot = std::atomic_load(&current);
+    return campus < snapshot->direct.size() && snapshot->direct[campus];
+}
+
+size_t TopicIndex::size() const {
+    return std::atomic_load(&current)->subscriptions;
+}
@@ -0,0 +1,114 @@
+#ifndef TOPIC_INDEX_H
+#define TOPIC_INDEX_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <memory>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+#include "campus_table.h"
+
+// Department-level publish/subscribe. A message to KARACHI, department
+// Admissions, is published on the topic "KARACHI/Admissions" and goes to
+// every campus subscribed to a matching pattern. Either half of a pattern
+// may be "*": "KARACHI/*" is everything addressed to Karachi (what each
+// campus is subscribed to at login), "*/Admissions" is Admissions traffic
+// for every campus. Departments match without regard to case.
+//
+// Campuses send "SUB:<pattern>,<pattern>" to replace their whole list; the
+// server answers binary clients with "TOPICS:<list>", the patterns it kept.
+
+#define TOPIC_WILDCARD "*"
+#define TOPIC_MAX_PER_SUBSCRIBER 256
+#define TOPIC_MAX_DEPARTMENT 64         // Characters in a department name
+
+// Campus ids in ascending order, each once. A topic rarely has more than a
+// few subscribers, so a short sorted list is smaller than a bit per campus
+// id and as quick to merge and test.
+class CampusSet {
+private:
+    std::vector<uint16_t> ids;
+
+public:
+    CampusSet() = default;
+    explicit CampusSet(std::vector<uint16_t> unsorted);    // Repeats dropped
+
+    void insert(uint16_t id);       // Cheapest in ascending order
+    bool contains(uint16_t id) const;
+    CampusSet& operator|=(const CampusSet& other);
+    bool operator==(const CampusSet& other) const { return ids == other.ids; }
+
+    // True if no id but (at most) id is in the set
+    bool only(uint16_t id) const { return ids.empty() || (ids.size() == 1 && ids[0] == id); }
+    bool empty() const { return ids.empty(); }
+    size_t size() const { return ids.size(); }
+    std::vector<uint16_t>::const_iterator begin() const { return ids.begin(); }
+    std::vector<uint16_t>::const_iterator end() const { return ids.end(); }
+};
+
+// A pattern. campus 0 is "*"; so is department "*".
+struct Topic {
+    uint16_t campus = 0;
+    std::string department;
+
+    bool operator==(const Topic& other) const {
+        return campus == other.campus && department == other.department;
+    }
+};
+
+// "CAMPUS/Department" split in two and checked for shape only (the campus
+// name is the caller's to look up). Surrounding spaces are dropped.
+bool parseTopic(const std::string& text, std::string& campus, std::string& department);
+
+// Subscription index read on every routed message. Lookups work on an
+// immutable snapshot: per campus (and for "*"), the set of who takes all
+// its departments plus a hash from department to set, so a publish costs
+// at most four hash lookups however many patterns exist. Subscribing
+// rebuilds the snapshot and swaps it in; that is rare next to publishing.
+class TopicIndex {
+public:
+    typedef CampusSet Subscribers;
+
+private:
+    struct Node {
+        Subscribers any;            // Subscribed to "<campus>/*"
+        std::unordered_map<std::string, Subscribers> departments;   // Lowercase keys
+    };
+
+    struct Snapshot {
+        std::vector<Node> campuses;     // Index 0 is "*"; up to the highest campus named
+        std::vector<bool> direct;       // See direct()
+        size_t subscriptions = 0;
+    };
+
+    std::mutex writerMutex;
+    std::vector<std::vector<Topic>> lists;      // By subscriber id; guarded by writerMutex
+    std::shared_ptr<const Snapshot> current;    // Atomic loads and stores only
+
+    void rebuild();
+    static void lookup(const Node& node, const std::string& key, Subscribers& matched);
+
+public:
+    TopicIndex();
+
+    // Replaces a subscriber's patterns, dropping repeats and any past
+    // TOPIC_MAX_PER_SUBSCRIBER. Returns what was kept.
+    std::vector<Topic> subscribe(uint16_t subscriber, const std::vector<Topic>& topics);
+    // Back to "<subscriber>/*"; the list form rebuilds once for them all
+    void reset(uint16_t subscriber);
+    void reset(const std::vector<uint16_t>& subscribers);
+
+    // Who takes a message for campus in department
+    Subscribers match(uint16_t campus, const std::string& department) const;
+
+    // True while only campus itself takes its messages, and all of them:
+    // its list is just "<campus>/*" and no one else's names it or "*".
+    // Routing then needs no lookup at all.
+    bool direct(uint16_t campus) const;
+
+    size_t size() const;        // Patterns across all subscribers
+};
+
+#endif // TOPIC_INDEX_H
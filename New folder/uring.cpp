@@ -0,0 +1,209 @@
+#include "uring.h"
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+static int sysSetup(unsigned entries, struct io_uring_params* params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int sysEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0);
+}
+
+static int sysRegister(int fd, unsigned opcode, void* arg, unsigned nrArgs) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nrArgs);
+}
+
+IoUring::IoUring()
+    : ringFd(-1), sqRing(MAP_FAILED), sqRingSize(0), sqHead(nullptr), sqTail(nullptr),
+      sqMask(nullptr), sqArray(nullptr), sqes(nullptr), sqesSize(0), sqeTail(0), sqeHead(0),
+      cqRing(MAP_FAILED), cqRingSize(0), cqHead(nullptr), cqTail(nullptr), cqMask(nullptr),
+      cqes(nullptr), bufferRing(nullptr), bufferRingSize(0), bufferMemory(nullptr),
+      bufferCount(0), bufferSize(0), bufferGroup(0) {
+}
+
+IoUring::~IoUring() {
+    release();
+}
+
+void IoUring::release() {
+    if (bufferRing) {
+        munmap(bufferRing, bufferRingSize);
+        bufferRing = nullptr;
+    }
+    delete[] bufferMemory;
+    bufferMemory = nullptr;
+
+    if (sqes) {
+        munmap(sqes, sqesSize);
+        sqes = nullptr;
+    }
+    if (cqRing != MAP_FAILED && cqRing != sqRing) {
+        munmap(cqRing, cqRingSize);
+    }
+    if (sqRing != MAP_FAILED) {
+        munmap(sqRing, sqRingSize);
+    }
+    sqRing = cqRing = MAP_FAILED;
+
+    if (ringFd >= 0) {
+        close(ringFd);
+        ringFd = -1;
+    }
+}
+
+bool IoUring::init(unsigned entries, std::string& error) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    ringFd = sysSetup(entries, &params);
+    if (ringFd < 0) {
+        error = std::string("io_uring_setup: ") + strerror(errno);
+        return false;
+    }
+
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMmap) {
+        sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+    }
+
+    sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                  ringFd, IORING_OFF_SQ_RING);
+    if (sqRing == MAP_FAILED) {
+        error = std::string("mmap SQ ring: ") + strerror(errno);
+        release();
+        return false;
+    }
+
+    if (singleMmap) {
+        cqRing = sqRing;
+    } else {
+        cqRing = mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ringFd, IORING_OFF_CQ_RING);
+        if (cqRing == MAP_FAILED) {
+            error = std::string("mmap CQ ring: ") + strerror(errno);
+            release();
+            return false;
+        }
+    }
+
+    sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    void* sqeMemory = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                           ringFd, IORING_OFF_SQES);
+    if (sqeMemory == MAP_FAILED) {
+        error = std::string("mmap SQEs: ") + strerror(errno);
+        release();
+        return false;
+    }
+    sqes = static_cast<struct io_uring_sqe*>(sqeMemory);
+
+    char* sq = static_cast<char*>(sqRing);
+    sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+    char* cq = static_cast<char*>(cqRing);
+    cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    sqeTail = sqeHead = *sqTail;
+    return true;
+}
+
+bool IoUring::registerBufferRing(unsigned short groupId, unsigned count, unsigned size,
+                                 std::string& error) {
+    // count must be a power of two for the ring mask
+    bufferRingSize = count * sizeof(struct io_uring_buf);
+    void* ringMemory = mmap(nullptr, bufferRingSize, PROT_READ | PROT_WRITE,
+                            MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (ringMemory == MAP_FAILED) {
+        error = std::string("mmap buffer ring: ") + strerror(errno);
+        bufferRingSize = 0;
+        return false;
+    }
+    bufferRing = static_cast<struct io_uring_buf_ring*>(ringMemory);
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<unsigned long>(bufferRing);
+    reg.ring_entries = count;
+    reg.bgid = groupId;
+
+    if (sysRegister(ringFd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        error = std::string("IORING_REGISTER_PBUF_RING: ") + strerror(errno);
+        munmap(bufferRing, bufferRingSize);
+        bufferRing = nullptr;
+        return false;
+    }
+
+    bufferCount = count;
+    bufferSize = size;
+    bufferGroup = groupId;
+    bufferMemory = new char[(size_t)count * size];
+
+    bufferRing->tail = 0;
+    for (unsigned i = 0; i < count; i++) {
+        recycleBuffer((unsigned short)i);
+    }
+    return true;
+}
+
+void IoUring::recycleBuffer(unsigned short bufferId) {
+    // Index the ring as a plain array: compiled as C++, the header's
+    // flexible-array trick places bufs[] 8 bytes past the ring start
+    struct io_uring_buf* slots = reinterpret_cast<struct io_uring_buf*>(bufferRing);
+    unsigned short tail = bufferRing->tail;
+    struct io_uring_buf* buf = &slots[tail & (bufferCount - 1)];
+    buf->addr = reinterpret_cast<unsigned long>(buffer(bufferId));
+    buf->len = bufferSize;
+    buf->bid = bufferId;
+    __atomic_store_n(&bufferRing->tail, (unsigned short)(tail + 1), __ATOMIC_RELEASE);
+}
+
+struct io_uring_sqe* IoUring::getSqe() {
+    unsigned head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+    if (sqeTail - head >= *sqMask + 1) {
+        return nullptr;     // Ring full: caller must submit first
+    }
+
+    unsigned index = sqeTail & *sqMask;
+    struct io_uring_sqe* sqe = &sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqArray[index] = index;
+    sqeTail++;
+    return sqe;
+}
+
+int IoUring::submitAndWait(unsigned waitCount) {
+    unsigned toSubmit = sqeTail - sqeHead;
+    __atomic_store_n(sqTail, sqeTail, __ATOMIC_RELEASE);
+    sqeHead = sqeTail;
+
+    int ret = sysEnter(ringFd, toSubmit, waitCount, waitCount ? IORING_ENTER_GETEVENTS : 0);
+    while (ret < 0 && errno == EINTR) {
+        // Submissions were consumed before the wait was interrupted
+        ret = sysEnter(ringFd, 0, waitCount, waitCount ? IORING_ENTER_GETEVENTS : 0);
+    }
+    return ret;
+}
+
+struct io_uring_cqe* IoUring::peekCqe() {
+    unsigned head = *cqHead;
+    if (head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+        return nullptr;
+    }
+    return &cqes[head & *cqMask];
+}
+
+void IoUring::cqeSeen() {
+    __atomic_store_n(cqHead, *cqHead + 1, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,71 @@
+#ifndef URING_H
+#define URING_H
+
+#include <string>
+#include <atomic>
+#include <linux/io_uring.h>
+
+// Thin wrapper over the raw io_uring syscalls (no liburing dependency).
+// Owns the submission/completion rings and, optionally, one provided
+// buffer ring that the kernel picks receive buffers from.
+class IoUring {
+private:
+    int ringFd;
+
+    // Submission queue
+    void* sqRing;
+    size_t sqRingSize;
+    unsigned* sqHead;
+    unsigned* sqTail;
+    unsigned* sqMask;
+    unsigned* sqArray;
+    struct io_uring_sqe* sqes;
+    size_t sqesSize;
+    unsigned sqeTail;       // Next free slot, published on submit
+    unsigned sqeHead;       // Last slot handed to the kernel
+
+    // Completion queue
+    void* cqRing;
+    size_t cqRingSize;
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned* cqMask;
+    struct io_uring_cqe* cqes;
+
+    // Provided buffer ring
+    struct io_uring_buf_ring* bufferRing;
+    size_t bufferRingSize;
+    char* bufferMemory;
+    unsigned bufferCount;
+    unsigned bufferSize;
+    unsigned short bufferGroup;
+
+    void release();
+
+public:
+    IoUring();
+    ~IoUring();
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    bool init(unsigned entries, std::string& error);
+    bool registerBufferRing(unsigned short groupId, unsigned count, unsigned size,
+                            std::string& error);
+
+    struct io_uring_sqe* getSqe();
+    unsigned pendingSubmissions() const { return sqeTail - sqeHead; }
+
+    // Publishes pending SQEs and waits for at least waitCount completions.
+    // This is the only syscall the event loop makes per iteration.
+    int submitAndWait(unsigned waitCount);
+
+    struct io_uring_cqe* peekCqe();
+    void cqeSeen();
+
+    char* buffer(unsigned short bufferId) { return bufferMemory + (size_t)bufferId * bufferSize; }
+    unsigned short group() const { return bufferGroup; }
+    void recycleBuffer(unsigned short bufferId);
+};
+
+#endif // URING_H
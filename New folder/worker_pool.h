@@ -0,0 +1,81 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <functional>
+#include <cstddef>
+
+// A few threads running posted tasks, oldest first. For work too slow for
+// an event loop, such as hashing a password at login.
+class WorkerPool {
+private:
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<std::function<void()>> tasks;
+    std::vector<std::thread> threads;
+    bool stopping = false;
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            ready.wait(lock, [this] { return stopping || !tasks.empty(); });
+            if (stopping) return;
+            std::function<void()> task = std::move(tasks.front());
+            tasks.pop_front();
+            lock.unlock();
+            task();
+            lock.lock();
+        }
+    }
+
+public:
+    WorkerPool() = default;
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+    ~WorkerPool() { stop(); }
+
+    void start(int count) {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = false;
+        for (int i = 0; i < count; i++) {
+            threads.emplace_back(&WorkerPool::run, this);
+        }
+    }
+
+    // Tasks still waiting when the pool stops are dropped
+    void post(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopping || threads.empty()) return;
+            tasks.push_back(std::move(task));
+        }
+        ready.notify_one();
+    }
+
+    // Waits for running tasks to finish
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            tasks.clear();
+        }
+        ready.notify_all();
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        threads.clear();
+    }
+
+    size_t backlog() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return tasks.size();
+    }
+
+    size_t size() const { return threads.size(); }
+};
+
+#endif // WORKER_POOL_H